@@ -0,0 +1,203 @@
+#include "absorbing_boundary.hpp"
+#include "parameters.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace mfem;
+
+
+
+bool on_absorbing_surface(const Parameters &param, const Vector &point)
+{
+  const BoundaryConditionsParameters &bc = param.bc;
+  const char *low[]  = { bc.left, bc.bottom, bc.front };
+  const char *high[] = { bc.right, bc.top, bc.back };
+  const double size[] = { param.grid.sx, param.grid.sy, param.grid.sz };
+  for (int d = 0; d < param.dimension; ++d)
+  {
+    const double tol = 1e-6 * size[d];
+    if (!strcmp(low[d], "abs") && fabs(point(d)) < tol) return true;
+    if (!strcmp(high[d], "abs") && fabs(point(d) - size[d]) < tol) return true;
+  }
+  return false;
+}
+
+
+
+void find_absorbing_faces(const Parameters &param, Mesh &mesh,
+                          vector<char> &marker)
+{
+  marker.assign(mesh.GetNumFaces(), 0);
+  Vector center(param.dimension);
+  for (int f = 0; f < mesh.GetNumFaces(); ++f)
+  {
+    int elem1, elem2;
+    mesh.GetFaceElements(f, &elem1, &elem2);
+    if (elem2 >= 0)
+      continue; // interior face
+    ElementTransformation &T = *mesh.GetFaceTransformation(f);
+    T.Transform(Geometries.GetCenter(mesh.GetFaceBaseGeometry(f)), center);
+    marker[f] = on_absorbing_surface(param, center);
+  }
+}
+
+
+
+AbsorbingBoundary::AbsorbingBoundary(const Parameters &param,
+                                     FiniteElementSpace &fespace,
+                                     const IntegrationRule *rule)
+  : _fespace(fespace)
+  , _rule(rule)
+  , _discontinuous(false)
+  , _elements()
+  , _index()
+  , _dofs()
+  , _B(nullptr)
+{
+  Mesh &mesh = *fespace.GetMesh();
+
+  // the dofs of a discontinuous space belong to the elements, so the terms of
+  // the boundary faces are assembled with the shape functions of the adjacent
+  // elements
+  _discontinuous =
+    (dynamic_cast<const L2_FECollection*>(fespace.FEColl()) != nullptr);
+
+  _index.assign(fespace.GetVSize(), -1);
+  Vector center(param.dimension);
+  Array<int> dofs;
+  for (int be = 0; be < mesh.GetNBE(); ++be)
+  {
+    ElementTransformation &T = *mesh.GetBdrElementTransformation(be);
+    T.Transform(Geometries.GetCenter(mesh.GetBdrElementBaseGeometry(be)),
+                center);
+    if (!on_absorbing_surface(param, center))
+      continue;
+    _elements.push_back(be);
+    if (_discontinuous)
+      fespace.GetElementDofs(mesh.GetBdrFaceTransformations(be)->Elem1No,
+                             dofs);
+    else
+      fespace.GetBdrElementDofs(be, dofs);
+    for (int i = 0; i < dofs.Size(); ++i)
+    {
+      if (_index[dofs[i]] < 0)
+      {
+        _index[dofs[i]] = _dofs.size();
+        _dofs.push_back(dofs[i]);
+      }
+    }
+  }
+
+  const int n = _dofs.size();
+  _B = new SparseMatrix(n, n);
+  set_media(param.media.rho_array, param.media.vp_array);
+
+  _x.resize(n);
+  _y.resize(n);
+}
+
+AbsorbingBoundary::~AbsorbingBoundary()
+{
+  delete _B;
+}
+
+void AbsorbingBoundary::set_media(const double *rho, const double *vp)
+{
+  Mesh &mesh = *_fespace.GetMesh();
+
+  // the pattern is built at the first assembly, and then only the values are
+  // refilled
+  const bool finalized = _B->Finalized();
+  if (finalized)
+    *_B = 0.0;
+
+  ConstantCoefficient one(1.0);
+  MassIntegrator mass_int(one);
+  mass_int.SetIntRule(_rule);
+
+  DenseMatrix elmat;
+  Vector shape;
+  Array<int> dofs;
+  for (size_t i = 0; i < _elements.size(); ++i)
+  {
+    const int be = _elements[i];
+    // 1/(rho*vp) of the cell adjacent to the boundary element
+    FaceElementTransformations *FT = mesh.GetBdrFaceTransformations(be);
+    MFEM_VERIFY(FT, "No element adjacent to the boundary element " + d2s(be));
+    const int cell = mesh.GetAttribute(FT->Elem1No) - 1;
+    const double impedance = rho[cell] * vp[cell];
+
+    if (_discontinuous)
+    {
+      const FiniteElement &fe = *_fespace.GetFE(FT->Elem1No);
+      const IntegrationRule &face_rule =
+        (_rule ? *_rule : IntRules.Get(FT->FaceGeom, 2*fe.GetOrder()));
+      elmat.SetSize(fe.GetDof());
+      elmat = 0.0;
+      shape.SetSize(fe.GetDof());
+      for (int q = 0; q < face_rule.GetNPoints(); ++q)
+      {
+        const IntegrationPoint &ip = face_rule.IntPoint(q);
+        FT->Face->SetIntPoint(&ip);
+        IntegrationPoint eip;
+        FT->Loc1.Transform(ip, eip);
+        fe.CalcShape(eip, shape);
+        AddMult_a_VVt(ip.weight * FT->Face->Weight(), shape, elmat);
+      }
+      _fespace.GetElementDofs(FT->Elem1No, dofs);
+    }
+    else
+    {
+      mass_int.AssembleElementMatrix(*_fespace.GetBE(be),
+                                     *_fespace.GetBdrElementTransformation(be),
+                                     elmat);
+      _fespace.GetBdrElementDofs(be, dofs);
+    }
+    elmat *= 1. / impedance;
+    for (int j = 0; j < dofs.Size(); ++j)
+      dofs[j] = _index[dofs[j]];
+    _B->AddSubMatrix(dofs, dofs, elmat);
+  }
+  if (!finalized)
+    _B->Finalize();
+}
+
+void AbsorbingBoundary::add_to(double a, SparseMatrix &A) const
+{
+  const int *I = _B->GetI();
+  const int *J = _B->GetJ();
+  const double *B = _B->GetData();
+  for (int r = 0; r < _B->Height(); ++r)
+    for (int p = I[r]; p < I[r+1]; ++p)
+      if (B[p] != 0.)
+        A.Add(_dofs[r], _dofs[J[p]], a * B[p]);
+}
+
+void AbsorbingBoundary::add_diagonal(double a, Vector &d) const
+{
+  const SparseMatrix &B = *_B;
+  for (int r = 0; r < B.Height(); ++r)
+    d[_dofs[r]] += a * B(r, r);
+}
+
+void AbsorbingBoundary::add_mult(double a, const double *x, double *y,
+                                 int k) const
+{
+  const int n = _dofs.size();
+  if ((int)_x.size() < n*k)
+  {
+    _x.resize(n*k);
+    _y.resize(n*k);
+  }
+  for (int i = 0; i < n; ++i)
+    for (int s = 0; s < k; ++s)
+      _x[i*k + s] = x[(size_t)_dofs[i]*k + s];
+  if (n > 0)
+    mult_interleaved(*_B, k, &_x[0], &_y[0]);
+  for (int i = 0; i < n; ++i)
+    for (int s = 0; s < k; ++s)
+      y[(size_t)_dofs[i]*k + s] += a * _y[i*k + s];
+}
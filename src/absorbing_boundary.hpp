@@ -0,0 +1,88 @@
+#ifndef ABSORBING_BOUNDARY_HPP
+#define ABSORBING_BOUNDARY_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <vector>
+
+class Parameters;
+
+/**
+ * Check if the point is on an absorbing surface: left (X=0), right (X=sx),
+ * bottom (Y=0), top (Y=sy), front (Z=0), back (Z=sz).
+ */
+bool on_absorbing_surface(const Parameters &param, const mfem::Vector &point);
+
+/**
+ * Mark (by nonzero values) the boundary faces of the mesh on the absorbing
+ * surfaces, e.g. the faces where DG has the natural condition instead of the
+ * penalty terms of the free surface.
+ */
+void find_absorbing_faces(const Parameters &param, mfem::Mesh &mesh,
+                          std::vector<char> &marker);
+
+/**
+ * First order (Clayton-Engquist, Stacey) absorbing boundary condition
+ * dp/dn = -1/vp dp/dt on the absorbing surfaces of the box domain. It adds the
+ * term B dp/dt to the semi-discrete system, where B is the boundary mass
+ * matrix with the coefficient 1/(rho*vp) of the adjacent cells, so no extra
+ * cells are needed. The matrix is assembled and stored for the dofs of the
+ * absorbing surfaces only (it's diagonal with the GLL quadrature in SEM). In
+ * a discontinuous (DG) space these are the dofs of the elements adjacent to
+ * the surfaces, and the matrix is the mass matrix of the faces with the shape
+ * functions of these elements.
+ */
+class AbsorbingBoundary
+{
+public:
+  /**
+   * @param rule - the rule of the quadrature on the boundary elements (the GLL
+   * one for SEM and DG with the GLL basis), or nullptr for the default one.
+   */
+  AbsorbingBoundary(const Parameters &param, mfem::FiniteElementSpace &fespace,
+                    const mfem::IntegrationRule *rule = nullptr);
+  ~AbsorbingBoundary();
+
+  /// number of the dofs on the absorbing surfaces
+  int n_dofs() const { return _dofs.size(); }
+
+  /**
+   * Refill the values of the matrix for other media (e.g. the next
+   * realization of an ensemble), given by the density and the velocity in
+   * the cells. The constructor fills it with the media of the parameters.
+   */
+  void set_media(const double *rho, const double *vp);
+
+  /**
+   * A += a*B. The sparsity pattern of A must include the one of the mass
+   * matrix.
+   */
+  void add_to(double a, mfem::SparseMatrix &A) const;
+
+  /**
+   * d += a*diag(B), e.g. for the diagonal system matrix with the GLL
+   * quadrature, where B is diagonal too.
+   */
+  void add_diagonal(double a, mfem::Vector &d) const;
+
+  /**
+   * y += a*B*x for k interleaved vectors (see mult_interleaved).
+   */
+  void add_mult(double a, const double *x, double *y, int k = 1) const;
+
+private:
+  mfem::FiniteElementSpace &_fespace;
+  const mfem::IntegrationRule *_rule;
+  bool _discontinuous; ///< the shape functions of the faces are the elements'
+  std::vector<int> _elements; ///< the boundary elements on the surfaces
+  std::vector<int> _index; ///< dof -> number among _dofs, or -1
+  std::vector<int> _dofs; ///< the dofs of the absorbing surfaces
+  mfem::SparseMatrix *_B; ///< the matrix in these dofs
+  mutable std::vector<double> _x, _y;
+
+  AbsorbingBoundary(const AbsorbingBoundary&);
+  AbsorbingBoundary& operator=(const AbsorbingBoundary&);
+};
+
+#endif // ABSORBING_BOUNDARY_HPP
@@ -2,6 +2,7 @@
 #include "GLL_quadrature.hpp"
 #include "parameters.hpp"
 #include "receivers.hpp"
+#include "shot_scheduler.hpp"
 #include "utilities.hpp"
 
 using namespace std;
@@ -11,6 +12,9 @@ using namespace mfem;
 
 void AcousticWave::run()
 {
+  ShotScheduler shots(param);
+  scheduler = &shots;
+
   if (!strcmp(param.method.name, "fem") || !strcmp(param.method.name, "FEM"))
   {
     run_FEM();
@@ -23,14 +27,26 @@ void AcousticWave::run()
   {
     run_DG();
   }
+  else if (!strcmp(param.method.name, "dgvp") || !strcmp(param.method.name, "DGVP"))
+  {
+    run_DGVP();
+  }
   else if (!strcmp(param.method.name, "gmsfem") || !strcmp(param.method.name, "GMsFEM"))
   {
-    run_GMsFEM();
+    // the multiscale basis is recomputed for every shot
+    for (int shot = scheduler->next(); shot >= 0; shot = scheduler->next())
+    {
+      param.set_shot(shot);
+      run_GMsFEM();
+    }
   }
   else
   {
     MFEM_ABORT("Unknown method to be used: " + string(param.method.name));
   }
+
+  shots.report(cout);
+  scheduler = nullptr;
 }
 
 
@@ -130,22 +146,23 @@ void open_seismo_outs(ofstream* &seisU, const Parameters &param,
 
 
 
-void output_seismograms(const Parameters& param, const Mesh& mesh,
-                        const GridFunction &U, ofstream* &seisU)
+void output_seismograms(const vector<ReceiversSet*> &sets_of_receivers,
+                        const Mesh& mesh, const GridFunction &U,
+                        ofstream* &seisU)
 {
   // for each set of receivers
-  for (size_t rec = 0; rec < param.sets_of_receivers.size(); ++rec)
+  for (size_t rec = 0; rec < sets_of_receivers.size(); ++rec)
   {
     MFEM_VERIFY(seisU[rec].is_open(), "The stream for writing seismograms is "
                 "not open");
 
-    const ReceiversSet *rec_set = param.sets_of_receivers[rec];
+    const ReceiversSet *rec_set = sets_of_receivers[rec];
 
     // pressure at the receivers
     const Vector u =
       compute_function_at_points(mesh, rec_set->n_receivers(),
-                                 &(rec_set->get_receivers()[0]),
-                                 &(rec_set->get_cells_containing_receivers()[0]), U);
+                                 rec_set->get_receivers(),
+                                 rec_set->get_cells_containing_receivers(), U);
     MFEM_ASSERT(u.Size() == rec_set->n_receivers(), "Sizes mismatch");
     for (int i = 0; i < u.Size(); ++i) {
       float val = u(i);
@@ -8,19 +8,25 @@
 #include <vector>
 
 class Parameters;
+class ReceiversSet;
+class ShotScheduler;
 
 
 
 class AcousticWave
 {
 public:
-  AcousticWave(const Parameters& p) : param(p) { }
+  AcousticWave(Parameters& p) : param(p), scheduler(nullptr) { }
   ~AcousticWave() { }
 
+  /**
+   * Run the simulation of all shots of the parameters.
+   */
   void run();
 
 private:
-  const Parameters& param;
+  Parameters& param; ///< not const, since the current shot is changed by runs
+  ShotScheduler *scheduler; ///< gives the shots to be run during run()
 
   void run_FEM() const;
   void run_SEM() const;
@@ -30,6 +36,12 @@ private:
   void run_SEM_serial() const;
   void run_DG_serial() const;
 
+  /// all realizations of the media ensemble with the operators assembled once
+  void run_SEM_ensemble() const;
+
+  /// first order velocity-pressure DG with the upwind flux and LSRK(5,4)
+  void run_DGVP() const;
+
 #if defined(MFEM_USE_MPI)
   void run_FEM_parallel() const;
   void run_SEM_parallel() const;
@@ -56,13 +68,16 @@ private:
 
 
 /**
- * Cell-wise constant coefficient.
+ * Cell-wise constant coefficient. The values are indexed either by the global
+ * cell number (the attribute of an element), or by the local element number
+ * (for the arrays describing only the cells of a part of a parallel mesh
+ * followed by its face neighbors).
  */
 class CWConstCoefficient : public mfem::Coefficient
 {
 public:
-  CWConstCoefficient(const double *array, bool own = 1)
-    : val_array(array), own_array(own)
+  CWConstCoefficient(const double *array, bool own = 1, bool local = 0)
+    : val_array(array), own_array(own), local_index(local)
   { }
 
   virtual ~CWConstCoefficient() { if (own_array) delete[] val_array; }
@@ -70,7 +85,7 @@ public:
   virtual double Eval(mfem::ElementTransformation &T,
                       const mfem::IntegrationPoint &/*ip*/)
   {
-    const int index = T.Attribute - 1; // use attribute as a cell number
+    const int index = cell_index(T);
     MFEM_VERIFY(index >= 0, "index is negative");
     return val_array[index];
   }
@@ -78,6 +93,13 @@ public:
 protected:
   const double *val_array;
   bool own_array;
+  bool local_index;
+
+  int cell_index(const mfem::ElementTransformation &T) const
+  {
+    // use attribute as a global cell number
+    return (local_index ? T.ElementNo : T.Attribute - 1);
+  }
 };
 
 
@@ -91,8 +113,9 @@ class CWFunctionCoefficient : public CWConstCoefficient
 public:
   CWFunctionCoefficient(double(*F)(const mfem::Vector&, const Parameters&),
                         const Parameters& p,
-                        const double *array, bool own = 1)
-    : CWConstCoefficient(array, own)
+                        const double *array, bool own = 1,
+                        bool local = 0)
+    : CWConstCoefficient(array, own, local)
     , Function(F)
     , param(p)
   { }
@@ -102,8 +125,7 @@ public:
   virtual double Eval(mfem::ElementTransformation &T,
                       const mfem::IntegrationPoint &ip)
   {
-    const int index = T.Attribute - 1; // use attribute as a cell number
-    const double cw_coef = val_array[index];
+    const double cw_coef = val_array[cell_index(T)];
     mfem::Vector transip;
     T.Transform(ip, transip);
     const double func_val = (*Function)(transip, param);
@@ -129,25 +151,49 @@ mfem::Vector compute_function_at_points(const mfem::Mesh& mesh, int n_points,
 void open_seismo_outs(std::ofstream* &seisU, const Parameters &param,
                       const std::string &method_name);
 
-void output_seismograms(const Parameters& param, const mfem::Mesh& mesh,
-                        const mfem::GridFunction &U, std::ofstream* &seisU);
+/**
+ * Write the values of U at the receivers of every set to the stream of the
+ * set (the streams are opened by open_seismo_outs for the same sets).
+ */
+void output_seismograms(const std::vector<ReceiversSet*> &sets_of_receivers,
+                        const mfem::Mesh& mesh, const mfem::GridFunction &U,
+                        std::ofstream* &seisU);
 
-void solve_dsygvd(const mfem::DenseMatrix &A, const mfem::DenseMatrix &B,
-                  mfem::DenseMatrix &eigenvectors);
+/**
+ * Find the n_modes smallest eigenvalues (in ascending order) and their
+ * eigenvectors of the generalized eigenproblem A x = lambda B x (A symmetric,
+ * B symmetric positive definite) by LAPACK dsygvx, so the cost of the
+ * eigenvectors scales with the number of modes. The eigenvalues are returned
+ * too if the vector is given. The workspace is reused between the calls.
+ */
+void solve_dsygvx(const mfem::DenseMatrix &A, const mfem::DenseMatrix &B,
+                  int n_modes, mfem::DenseMatrix &eigenvectors,
+                  mfem::Vector *eigenvalues = nullptr);
 
-extern "C" void dsygvd_(int *ITYPE,
+extern "C" void dsygvx_(int *ITYPE,
                         char *JOBZ,
+                        char *RANGE,
                         char *UPLO,
                         int *N,
                         double *A,
                         int *LDA,
                         double *B,
                         int *LDB,
+                        double *VL,
+                        double *VU,
+                        int *IL,
+                        int *IU,
+                        double *ABSTOL,
+                        int *M,
                         double *W,
+                        double *Z,
+                        int *LDZ,
                         double *WORK,
                         int *LWORK,
                         int *IWORK,
-                        int *LIWORK,
+                        int *IFAIL,
                         int *INFO);
 
+extern "C" double dlamch_(char *CMACH);
+
 #endif // ACOUSTIC_WAVE_HPP
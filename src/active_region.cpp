@@ -0,0 +1,127 @@
+#include "active_region.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+using namespace mfem;
+
+
+
+ActiveRegion::ActiveRegion(FiniteElementSpace &fespace, double vp_max,
+                           double safety, double full_fraction)
+  : _fespace(fespace)
+  , _vp_max(vp_max)
+  , _safety(safety)
+  , _full_fraction(full_fraction)
+  , _dim(fespace.GetMesh()->Dimension())
+  , _h(0.)
+  , _radius(-1.)
+  , _full(false)
+{
+  Mesh &mesh = *fespace.GetMesh();
+  const int n_elements = mesh.GetNE();
+  _centers.resize(n_elements * _dim);
+  _radii.resize(n_elements);
+
+  Array<int> vertices;
+  for (int el = 0; el < n_elements; ++el)
+  {
+    mesh.GetElementVertices(el, vertices);
+    double *c = &_centers[el*_dim];
+    for (int d = 0; d < _dim; ++d)
+    {
+      c[d] = 0.;
+      for (int v = 0; v < vertices.Size(); ++v)
+        c[d] += mesh.GetVertex(vertices[v])[d];
+      c[d] /= vertices.Size();
+    }
+    double r2 = 0.;
+    for (int v = 0; v < vertices.Size(); ++v)
+    {
+      double dist2 = 0.;
+      for (int d = 0; d < _dim; ++d)
+      {
+        const double x = mesh.GetVertex(vertices[v])[d] - c[d];
+        dist2 += x*x;
+      }
+      r2 = max(r2, dist2);
+    }
+    _radii[el] = sqrt(r2);
+    _h = max(_h, 2.*_radii[el]);
+  }
+}
+
+void ActiveRegion::start(const double *B, int k)
+{
+  for (int d = 0; d < 3; ++d)
+  {
+    _box[0][d] = DBL_MAX;
+    _box[1][d] = -DBL_MAX;
+  }
+
+  Array<int> dofs;
+  for (int el = 0; el < _fespace.GetNE(); ++el)
+  {
+    _fespace.GetElementDofs(el, dofs);
+    bool source = false;
+    for (int i = 0; i < dofs.Size() && !source; ++i)
+      for (int s = 0; s < k && !source; ++s)
+        source = (B[(size_t)dofs[i]*k + s] != 0.);
+    if (!source)
+      continue;
+    for (int d = 0; d < _dim; ++d)
+    {
+      _box[0][d] = min(_box[0][d], _centers[el*_dim + d] - _radii[el]);
+      _box[1][d] = max(_box[1][d], _centers[el*_dim + d] + _radii[el]);
+    }
+  }
+
+  _radius = -1.;
+  _full = (_box[0][0] > _box[1][0]); // no source - nothing to track
+  _active.assign(_fespace.GetNE(), 0);
+  _in_rows.assign(_fespace.GetVSize(), 0);
+  _rows.clear();
+}
+
+bool ActiveRegion::update(double t)
+{
+  if (_full)
+    return false;
+
+  const double radius = _safety * _vp_max * t + 2.*_h;
+  if (radius <= _radius)
+    return false;
+  _radius = radius + _h; // so it's recomputed once the front moves by h
+
+  Array<int> dofs;
+  for (int el = 0; el < _fespace.GetNE(); ++el)
+  {
+    if (_active[el])
+      continue;
+    double dist2 = 0.; // from the center to the box of the source
+    for (int d = 0; d < _dim; ++d)
+    {
+      const double c = _centers[el*_dim + d];
+      const double x = max(max(_box[0][d] - c, c - _box[1][d]), 0.);
+      dist2 += x*x;
+    }
+    if (sqrt(dist2) - _radii[el] > _radius)
+      continue;
+    _active[el] = 1;
+    _fespace.GetElementDofs(el, dofs);
+    for (int i = 0; i < dofs.Size(); ++i)
+    {
+      if (!_in_rows[dofs[i]])
+      {
+        _in_rows[dofs[i]] = 1;
+        _rows.push_back(dofs[i]);
+      }
+    }
+  }
+  sort(_rows.begin(), _rows.end());
+
+  _full = (_rows.size() >= _full_fraction * _fespace.GetVSize());
+  return true;
+}
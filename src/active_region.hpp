@@ -0,0 +1,63 @@
+#ifndef ACTIVE_REGION_HPP
+#define ACTIVE_REGION_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <vector>
+
+/**
+ * The part of the mesh reached by the waves from a localized source by the
+ * given time, so the explicit time stepping can skip the rest, where the
+ * solution is still zero. The region is the set of elements within the
+ * distance safety*vp_max*t plus a halo of two element sizes from the elements
+ * of the source support, and its rows (dofs) are recomputed only when the
+ * front moves by an element size. Once the region covers the given fraction
+ * of the dofs, the full update is to be used.
+ */
+class ActiveRegion
+{
+public:
+  ActiveRegion(mfem::FiniteElementSpace &fespace, double vp_max,
+               double safety = 1.1, double full_fraction = 0.5);
+
+  /**
+   * Start a new time loop with the given source vectors (k interleaved
+   * vectors): the source support is where they are nonzero.
+   */
+  void start(const double *B, int k);
+
+  /**
+   * Extend the region to the time t. Returns true if the rows changed.
+   */
+  bool update(double t);
+
+  /// the region covers enough of the mesh for the full update
+  bool full() const { return _full; }
+
+  /// the dofs of the region (sorted)
+  const std::vector<int>& rows() const { return _rows; }
+
+private:
+  mfem::FiniteElementSpace &_fespace;
+  double _vp_max;
+  double _safety;
+  double _full_fraction;
+
+  int _dim;
+  std::vector<double> _centers; ///< of the elements
+  std::vector<double> _radii;   ///< max distance from a center to a vertex
+  double _h;                    ///< max element size
+
+  double _box[2][3];  ///< bounding box of the source support
+  double _radius;     ///< the distance the region is computed for
+  bool _full;
+  std::vector<char> _active; ///< per element
+  std::vector<char> _in_rows; ///< per dof
+  std::vector<int> _rows;
+
+  ActiveRegion(const ActiveRegion&);
+  ActiveRegion& operator=(const ActiveRegion&);
+};
+
+#endif // ACTIVE_REGION_HPP
@@ -0,0 +1,329 @@
+#include "compression.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+
+
+//------------------------------------------------------------------------------
+//
+// Auxiliary functions
+//
+//------------------------------------------------------------------------------
+static inline uint32_t zigzag32(int32_t v)
+{
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag32(uint32_t v)
+{
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline uint64_t zigzag64(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag64(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline void put_varint(uint64_t v, vector<unsigned char> &out)
+{
+  while (v >= 0x80)
+  {
+    out.push_back((unsigned char)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((unsigned char)v);
+}
+
+static inline uint64_t get_varint(const unsigned char *data, uint64_t n_bytes,
+                                  uint64_t &pos)
+{
+  uint64_t v = 0;
+  for (int shift = 0; ; shift += 7)
+  {
+    if (pos >= n_bytes || shift > 63)
+      throw runtime_error("Corrupted compressed data (varint)");
+    const unsigned char b = data[pos++];
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) break;
+  }
+  return v;
+}
+
+/**
+ * Encode the runs of zero bytes by their lengths: a non-zero byte is copied,
+ * a run of zeros is stored as 0 followed by the length of the run - 1.
+ */
+static void encode_zero_runs(const vector<unsigned char> &in,
+                             vector<unsigned char> &out)
+{
+  const size_t n = in.size();
+  for (size_t i = 0; i < n; )
+  {
+    if (in[i] != 0)
+    {
+      out.push_back(in[i++]);
+      continue;
+    }
+    size_t j = i;
+    while (j < n && in[j] == 0) ++j;
+    out.push_back(0);
+    put_varint(j - i - 1, out);
+    i = j;
+  }
+}
+
+static void decode_zero_runs(const unsigned char *data, uint64_t n_bytes,
+                             vector<unsigned char> &out)
+{
+  out.clear();
+  uint64_t pos = 0;
+  while (pos < n_bytes)
+  {
+    const unsigned char b = data[pos++];
+    if (b != 0)
+      out.push_back(b);
+    else
+      out.resize(out.size() + get_varint(data, n_bytes, pos) + 1, 0);
+  }
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Lossless coding of float values
+//
+//------------------------------------------------------------------------------
+void compress_lossless(const float *values, uint64_t n_rows, uint64_t n_cols,
+                       vector<unsigned char> &out)
+{
+  const uint64_t n = n_rows * n_cols;
+  const int n_planes = sizeof(uint32_t);
+
+  // shuffled bytes of the differences between consecutive values in time
+  vector<unsigned char> planes(n * n_planes);
+  for (uint64_t c = 0, k = 0; c < n_cols; ++c)
+  {
+    uint32_t prev = 0;
+    for (uint64_t r = 0; r < n_rows; ++r, ++k)
+    {
+      uint32_t bits;
+      memcpy(&bits, &values[r*n_cols + c], sizeof(bits));
+      const uint32_t code = zigzag32((int32_t)(bits - prev));
+      prev = bits;
+      for (int b = 0; b < n_planes; ++b)
+        planes[b*n + k] = (unsigned char)(code >> (8*b));
+    }
+  }
+
+  out.clear();
+  encode_zero_runs(planes, out);
+}
+
+void decompress_lossless(const unsigned char *data, uint64_t n_bytes,
+                         uint64_t n_rows, uint64_t n_cols, float *values)
+{
+  const uint64_t n = n_rows * n_cols;
+  const int n_planes = sizeof(uint32_t);
+
+  vector<unsigned char> planes;
+  decode_zero_runs(data, n_bytes, planes);
+  if (planes.size() != n * n_planes)
+    throw runtime_error("Corrupted compressed data (unexpected size)");
+
+  for (uint64_t c = 0, k = 0; c < n_cols; ++c)
+  {
+    uint32_t prev = 0;
+    for (uint64_t r = 0; r < n_rows; ++r, ++k)
+    {
+      uint32_t code = 0;
+      for (int b = 0; b < n_planes; ++b)
+        code |= (uint32_t)planes[b*n + k] << (8*b);
+      const uint32_t bits = prev + (uint32_t)unzigzag32(code);
+      prev = bits;
+      memcpy(&values[r*n_cols + c], &bits, sizeof(bits));
+    }
+  }
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Error-bounded lossy coding of double values
+//
+//------------------------------------------------------------------------------
+/**
+ * The code of a value stored exactly. The codes of the quantized values are
+ * below 2^51 (|q| < 1e15), and the zero residual is the code 0, so the quiet
+ * parts of a field are the runs of zero bytes.
+ */
+static const uint64_t OUTLIER_CODE = (uint64_t)1 << 62;
+
+void compress_lossy(const double *values, uint64_t n, double tolerance,
+                    vector<unsigned char> &out)
+{
+  if (!(tolerance > 0))
+    throw runtime_error("The tolerance of lossy compression must be >0");
+
+  const double quantum = 2.0 * tolerance;
+  const double max_code = 1e15; // far below the precision limit of int64
+
+  vector<double> outliers;
+  vector<unsigned char> codes;
+  codes.reserve(n);
+
+  double pred = 0.; // prediction is the previous reconstructed value
+  for (uint64_t i = 0; i < n; ++i)
+  {
+    const double q = floor((values[i] - pred) / quantum + 0.5);
+    const double recon = pred + quantum * q;
+    if (fabs(q) < max_code && fabs(recon - values[i]) <= tolerance)
+    {
+      put_varint(zigzag64((int64_t)q), codes);
+      pred = recon;
+    }
+    else
+    {
+      put_varint(OUTLIER_CODE, codes); // the value is stored separately
+      outliers.push_back(values[i]);
+      pred = values[i];
+    }
+  }
+
+  out.clear();
+  const uint64_t n_outliers = outliers.size();
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(&n_outliers);
+  out.insert(out.end(), p, p + sizeof(n_outliers));
+  if (n_outliers > 0)
+  {
+    p = reinterpret_cast<const unsigned char*>(&outliers[0]);
+    out.insert(out.end(), p, p + n_outliers*sizeof(double));
+  }
+  encode_zero_runs(codes, out);
+}
+
+void decompress_lossy(const unsigned char *data, uint64_t n_bytes, uint64_t n,
+                      double tolerance, double *values)
+{
+  const double quantum = 2.0 * tolerance;
+
+  uint64_t n_outliers;
+  if (n_bytes < sizeof(n_outliers))
+    throw runtime_error("Corrupted compressed data (no outliers)");
+  memcpy(&n_outliers, data, sizeof(n_outliers));
+  const uint64_t codes_start = sizeof(n_outliers) + n_outliers*sizeof(double);
+  if (n_bytes < codes_start)
+    throw runtime_error("Corrupted compressed data (outliers)");
+  const unsigned char *outliers = data + sizeof(n_outliers);
+
+  vector<unsigned char> codes;
+  decode_zero_runs(data + codes_start, n_bytes - codes_start, codes);
+  if (codes.size() < n)
+    throw runtime_error("Corrupted compressed data (too few codes)");
+
+  uint64_t pos = 0, k = 0;
+  double pred = 0.;
+  for (uint64_t i = 0; i < n; ++i)
+  {
+    const uint64_t code = get_varint(&codes[0], codes.size(), pos);
+    if (code == OUTLIER_CODE)
+    {
+      if (k >= n_outliers)
+        throw runtime_error("Corrupted compressed data (too many outliers)");
+      memcpy(&values[i], outliers + k*sizeof(double), sizeof(double));
+      ++k;
+    }
+    else if (code > OUTLIER_CODE)
+      throw runtime_error("Corrupted compressed data (code)");
+    else
+    {
+      const double q = (double)unzigzag64(code);
+      values[i] = pred + quantum * q;
+    }
+    pred = values[i];
+  }
+}
+
+double absolute_tolerance(const double *values, uint64_t n,
+                          double rel_tolerance)
+{
+  if (n == 0) return rel_tolerance;
+  double min_val = values[0], max_val = values[0];
+  for (uint64_t i = 1; i < n; ++i)
+  {
+    min_val = min(min_val, values[i]);
+    max_val = max(max_val, values[i]);
+  }
+  const double range = max_val - min_val;
+  // a constant field: any positive tolerance gives the exact values
+  return (range > 0 ? rel_tolerance * range : rel_tolerance);
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// File format
+//
+//------------------------------------------------------------------------------
+void write_compressed_file_header(ostream &out)
+{
+  out.write(COMPRESSED_FILE_MAGIC, 4);
+  out.write(reinterpret_cast<const char*>(&COMPRESSED_FILE_VERSION),
+            sizeof(COMPRESSED_FILE_VERSION));
+}
+
+void read_compressed_file_header(istream &in)
+{
+  char magic[4];
+  uint32_t version = 0;
+  in.read(magic, 4);
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  if (!in || strncmp(magic, COMPRESSED_FILE_MAGIC, 4) != 0)
+    throw runtime_error("This is not a compressed acwave file");
+  if (version != COMPRESSED_FILE_VERSION)
+    throw runtime_error("Unsupported version of the compressed file");
+}
+
+void write_chunk(ostream &out, const ChunkHeader &header, const string &text,
+                 const vector<unsigned char> &payload)
+{
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!text.empty())
+    out.write(text.c_str(), text.size());
+  if (!payload.empty())
+    out.write(reinterpret_cast<const char*>(&payload[0]), payload.size());
+  if (!out)
+    throw runtime_error("Failed to write a compressed chunk");
+}
+
+bool read_chunk(istream &in, ChunkHeader &header, string &text,
+                vector<unsigned char> &payload)
+{
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (in.gcount() == 0 && in.eof())
+    return false;
+  if (!in)
+    throw runtime_error("Corrupted compressed file (chunk header)");
+
+  text.resize(header.text_size);
+  if (header.text_size > 0)
+    in.read(&text[0], header.text_size);
+  payload.resize(header.n_bytes);
+  if (header.n_bytes > 0)
+    in.read(reinterpret_cast<char*>(&payload[0]), header.n_bytes);
+  if (!in)
+    throw runtime_error("Corrupted compressed file (chunk data)");
+
+  return true;
+}
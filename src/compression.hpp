@@ -0,0 +1,90 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Compression of the output data (seismograms and snapshots). This part of the
+ * code doesn't depend on MFEM, since it's used by the standalone decompressor
+ * as well.
+ *
+ * A compressed file starts with a file header followed by a sequence of chunks.
+ * Every chunk has its own header describing the codec, the shape of the data
+ * and the size of the compressed payload.
+ */
+
+const char COMPRESSED_FILE_MAGIC[] = "ACWZ";
+const uint32_t COMPRESSED_FILE_VERSION = 2;
+
+enum CompressionCodec
+{
+  LOSSLESS_FLOAT = 1, ///< byte-shuffle + delta coding of float values
+  LOSSY_DOUBLE   = 2  ///< error-bounded quantization of double values
+};
+
+struct ChunkHeader
+{
+  uint32_t codec;       ///< one of CompressionCodec values
+  uint32_t text_size;   ///< size of a text description following the header
+  uint64_t n_rows;      ///< number of time steps (1 for a snapshot)
+  uint64_t n_cols;      ///< number of values in one time step
+  double   tolerance;   ///< absolute error bound (lossy codec)
+  uint64_t n_bytes;     ///< size of the compressed payload in bytes
+};
+
+/**
+ * Lossless compression of n_rows x n_cols float values (stored row-by-row, as
+ * time steps of seismograms are). The values are coded column-by-column, i.e.
+ * along the time for every receiver: the differences between consecutive bit
+ * patterns are shuffled into byte planes and the runs of zero bytes are
+ * encoded by their lengths.
+ */
+void compress_lossless(const float *values, uint64_t n_rows, uint64_t n_cols,
+                       std::vector<unsigned char> &out);
+
+void decompress_lossless(const unsigned char *data, uint64_t n_bytes,
+                         uint64_t n_rows, uint64_t n_cols, float *values);
+
+/**
+ * Lossy compression of n double values with an absolute error bound: every
+ * value is predicted by the previous reconstructed one, and the difference is
+ * quantized with the step 2*tolerance, so that |value - reconstructed| <=
+ * tolerance. The values that can't be represented within the bound are stored
+ * exactly. The zero differences (quiet parts of a field) are coded as the
+ * runs of zero bytes.
+ */
+void compress_lossy(const double *values, uint64_t n, double tolerance,
+                    std::vector<unsigned char> &out);
+
+void decompress_lossy(const unsigned char *data, uint64_t n_bytes, uint64_t n,
+                      double tolerance, double *values);
+
+/**
+ * The absolute tolerance corresponding to the relative one for the given
+ * values: rel_tolerance * (max - min).
+ */
+double absolute_tolerance(const double *values, uint64_t n,
+                          double rel_tolerance);
+
+void write_compressed_file_header(std::ostream &out);
+
+/**
+ * Read and check the header of a compressed file.
+ */
+void read_compressed_file_header(std::istream &in);
+
+void write_chunk(std::ostream &out, const ChunkHeader &header,
+                 const std::string &text,
+                 const std::vector<unsigned char> &payload);
+
+/**
+ * Read the next chunk of a compressed file.
+ * @return false if there are no more chunks
+ */
+bool read_chunk(std::istream &in, ChunkHeader &header, std::string &text,
+                std::vector<unsigned char> &payload);
+
+#endif // COMPRESSION_HPP
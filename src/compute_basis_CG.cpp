@@ -1,12 +1,166 @@
 #include "acoustic_wave.hpp"
+#include "mass_solver.hpp"
 #include "parameters.hpp"
+#include "structured_assembly.hpp"
 #include "utilities.hpp"
 
+#include <random>
+
 using namespace std;
 using namespace mfem;
 
 
 
+/**
+ * Harmonic extensions (S_II x_I = -S_IB x_B) of the given boundary values into
+ * the interior of the coarse cell, the columns of W.
+ * @param data - the boundary values (at the bdr_dofs) of the snapshots, or
+ * nullptr for a unit value at every boundary dof in turn.
+ */
+static void harmonic_extensions(const SparseMatrix &S,
+                                const Array<int> &bdr_dofs,
+                                const DenseMatrix *data, int n_threads,
+                                DenseMatrix &W)
+{
+  // the system matrix is the same for all snapshots, so it's factorized once
+  // and solved for all the columns
+  const int n_dofs = S.Height();
+  const int n_bdr = bdr_dofs.Size();
+  const int n_snap = (data ? data->Width() : n_bdr);
+  vector<int> bdr_index(n_dofs, -1); // dof -> number among the bdr_dofs
+  for (int bd = 0; bd < n_bdr; ++bd)
+    bdr_index[bdr_dofs[bd]] = bd;
+  vector<int> interior; // interior number -> dof
+  vector<int> int_index(n_dofs, -1);
+  for (int i = 0; i < n_dofs; ++i)
+  {
+    if (bdr_index[i] < 0)
+    {
+      int_index[i] = interior.size();
+      interior.push_back(i);
+    }
+  }
+
+  const int n_int = interior.size();
+  const int *I = S.GetI();
+  const int *J = S.GetJ();
+  const double *values = S.GetData();
+  int *A_I = new int[n_int + 1];
+  A_I[0] = 0;
+  for (int r = 0; r < n_int; ++r)
+  {
+    A_I[r+1] = A_I[r];
+    for (int p = I[interior[r]]; p < I[interior[r]+1]; ++p)
+      if (int_index[J[p]] >= 0)
+        ++A_I[r+1];
+  }
+  int *A_J = new int[A_I[n_int]];
+  double *A_data = new double[A_I[n_int]];
+  DenseMatrix RHS(n_int, n_snap);
+  RHS = 0.0;
+  for (int r = 0; r < n_int; ++r)
+  {
+    int q = A_I[r];
+    for (int p = I[interior[r]]; p < I[interior[r]+1]; ++p)
+    {
+      const int bd = bdr_index[J[p]];
+      if (bd < 0)
+      {
+        A_J[q] = int_index[J[p]];
+        A_data[q++] = values[p];
+      }
+      else if (!data)
+        RHS(r, bd) = -values[p];
+      else
+      {
+        for (int c = 0; c < n_snap; ++c)
+          RHS(r, c) -= values[p] * (*data)(bd, c);
+      }
+    }
+  }
+  SparseMatrix A_II(A_I, A_J, A_data, n_int, n_int);
+
+  DenseMatrix X_int; // the interior values of the snapshots
+  if (n_int > 0)
+  {
+    SkylineCholeskySolver solver(A_II);
+    solver.SetOperator(A_II);
+    solver.Mult(RHS, X_int, n_threads);
+  }
+
+  W.SetSize(n_dofs, n_snap);
+  W = 0.0;
+  for (int c = 0; c < n_snap; ++c)
+  {
+    for (int bd = 0; bd < n_bdr; ++bd)
+      W(bdr_dofs[bd], c) = (data ? (*data)(bd, c) : (bd == c ? 1. : 0.));
+    for (int r = 0; r < n_int; ++r)
+      W(interior[r], c) = X_int(r, c);
+  }
+}
+
+
+
+/**
+ * The spectral problem in the snapshot space: W^T S W z = lambda W^T EM W z,
+ * only the n_modes smallest modes are computed.
+ */
+static void snapshot_eigenproblem(const SparseMatrix &S,
+                                  const SparseMatrix &EM, const DenseMatrix &W,
+                                  int n_modes, DenseMatrix &eigenvectors,
+                                  Vector &eigenvalues)
+{
+  const DenseMatrix *WTSW = RAP(S, W);
+  const DenseMatrix *WTEMW = RAP(EM, W);
+  solve_dsygvx(*WTSW, *WTEMW, n_modes, eigenvectors, &eigenvalues);
+  delete WTEMW;
+  delete WTSW;
+}
+
+
+
+/**
+ * Subspace iterations improving the randomized snapshot space. The random
+ * boundary values are rough, so their harmonic extensions are far from the
+ * smooth low modes of the spectral problem. Every iteration replaces W by
+ * (S + sigma EM)^{-1} EM W, which stays in the snapshot space (the interior
+ * rows of EM are zero, so the result is harmonic in the interior) and damps
+ * the high modes. Before every iteration the columns are made EM-orthonormal
+ * by the Rayleigh-Ritz step. The tiny shift sigma makes the matrix positive
+ * definite (S is singular with the constants).
+ */
+static void subspace_iterations(const SparseMatrix &S, const SparseMatrix &EM,
+                                int n_iter, int n_threads, DenseMatrix &W)
+{
+  const int n_snap = W.Width();
+  DenseMatrix Z, X(W.Height(), n_snap), B(W.Height(), n_snap);
+  Vector ritz_values;
+  snapshot_eigenproblem(S, EM, W, n_snap, Z, ritz_values);
+
+  const double sigma = 1e-6 * ritz_values(n_snap - 1);
+  SparseMatrix *A = Add(1., S, sigma, EM);
+  SkylineCholeskySolver solver(*A);
+  solver.SetOperator(*A);
+
+  for (int it = 0; it < n_iter; ++it)
+  {
+    if (it > 0)
+      snapshot_eigenproblem(S, EM, W, n_snap, Z, ritz_values);
+    Mult(W, Z, X);
+    for (int c = 0; c < n_snap; ++c)
+    {
+      Vector x, b;
+      X.GetColumnReference(c, x);
+      B.GetColumnReference(c, b);
+      EM.Mult(x, b);
+    }
+    solver.Mult(B, W, n_threads);
+  }
+  delete A;
+}
+
+
+
 static
 void compute_boundary_basis_CG(const Parameters &param,
                                Mesh *fine_mesh, int n_boundary_bf, int n_interior_bf,
@@ -25,8 +179,11 @@ void compute_boundary_basis_CG(const Parameters &param,
   chrono.Clear();
   cout << "Stif matrix..." << flush;
   BilinearForm stif(&fespace);
-  stif.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
+  stif.AddDomainIntegrator(stiffness_integrator(*fine_mesh,
+                                                one_over_rho_coef));
   stif.Assemble();
+  stif.Finalize();
+  const SparseMatrix &S = stif.SpMat();
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
 
   Array<int> ess_bdr;
@@ -38,33 +195,27 @@ void compute_boundary_basis_CG(const Parameters &param,
     fespace.GetEssentialTrueDofs(ess_bdr, ess_tdof_list);
   }
 
+  // the randomized snapshot space: the harmonic extensions of a few random
+  // boundary values (gms_nb + oversampling) instead of all unit ones
+  const MethodParameters &method = param.method;
+  const int n_bdr = ess_tdof_list.Size();
+  DenseMatrix random_data;
+  if (method.gms_randomized && n_boundary_bf + method.gms_oversampling < n_bdr)
+  {
+    random_data.SetSize(n_bdr, n_boundary_bf + method.gms_oversampling);
+    mt19937 generator; // the same data for every run (the cached bases)
+    normal_distribution<double> normal;
+    for (int c = 0; c < random_data.Width(); ++c)
+      for (int bd = 0; bd < n_bdr; ++bd)
+        random_data(bd, c) = normal(generator);
+  }
+  const DenseMatrix *data = (random_data.Width() > 0 ? &random_data : nullptr);
+
   chrono.Clear();
   cout << "Snapshot matrix..." << flush;
-  DenseMatrix W(fespace.GetVSize(), ess_tdof_list.Size());
+  DenseMatrix W;
   {
-
-    Vector b(fespace.GetVSize()); // RHS (it's always 0 in the loop)
-
-    const int maxiter = 1000;
-    const double rtol = 1e-12;
-    const double atol = 1e-24;
-    for (int bd = 0; bd < ess_tdof_list.Size(); ++bd)
-    {
-      Vector x;
-      W.GetColumnReference(bd, x);
-      x = 0.;
-      x(ess_tdof_list[bd]) = 1.;
-      b = 0.;
-
-      mfem::SparseMatrix A; // mat after eliminating b.c.
-      mfem::Vector X, B;
-      stif.FormLinearSystem(ess_tdof_list, x, b, A, X, B);
-
-      mfem::GSSmoother precond(A);
-      mfem::PCG(A, precond, B, X, 0, maxiter, rtol, atol);
-
-      stif.RecoverFEMSolution(X, b, x);
-    }
+    harmonic_extensions(S, ess_tdof_list, data, method.gms_threads, W);
 
     if (param.output.view_snapshot_space)
     {
@@ -72,13 +223,13 @@ void compute_boundary_basis_CG(const Parameters &param,
       int  visport   = 19916;
       socketstream mode_sock(vishost, visport);
       mode_sock.precision(8);
-      for (int bd = 0; bd < ess_tdof_list.Size(); ++bd) {
+      for (int bd = 0; bd < W.Width(); ++bd) {
         Vector x;
         W.GetColumn(bd, x);
         GridFunction X;
         X.MakeRef(&fespace, x, 0);
         mode_sock << "solution\n" << *fine_mesh << X
-                  << "window_title 'Snapshot " << bd+1 << '/' << ess_tdof_list.Size()
+                  << "window_title 'Snapshot " << bd+1 << '/' << W.Width()
                   << "'" << std::endl;
 
         char c;
@@ -90,20 +241,8 @@ void compute_boundary_basis_CG(const Parameters &param,
       mode_sock.close();
     }
   }
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-
-  chrono.Clear();
-  cout << "Sfull matrix..." << flush;
-  const SparseMatrix &S = stif.SpMat();
-  const SparseMatrix &Se= stif.SpMatElim();
-  SparseMatrix *Sfull = Add(S, Se);
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-
-  chrono.Clear();
-  cout << "WTSW matrix..." << flush;
-  const DenseMatrix *WTSW = RAP(*Sfull, W);
-  delete Sfull;
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  double snapshot_time = chrono.RealTime();
+  cout << "done. Time = " << snapshot_time << " sec" << endl;
 
   chrono.Clear();
   cout << "Edge mass matrix..." << flush;
@@ -111,22 +250,59 @@ void compute_boundary_basis_CG(const Parameters &param,
   edge_mass.AddBoundaryIntegrator(new MassIntegrator(one_over_K_coef));
   edge_mass.Assemble();
   edge_mass.Finalize();
+  const SparseMatrix &EM = edge_mass.SpMat();
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
 
+  if (data && method.gms_power_iterations > 0)
+  {
+    chrono.Clear();
+    cout << "Subspace iterations (" << method.gms_power_iterations << ")..."
+         << flush;
+    subspace_iterations(S, EM, method.gms_power_iterations,
+                        method.gms_threads, W);
+    snapshot_time += chrono.RealTime();
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  }
+
+  MFEM_VERIFY(W.Width() >= n_boundary_bf, "The number of snapshots (" +
+              d2s(W.Width()) + ") is less than the number of boundary basis "
+              "functions");
   chrono.Clear();
-  cout << "WTEMW matrix..." << flush;
-  const SparseMatrix &EM = edge_mass.SpMat();
-  const DenseMatrix *WTEMW = RAP(EM, W);
+  cout << "Snapshot eigenproblem (" << W.Width() << " snapshots)..." << flush;
+  DenseMatrix eigenvectors;
+  Vector eigenvalues;
+  snapshot_eigenproblem(S, EM, W, n_boundary_bf, eigenvectors, eigenvalues);
+  const double time_of_reduced = snapshot_time + chrono.RealTime();
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
 
-  DenseMatrix eigenvectors(WTSW->Height(), WTSW->Width());
-  solve_dsygvd(*WTSW, *WTEMW, eigenvectors);
-
-  DenseMatrix selected_eigenvectors(eigenvectors.Height(), n_boundary_bf);
-  selected_eigenvectors.CopyCols(eigenvectors, 0, n_boundary_bf-1);
+  if (data && method.gms_randomized_check)
+  {
+    // accuracy and cost of the randomized snapshot space against the full one
+    // (its eigenvalues are the lower bounds of the randomized ones); the
+    // eigenvalues of the constants are zeros up to the round-off, so they
+    // aren't compared
+    chrono.Clear();
+    DenseMatrix W_full, eigenvectors_full;
+    Vector eigenvalues_full;
+    harmonic_extensions(S, ess_tdof_list, nullptr, method.gms_threads, W_full);
+    snapshot_eigenproblem(S, EM, W_full, n_boundary_bf, eigenvectors_full,
+                          eigenvalues_full);
+    const double time_of_full = chrono.RealTime();
+    double max_error = 0.;
+    for (int i = 0; i < n_boundary_bf; ++i)
+    {
+      const double lambda = eigenvalues_full[i];
+      if (fabs(lambda) > 1e-8 * fabs(eigenvalues_full[n_boundary_bf-1]))
+        max_error = max(max_error, (eigenvalues[i] - lambda) / fabs(lambda));
+    }
+    cout << "Randomized snapshots: " << W.Width() << " of " << n_bdr
+         << ", time " << time_of_reduced << " sec vs " << time_of_full
+         << " sec, max relative error of " << n_boundary_bf
+         << " eigenvalues " << max_error << endl;
+  }
 
   DenseMatrix boundary_basis(fespace.GetVSize(), n_boundary_bf);
-  Mult(W, selected_eigenvectors, boundary_basis);
+  Mult(W, eigenvectors, boundary_basis);
 
   R.SetSize(fespace.GetVSize(), n_boundary_bf + n_interior_bf);
   for (int col = 0; col < n_boundary_bf; ++col)
@@ -135,9 +311,6 @@ void compute_boundary_basis_CG(const Parameters &param,
       R(row, col) = boundary_basis(row, col);
   }
 
-  delete WTEMW;
-  delete WTSW;
-
   if (param.output.view_boundary_basis)
   {
     char vishost[] = "localhost";
@@ -192,7 +365,8 @@ void compute_interior_basis_CG(const Parameters &param,
   chrono.Clear();
   cout << "Par Stif matrix..." << flush;
   ParBilinearForm par_stif(&par_fespace);
-  par_stif.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
+  par_stif.AddDomainIntegrator(stiffness_integrator(par_fine_mesh,
+                                                    one_over_rho_coef));
   par_stif.Assemble();
   par_stif.EliminateEssentialBCDiag(ess_bdr, 1.0);
   par_stif.Finalize();
@@ -202,7 +376,8 @@ void compute_interior_basis_CG(const Parameters &param,
   chrono.Clear();
   cout << "Par Mass matrix..." << flush;
   ParBilinearForm par_mass(&par_fespace);
-  par_mass.AddDomainIntegrator(new MassIntegrator(one_over_K_coef));
+  par_mass.AddDomainIntegrator(mass_integrator(par_fine_mesh,
+                                               one_over_K_coef));
   par_mass.Assemble();
   par_mass.EliminateEssentialBCDiag(ess_bdr, numeric_limits<double>::min());
   par_mass.Finalize();
@@ -1,81 +1,104 @@
 #include "acoustic_wave.hpp"
 #include "parameters.hpp"
+#include "structured_assembly.hpp"
 #include "utilities.hpp"
 
+#include <algorithm>
+#include <vector>
+
 using namespace std;
 using namespace mfem;
 
 
 
-void solve_dsygvd(const DenseMatrix &A, const DenseMatrix &B, DenseMatrix &eigenvectors)
+/**
+ * The workspace of solve_dsygvx kept between the calls (one per thread), so
+ * it's allocated (and the optimal size of WORK is queried) only when the
+ * problem gets larger than the previous ones.
+ */
+struct EigenWorkspace
+{
+  EigenWorkspace() : N(0) { }
+  int N; ///< the size WORK has been queried for
+  vector<double> A, B, eigenvalues, Z, WORK;
+  vector<int> IWORK, IFAIL;
+};
+
+void solve_dsygvx(const DenseMatrix &A, const DenseMatrix &B, int n_modes,
+                  DenseMatrix &eigenvectors, Vector *eigenvalues_out)
 {
+  static thread_local EigenWorkspace ws;
+
   int ITYPE = 1; // solve Ax = \lambda Bx
   char JOBZ = 'V'; // get eigenvectors
+  char RANGE = 'I'; // the eigenvalues with the indices IL..IU
   char UPLO = 'L'; // upper or lower triangle is used
 
   int N = A.Height(); // matrix dimension
-  double *a_data = new double[N*N];
+  MFEM_VERIFY(B.Height() == N && A.Width() == N && B.Width() == N,
+              "The matrices of the eigenproblem are of different sizes");
+  MFEM_VERIFY(n_modes >= 1 && n_modes <= N, "The number of modes (" +
+              d2s(n_modes) + ") is out of range [1, " + d2s(N) + "]");
+
+  const size_t NN = (size_t)N*N;
+  if (ws.A.size() < NN)
   {
-    const double *d = A.Data();
-    for (int i = 0; i < N*N; ++i)
-      a_data[i] = d[i];
+    ws.A.resize(NN);
+    ws.B.resize(NN);
   }
-
-  int LDA = N; // leading dimension of A
-  double *b_data = new double[N*N];
+  copy(A.Data(), A.Data() + NN, ws.A.begin());
+  copy(B.Data(), B.Data() + NN, ws.B.begin());
+  if ((int)ws.eigenvalues.size() < N)
   {
-    const double *d = B.Data();
-    for (int i = 0; i < N*N; ++i)
-      b_data[i] = d[i];
+    ws.eigenvalues.resize(N);
+    ws.IWORK.resize(5*N);
+    ws.IFAIL.resize(N);
   }
+  if (ws.Z.size() < (size_t)N*n_modes)
+    ws.Z.resize((size_t)N*n_modes);
 
+  int LDA = N; // leading dimension of A
   int LDB = N; // leading dimension of B
+  int LDZ = N; // leading dimension of the eigenvectors
+  double VL = 0., VU = 0.; // not used for RANGE = 'I'
+  int IL = 1, IU = n_modes; // the smallest n_modes eigenvalues
+  char CMACH = 'S'; // safe minimum
+  double ABSTOL = 2. * dlamch_(&CMACH); // the most accurate eigenvalues
+  int M; // number of the found eigenvalues
+  int INFO;
 
-  double *eigenvalues = new double[N];
-
-  int LWORK = 1 + 6*N + 2*N*N;
-  double *WORK = new double[LWORK];
+  if (N > ws.N)
+  {
+    int LWORK = -1; // workspace query
+    double work_size;
+    dsygvx_(&ITYPE, &JOBZ, &RANGE, &UPLO, &N, &ws.A[0], &LDA, &ws.B[0], &LDB,
+            &VL, &VU, &IL, &IU, &ABSTOL, &M, &ws.eigenvalues[0], &ws.Z[0],
+            &LDZ, &work_size, &LWORK, &ws.IWORK[0], &ws.IFAIL[0], &INFO);
+    ws.WORK.resize(max((size_t)work_size, (size_t)8*N));
+    ws.N = N;
+  }
 
-  int LIWORK = 3 + 5*N;
-  int *IWORK = new int[LIWORK];
+  int LWORK = ws.WORK.size();
+  dsygvx_(&ITYPE, &JOBZ, &RANGE, &UPLO, &N, &ws.A[0], &LDA, &ws.B[0], &LDB,
+          &VL, &VU, &IL, &IU, &ABSTOL, &M, &ws.eigenvalues[0], &ws.Z[0],
+          &LDZ, &ws.WORK[0], &LWORK, &ws.IWORK[0], &ws.IFAIL[0], &INFO);
 
-  int INFO;
-  dsygvd_(&ITYPE,
-          &JOBZ,
-          &UPLO,
-          &N,
-          a_data,
-          &LDA,
-          b_data,
-          &LDB,
-          eigenvalues,
-          WORK,
-          &LWORK,
-          IWORK,
-          &LIWORK,
-          &INFO);
-
-  delete[] IWORK;
-  delete[] WORK;
-  delete[] eigenvalues;
-  delete[] b_data;
-
-  if (INFO != 0)
+  if (INFO != 0 || M != n_modes)
   {
-    std::cerr << "\nINFO = " << INFO << "\nN = " << N << std::endl;
+    std::cerr << "\nINFO = " << INFO << "\nN = " << N << "\nM = " << M
+              << std::endl;
     MFEM_ABORT("The solution of the eigenproblem is not found");
   }
 
-//  for (int i = 0; i < N; ++i)
-//    math::normalize(N, &a_data[i*N]);
-
-  for (int i = 0, k = 0; i < N; ++i)
+  if (eigenvalues_out)
   {
-    for (int j = 0; j < N; ++j, ++k)
-      eigenvectors(j, i) = a_data[k];
+    eigenvalues_out->SetSize(n_modes);
+    for (int i = 0; i < n_modes; ++i)
+      (*eigenvalues_out)[i] = ws.eigenvalues[i];
   }
 
-  delete[] a_data;
+  eigenvectors.SetSize(N, n_modes);
+  copy(ws.Z.begin(), ws.Z.begin() + (size_t)N*n_modes, eigenvectors.Data());
 }
 
 
@@ -115,7 +138,8 @@ void AcousticWave::compute_basis_DG(Mesh *fine_mesh, int n_boundary_bf, int n_in
     W.SetSize(fespace.GetVSize(), ess_tdof_list.Size());
 
     BilinearForm stif(&CG_fespace);
-    stif.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
+    stif.AddDomainIntegrator(stiffness_integrator(*fine_mesh,
+                                                  one_over_rho_coef));
     stif.Assemble();
 
     Vector b(CG_fespace.GetVSize()); // RHS (it's always 0 in the loop)
@@ -213,14 +237,11 @@ void AcousticWave::compute_basis_DG(Mesh *fine_mesh, int n_boundary_bf, int n_in
   const DenseMatrix *WTEMW = RAP(EM, W);
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
 
-  DenseMatrix eigenvectors(WTSW->Height(), WTSW->Width());
-  solve_dsygvd(*WTSW, *WTEMW, eigenvectors);
-
-  DenseMatrix selected_eigenvectors(eigenvectors.Height(), n_boundary_bf);
-  selected_eigenvectors.CopyCols(eigenvectors, 0, n_boundary_bf-1);
+  DenseMatrix eigenvectors;
+  solve_dsygvx(*WTSW, *WTEMW, n_boundary_bf, eigenvectors);
 
   DenseMatrix boundary_basis(fespace.GetVSize(), n_boundary_bf);
-  Mult(W, selected_eigenvectors, boundary_basis);
+  Mult(W, eigenvectors, boundary_basis);
 
   {
     char vishost[] = "localhost";
@@ -262,7 +283,8 @@ void AcousticWave::compute_basis_DG(Mesh *fine_mesh, int n_boundary_bf, int n_in
 
     cout << "Stif matrix..." << flush;
     ParBilinearForm par_stif(&par_fespace);
-    par_stif.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
+    par_stif.AddDomainIntegrator(stiffness_integrator(par_fine_mesh,
+                                                      one_over_rho_coef));
     par_stif.AddInteriorFaceIntegrator(
           new DGDiffusionIntegrator(one_over_rho_coef,
                                     param.method.dg_sigma,
@@ -279,7 +301,8 @@ void AcousticWave::compute_basis_DG(Mesh *fine_mesh, int n_boundary_bf, int n_in
 
     cout << "Mass matrix..." << flush;
     ParBilinearForm par_mass(&par_fespace);
-    par_mass.AddDomainIntegrator(new MassIntegrator(one_over_K_coef));
+    par_mass.AddDomainIntegrator(mass_integrator(par_fine_mesh,
+                                                 one_over_K_coef));
     par_mass.Assemble();
     par_mass.Finalize();
     HypreParMatrix *par_M = par_mass.ParallelAssemble();
@@ -0,0 +1,643 @@
+#include "dg_operator.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mfem;
+
+static const double unit = 1.0; ///< the 1x1 "matrix" of the absent direction
+
+
+
+/**
+ * Values and derivatives of the 1D basis functions at the points of the rule:
+ * B[q*n + i] = phi_i(x_q), G[q*n + i] = phi_i'(x_q).
+ */
+static void tabulate(const FiniteElement &segment, const IntegrationRule &rule,
+                     vector<double> &B, vector<double> &G)
+{
+  const int n = segment.GetDof();
+  Vector shape(n);
+  DenseMatrix dshape(n, 1);
+  B.resize(rule.GetNPoints() * n);
+  G.resize(rule.GetNPoints() * n);
+  for (int q = 0; q < rule.GetNPoints(); ++q)
+  {
+    segment.CalcShape(rule.IntPoint(q), shape);
+    segment.CalcDShape(rule.IntPoint(q), dshape);
+    for (int i = 0; i < n; ++i)
+    {
+      B[q*n + i] = shape(i);
+      G[q*n + i] = dshape(i, 0);
+    }
+  }
+}
+
+/**
+ * The local face (2*direction + side) of the reference element containing the
+ * point.
+ */
+static int local_face(const IntegrationPoint &ip, int dim)
+{
+  const double x[] = { ip.x, ip.y, ip.z };
+  const double tol = 1e-12;
+  for (int d = 0; d < dim; ++d)
+  {
+    if (fabs(x[d]) < tol)
+      return 2*d;
+    if (fabs(x[d] - 1.) < tol)
+      return 2*d + 1;
+  }
+  MFEM_ABORT("The point is not on a face of the reference element");
+  return -1;
+}
+
+/// index of (a,b) in the packed upper triangle of a symmetric matrix
+static inline int sym(int a, int b, int dim)
+{
+  if (a > b)
+    std::swap(a, b);
+  return a*dim - a*(a-1)/2 + (b-a);
+}
+
+
+
+DGStiffnessOperator::DGStiffnessOperator(FiniteElementSpace &fespace,
+                                         Coefficient &one_over_rho,
+                                         double sigma, double kappa,
+                                         const IntegrationRule *volume_rule,
+                                         const vector<char> *natural_faces)
+  : Operator(fespace.GetVSize())
+  , _dim(fespace.GetMesh()->Dimension())
+  , _n(0), _nv(0), _nf(0)
+  , _n_dofs(0), _n_vpts(0), _n_fpts(0)
+  , _sigma(sigma)
+  , _face_rule(nullptr)
+  , _Bv(), _Gv(), _Bf(), _Gf(), _B_end(), _G_end()
+  , _volume_factors()
+  , _faces()
+  , _face_factors()
+  , _face_perm()
+  , _t1(), _t2(), _grad(), _flux()
+{
+  Mesh &mesh = *fespace.GetMesh();
+  const int n_elements = mesh.GetNE();
+  MFEM_VERIFY(n_elements > 0, "The mesh is empty");
+  MFEM_VERIFY(fespace.GetVDim() == 1, "Only scalar spaces are supported");
+
+  const FiniteElement &fe = *fespace.GetFE(0);
+  const int geom = fe.GetGeomType();
+  MFEM_VERIFY(geom == Geometry::SQUARE || geom == Geometry::CUBE,
+              "The matrix-free DG operator requires quadrilateral or "
+              "hexahedral elements");
+  const int order = fe.GetOrder();
+  _n = order + 1;
+  _n_dofs = fe.GetDof();
+  MFEM_VERIFY(_n_dofs == (_dim == 2 ? _n*_n : _n*_n*_n), "The element is not "
+              "a tensor product of order " + d2s(order));
+
+  const FiniteElement *segment =
+    fespace.FEColl()->FiniteElementForGeometry(Geometry::SEGMENT);
+  MFEM_VERIFY(segment && segment->GetDof() == _n, "The 1D element of the "
+              "collection doesn't match the elements of the mesh");
+
+  // the same quadrature as the one of the DiffusionIntegrator for the Qk
+  // elements and of the DGDiffusionIntegrator
+  const IntegrationRule &vrule = (volume_rule ? *volume_rule :
+                                  IntRules.Get(Geometry::SEGMENT,
+                                               2*order + _dim - 1));
+  _face_rule = &IntRules.Get(Geometry::SEGMENT, 2*order);
+  _nv = vrule.GetNPoints();
+  _nf = _face_rule->GetNPoints();
+  _n_vpts = (_dim == 2 ? _nv*_nv : _nv*_nv*_nv);
+  _n_fpts = (_dim == 2 ? _nf : _nf*_nf);
+
+  tabulate(*segment, vrule, _Bv, _Gv);
+  tabulate(*segment, *_face_rule, _Bf, _Gf);
+  IntegrationRule ends(2);
+  ends.IntPoint(0).x = 0.;
+  ends.IntPoint(1).x = 1.;
+  tabulate(*segment, ends, _B_end, _G_end);
+
+  // the basis of the element must be the tensor product of the 1D basis with
+  // the dofs in the lexicographic order
+  {
+    const double coord[] = { 0.31, 0.57, 0.83 };
+    IntegrationPoint ip;
+    ip.Set3(coord[0], coord[1], coord[2]);
+    Vector shape(_n_dofs);
+    fe.CalcShape(ip, shape);
+    Vector shape1d[3];
+    for (int d = 0; d < _dim; ++d)
+    {
+      IntegrationPoint ip1d;
+      ip1d.x = coord[d];
+      shape1d[d].SetSize(_n);
+      segment->CalcShape(ip1d, shape1d[d]);
+    }
+    const int nz = (_dim == 3 ? _n : 1);
+    double diff = 0.;
+    for (int k = 0; k < nz; ++k)
+      for (int j = 0; j < _n; ++j)
+        for (int i = 0; i < _n; ++i)
+        {
+          const double z = (_dim == 3 ? shape1d[2](k) : 1.);
+          const double s = shape1d[0](i) * shape1d[1](j) * z;
+          diff = max(diff, fabs(s - shape((k*_n + j)*_n + i)));
+        }
+    MFEM_VERIFY(diff < 1e-12, "The basis of the elements isn't a tensor "
+                "product in the lexicographic order");
+  }
+
+  Array<int> vdofs;
+  for (int el = 0; el < n_elements; ++el)
+  {
+    MFEM_VERIFY(fespace.GetFE(el)->GetGeomType() == geom &&
+                fespace.GetFE(el)->GetOrder() == order,
+                "The elements must be of the same type");
+    fespace.GetElementVDofs(el, vdofs);
+    for (int i = 0; i < _n_dofs; ++i)
+      MFEM_VERIFY(vdofs[i] == el*_n_dofs + i, "The dofs of the elements "
+                  "must be numbered element by element");
+  }
+
+  const int max_n = max(_n, max(_nv, _nf));
+  _t1.resize(max_n * max_n * max_n);
+  _t2.resize(max_n * max_n * max_n);
+  _grad.resize(_dim * _n_vpts);
+  _flux.resize(_dim * _n_vpts);
+  for (int s = 0; s < 2; ++s)
+  {
+    _trace[s].resize((_dim + 1) * _n_fpts);
+    _coefs[s].resize((_dim + 1) * _n_fpts);
+  }
+
+  // geometric factors of the volume kernel
+  const int nfac = n_factors();
+  _volume_factors.resize(n_elements * _n_vpts * nfac);
+  DenseMatrix adj(_dim);
+  for (int el = 0; el < n_elements; ++el)
+  {
+    ElementTransformation *T = mesh.GetElementTransformation(el);
+    for (int p = 0; p < _n_vpts; ++p)
+    {
+      const int qx = p % _nv;
+      const int qy = (p / _nv) % _nv;
+      const int qz = p / (_nv * _nv);
+      IntegrationPoint ip;
+      ip.x = vrule.IntPoint(qx).x;
+      ip.y = vrule.IntPoint(qy).x;
+      ip.z = (_dim == 3 ? vrule.IntPoint(qz).x : 0.);
+      ip.weight = vrule.IntPoint(qx).weight * vrule.IntPoint(qy).weight *
+                  (_dim == 3 ? vrule.IntPoint(qz).weight : 1.);
+      T->SetIntPoint(&ip);
+      CalcAdjugate(T->Jacobian(), adj);
+      const double c = ip.weight * one_over_rho.Eval(*T, ip) / T->Weight();
+      double *D = &_volume_factors[(el*_n_vpts + p) * nfac];
+      for (int a = 0; a < _dim; ++a)
+        for (int b = a; b < _dim; ++b)
+        {
+          double s = 0.;
+          for (int l = 0; l < _dim; ++l)
+            s += adj(a, l) * adj(b, l);
+          D[sym(a, b, _dim)] = c * s;
+        }
+    }
+  }
+
+  // geometric factors of the face kernel
+  const int n_faces = mesh.GetNumFaces();
+  const int stride = 2*_dim + 1;
+  _faces.resize(n_faces);
+  _face_factors.assign(n_faces * _n_fpts * stride, 0.);
+  _face_perm.resize(n_faces * _n_fpts);
+  IntegrationRule points[2];
+  DenseMatrix normals(_dim, _n_fpts); // scaled by the area of the face
+  DenseMatrix X1(_dim, _n_fpts), X2(_dim, _n_fpts); // physical points
+  Vector x(_dim);
+  for (int f = 0; f < n_faces; ++f)
+  {
+    Face &face = _faces[f];
+    mesh.GetFaceElements(f, &face.elem[0], &face.elem[1]);
+    face.offset = f * _n_fpts;
+    const bool interior = (face.elem[1] >= 0);
+    if (!interior && natural_faces && (*natural_faces)[f])
+    {
+      face.elem[0] = -1; // dropped below
+      continue;
+    }
+
+    FaceElementTransformations *FT = mesh.GetFaceElementTransformations(f);
+    const IntegrationPoint &center = Geometries.GetCenter(FT->FaceGeom);
+    IntegrationPoint eip;
+    FT->Loc1.Transform(center, eip);
+    face.local_face[0] = local_face(eip, _dim);
+    face.local_face[1] = -1;
+    if (interior)
+    {
+      FT->Loc2.Transform(center, eip);
+      face.local_face[1] = local_face(eip, _dim);
+    }
+
+    // the first element: the normals, the normal derivatives and the
+    // penalty weights (the half of them on the interior faces)
+    const double half = (interior ? 0.5 : 1.);
+    face_points(face.local_face[0], points[0]);
+    ElementTransformation *T = mesh.GetElementTransformation(face.elem[0]);
+    const int dir = face.local_face[0] / 2;
+    const double sign = (face.local_face[0] % 2 ? 1. : -1.);
+    for (int q = 0; q < _n_fpts; ++q)
+    {
+      const IntegrationPoint &ip = points[0].IntPoint(q);
+      T->SetIntPoint(&ip);
+      CalcAdjugate(T->Jacobian(), adj);
+      double *F = &_face_factors[(face.offset + q) * stride];
+      double nn = 0.;
+      for (int i = 0; i < _dim; ++i)
+      {
+        normals(i, q) = sign * adj(dir, i); // adj(J)^T * n_ref
+        nn += normals(i, q) * normals(i, q);
+      }
+      const double w = half * ip.weight * one_over_rho.Eval(*T, ip) /
+                       T->Weight();
+      for (int i = 0; i < _dim; ++i)
+      {
+        double s = 0.;
+        for (int j = 0; j < _dim; ++j)
+          s += adj(i, j) * normals(j, q);
+        F[i] = w * s;
+      }
+      F[2*_dim] = w * nn;
+      T->Transform(ip, x);
+      X1.SetCol(q, x);
+      _face_perm[face.offset + q] = q;
+    }
+
+    if (interior)
+    {
+      // the points of the second element matching the ones of the first
+      face_points(face.local_face[1], points[1]);
+      T = mesh.GetElementTransformation(face.elem[1]);
+      double size = 0.;
+      for (int r = 0; r < _n_fpts; ++r)
+      {
+        T->Transform(points[1].IntPoint(r), x);
+        X2.SetCol(r, x);
+        size = max(size, DistanceSquared(X1.GetColumn(0), X1.GetColumn(r),
+                                         _dim));
+      }
+      const double tol = 1e-12 * size;
+      for (int q = 0; q < _n_fpts; ++q)
+      {
+        int best = 0;
+        double best_dist = DistanceSquared(X1.GetColumn(q), X2.GetColumn(0),
+                                           _dim);
+        for (int r = 1; r < _n_fpts; ++r)
+        {
+          const double dist = DistanceSquared(X1.GetColumn(q), X2.GetColumn(r),
+                                              _dim);
+          if (dist < best_dist)
+          {
+            best = r;
+            best_dist = dist;
+          }
+        }
+        MFEM_VERIFY(_n_fpts == 1 || best_dist <= tol, "The quadrature points "
+                    "of the face " + d2s(f) + " don't match (non-conforming "
+                    "mesh?)");
+        _face_perm[face.offset + q] = best;
+
+        const IntegrationPoint &ip = points[1].IntPoint(best);
+        T->SetIntPoint(&ip);
+        CalcAdjugate(T->Jacobian(), adj);
+        double *F = &_face_factors[(face.offset + q) * stride];
+        double nn = 0.;
+        for (int i = 0; i < _dim; ++i)
+          nn += normals(i, q) * normals(i, q);
+        const double w = half * points[0].IntPoint(q).weight *
+                         one_over_rho.Eval(*T, ip) / T->Weight();
+        for (int i = 0; i < _dim; ++i)
+        {
+          double s = 0.;
+          for (int j = 0; j < _dim; ++j)
+            s += adj(i, j) * normals(j, q);
+          F[_dim + i] = w * s;
+        }
+        F[2*_dim] += w * nn;
+      }
+    }
+
+    for (int q = 0; q < _n_fpts; ++q)
+      _face_factors[(face.offset + q) * stride + 2*_dim] *= kappa;
+  }
+
+  // the faces with the natural condition have no terms
+  size_t n_kept = 0;
+  for (size_t f = 0; f < _faces.size(); ++f)
+    if (_faces[f].elem[0] >= 0)
+      _faces[n_kept++] = _faces[f];
+  _faces.resize(n_kept);
+}
+
+size_t DGStiffnessOperator::memory() const
+{
+  return (_volume_factors.size() + _face_factors.size()) * sizeof(double) +
+         _face_perm.size() * sizeof(int) + _faces.size() * sizeof(Face);
+}
+
+void DGStiffnessOperator::face_points(int lf, IntegrationRule &points) const
+{
+  const int dir = lf / 2;
+  const double side = lf % 2;
+  const int free0 = (dir == 0 ? 1 : 0);
+  const int free1 = (dir == 2 ? 1 : 2);
+  points.SetSize(_n_fpts);
+  for (int q = 0; q < _n_fpts; ++q)
+  {
+    const int a = q % _nf;
+    const int b = q / _nf;
+    double x[] = { 0., 0., 0. };
+    x[dir] = side;
+    x[free0] = _face_rule->IntPoint(a).x;
+    double weight = _face_rule->IntPoint(a).weight;
+    if (_dim == 3)
+    {
+      x[free1] = _face_rule->IntPoint(b).x;
+      weight *= _face_rule->IntPoint(b).weight;
+    }
+    IntegrationPoint &ip = points.IntPoint(q);
+    ip.Set3(x[0], x[1], x[2]);
+    ip.weight = weight;
+  }
+}
+
+void DGStiffnessOperator::face_matrices(int lf, int deriv, const double *M[3],
+                                        int n[3], int m[3]) const
+{
+  const int dir = lf / 2;
+  const int side = lf % 2;
+  for (int d = 0; d < 3; ++d)
+  {
+    if (d >= _dim)
+    {
+      M[d] = &unit;
+      n[d] = m[d] = 1;
+    }
+    else if (d == dir)
+    {
+      M[d] = (deriv == d ? &_G_end[side*_n] : &_B_end[side*_n]);
+      n[d] = _n;
+      m[d] = 1;
+    }
+    else
+    {
+      M[d] = (deriv == d ? &_Gf[0] : &_Bf[0]);
+      n[d] = _n;
+      m[d] = _nf;
+    }
+  }
+}
+
+void DGStiffnessOperator::contract(const double *const M[3], const int n[3],
+                                   const int m[3], const double *u,
+                                   double *out) const
+{
+  const int nx = n[0], ny = n[1], nz = n[2];
+  const int mx = m[0], my = m[1], mz = m[2];
+  double *t1 = &_t1[0];
+  double *t2 = &_t2[0];
+
+  // t1(qx,j,k) = sum_i Mx(qx,i) u(i,j,k)
+  for (int kj = 0; kj < nz*ny; ++kj)
+  {
+    const double *uk = u + kj*nx;
+    double *o = t1 + kj*mx;
+    for (int qx = 0; qx < mx; ++qx)
+    {
+      double s = 0.;
+      for (int i = 0; i < nx; ++i)
+        s += M[0][qx*nx + i] * uk[i];
+      o[qx] = s;
+    }
+  }
+  // t2(qx,qy,k) = sum_j My(qy,j) t1(qx,j,k)
+  for (int k = 0; k < nz; ++k)
+    for (int qy = 0; qy < my; ++qy)
+    {
+      double *o = t2 + (k*my + qy)*mx;
+      std::fill(o, o + mx, 0.);
+      for (int j = 0; j < ny; ++j)
+      {
+        const double c = M[1][qy*ny + j];
+        const double *t = t1 + (k*ny + j)*mx;
+        for (int qx = 0; qx < mx; ++qx)
+          o[qx] += c * t[qx];
+      }
+    }
+  // out(qx,qy,qz) = sum_k Mz(qz,k) t2(qx,qy,k)
+  for (int qz = 0; qz < mz; ++qz)
+    for (int qy = 0; qy < my; ++qy)
+    {
+      double *o = out + (qz*my + qy)*mx;
+      std::fill(o, o + mx, 0.);
+      for (int k = 0; k < nz; ++k)
+      {
+        const double c = M[2][qz*nz + k];
+        const double *t = t2 + (k*my + qy)*mx;
+        for (int qx = 0; qx < mx; ++qx)
+          o[qx] += c * t[qx];
+      }
+    }
+}
+
+void DGStiffnessOperator::add_contract_t(const double *const M[3],
+                                         const int n[3], const int m[3],
+                                         const double *in, double *u) const
+{
+  const int nx = n[0], ny = n[1], nz = n[2];
+  const int mx = m[0], my = m[1], mz = m[2];
+  double *t1 = &_t1[0];
+  double *t2 = &_t2[0];
+
+  // t2(qx,qy,k) = sum_qz Mz(qz,k) in(qx,qy,qz)
+  for (int k = 0; k < nz; ++k)
+    for (int qy = 0; qy < my; ++qy)
+    {
+      double *o = t2 + (k*my + qy)*mx;
+      std::fill(o, o + mx, 0.);
+      for (int qz = 0; qz < mz; ++qz)
+      {
+        const double c = M[2][qz*nz + k];
+        const double *t = in + (qz*my + qy)*mx;
+        for (int qx = 0; qx < mx; ++qx)
+          o[qx] += c * t[qx];
+      }
+    }
+  // t1(qx,j,k) = sum_qy My(qy,j) t2(qx,qy,k)
+  for (int k = 0; k < nz; ++k)
+    for (int j = 0; j < ny; ++j)
+    {
+      double *o = t1 + (k*ny + j)*mx;
+      std::fill(o, o + mx, 0.);
+      for (int qy = 0; qy < my; ++qy)
+      {
+        const double c = M[1][qy*ny + j];
+        const double *t = t2 + (k*my + qy)*mx;
+        for (int qx = 0; qx < mx; ++qx)
+          o[qx] += c * t[qx];
+      }
+    }
+  // u(i,j,k) += sum_qx Mx(qx,i) t1(qx,j,k)
+  for (int kj = 0; kj < nz*ny; ++kj)
+  {
+    const double *t = t1 + kj*mx;
+    double *uk = u + kj*nx;
+    for (int i = 0; i < nx; ++i)
+    {
+      double s = 0.;
+      for (int qx = 0; qx < mx; ++qx)
+        s += M[0][qx*nx + i] * t[qx];
+      uk[i] += s;
+    }
+  }
+}
+
+void DGStiffnessOperator::face_trace(int lf, const double *u,
+                                     double *trace) const
+{
+  const double *M[3];
+  int n[3], m[3];
+  for (int c = 0; c <= _dim; ++c) // the value, then the reference gradient
+  {
+    face_matrices(lf, c - 1, M, n, m);
+    contract(M, n, m, u, trace + c*_n_fpts);
+  }
+}
+
+void DGStiffnessOperator::add_face_trace_t(int lf, const double *trace,
+                                           double *u) const
+{
+  const double *M[3];
+  int n[3], m[3];
+  for (int c = 0; c <= _dim; ++c)
+  {
+    face_matrices(lf, c - 1, M, n, m);
+    add_contract_t(M, n, m, trace + c*_n_fpts, u);
+  }
+}
+
+void DGStiffnessOperator::Mult(const Vector &x, Vector &y) const
+{
+  MFEM_VERIFY(x.Size() == width, "Wrong size of the vector");
+  y.SetSize(height);
+  y = 0.0;
+  const double *X = x.GetData();
+  double *Y = y.GetData();
+
+  // volume kernel: the reference gradients at the quadrature points, the
+  // geometric factors, and the transposed gradients
+  const int n[] = { _n, _n, (_dim == 3 ? _n : 1) };
+  const int m[] = { _nv, _nv, (_dim == 3 ? _nv : 1) };
+  const int nfac = n_factors();
+  const int n_elements = _volume_factors.size() / (_n_vpts * nfac);
+  for (int el = 0; el < n_elements; ++el)
+  {
+    const double *u = X + el*_n_dofs;
+    for (int d = 0; d < _dim; ++d)
+    {
+      const double *M[] = { (d == 0 ? &_Gv[0] : &_Bv[0]),
+                            (d == 1 ? &_Gv[0] : &_Bv[0]),
+                            (_dim == 3 ? (d == 2 ? &_Gv[0] : &_Bv[0]) :
+                                         &unit) };
+      contract(M, n, m, u, &_grad[d*_n_vpts]);
+    }
+
+    const double *D = &_volume_factors[el * _n_vpts * nfac];
+    for (int p = 0; p < _n_vpts; ++p, D += nfac)
+      for (int a = 0; a < _dim; ++a)
+      {
+        double s = 0.;
+        for (int b = 0; b < _dim; ++b)
+          s += D[sym(a, b, _dim)] * _grad[b*_n_vpts + p];
+        _flux[a*_n_vpts + p] = s;
+      }
+
+    for (int d = 0; d < _dim; ++d)
+    {
+      const double *M[] = { (d == 0 ? &_Gv[0] : &_Bv[0]),
+                            (d == 1 ? &_Gv[0] : &_Bv[0]),
+                            (_dim == 3 ? (d == 2 ? &_Gv[0] : &_Bv[0]) :
+                                         &unit) };
+      add_contract_t(M, n, m, &_flux[d*_n_vpts], Y + el*_n_dofs);
+    }
+  }
+
+  // face kernel: with the jump [u] = u1 - u2 and the average flux {Q du/dn}
+  // it's -{Q du/dn}[v] + sigma*{Q dv/dn}[u] + kappa*{Q/h}[u][v]
+  const int stride = 2*_dim + 1;
+  for (size_t f = 0; f < _faces.size(); ++f)
+  {
+    const Face &face = _faces[f];
+    const bool interior = (face.elem[1] >= 0);
+    const double *t0 = &_trace[0][0];
+    const double *t1 = &_trace[1][0];
+    double *c0 = &_coefs[0][0];
+    double *c1 = &_coefs[1][0];
+
+    face_trace(face.local_face[0], X + face.elem[0]*_n_dofs, &_trace[0][0]);
+    if (interior)
+      face_trace(face.local_face[1], X + face.elem[1]*_n_dofs, &_trace[1][0]);
+
+    for (int q = 0; q < _n_fpts; ++q)
+    {
+      const double *F = &_face_factors[(face.offset + q) * stride];
+      const int r = _face_perm[face.offset + q];
+      double flux = 0.;
+      for (int d = 0; d < _dim; ++d)
+        flux += F[d] * t0[(d+1)*_n_fpts + q];
+      double jump = t0[q];
+      if (interior)
+      {
+        for (int d = 0; d < _dim; ++d)
+          flux += F[_dim + d] * t1[(d+1)*_n_fpts + r];
+        jump -= t1[r];
+      }
+      const double a = -flux + F[2*_dim] * jump;
+      const double b = _sigma * jump;
+      c0[q] = a;
+      for (int d = 0; d < _dim; ++d)
+        c0[(d+1)*_n_fpts + q] = b * F[d];
+      if (interior)
+      {
+        c1[r] = -a;
+        for (int d = 0; d < _dim; ++d)
+          c1[(d+1)*_n_fpts + r] = b * F[_dim + d];
+      }
+    }
+
+    add_face_trace_t(face.local_face[0], c0, Y + face.elem[0]*_n_dofs);
+    if (interior)
+      add_face_trace_t(face.local_face[1], c1, Y + face.elem[1]*_n_dofs);
+  }
+}
+
+double DGStiffnessOperator::relative_difference(const Operator &A) const
+{
+  MFEM_VERIFY(A.Height() == height && A.Width() == width, "The sizes of the "
+              "operators differ");
+  Vector x(width), y(height), z(height);
+  double diff = 0.;
+  for (int v = 1; v <= 3; ++v)
+  {
+    for (int i = 0; i < width; ++i)
+      x(i) = sin(0.7*v*i + 1.);
+    Mult(x, y);
+    A.Mult(x, z);
+    const double norm = y.Norml2();
+    z -= y;
+    diff = max(diff, (norm > 0. ? z.Norml2() / norm : z.Norml2()));
+  }
+  return diff;
+}
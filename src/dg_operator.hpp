@@ -0,0 +1,108 @@
+#ifndef DG_OPERATOR_HPP
+#define DG_OPERATOR_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <vector>
+
+/**
+ * Matrix-free stiffness operator of the interior penalty DG method on meshes
+ * of quadrilaterals or hexahedra. It's the operator assembled by the
+ * DiffusionIntegrator in the elements and the DGDiffusionIntegrator on the
+ * interior and the boundary faces, but no global matrix is built: the
+ * operator is applied as a volume kernel over the elements and a face kernel
+ * over the faces of the mesh. Both kernels use the tensor-product structure of
+ * the basis (sum factorization), and only the geometric factors (with the
+ * coefficient) at the quadrature points are stored.
+ */
+class DGStiffnessOperator : public mfem::Operator
+{
+public:
+  /**
+   * @param volume_rule - the 1D rule of the quadrature in the elements (e.g.
+   * GLL, as the one of the assembled operator), or nullptr for the default
+   * rule of the DiffusionIntegrator.
+   * @param natural_faces - the marker of the boundary faces without the face
+   * terms (the natural boundary condition), or nullptr for the terms on all
+   * boundary faces.
+   */
+  DGStiffnessOperator(mfem::FiniteElementSpace &fespace,
+                      mfem::Coefficient &one_over_rho,
+                      double sigma, double kappa,
+                      const mfem::IntegrationRule *volume_rule = nullptr,
+                      const std::vector<char> *natural_faces = nullptr);
+
+  virtual void Mult(const mfem::Vector &x, mfem::Vector &y) const;
+
+  /// memory (in bytes) taken by the geometric factors
+  size_t memory() const;
+
+  /**
+   * Relative difference ||Ax - Sx|| / ||Sx|| between this operator S and the
+   * given one (e.g. the assembled matrix) on several pseudo-random vectors.
+   */
+  double relative_difference(const mfem::Operator &A) const;
+
+private:
+  struct Face
+  {
+    int elem[2];       ///< the second element is -1 for the boundary faces
+    int local_face[2]; ///< 2*direction + side (0 - the face at 0, 1 - at 1)
+    int offset;        ///< of the quadrature points of the face
+  };
+
+  int _dim;
+  int _n;        ///< number of dofs in one direction
+  int _nv;       ///< number of quadrature points in one direction (volume)
+  int _nf;       ///< number of quadrature points in one direction (faces)
+  int _n_dofs;   ///< number of dofs of an element
+  int _n_vpts;   ///< number of quadrature points of an element
+  int _n_fpts;   ///< number of quadrature points of a face
+  double _sigma;
+
+  const mfem::IntegrationRule *_face_rule; ///< 1D rule of the faces
+
+  /**
+   * Values (B) and derivatives (G) of the 1D basis functions (columns) at the
+   * volume and face quadrature points and at the ends of the segment (rows).
+   */
+  std::vector<double> _Bv, _Gv, _Bf, _Gf, _B_end, _G_end;
+
+  /// the symmetric matrix Q*w*adj(J)*adj(J)^T/det(J) at every volume point
+  std::vector<double> _volume_factors;
+
+  std::vector<Face> _faces;
+
+  /**
+   * At every face point: the vectors Q*w*adj(J)*n/det(J) (the normal
+   * derivatives, halved on the interior faces) of both sides, and the penalty
+   * weight.
+   */
+  std::vector<double> _face_factors;
+
+  /// face points of the second element for the points of the first one
+  std::vector<int> _face_perm;
+
+  mutable std::vector<double> _t1, _t2;
+  mutable std::vector<double> _grad, _flux;
+  mutable std::vector<double> _trace[2]; ///< values and gradients on a face
+  mutable std::vector<double> _coefs[2];
+
+  int n_factors() const { return _dim * (_dim + 1) / 2; }
+
+  void face_points(int local_face, mfem::IntegrationRule &points) const;
+  void face_matrices(int local_face, int deriv, const double *M[3],
+                     int n[3], int m[3]) const;
+  void contract(const double *const M[3], const int n[3], const int m[3],
+                const double *u, double *out) const;
+  void add_contract_t(const double *const M[3], const int n[3],
+                      const int m[3], const double *in, double *u) const;
+  void face_trace(int local_face, const double *u, double *trace) const;
+  void add_face_trace_t(int local_face, const double *trace, double *u) const;
+
+  DGStiffnessOperator(const DGStiffnessOperator&);
+  DGStiffnessOperator& operator=(const DGStiffnessOperator&);
+};
+
+#endif // DG_OPERATOR_HPP
@@ -0,0 +1,763 @@
+#include "distributed_mesh.hpp"
+#include "parameters.hpp"
+#include "partitioning.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#if defined(MFEM_USE_MPI)
+
+using namespace std;
+using namespace mfem;
+
+
+
+//------------------------------------------------------------------------------
+//
+// Auxiliary functions
+//
+//------------------------------------------------------------------------------
+/**
+ * The first cell of every block in one direction (and n as the last value).
+ */
+static vector<int> block_starts(int n, int p)
+{
+  vector<int> starts(p + 1);
+  for (int b = 0; b <= p; ++b)
+    starts[b] = b * (n / p) + min(b, n % p);
+  return starts;
+}
+
+/**
+ * The blocks containing a vertex with the given index (one or two blocks).
+ */
+static void blocks_of_vertex(int i, const vector<int> &starts,
+                             vector<int> &blocks)
+{
+  blocks.clear();
+  for (size_t b = 0; b + 1 < starts.size(); ++b)
+    if (starts[b] <= i && i <= starts[b+1])
+      blocks.push_back(b);
+}
+
+/**
+ * The block containing a cell with the given index.
+ */
+static int block_of_cell(int i, const vector<int> &starts)
+{
+  return upper_bound(starts.begin(), starts.end(), i) - starts.begin() - 1;
+}
+
+
+
+/**
+ * A Cartesian block of cells of one process, and its description in the format
+ * of ParMesh::ParPrint.
+ */
+class CartesianPart
+{
+public:
+  CartesianPart(int myid, int nproc, int dim, const GridParameters &grid);
+
+  void print(ostream &out) const;
+
+private:
+  int _myid;
+  int _dim;
+  int _n[3];          ///< global number of cells
+  double _size[3];    ///< size of the domain
+  int _p[3];          ///< number of blocks of processes
+  vector<int> _starts[3];
+  int _lo[3], _hi[3]; ///< my cells: [_lo, _hi)
+
+  int n_local_vertices(int d) const { return _hi[d] - _lo[d] + 1; }
+
+  long global_vertex(const int v[]) const
+  {
+    long id = v[0];
+    for (int d = 1, stride = 1; d < _dim; ++d)
+    {
+      stride *= _n[d-1] + 1;
+      id += (long)v[d] * stride;
+    }
+    return id;
+  }
+
+  /// local vertex numbers are increasing with global ones
+  int local_vertex(const int v[]) const
+  {
+    int id = v[0] - _lo[0];
+    for (int d = 1, stride = 1; d < _dim; ++d)
+    {
+      stride *= n_local_vertices(d-1);
+      id += (v[d] - _lo[d]) * stride;
+    }
+    return id;
+  }
+
+  int rank_of_block(const int b[]) const
+  {
+    return b[0] + _p[0] * (b[1] + (_dim == 3 ? _p[1] * b[2] : 0));
+  }
+
+  /**
+   * Processes sharing an entity (vertex, edge or face) with the lower corner v,
+   * which spans a cell in the directions with extent[d] == 1.
+   */
+  void sharing_ranks(const int v[], const int extent[],
+                     vector<int> &ranks) const;
+
+  void print_elements(ostream &out) const;
+  void print_boundary(ostream &out) const;
+  void print_vertices(ostream &out) const;
+  void print_shared(ostream &out) const;
+};
+
+CartesianPart::CartesianPart(int myid, int nproc, int dim,
+                             const GridParameters &grid)
+  : _myid(myid)
+  , _dim(dim)
+{
+  _n[0] = grid.nx; _n[1] = grid.ny; _n[2] = (dim == 3 ? grid.nz : 1);
+  _size[0] = grid.sx; _size[1] = grid.sy; _size[2] = grid.sz;
+
+  processors_grid(nproc, dim, _n, _p);
+
+  const int b[] = { _myid % _p[0], (_myid / _p[0]) % _p[1],
+                    _myid / (_p[0] * _p[1]) };
+  for (int d = 0; d < 3; ++d)
+  {
+    _starts[d] = block_starts(_n[d], _p[d]);
+    _lo[d] = _starts[d][b[d]];
+    _hi[d] = _starts[d][b[d]+1];
+  }
+}
+
+void CartesianPart::sharing_ranks(const int v[], const int extent[],
+                                  vector<int> &ranks) const
+{
+  vector<int> blocks[3];
+  for (int d = 0; d < 3; ++d)
+  {
+    if (d >= _dim)
+      blocks[d].assign(1, 0);
+    else if (extent[d])
+      blocks[d].assign(1, block_of_cell(v[d], _starts[d]));
+    else
+      blocks_of_vertex(v[d], _starts[d], blocks[d]);
+  }
+
+  ranks.clear();
+  int b[3];
+  for (size_t k = 0; k < blocks[2].size(); ++k)
+    for (size_t j = 0; j < blocks[1].size(); ++j)
+      for (size_t i = 0; i < blocks[0].size(); ++i)
+      {
+        b[0] = blocks[0][i]; b[1] = blocks[1][j]; b[2] = blocks[2][k];
+        ranks.push_back(rank_of_block(b));
+      }
+  sort(ranks.begin(), ranks.end());
+}
+
+void CartesianPart::print(ostream &out) const
+{
+  out.precision(17);
+  out << "MFEM mesh v1.0\n\ndimension\n" << _dim << "\n";
+  print_elements(out);
+  print_boundary(out);
+  print_vertices(out);
+  out << "\nmfem_serial_mesh_end\n";
+  print_shared(out);
+  out << "\nmfem_mesh_end" << endl;
+}
+
+void CartesianPart::print_elements(ostream &out) const
+{
+  const int n_cells = (_hi[0] - _lo[0]) * (_hi[1] - _lo[1]) *
+                      (_dim == 3 ? _hi[2] - _lo[2] : 1);
+  out << "\nelements\n" << n_cells << "\n";
+
+  const int geom = (_dim == 2 ? Geometry::SQUARE : Geometry::CUBE);
+  const int zlo = (_dim == 3 ? _lo[2] : 0), zhi = (_dim == 3 ? _hi[2] : 1);
+  for (int z = zlo; z < zhi; ++z)
+    for (int y = _lo[1]; y < _hi[1]; ++y)
+      for (int x = _lo[0]; x < _hi[0]; ++x)
+      {
+        const long cell = x + (long)_n[0] * (y + (long)_n[1] * z);
+        out << cell + 1 << " " << geom;
+        // the same order of vertices as in the serial mesh generated by MFEM
+        const int corners[][3] = { { x,   y,   z   }, { x+1, y,   z   },
+                                   { x+1, y+1, z   }, { x,   y+1, z   },
+                                   { x,   y,   z+1 }, { x+1, y,   z+1 },
+                                   { x+1, y+1, z+1 }, { x,   y+1, z+1 } };
+        const int n_corners = (_dim == 2 ? 4 : 8);
+        for (int c = 0; c < n_corners; ++c)
+          out << " " << local_vertex(corners[c]);
+        out << "\n";
+      }
+}
+
+void CartesianPart::print_boundary(ostream &out) const
+{
+  ostringstream bdr;
+  int n_bdr = 0;
+
+  if (_dim == 2)
+  {
+    // attributes: 1 - bottom, 2 - right, 3 - top, 4 - left
+    for (int x = _lo[0]; x < _hi[0]; ++x)
+    {
+      if (_lo[1] == 0)
+      {
+        const int v0[] = { x, 0 }, v1[] = { x+1, 0 };
+        bdr << "1 " << Geometry::SEGMENT << " " << local_vertex(v0) << " "
+            << local_vertex(v1) << "\n";
+        ++n_bdr;
+      }
+      if (_hi[1] == _n[1])
+      {
+        const int v0[] = { x+1, _n[1] }, v1[] = { x, _n[1] };
+        bdr << "3 " << Geometry::SEGMENT << " " << local_vertex(v0) << " "
+            << local_vertex(v1) << "\n";
+        ++n_bdr;
+      }
+    }
+    for (int y = _lo[1]; y < _hi[1]; ++y)
+    {
+      if (_lo[0] == 0)
+      {
+        const int v0[] = { 0, y+1 }, v1[] = { 0, y };
+        bdr << "4 " << Geometry::SEGMENT << " " << local_vertex(v0) << " "
+            << local_vertex(v1) << "\n";
+        ++n_bdr;
+      }
+      if (_hi[0] == _n[0])
+      {
+        const int v0[] = { _n[0], y }, v1[] = { _n[0], y+1 };
+        bdr << "2 " << Geometry::SEGMENT << " " << local_vertex(v0) << " "
+            << local_vertex(v1) << "\n";
+        ++n_bdr;
+      }
+    }
+  }
+  else
+  {
+    // attributes: 1 - bottom (z=0), 2 - front (y=0), 3 - right (x=sx),
+    // 4 - back (y=sy), 5 - left (x=0), 6 - top (z=sz)
+    const int nx = _n[0], ny = _n[1], nz = _n[2];
+    const int g = Geometry::SQUARE;
+    for (int y = _lo[1]; y < _hi[1]; ++y)
+      for (int x = _lo[0]; x < _hi[0]; ++x)
+      {
+        if (_lo[2] == 0)
+        {
+          const int v[][3] = { { x, y, 0 }, { x, y+1, 0 }, { x+1, y+1, 0 },
+                               { x+1, y, 0 } };
+          bdr << "1 " << g;
+          for (int c = 0; c < 4; ++c) bdr << " " << local_vertex(v[c]);
+          bdr << "\n";
+          ++n_bdr;
+        }
+        if (_hi[2] == nz)
+        {
+          const int v[][3] = { { x, y, nz }, { x+1, y, nz }, { x+1, y+1, nz },
+                               { x, y+1, nz } };
+          bdr << "6 " << g;
+          for (int c = 0; c < 4; ++c) bdr << " " << local_vertex(v[c]);
+          bdr << "\n";
+          ++n_bdr;
+        }
+      }
+    for (int z = _lo[2]; z < _hi[2]; ++z)
+      for (int x = _lo[0]; x < _hi[0]; ++x)
+      {
+        if (_lo[1] == 0)
+        {
+          const int v[][3] = { { x, 0, z }, { x+1, 0, z }, { x+1, 0, z+1 },
+                               { x, 0, z+1 } };
+          bdr << "2 " << g;
+          for (int c = 0; c < 4; ++c) bdr << " " << local_vertex(v[c]);
+          bdr << "\n";
+          ++n_bdr;
+        }
+        if (_hi[1] == ny)
+        {
+          const int v[][3] = { { x, ny, z }, { x, ny, z+1 }, { x+1, ny, z+1 },
+                               { x+1, ny, z } };
+          bdr << "4 " << g;
+          for (int c = 0; c < 4; ++c) bdr << " " << local_vertex(v[c]);
+          bdr << "\n";
+          ++n_bdr;
+        }
+      }
+    for (int z = _lo[2]; z < _hi[2]; ++z)
+      for (int y = _lo[1]; y < _hi[1]; ++y)
+      {
+        if (_lo[0] == 0)
+        {
+          const int v[][3] = { { 0, y, z }, { 0, y, z+1 }, { 0, y+1, z+1 },
+                               { 0, y+1, z } };
+          bdr << "5 " << g;
+          for (int c = 0; c < 4; ++c) bdr << " " << local_vertex(v[c]);
+          bdr << "\n";
+          ++n_bdr;
+        }
+        if (_hi[0] == nx)
+        {
+          const int v[][3] = { { nx, y, z }, { nx, y+1, z }, { nx, y+1, z+1 },
+                               { nx, y, z+1 } };
+          bdr << "3 " << g;
+          for (int c = 0; c < 4; ++c) bdr << " " << local_vertex(v[c]);
+          bdr << "\n";
+          ++n_bdr;
+        }
+      }
+  }
+
+  out << "\nboundary\n" << n_bdr << "\n" << bdr.str();
+}
+
+void CartesianPart::print_vertices(ostream &out) const
+{
+  const int nz = (_dim == 3 ? n_local_vertices(2) : 1);
+  out << "\nvertices\n" << n_local_vertices(0) * n_local_vertices(1) * nz
+      << "\n" << _dim << "\n";
+  const int zlo = (_dim == 3 ? _lo[2] : 0), zhi = (_dim == 3 ? _hi[2] : 0);
+  for (int z = zlo; z <= zhi; ++z)
+    for (int y = _lo[1]; y <= _hi[1]; ++y)
+      for (int x = _lo[0]; x <= _hi[0]; ++x)
+      {
+        out << ((double)x / _n[0]) * _size[0] << " "
+            << ((double)y / _n[1]) * _size[1];
+        if (_dim == 3)
+          out << " " << ((double)z / _n[2]) * _size[2];
+        out << "\n";
+      }
+}
+
+/**
+ * Shared entities of one group of processes. Every process lists them in the
+ * order of global vertex numbers, so the order is the same for all processes
+ * of the group.
+ */
+struct SharedEntities
+{
+  vector<pair<long, int> > vertices;                 ///< (global, local)
+  vector<pair<vector<long>, vector<int> > > edges;   ///< (global, local)
+  vector<pair<vector<long>, vector<int> > > faces;
+};
+
+void CartesianPart::print_shared(ostream &out) const
+{
+  map<vector<int>, int> group_ids;
+  vector<vector<int> > groups(1, vector<int>(1, _myid)); // the local group
+  group_ids[groups[0]] = 0;
+  vector<SharedEntities> shared(1);
+
+  const int zlo = (_dim == 3 ? _lo[2] : 0), zhi = (_dim == 3 ? _hi[2] : 0);
+  vector<int> ranks;
+
+  // all entities of the closed block of the process: the lower corner v, and
+  // the directions in which an entity spans a cell
+  const int n_patterns = (_dim == 2 ? 4 : 8);
+  for (int pattern = 0; pattern < n_patterns; ++pattern)
+  {
+    const int extent[] = { pattern & 1, (pattern >> 1) & 1, (pattern >> 2) & 1 };
+    const int edim = extent[0] + extent[1] + extent[2];
+    if (edim == _dim) continue; // cells are not shared
+
+    for (int z = zlo; z <= zhi - extent[2]; ++z)
+      for (int y = _lo[1]; y <= _hi[1] - extent[1]; ++y)
+        for (int x = _lo[0]; x <= _hi[0] - extent[0]; ++x)
+        {
+          const int v[] = { x, y, z };
+          sharing_ranks(v, extent, ranks);
+          if (ranks.size() < 2) continue;
+
+          map<vector<int>, int>::iterator it = group_ids.find(ranks);
+          int gr;
+          if (it == group_ids.end())
+          {
+            gr = groups.size();
+            group_ids[ranks] = gr;
+            groups.push_back(ranks);
+            shared.push_back(SharedEntities());
+          }
+          else
+            gr = it->second;
+
+          if (edim == 0)
+          {
+            shared[gr].vertices.push_back(make_pair(global_vertex(v),
+                                                    local_vertex(v)));
+            continue;
+          }
+
+          // corners of an edge or a face in the cyclic order
+          vector<vector<int> > corners(1, vector<int>(v, v + 3));
+          for (int d = 0; d < 3; ++d)
+          {
+            if (!extent[d]) continue;
+            const int n = corners.size();
+            for (int c = n - 1; c >= 0; --c)
+            {
+              vector<int> w = corners[c];
+              ++w[d];
+              corners.push_back(w);
+            }
+          }
+          vector<long> glob(corners.size());
+          vector<int> loc(corners.size());
+          for (size_t c = 0; c < corners.size(); ++c)
+          {
+            glob[c] = global_vertex(&corners[c][0]);
+            loc[c] = local_vertex(&corners[c][0]);
+          }
+          // the first corner has the smallest global number, and the face
+          // goes towards its neighbor with the smaller global number
+          if (corners.size() == 4 && glob[3] < glob[1])
+          {
+            swap(glob[1], glob[3]);
+            swap(loc[1], loc[3]);
+          }
+          if (edim == 1)
+            shared[gr].edges.push_back(make_pair(glob, loc));
+          else
+            shared[gr].faces.push_back(make_pair(glob, loc));
+        }
+  }
+
+  out << "\ncommunication_groups\nnumber_of_groups " << groups.size()
+      << "\n\n# number of entities in each group, followed by group ids in "
+      << "group\n";
+  for (size_t gr = 0; gr < groups.size(); ++gr)
+  {
+    out << groups[gr].size();
+    for (size_t r = 0; r < groups[gr].size(); ++r)
+      out << " " << groups[gr][r];
+    out << "\n";
+  }
+
+  int n_vertices = 0, n_edges = 0, n_faces = 0;
+  for (size_t gr = 1; gr < shared.size(); ++gr)
+  {
+    sort(shared[gr].vertices.begin(), shared[gr].vertices.end());
+    sort(shared[gr].edges.begin(), shared[gr].edges.end());
+    sort(shared[gr].faces.begin(), shared[gr].faces.end());
+    n_vertices += shared[gr].vertices.size();
+    n_edges += shared[gr].edges.size();
+    n_faces += shared[gr].faces.size();
+  }
+
+  out << "\ntotal_shared_vertices " << n_vertices << "\n";
+  out << "total_shared_edges " << n_edges << "\n";
+  if (_dim == 3)
+    out << "total_shared_faces " << n_faces << "\n";
+
+  for (size_t gr = 1; gr < shared.size(); ++gr)
+  {
+    const SharedEntities &s = shared[gr];
+    out << "\n#group " << gr << "\nshared_vertices " << s.vertices.size()
+        << "\n";
+    for (size_t i = 0; i < s.vertices.size(); ++i)
+      out << s.vertices[i].second << "\n";
+    out << "\nshared_edges " << s.edges.size() << "\n";
+    for (size_t i = 0; i < s.edges.size(); ++i)
+      out << s.edges[i].second[0] << " " << s.edges[i].second[1] << "\n";
+    if (_dim == 3)
+    {
+      out << "\nshared_faces " << s.faces.size() << "\n";
+      for (size_t i = 0; i < s.faces.size(); ++i)
+      {
+        out << Geometry::SQUARE;
+        for (int c = 0; c < 4; ++c)
+          out << " " << s.faces[i].second[c];
+        out << "\n";
+      }
+    }
+  }
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Parallel meshes
+//
+//------------------------------------------------------------------------------
+ParMesh* create_cartesian_par_mesh(MPI_Comm comm, int dim,
+                                   const GridParameters &grid)
+{
+  int myid, nproc;
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nproc);
+
+  stringstream part;
+  CartesianPart(myid, nproc, dim, grid).print(part);
+  return new ParMesh(comm, part);
+}
+
+/**
+ * The mean of the coordinates of the vertices.
+ */
+static void center(const Mesh &mesh, const Array<int> &vertices,
+                   vector<double> &key)
+{
+  const int dim = mesh.SpaceDimension();
+  for (int d = 0; d < dim; ++d)
+  {
+    double c = 0.;
+    for (int v = 0; v < vertices.Size(); ++v)
+      c += mesh.GetVertex(vertices[v])[d];
+    key.push_back(c / vertices.Size());
+  }
+}
+
+/**
+ * The entities of a parallel mesh which don't depend on its local numbering:
+ * the boundary elements (attribute and center), and the shared vertices,
+ * edges and faces (dimension, ranks of the group and center), sorted.
+ */
+static void sorted_entities(ParMesh &mesh, vector<vector<double> > &entities)
+{
+  entities.clear();
+  Array<int> vertices;
+  for (int be = 0; be < mesh.GetNBE(); ++be)
+  {
+    vector<double> key(1, -1. - mesh.GetBdrAttribute(be));
+    mesh.GetBdrElementVertices(be, vertices);
+    center(mesh, vertices, key);
+    entities.push_back(key);
+  }
+
+  for (int gr = 1; gr < mesh.GetNGroups(); ++gr)
+  {
+    vector<double> ranks;
+    for (int k = 0; k < mesh.gtopo.GetGroupSize(gr); ++k)
+      ranks.push_back(mesh.gtopo.GetNeighborRank(mesh.gtopo.GetGroup(gr)[k]));
+    sort(ranks.begin(), ranks.end());
+    ranks.insert(ranks.begin(), ranks.size());
+
+    for (int i = 0; i < mesh.GroupNVertices(gr); ++i)
+    {
+      vector<double> key(1, 0.);
+      key.insert(key.end(), ranks.begin(), ranks.end());
+      vertices.SetSize(1);
+      vertices[0] = mesh.GroupVertex(gr, i);
+      center(mesh, vertices, key);
+      entities.push_back(key);
+    }
+    for (int i = 0; i < mesh.GroupNEdges(gr); ++i)
+    {
+      int edge, orientation;
+      mesh.GroupEdge(gr, i, edge, orientation);
+      vector<double> key(1, 1.);
+      key.insert(key.end(), ranks.begin(), ranks.end());
+      mesh.GetEdgeVertices(edge, vertices);
+      center(mesh, vertices, key);
+      entities.push_back(key);
+    }
+    for (int i = 0; i < mesh.GroupNFaces(gr); ++i)
+    {
+      int face, orientation;
+      mesh.GroupFace(gr, i, face, orientation);
+      vector<double> key(1, 2.);
+      key.insert(key.end(), ranks.begin(), ranks.end());
+      mesh.GetFaceVertices(face, vertices);
+      center(mesh, vertices, key);
+      entities.push_back(key);
+    }
+  }
+  sort(entities.begin(), entities.end());
+}
+
+/**
+ * The first difference between the parallel meshes (with the same elements in
+ * the same order), or an empty string.
+ */
+static string compare_par_meshes(ParMesh &mesh, ParMesh &reference,
+                                 double tol)
+{
+  if (mesh.GetNE() != reference.GetNE() || mesh.GetNV() != reference.GetNV() ||
+      mesh.GetNBE() != reference.GetNBE() ||
+      mesh.GetNEdges() != reference.GetNEdges() ||
+      mesh.GetNFaces() != reference.GetNFaces() ||
+      mesh.GetNSharedFaces() != reference.GetNSharedFaces())
+    return "different numbers of elements, vertices, boundary elements, "
+           "edges, faces or shared faces";
+
+  Array<int> vertices, ref_vertices;
+  for (int el = 0; el < mesh.GetNE(); ++el)
+  {
+    if (mesh.GetAttribute(el) != reference.GetAttribute(el))
+      return "different attributes of the element " + d2s(el);
+    mesh.GetElementVertices(el, vertices);
+    reference.GetElementVertices(el, ref_vertices);
+    if (vertices.Size() != ref_vertices.Size())
+      return "different vertices of the element " + d2s(el);
+    for (int v = 0; v < vertices.Size(); ++v)
+      for (int d = 0; d < mesh.SpaceDimension(); ++d)
+        if (fabs(mesh.GetVertex(vertices[v])[d] -
+                 reference.GetVertex(ref_vertices[v])[d]) > tol)
+          return "different vertices of the element " + d2s(el);
+  }
+
+  vector<vector<double> > entities, ref_entities;
+  sorted_entities(mesh, entities);
+  sorted_entities(reference, ref_entities);
+  if (entities.size() != ref_entities.size())
+    return "different numbers of boundary elements and shared entities";
+  for (size_t i = 0; i < entities.size(); ++i)
+  {
+    bool same = (entities[i].size() == ref_entities[i].size());
+    for (size_t k = 0; same && k < entities[i].size(); ++k)
+      same = (fabs(entities[i][k] - ref_entities[i][k]) <= tol);
+    if (!same)
+      return "different boundary elements or shared entities";
+  }
+  return "";
+}
+
+void check_cartesian_par_mesh(ParMesh &par_mesh, int dim,
+                              const GridParameters &grid, ostream &out)
+{
+  MPI_Comm comm = par_mesh.GetComm();
+  int myid, nproc;
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nproc);
+
+  // the reference: the serial mesh split into the same blocks by ParMesh
+  const int generate_edges = 1;
+  Mesh *mesh = (dim == 2 ?
+                new Mesh(grid.nx, grid.ny, Element::QUADRILATERAL,
+                         generate_edges, grid.sx, grid.sy) :
+                new Mesh(grid.nx, grid.ny, grid.nz, Element::HEXAHEDRON,
+                         generate_edges, grid.sx, grid.sy, grid.sz));
+  for (int el = 0; el < mesh->GetNE(); ++el)
+    mesh->GetElement(el)->SetAttribute(el+1);
+
+  const int n[] = { grid.nx, grid.ny, (dim == 3 ? grid.nz : 1) };
+  int p[3];
+  processors_grid(nproc, dim, n, p);
+  vector<int> starts[3];
+  for (int d = 0; d < 3; ++d)
+    starts[d] = block_starts(n[d], p[d]);
+  Array<int> partitioning(mesh->GetNE());
+  for (int el = 0; el < mesh->GetNE(); ++el)
+  {
+    const int cell[] = { el % n[0], (el / n[0]) % n[1], el / (n[0] * n[1]) };
+    int b[3];
+    for (int d = 0; d < 3; ++d)
+      b[d] = block_of_cell(cell[d], starts[d]);
+    partitioning[el] = b[0] + p[0] * (b[1] + p[1] * b[2]);
+  }
+  ParMesh reference(comm, *mesh, partitioning.GetData());
+  delete mesh;
+
+  const double tol = 1e-12 * max(grid.sx, max(grid.sy, grid.sz));
+  string error = compare_par_meshes(par_mesh, reference, tol);
+
+  if (error.empty())
+  {
+    // the same numbers of global true dofs mean the consistent sharing
+    H1_FECollection fec(2, dim);
+    ParFiniteElementSpace fespace(&par_mesh, &fec);
+    ParFiniteElementSpace ref_fespace(&reference, &fec);
+    if (fespace.GlobalTrueVSize() != ref_fespace.GlobalTrueVSize())
+      error = "different numbers of true dofs of the quadratic space";
+  }
+
+  if (error.empty())
+  {
+    // the round trip through ParPrint and the reading as in read_par_mesh
+    ostringstream printed;
+    printed.precision(17);
+    par_mesh.ParPrint(printed);
+    istringstream in(printed.str());
+    ParMesh read_mesh(comm, in);
+    ostringstream printed_again;
+    printed_again.precision(17);
+    read_mesh.ParPrint(printed_again);
+    if (printed.str() != printed_again.str())
+      error = "the mesh printed by ParPrint and read back is printed "
+              "differently";
+    else
+      error = compare_par_meshes(read_mesh, reference, tol);
+  }
+
+  int ok = error.empty(), all_ok;
+  MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+  if (!ok)
+    cerr << "Process " << myid << ": the distributed mesh differs from the "
+         << "reference one: " << error << endl;
+  MFEM_VERIFY(all_ok, "The check of the distributed mesh failed");
+  if (myid == 0)
+    out << "  The distributed mesh is the same as the one made from the "
+        << "serial mesh" << endl;
+}
+
+string par_mesh_filename(const string &prefix, int rank)
+{
+  return prefix + "." + d2s(rank, false, 0, false, 6);
+}
+
+/**
+ * The largest rank in the communication groups of a part of a mesh in the
+ * format of ParMesh::ParPrint (-1 if there are no groups).
+ */
+static int max_group_rank(const string &part)
+{
+  const size_t pos = part.find("communication_groups");
+  if (pos == string::npos)
+    return -1;
+  istringstream in(part.substr(pos));
+  string word;
+  int n_groups = 0;
+  in >> word >> word >> n_groups; // communication_groups number_of_groups N
+  int max_rank = -1;
+  string line;
+  for (int gr = 0; gr < n_groups && getline(in, line); )
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    istringstream group(line);
+    int size, rank;
+    group >> size;
+    for (int k = 0; k < size && group >> rank; ++k)
+      max_rank = max(max_rank, rank);
+    ++gr;
+  }
+  return max_rank;
+}
+
+ParMesh* read_par_mesh(MPI_Comm comm, const string &prefix)
+{
+  int myid, nproc;
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nproc);
+
+  const string filename = par_mesh_filename(prefix, myid);
+  ifstream in(filename.c_str());
+  MFEM_VERIFY(in, "File '" + filename + "' can't be opened. The number of "
+              "processes must be the same as the number of parts of the mesh");
+  ostringstream part;
+  part << in.rdbuf();
+
+  // a part made for more processes refers to the ranks beyond ours, which
+  // ParMesh would try to communicate with, so it's checked before
+  int max_rank = max_group_rank(part.str());
+  MPI_Allreduce(MPI_IN_PLACE, &max_rank, 1, MPI_INT, MPI_MAX, comm);
+  MFEM_VERIFY(max_rank < nproc, "The parts '" + prefix + ".*' are made for "
+              "more processes (at least " + d2s(max_rank + 1) + ") than " +
+              d2s(nproc));
+
+  istringstream part_in(part.str());
+  return new ParMesh(comm, part_in);
+}
+
+#endif // MFEM_USE_MPI
@@ -0,0 +1,53 @@
+#ifndef DISTRIBUTED_MESH_HPP
+#define DISTRIBUTED_MESH_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <iostream>
+#include <string>
+
+#if defined(MFEM_USE_MPI)
+
+class GridParameters;
+
+/**
+ * Create a parallel Cartesian mesh (quadrilaterals in 2D, hexahedra in 3D)
+ * without a serial mesh: the processes are arranged in a Cartesian grid, and
+ * every process builds only its own block of cells, described in the format of
+ * ParMesh::ParPrint (including the shared vertices, edges and faces). The
+ * elements, their vertices and the boundary attributes are the same as in the
+ * serial mesh generated by MFEM, and the attribute of every element is its
+ * global cell number (+1).
+ */
+mfem::ParMesh* create_cartesian_par_mesh(MPI_Comm comm, int dim,
+                                         const GridParameters &grid);
+
+/**
+ * Check the distributed Cartesian mesh (collective): it's compared with the
+ * parallel mesh made by MFEM from the serial mesh split into the same blocks
+ * of cells (the elements with their vertices and attributes, the boundary,
+ * the shared vertices, edges and faces of every group, and the number of true
+ * dofs of a quadratic space), and it's printed by ParMesh::ParPrint, read back
+ * as by read_par_mesh and printed again to the same text. It builds the serial
+ * mesh, so it's for small grids only. The run is aborted if the meshes differ.
+ */
+void check_cartesian_par_mesh(mfem::ParMesh &par_mesh, int dim,
+                              const GridParameters &grid, std::ostream &out);
+
+/**
+ * Read a parallel mesh from pre-partitioned files (one file per process, made
+ * by the partitioning tool from a serial mesh). The number of processes must
+ * be the same as the number of parts, which is checked by the ranks of the
+ * communication groups of the parts.
+ */
+mfem::ParMesh* read_par_mesh(MPI_Comm comm, const std::string &prefix);
+
+/**
+ * The name of the file with the part of a mesh for the given process.
+ */
+std::string par_mesh_filename(const std::string &prefix, int rank);
+
+#endif // MFEM_USE_MPI
+
+#endif // DISTRIBUTED_MESH_HPP
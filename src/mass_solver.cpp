@@ -0,0 +1,914 @@
+#include "mass_solver.hpp"
+#include "parameters.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+using namespace std;
+using namespace mfem;
+
+extern "C" void dpotrf_(char *UPLO, int *N, double *A, int *LDA, int *INFO);
+extern "C" void dpotrs_(char *UPLO, int *N, int *NRHS, double *A, int *LDA,
+                        double *B, int *LDB, int *INFO);
+
+
+
+PCGMassSolver::PCGMassSolver(const SparseMatrix &A)
+  : Solver(A.Height(), true) // the previous solution is the initial guess
+  , _A(&A)
+  , _prec(A)
+{ }
+
+void PCGMassSolver::SetOperator(const Operator &op)
+{
+  _A = dynamic_cast<const SparseMatrix*>(&op);
+  MFEM_VERIFY(_A, "The operator must be a sparse matrix");
+  _prec.SetOperator(*_A);
+}
+
+void PCGMassSolver::Mult(const Vector &b, Vector &x) const
+{
+  PCG(*_A, _prec, b, x, 0, 200, 1e-12, 0.0);
+}
+
+
+
+/**
+ * Reverse Cuthill-McKee ordering of the graph of the matrix: breadth-first
+ * search from a vertex of the minimal degree in every connected component,
+ * visiting the neighbors in the order of increasing degree.
+ */
+static void rcm_ordering(const SparseMatrix &A, vector<int> &perm)
+{
+  const int n = A.Height();
+  const int *I = A.GetI(), *J = A.GetJ();
+
+  vector<int> degree(n);
+  for (int i = 0; i < n; ++i)
+    degree[i] = I[i+1] - I[i];
+
+  vector<int> by_degree(n);
+  for (int i = 0; i < n; ++i)
+    by_degree[i] = i;
+  stable_sort(by_degree.begin(), by_degree.end(),
+              [&degree](int a, int b) { return degree[a] < degree[b]; });
+
+  perm.clear();
+  perm.reserve(n);
+  vector<bool> visited(n, false);
+  vector<int> neighbors;
+  for (int s = 0; s < n; ++s)
+  {
+    const int start = by_degree[s];
+    if (visited[start])
+      continue;
+    visited[start] = true;
+    size_t head = perm.size();
+    perm.push_back(start);
+    while (head < perm.size())
+    {
+      const int v = perm[head++];
+      neighbors.clear();
+      for (int k = I[v]; k < I[v+1]; ++k)
+        if (!visited[J[k]])
+        {
+          visited[J[k]] = true;
+          neighbors.push_back(J[k]);
+        }
+      stable_sort(neighbors.begin(), neighbors.end(),
+                  [&degree](int a, int b) { return degree[a] < degree[b]; });
+      perm.insert(perm.end(), neighbors.begin(), neighbors.end());
+    }
+  }
+  reverse(perm.begin(), perm.end());
+}
+
+SkylineCholeskySolver::SkylineCholeskySolver(const SparseMatrix &A)
+  : Solver(A.Height(), false)
+  , _perm()
+  , _iperm()
+  , _first()
+  , _start()
+  , _L()
+  , _work()
+{
+  MFEM_VERIFY(A.Finalized(), "The matrix must be finalized");
+  const int n = A.Height();
+  const int *I = A.GetI(), *J = A.GetJ();
+
+  rcm_ordering(A, _perm);
+  _iperm.resize(n);
+  for (int i = 0; i < n; ++i)
+    _iperm[_perm[i]] = i;
+
+  _first.resize(n);
+  _start.resize(n + 1);
+  _start[0] = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    const int row = _perm[i];
+    int first = i;
+    for (int k = I[row]; k < I[row+1]; ++k)
+      first = min(first, _iperm[J[k]]);
+    _first[i] = first;
+    _start[i+1] = _start[i] + (i - first + 1);
+  }
+}
+
+void SkylineCholeskySolver::SetOperator(const Operator &op)
+{
+  const SparseMatrix *A = dynamic_cast<const SparseMatrix*>(&op);
+  MFEM_VERIFY(A && A->Height() == (int)_perm.size(), "The operator must be "
+              "the sparse matrix given to the constructor");
+  const int n = A->Height();
+  const int *I = A->GetI(), *J = A->GetJ();
+  const double *data = A->GetData();
+
+  // the lower triangle of the permuted matrix in the envelope
+  _L.assign(_start[n], 0.);
+  for (int i = 0; i < n; ++i)
+  {
+    const int row = _perm[i];
+    for (int k = I[row]; k < I[row+1]; ++k)
+    {
+      const int j = _iperm[J[k]];
+      MFEM_VERIFY(j >= _first[i], "The sparsity pattern has been changed");
+      if (j <= i)
+        _L[_start[i] + j - _first[i]] = data[k];
+    }
+  }
+
+  // row-by-row factorization: only the envelope is filled
+  for (int i = 0; i < n; ++i)
+  {
+    double *Li = &_L[_start[i]] - _first[i]; // Li[k] = L(i,k)
+    for (int j = _first[i]; j < i; ++j)
+    {
+      const double *Lj = &_L[_start[j]] - _first[j];
+      double s = Li[j];
+      for (int k = max(_first[i], _first[j]); k < j; ++k)
+        s -= Li[k] * Lj[k];
+      Li[j] = s / Lj[j];
+    }
+    double d = Li[i];
+    for (int k = _first[i]; k < i; ++k)
+      d -= Li[k] * Li[k];
+    MFEM_VERIFY(d > 0., "The matrix is not positive definite (row " + d2s(i) +
+                ")");
+    Li[i] = sqrt(d);
+  }
+  _work.resize(n);
+}
+
+void SkylineCholeskySolver::Mult(const Vector &b, Vector &x) const
+{
+  MFEM_VERIFY(!_L.empty(), "The matrix is not factorized");
+  const int n = _perm.size();
+  double *y = &_work[0];
+  for (int i = 0; i < n; ++i)
+    y[i] = b[_perm[i]];
+
+  // L y = P b
+  for (int i = 0; i < n; ++i)
+  {
+    const double *Li = &_L[_start[i]] - _first[i];
+    double s = y[i];
+    for (int k = _first[i]; k < i; ++k)
+      s -= Li[k] * y[k];
+    y[i] = s / Li[i];
+  }
+
+  // L^T z = y (column-oriented, since L is stored by rows)
+  for (int i = n - 1; i >= 0; --i)
+  {
+    const double *Li = &_L[_start[i]] - _first[i];
+    y[i] /= Li[i];
+    for (int k = _first[i]; k < i; ++k)
+      y[k] -= Li[k] * y[i];
+  }
+
+  x.SetSize(n);
+  for (int i = 0; i < n; ++i)
+    x[_perm[i]] = y[i];
+}
+
+void SkylineCholeskySolver::Mult(const DenseMatrix &B, DenseMatrix &X,
+                                 int n_threads) const
+{
+  MFEM_VERIFY(!_L.empty(), "The matrix is not factorized");
+  const int m = B.Width();
+  X.SetSize(_perm.size(), m);
+  if (n_threads == 0)
+    n_threads = max(1u, thread::hardware_concurrency());
+  n_threads = max(1, min(n_threads, m));
+
+  // contiguous ranges of columns, the first one is solved by this thread
+  vector<thread> threads;
+  for (int t = 1; t < n_threads; ++t)
+    threads.push_back(thread(&SkylineCholeskySolver::solve_columns, this,
+                             cref(B), ref(X), (int)((long)m*t/n_threads),
+                             (int)((long)m*(t+1)/n_threads)));
+  solve_columns(B, X, 0, m / n_threads);
+  for (size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+}
+
+void SkylineCholeskySolver::solve_columns(const DenseMatrix &B, DenseMatrix &X,
+                                          int first, int last) const
+{
+  const int n = _perm.size();
+  const int nb = 8; // columns substituted together
+  vector<double> Y((size_t)n*nb); // interleaved columns
+  double s[nb];
+
+  for (int c0 = first; c0 < last; c0 += nb)
+  {
+    const int nc = min(nb, last - c0);
+    for (int i = 0; i < n; ++i)
+      for (int c = 0; c < nc; ++c)
+        Y[(size_t)i*nb + c] = B(_perm[i], c0 + c);
+
+    // L Y = P B
+    for (int i = 0; i < n; ++i)
+    {
+      const double *Li = &_L[_start[i]] - _first[i];
+      double *yi = &Y[(size_t)i*nb];
+      for (int c = 0; c < nc; ++c)
+        s[c] = yi[c];
+      for (int k = _first[i]; k < i; ++k)
+      {
+        const double *yk = &Y[(size_t)k*nb];
+        for (int c = 0; c < nc; ++c)
+          s[c] -= Li[k] * yk[c];
+      }
+      for (int c = 0; c < nc; ++c)
+        yi[c] = s[c] / Li[i];
+    }
+
+    // L^T Z = Y
+    for (int i = n - 1; i >= 0; --i)
+    {
+      const double *Li = &_L[_start[i]] - _first[i];
+      double *yi = &Y[(size_t)i*nb];
+      for (int c = 0; c < nc; ++c)
+        yi[c] /= Li[i];
+      for (int k = _first[i]; k < i; ++k)
+      {
+        double *yk = &Y[(size_t)k*nb];
+        for (int c = 0; c < nc; ++c)
+          yk[c] -= Li[k] * yi[c];
+      }
+    }
+
+    for (int i = 0; i < n; ++i)
+      for (int c = 0; c < nc; ++c)
+        X(_perm[i], c0 + c) = Y[(size_t)i*nb + c];
+  }
+}
+
+
+
+/**
+ * Positions of the dofs of the space: the images of the nodes of the
+ * reference elements, or the centers of the elements for the elements without
+ * nodes.
+ */
+static void dof_positions(const FiniteElementSpace &fespace, int dim,
+                          vector<double> &x)
+{
+  x.assign((size_t)fespace.GetVSize() * dim, 0.);
+  Array<int> vdofs;
+  Vector pos(dim);
+  for (int el = 0; el < fespace.GetNE(); ++el)
+  {
+    const FiniteElement &fe = *fespace.GetFE(el);
+    const IntegrationRule &nodes = fe.GetNodes();
+    const bool nodal = nodes.GetNPoints() == fe.GetDof();
+    ElementTransformation *T = fespace.GetElementTransformation(el);
+    fespace.GetElementVDofs(el, vdofs);
+    for (int k = 0; k < vdofs.Size(); ++k)
+    {
+      const IntegrationPoint &ip = nodal ? nodes.IntPoint(k % fe.GetDof()) :
+                                   Geometries.GetCenter(fe.GetGeomType());
+      T->SetIntPoint(&ip);
+      T->Transform(ip, pos);
+      const int dof = vdofs[k] >= 0 ? vdofs[k] : -1 - vdofs[k];
+      for (int d = 0; d < dim; ++d)
+        x[(size_t)dof*dim + d] = pos[d];
+    }
+  }
+}
+
+/**
+ * Order of the dofs along one coordinate (ties by the numbers, so that the
+ * median split is well defined for coinciding dofs).
+ */
+class CoordinateLess
+{
+public:
+  CoordinateLess(const double *x, int dim, int axis)
+    : _x(x), _dim(dim), _axis(axis)
+  { }
+  bool operator()(int a, int b) const
+  {
+    const double xa = _x[(size_t)a*_dim + _axis];
+    const double xb = _x[(size_t)b*_dim + _axis];
+    return xa < xb || (xa == xb && a < b);
+  }
+private:
+  const double *_x;
+  int _dim, _axis;
+};
+
+/**
+ * Nested dissection of the subgraph of the vertices (all having owner == id):
+ * the vertices are split by the median of the coordinate with the largest
+ * extent, the vertices of the second half coupled with the first one form
+ * the separator, and the halves are numbered (recursively) before it.
+ */
+static void dissect(const SparseMatrix &A, const vector<double> &x, int dim,
+                    vector<int> &vertices, int id, int &next_id,
+                    vector<int> &owner, vector<int> &perm)
+{
+  const int leaf_size = 64;
+  if ((int)vertices.size() <= leaf_size)
+  {
+    perm.insert(perm.end(), vertices.begin(), vertices.end());
+    return;
+  }
+
+  int axis = 0;
+  double max_extent = -1.;
+  for (int d = 0; d < dim; ++d)
+  {
+    double lo = x[(size_t)vertices[0]*dim + d], hi = lo;
+    for (size_t i = 1; i < vertices.size(); ++i)
+    {
+      lo = min(lo, x[(size_t)vertices[i]*dim + d]);
+      hi = max(hi, x[(size_t)vertices[i]*dim + d]);
+    }
+    if (hi - lo > max_extent)
+    {
+      max_extent = hi - lo;
+      axis = d;
+    }
+  }
+  const int mid = vertices.size() / 2;
+  nth_element(vertices.begin(), vertices.begin() + mid, vertices.end(),
+              CoordinateLess(&x[0], dim, axis));
+
+  const int id_1 = next_id++, id_2 = next_id++;
+  for (size_t i = 0; i < vertices.size(); ++i)
+    owner[vertices[i]] = ((int)i < mid ? id_1 : id_2);
+
+  const int *I = A.GetI(), *J = A.GetJ();
+  vector<int> part_1(vertices.begin(), vertices.begin() + mid), part_2;
+  vector<int> separator;
+  for (size_t i = mid; i < vertices.size(); ++i)
+  {
+    const int v = vertices[i];
+    bool coupled = false;
+    for (int k = I[v]; k < I[v+1] && !coupled; ++k)
+      coupled = (owner[J[k]] == id_1);
+    if (coupled)
+      separator.push_back(v);
+    else
+      part_2.push_back(v);
+  }
+  for (size_t i = 0; i < separator.size(); ++i)
+    owner[separator[i]] = id;
+  vector<int>().swap(vertices); // not needed in the recursion
+
+  dissect(A, x, dim, part_1, id_1, next_id, owner, perm);
+  dissect(A, x, dim, part_2, id_2, next_id, owner, perm);
+  perm.insert(perm.end(), separator.begin(), separator.end());
+}
+
+SparseCholeskySolver::SparseCholeskySolver(const SparseMatrix &A,
+                                           const FiniteElementSpace &fespace)
+  : Solver(A.Height(), false)
+  , _perm()
+  , _iperm()
+  , _A_start()
+  , _A_col()
+  , _A_pos()
+  , _parent()
+  , _col_start()
+  , _L_row()
+  , _L()
+  , _work()
+{
+  MFEM_VERIFY(A.Finalized(), "The matrix must be finalized");
+  MFEM_VERIFY(A.Height() == fespace.GetVSize(), "The matrix must be defined "
+              "on the finite element space");
+  const int n = A.Height();
+  const int *I = A.GetI(), *J = A.GetJ();
+
+  const int dim = fespace.GetMesh()->SpaceDimension();
+  vector<double> x;
+  dof_positions(fespace, dim, x);
+  vector<int> vertices(n), owner(n, 0);
+  for (int i = 0; i < n; ++i)
+    vertices[i] = i;
+  int next_id = 1;
+  _perm.reserve(n);
+  dissect(A, x, dim, vertices, 0, next_id, owner, _perm);
+  _iperm.resize(n);
+  for (int i = 0; i < n; ++i)
+    _iperm[_perm[i]] = i;
+
+  // the lower triangle of the permuted matrix by rows
+  _A_start.assign(n + 1, 0);
+  for (int row = 0; row < n; ++row)
+    for (int k = I[row]; k < I[row+1]; ++k)
+      if (_iperm[J[k]] <= _iperm[row])
+        ++_A_start[_iperm[row] + 1];
+  for (int i = 0; i < n; ++i)
+    _A_start[i+1] += _A_start[i];
+  _A_col.resize(_A_start[n]);
+  _A_pos.assign(I[n], -1);
+  vector<int> next(_A_start.begin(), _A_start.end() - 1);
+  for (int row = 0; row < n; ++row)
+    for (int k = I[row]; k < I[row+1]; ++k)
+    {
+      const int i = _iperm[row], j = _iperm[J[k]];
+      if (j <= i)
+      {
+        _A_pos[k] = next[i];
+        _A_col[next[i]++] = j;
+      }
+    }
+
+  // elimination tree (with the path compression by the ancestors)
+  _parent.assign(n, -1);
+  vector<int> ancestor(n, -1);
+  for (int k = 0; k < n; ++k)
+    for (int p = _A_start[k]; p < _A_start[k+1]; ++p)
+      for (int i = _A_col[p]; i != -1 && i < k; )
+      {
+        const int up = ancestor[i];
+        ancestor[i] = k;
+        if (up == -1)
+          _parent[i] = k;
+        i = up;
+      }
+
+  // sizes of the columns of the factor from the patterns of its rows
+  vector<int> count(n, 1), mark(n, -1), pattern(n);
+  for (int k = 0; k < n; ++k)
+  {
+    const int top = row_pattern(k, mark, &pattern[0]);
+    for (int p = top; p < n; ++p)
+      ++count[pattern[p]];
+  }
+  _col_start.resize(n + 1);
+  _col_start[0] = 0;
+  for (int i = 0; i < n; ++i)
+    _col_start[i+1] = _col_start[i] + count[i];
+  _work.resize(n);
+}
+
+/**
+ * The columns of the nonzero entries of the row k of the factor (except the
+ * diagonal) in pattern[top, n), where top is returned: the paths from the
+ * columns of the row of the matrix to k in the elimination tree.
+ */
+int SparseCholeskySolver::row_pattern(int k, vector<int> &mark,
+                                      int *pattern) const
+{
+  const int n = _parent.size();
+  int top = n;
+  mark[k] = k;
+  for (int p = _A_start[k]; p < _A_start[k+1]; ++p)
+  {
+    int len = 0;
+    for (int i = _A_col[p]; mark[i] != k; i = _parent[i])
+    {
+      pattern[len++] = i;
+      mark[i] = k;
+    }
+    while (len > 0)
+      pattern[--top] = pattern[--len];
+  }
+  return top;
+}
+
+void SparseCholeskySolver::SetOperator(const Operator &op)
+{
+  const SparseMatrix *A = dynamic_cast<const SparseMatrix*>(&op);
+  MFEM_VERIFY(A && A->Height() == (int)_perm.size() &&
+              A->NumNonZeroElems() == (int)_A_pos.size(), "The operator must "
+              "be the sparse matrix given to the constructor");
+  const int n = A->Height();
+  const double *data = A->GetData();
+
+  vector<double> A_values(_A_col.size(), 0.);
+  for (size_t k = 0; k < _A_pos.size(); ++k)
+    if (_A_pos[k] >= 0)
+      A_values[_A_pos[k]] = data[k];
+
+  // up-looking factorization: the row k of the factor is the solution of the
+  // lower triangular system with the first k rows, and it's appended to the
+  // columns of the factor
+  _L_row.resize(_col_start[n]);
+  _L.resize(_col_start[n]);
+  vector<uint64_t> next(_col_start.begin(), _col_start.end() - 1);
+  vector<int> mark(n, -1), pattern(n);
+  double *y = &_work[0];
+  fill(_work.begin(), _work.end(), 0.);
+  for (int k = 0; k < n; ++k)
+  {
+    const int top = row_pattern(k, mark, &pattern[0]);
+    double d = 0.;
+    for (int p = _A_start[k]; p < _A_start[k+1]; ++p)
+    {
+      if (_A_col[p] == k)
+        d = A_values[p];
+      else
+        y[_A_col[p]] = A_values[p];
+    }
+    for (int p = top; p < n; ++p)
+    {
+      const int i = pattern[p];
+      const double l_ki = y[i] / _L[_col_start[i]];
+      y[i] = 0.;
+      for (uint64_t q = _col_start[i] + 1; q < next[i]; ++q)
+        y[_L_row[q]] -= _L[q] * l_ki;
+      d -= l_ki * l_ki;
+      _L_row[next[i]] = k;
+      _L[next[i]++] = l_ki;
+    }
+    MFEM_VERIFY(d > 0., "The matrix is not positive definite (row " + d2s(k) +
+                ")");
+    _L_row[next[k]] = k;
+    _L[next[k]++] = sqrt(d);
+  }
+}
+
+void SparseCholeskySolver::Mult(const Vector &b, Vector &x) const
+{
+  MFEM_VERIFY(!_L.empty(), "The matrix is not factorized");
+  const int n = _perm.size();
+  double *y = &_work[0];
+  for (int i = 0; i < n; ++i)
+    y[i] = b[_perm[i]];
+
+  // L y = P b (column-oriented, since L is stored by columns)
+  for (int j = 0; j < n; ++j)
+  {
+    y[j] /= _L[_col_start[j]];
+    for (uint64_t q = _col_start[j] + 1; q < _col_start[j+1]; ++q)
+      y[_L_row[q]] -= _L[q] * y[j];
+  }
+
+  // L^T z = y
+  for (int j = n - 1; j >= 0; --j)
+  {
+    double s = y[j];
+    for (uint64_t q = _col_start[j] + 1; q < _col_start[j+1]; ++q)
+      s -= _L[q] * y[_L_row[q]];
+    y[j] = s / _L[_col_start[j]];
+  }
+
+  x.SetSize(n);
+  for (int i = 0; i < n; ++i)
+    x[_perm[i]] = y[i];
+}
+
+
+
+BlockCholeskySolver::BlockCholeskySolver(const SparseMatrix &A,
+                                         const FiniteElementSpace &fespace)
+  : Solver(A.Height(), false)
+  , _fespace(fespace)
+  , _offsets()
+  , _factors()
+  , _work()
+{
+  SetOperator(A);
+}
+
+void BlockCholeskySolver::SetOperator(const Operator &op)
+{
+  const SparseMatrix *A = dynamic_cast<const SparseMatrix*>(&op);
+  MFEM_VERIFY(A, "The operator must be a sparse matrix");
+  const int n_elements = _fespace.GetNE();
+
+  // the matrix must not couple the dofs of different elements
+  vector<int> dof_element(A->Height(), -1);
+  Array<int> vdofs;
+  _offsets.resize(n_elements + 1);
+  _offsets[0] = 0;
+  int max_size = 0;
+  for (int el = 0; el < n_elements; ++el)
+  {
+    _fespace.GetElementVDofs(el, vdofs);
+    for (int i = 0; i < vdofs.Size(); ++i)
+      dof_element[vdofs[i]] = el;
+    _offsets[el+1] = _offsets[el] + vdofs.Size() * vdofs.Size();
+    max_size = max(max_size, vdofs.Size());
+  }
+  const int *I = A->GetI(), *J = A->GetJ();
+  for (int i = 0; i < A->Height(); ++i)
+    for (int k = I[i]; k < I[i+1]; ++k)
+      MFEM_VERIFY(dof_element[i] == dof_element[J[k]], "The matrix is not "
+                  "block diagonal (row " + d2s(i) + ")");
+
+  _factors.resize(_offsets[n_elements]);
+  DenseMatrix block;
+  for (int el = 0; el < n_elements; ++el)
+  {
+    _fespace.GetElementVDofs(el, vdofs);
+    A->GetSubMatrix(vdofs, vdofs, block);
+    int n = vdofs.Size(), info = 0;
+    char uplo = 'L';
+    double *factor = &_factors[_offsets[el]];
+    memcpy(factor, block.Data(), n * n * sizeof(double));
+    dpotrf_(&uplo, &n, factor, &n, &info);
+    MFEM_VERIFY(info == 0, "The block of the element " + d2s(el) + " is not "
+                "positive definite (dpotrf info " + d2s(info) + ")");
+  }
+  _work.resize(max_size);
+}
+
+void BlockCholeskySolver::Mult(const Vector &b, Vector &x) const
+{
+  x.SetSize(b.Size());
+  Array<int> vdofs;
+  for (int el = 0; el < _fespace.GetNE(); ++el)
+  {
+    _fespace.GetElementVDofs(el, vdofs);
+    int n = vdofs.Size(), nrhs = 1, info = 0;
+    char uplo = 'L';
+    for (int i = 0; i < n; ++i)
+      _work[i] = b[vdofs[i]];
+    dpotrs_(&uplo, &n, &nrhs, const_cast<double*>(&_factors[_offsets[el]]),
+            &n, &_work[0], &n, &info);
+    for (int i = 0; i < n; ++i)
+      x[vdofs[i]] = _work[i];
+  }
+}
+
+
+
+ChebyshevMassSolver::ChebyshevMassSolver(const SparseMatrix &A,
+                                         double rel_tol)
+  : Solver(A.Height(), false)
+  , _A(&A)
+#if defined(MFEM_USE_MPI)
+  , _comm(MPI_COMM_NULL)
+#endif
+  , _rel_tol(rel_tol)
+  , _inv_diag()
+  , _lambda_min(0.)
+  , _lambda_max(0.)
+  , _n_iter(0)
+  , _r(), _d(), _z()
+{
+  Vector diag;
+  A.GetDiag(diag);
+  setup(diag);
+}
+
+#if defined(MFEM_USE_MPI)
+ChebyshevMassSolver::ChebyshevMassSolver(HypreParMatrix &A, double rel_tol)
+  : Solver(A.Height(), false)
+  , _A(&A)
+  , _comm(A.GetComm())
+  , _rel_tol(rel_tol)
+  , _inv_diag()
+  , _lambda_min(0.)
+  , _lambda_max(0.)
+  , _n_iter(0)
+  , _r(), _d(), _z()
+{
+  Vector diag;
+  A.GetDiag(diag);
+  setup(diag);
+}
+#endif
+
+void ChebyshevMassSolver::SetOperator(const Operator &)
+{
+  MFEM_ABORT("The operator of the Chebyshev solver is set at the construction");
+}
+
+double ChebyshevMassSolver::dot(const Vector &x, const Vector &y) const
+{
+  double d = x * y;
+#if defined(MFEM_USE_MPI)
+  if (_comm != MPI_COMM_NULL)
+    MPI_Allreduce(MPI_IN_PLACE, &d, 1, MPI_DOUBLE, MPI_SUM, _comm);
+#endif
+  return d;
+}
+
+void ChebyshevMassSolver::setup(const Vector &diag)
+{
+  const int n = diag.Size();
+  _inv_diag.SetSize(n);
+  for (int i = 0; i < n; ++i)
+  {
+    MFEM_VERIFY(diag[i] > 0., "The diagonal of the matrix must be positive "
+                "(row " + d2s(i) + ")");
+    _inv_diag[i] = 1. / diag[i];
+  }
+  _r.SetSize(n);
+  _d.SetSize(n);
+  _z.SetSize(n);
+
+  // the eigenvalues of D^{-1}A are the Rayleigh quotients (x,Ax)/(x,Dx) of
+  // the power iterations with D^{-1}A (the largest one) and with
+  // lambda_max*I - D^{-1}A (the smallest one)
+  const int n_power_iter = 30;
+  Vector x(n), Ax(n), Dx(n);
+  for (int i = 0; i < n; ++i)
+    x[i] = 1. + 0.5 * sin(1. + i); // not orthogonal to the extreme modes
+
+  for (int shifted = 0; shifted < 2; ++shifted)
+  {
+    double lambda = 0.;
+    for (int it = 0; it < n_power_iter; ++it)
+    {
+      _A->Mult(x, Ax);
+      for (int i = 0; i < n; ++i)
+        Dx[i] = diag[i] * x[i];
+      const double xDx = dot(x, Dx);
+      lambda = dot(x, Ax) / xDx;
+      const double scale = 1. / sqrt(xDx);
+      for (int i = 0; i < n; ++i)
+      {
+        const double y = _inv_diag[i] * Ax[i];
+        x[i] = scale * (shifted ? _lambda_max * x[i] - y : y);
+      }
+    }
+    if (shifted)
+      _lambda_min = lambda;
+    else
+      _lambda_max = lambda;
+  }
+
+  // safety margins: the iteration diverges if the largest eigenvalue is
+  // underestimated, and it's only slower if the smallest one is overestimated
+  _lambda_max *= 1.1;
+  _lambda_min = min(0.9 * _lambda_min, 0.5 * _lambda_max);
+  MFEM_VERIFY(_lambda_min > 0., "The matrix is not positive definite");
+
+  // the smallest eigenvalue converges slowly in the power iterations, so the
+  // number of iterations is checked by the residual of a test system, and the
+  // bound is lowered until the tolerance is reached
+  for (int i = 0; i < n; ++i)
+    x[i] = 1. + 0.5 * sin(1. + i);
+  Vector b(n), r(n);
+  _A->Mult(x, b);
+  const double b_norm = sqrt(dot(b, b));
+  const int max_iter = 1000;
+  const int n_attempts = 10;
+  double res_norm = 0.;
+  for (int attempt = 0; attempt < n_attempts; ++attempt)
+  {
+    const double sqrt_cond = sqrt(_lambda_max / _lambda_min);
+    const double rate = (sqrt_cond - 1.) / (sqrt_cond + 1.);
+    _n_iter = max(1, (int)ceil(log(0.5 * _rel_tol) / log(rate)));
+    MFEM_VERIFY(_n_iter <= max_iter, "The Chebyshev mass solver needs " +
+                d2s(_n_iter) + " iterations (more than " + d2s(max_iter) +
+                ") for the tolerance " + d2s(_rel_tol) + ", the spectrum "
+                "bounds are [" + d2s(_lambda_min) + ", " + d2s(_lambda_max) +
+                "]; use the pcg mass solver");
+
+    Mult(b, x);
+    _A->Mult(x, r);
+    r -= b;
+    res_norm = sqrt(dot(r, r));
+    if (res_norm <= _rel_tol * b_norm)
+      return;
+    _lambda_min *= 0.5;
+  }
+  MFEM_ABORT("The Chebyshev mass solver doesn't reach the tolerance " +
+             d2s(_rel_tol) + " on the test system (relative residual " +
+             d2s(res_norm / b_norm) + " after " + d2s(n_attempts) +
+             " attempts); use the pcg mass solver");
+}
+
+void ChebyshevMassSolver::Mult(const Vector &b, Vector &x) const
+{
+  const int n = b.Size();
+  const double theta = 0.5 * (_lambda_max + _lambda_min);
+  const double delta = 0.5 * (_lambda_max - _lambda_min);
+  const double sigma = theta / delta;
+  double rho = 1. / sigma;
+
+  x.SetSize(n);
+  x = 0.0;
+  _r = b;
+  for (int i = 0; i < n; ++i)
+    _d[i] = _inv_diag[i] * _r[i] / theta;
+
+  for (int it = 0; it < _n_iter; ++it)
+  {
+    x += _d;
+    if (it == _n_iter - 1)
+      break;
+    _A->Mult(_d, _z);
+    _r -= _z;
+    const double rho_new = 1. / (2. * sigma - rho);
+    const double c = 2. * rho_new / delta;
+    for (int i = 0; i < n; ++i)
+      _d[i] = rho_new * rho * _d[i] + c * _inv_diag[i] * _r[i];
+    rho = rho_new;
+  }
+}
+
+
+
+Solver* new_mass_solver(const MethodParameters &method, const SparseMatrix &A,
+                        const FiniteElementSpace &fespace, bool block_diagonal)
+{
+  const string name = method.mass_solver;
+  if (name == "pcg")
+  {
+    cout << "Mass solver: PCG" << endl;
+    return new PCGMassSolver(A);
+  }
+  if (name == "chebyshev")
+  {
+    ChebyshevMassSolver *solver = new ChebyshevMassSolver(A);
+    cout << "Mass solver: Chebyshev, " << solver->n_iterations()
+         << " iterations" << endl;
+    return solver;
+  }
+
+  if (block_diagonal)
+  {
+    // the factors take as much memory as the matrix itself
+    cout << "Mass solver: Cholesky of the element blocks" << endl;
+    return new BlockCholeskySolver(A, fespace);
+  }
+
+  SparseCholeskySolver *solver = new SparseCholeskySolver(A, fespace);
+  const double size_MB = solver->factor_size() / 1048576.;
+  if (name == "auto" && size_MB > method.mass_solver_memory)
+  {
+    cout << "Mass solver: PCG (the Cholesky factor would take " << size_MB
+         << " MB, more than " << method.mass_solver_memory << " MB)" << endl;
+    delete solver;
+    return new PCGMassSolver(A);
+  }
+  cout << "Mass solver: sparse Cholesky with nested dissection ordering, "
+       "factor " << size_MB << " MB" << endl;
+  solver->SetOperator(A);
+  return solver;
+}
+
+#if defined(MFEM_USE_MPI)
+/**
+ * CG with the Jacobi preconditioner, both created once.
+ */
+class CGJacobiMassSolver : public Solver
+{
+public:
+  CGJacobiMassSolver(HypreParMatrix &A)
+    : Solver(A.Height(), false)
+    , _prec()
+    , _cg(A.GetComm())
+  {
+    _prec.SetType(HypreSmoother::Jacobi);
+    _cg.SetPreconditioner(_prec);
+    _cg.SetOperator(A);
+    _cg.iterative_mode = false;
+    _cg.SetRelTol(1e-12);
+    _cg.SetAbsTol(0.0);
+    _cg.SetMaxIter(200);
+    _cg.SetPrintLevel(0);
+  }
+
+  virtual void SetOperator(const Operator &op) { _cg.SetOperator(op); }
+  virtual void Mult(const Vector &b, Vector &x) const { _cg.Mult(b, x); }
+
+private:
+  HypreSmoother _prec;
+  CGSolver _cg;
+};
+
+Solver* new_mass_solver(const MethodParameters &method, HypreParMatrix &A,
+                        ostream &out)
+{
+  const string name = method.mass_solver;
+  if (name == "pcg")
+  {
+    out << "Mass solver: CG with Jacobi preconditioner" << endl;
+    return new CGJacobiMassSolver(A);
+  }
+  MFEM_VERIFY(name == "auto" || name == "chebyshev", "The mass solver '" +
+              name + "' isn't available for distributed matrices");
+  ChebyshevMassSolver *solver = new ChebyshevMassSolver(A);
+  out << "Mass solver: Chebyshev, eigenvalues of the Jacobi-scaled matrix in ["
+      << solver->min_eigenvalue() << ", " << solver->max_eigenvalue()
+      << "], " << solver->n_iterations() << " iterations" << endl;
+  return solver;
+}
+#endif // MFEM_USE_MPI
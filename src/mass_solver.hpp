@@ -0,0 +1,220 @@
+#ifndef MASS_SOLVER_HPP
+#define MASS_SOLVER_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+class MethodParameters;
+
+
+
+/**
+ * The preconditioned CG (with the Gauss-Seidel smoother) solving the system
+ * at every time step from the previous solution. It needs no extra memory.
+ */
+class PCGMassSolver : public mfem::Solver
+{
+public:
+  PCGMassSolver(const mfem::SparseMatrix &A);
+
+  virtual void SetOperator(const mfem::Operator &op);
+  virtual void Mult(const mfem::Vector &b, mfem::Vector &x) const;
+
+private:
+  const mfem::SparseMatrix *_A;
+  mutable mfem::GSSmoother _prec;
+};
+
+
+
+/**
+ * Sparse Cholesky factorization of a symmetric positive definite matrix in
+ * the envelope (skyline) format with the reverse Cuthill-McKee ordering,
+ * which keeps the envelope narrow. The matrix is factorized once, and every
+ * solve is a forward and a backward substitution. The envelope grows as
+ * N^{3/2} in 2D, but as N^{5/3} in 3D, so it's used for the small local
+ * problems with many right hand sides (GMsFEM snapshots), while the global
+ * mass matrices are factorized by SparseCholeskySolver.
+ */
+class SkylineCholeskySolver : public mfem::Solver
+{
+public:
+  /**
+   * Compute the ordering and the envelope of the factor (not the factor).
+   */
+  SkylineCholeskySolver(const mfem::SparseMatrix &A);
+
+  /// memory (in bytes) taken by the factor
+  uint64_t factor_size() const { return _start.back() * sizeof(double); }
+
+  /**
+   * Factorize the matrix (with the same sparsity pattern as the one given to
+   * the constructor).
+   */
+  virtual void SetOperator(const mfem::Operator &op);
+  virtual void Mult(const mfem::Vector &b, mfem::Vector &x) const;
+
+  /**
+   * Solve for a block of right hand sides (the columns of B). The columns are
+   * shared among the threads, and every thread substitutes a few columns at
+   * once, so every row of the factor loaded from memory is used for all of
+   * them.
+   */
+  void Mult(const mfem::DenseMatrix &B, mfem::DenseMatrix &X,
+            int n_threads = 1) const;
+
+private:
+  std::vector<int> _perm;   ///< new -> old numbers of rows
+  std::vector<int> _iperm;  ///< old -> new numbers of rows
+  std::vector<int> _first;  ///< first column of the envelope of every row
+  std::vector<uint64_t> _start; ///< offsets of the rows of the factor
+  std::vector<double> _L;   ///< rows of the factor (the diagonal is last)
+  mutable std::vector<double> _work;
+
+  void solve_columns(const mfem::DenseMatrix &B, mfem::DenseMatrix &X,
+                     int first, int last) const;
+};
+
+
+
+/**
+ * Sparse Cholesky factorization of a symmetric positive definite matrix with
+ * the nested dissection ordering: the dofs are split recursively by the
+ * median plane across the longest side of their bounding box, and the dofs
+ * coupled across the plane (the separator) are numbered after both halves.
+ * The factor is stored by columns with only the fill-in entries, which grow
+ * as N log N in 2D and N^{4/3} in 3D (vs N^{3/2} and N^{5/3} of the RCM
+ * envelope). E.g. for the Q1 mass matrix on a 40^3 grid the factor takes
+ * 346 MB (and ~3e10 flops) instead of 1462 MB (and ~7e11 flops).
+ */
+class SparseCholeskySolver : public mfem::Solver
+{
+public:
+  /**
+   * Compute the ordering (from the positions of the dofs of the space) and
+   * the sparsity pattern of the factor (not the factor).
+   */
+  SparseCholeskySolver(const mfem::SparseMatrix &A,
+                       const mfem::FiniteElementSpace &fespace);
+
+  /// memory (in bytes) taken by the factor
+  uint64_t factor_size() const
+  { return _col_start.back() * (sizeof(int) + sizeof(double)); }
+
+  /**
+   * Factorize the matrix (with the same sparsity pattern as the one given to
+   * the constructor).
+   */
+  virtual void SetOperator(const mfem::Operator &op);
+  virtual void Mult(const mfem::Vector &b, mfem::Vector &x) const;
+
+private:
+  std::vector<int> _perm;   ///< new -> old numbers of rows
+  std::vector<int> _iperm;  ///< old -> new numbers of rows
+  std::vector<int> _A_start;///< offsets of the rows of the permuted lower
+                            ///< triangle of the matrix
+  std::vector<int> _A_col;  ///< its columns
+  std::vector<int> _A_pos;  ///< entry of the matrix -> its entry, or -1
+  std::vector<int> _parent; ///< elimination tree
+  std::vector<uint64_t> _col_start; ///< offsets of the columns of the factor
+  std::vector<int> _L_row;  ///< rows of the factor (the diagonal is first)
+  std::vector<double> _L;   ///< values of the factor
+  mutable std::vector<double> _work;
+
+  int row_pattern(int k, std::vector<int> &mark, int *pattern) const;
+};
+
+
+
+/**
+ * Dense Cholesky factorization (LAPACK) of every diagonal block of a block
+ * diagonal matrix, e.g. of the DG mass matrix, where the blocks are the
+ * elements.
+ */
+class BlockCholeskySolver : public mfem::Solver
+{
+public:
+  BlockCholeskySolver(const mfem::SparseMatrix &A,
+                      const mfem::FiniteElementSpace &fespace);
+
+  virtual void SetOperator(const mfem::Operator &op);
+  virtual void Mult(const mfem::Vector &b, mfem::Vector &x) const;
+
+private:
+  const mfem::FiniteElementSpace &_fespace;
+  std::vector<int> _offsets; ///< offsets of the factors of the blocks
+  std::vector<double> _factors;
+  mutable std::vector<double> _work;
+};
+
+
+
+/**
+ * Chebyshev iteration with the Jacobi preconditioner. The bounds of the
+ * spectrum of the Jacobi-scaled matrix are estimated once (by power
+ * iterations) at the setup, and then a fixed number of iterations, enough to
+ * reduce the error by the given tolerance, is done for every system. So
+ * unlike CG, the solves need no global reductions, only the products with
+ * the matrix. The setup fails if the tolerance isn't reached on a test system
+ * or needs more than 1000 iterations, rather than solving less accurately.
+ */
+class ChebyshevMassSolver : public mfem::Solver
+{
+public:
+  ChebyshevMassSolver(const mfem::SparseMatrix &A, double rel_tol = 1e-12);
+#if defined(MFEM_USE_MPI)
+  ChebyshevMassSolver(mfem::HypreParMatrix &A, double rel_tol = 1e-12);
+#endif
+
+  virtual void SetOperator(const mfem::Operator &op);
+  virtual void Mult(const mfem::Vector &b, mfem::Vector &x) const;
+
+  int n_iterations() const { return _n_iter; }
+  double min_eigenvalue() const { return _lambda_min; }
+  double max_eigenvalue() const { return _lambda_max; }
+
+private:
+  const mfem::Operator *_A;
+#if defined(MFEM_USE_MPI)
+  MPI_Comm _comm; ///< for the dot products at the setup (or MPI_COMM_NULL)
+#endif
+  double _rel_tol;
+  mfem::Vector _inv_diag;
+  double _lambda_min, _lambda_max; ///< bounds of the spectrum of D^{-1}A
+  int _n_iter;
+  mutable mfem::Vector _r, _d, _z;
+
+  void setup(const mfem::Vector &diag);
+  double dot(const mfem::Vector &x, const mfem::Vector &y) const;
+};
+
+
+
+/**
+ * The solver of the systems with the constant (mass) matrix of the time
+ * stepping chosen by the method parameters: Cholesky factorization (per
+ * element, if the matrix is block diagonal, otherwise sparse with the nested
+ * dissection ordering), Chebyshev iteration, or PCG if it's requested, or if
+ * the factor would take more memory than allowed (mass_solver_memory, which
+ * large 3D meshes may still exceed). The chosen solver is printed.
+ */
+mfem::Solver* new_mass_solver(const MethodParameters &method,
+                              const mfem::SparseMatrix &A,
+                              const mfem::FiniteElementSpace &fespace,
+                              bool block_diagonal);
+
+#if defined(MFEM_USE_MPI)
+/**
+ * The same for a distributed matrix: Chebyshev iteration (auto), or CG with
+ * the Jacobi preconditioner. The solver is to be created once and used for
+ * all time steps.
+ */
+mfem::Solver* new_mass_solver(const MethodParameters &method,
+                              mfem::HypreParMatrix &A, std::ostream &out);
+#endif
+
+#endif // MASS_SOLVER_HPP
@@ -0,0 +1,181 @@
+#include "media_update.hpp"
+#include "acoustic_wave.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace mfem;
+
+
+
+MediaUpdate::MediaUpdate(FiniteElementSpace &fespace, double *one_over_rho,
+                         double *one_over_K, const IntegrationRule *rule)
+  : _fespace(fespace)
+  , _one_over_rho(one_over_rho)
+  , _one_over_K(one_over_K)
+  , _rule(rule)
+  , _dg(false)
+  , _dg_sigma(0.)
+  , _dg_kappa(0.)
+  , _cell_to_element()
+  , _face_to_bdr_element()
+  , _absorbing_faces()
+  , _delta_one_over_rho()
+  , _delta_one_over_K()
+{
+  const Mesh *mesh = _fespace.GetMesh();
+
+  // the cells are numbered by the attributes of the elements, as in
+  // CWConstCoefficient
+  int n_cells = 0;
+  for (int el = 0; el < mesh->GetNE(); ++el)
+    n_cells = max(n_cells, mesh->GetAttribute(el));
+
+  _cell_to_element.resize(n_cells, -1);
+  for (int el = 0; el < mesh->GetNE(); ++el)
+    _cell_to_element[mesh->GetAttribute(el) - 1] = el;
+
+  _delta_one_over_rho.resize(n_cells, 0.);
+  _delta_one_over_K.resize(n_cells, 0.);
+}
+
+void MediaUpdate::set_dg(double sigma, double kappa,
+                         const vector<char> &absorbing_faces)
+{
+  Mesh *mesh = _fespace.GetMesh();
+  MFEM_VERIFY((int)absorbing_faces.size() == mesh->GetNumFaces(),
+              "The marker of the absorbing faces doesn't match the mesh");
+
+  _dg = true;
+  _dg_sigma = sigma;
+  _dg_kappa = kappa;
+  _absorbing_faces = absorbing_faces;
+
+  _face_to_bdr_element.assign(mesh->GetNumFaces(), -1);
+  for (int be = 0; be < mesh->GetNBE(); ++be)
+    _face_to_bdr_element[mesh->GetBdrElementEdgeIndex(be)] = be;
+}
+
+void MediaUpdate::update(const vector<int> &cells, const double *rho,
+                         const double *vp, SparseMatrix &S, SparseMatrix &M)
+{
+  vector<int> elements;
+  for (size_t i = 0; i < cells.size(); ++i)
+  {
+    const int cell = cells[i];
+    if (cell < 0 || cell >= (int)_cell_to_element.size() ||
+        _cell_to_element[cell] < 0)
+      continue;
+    MFEM_VERIFY(rho[i] > 1.0 && vp[i] > 1.0, "Incorrect media properties");
+
+    const double new_one_over_rho = 1. / rho[i];
+    const double new_one_over_K   = 1. / (rho[i]*vp[i]*vp[i]);
+    _delta_one_over_rho[cell] = new_one_over_rho - _one_over_rho[cell];
+    _delta_one_over_K[cell]   = new_one_over_K - _one_over_K[cell];
+    elements.push_back(_cell_to_element[cell]);
+  }
+  // the differences of a repeated cell are set by its last entry, and its
+  // element must be assembled once
+  sort(elements.begin(), elements.end());
+  elements.erase(unique(elements.begin(), elements.end()), elements.end());
+
+  const bool own_array = false;
+  CWConstCoefficient delta_one_over_rho(&_delta_one_over_rho[0], own_array);
+  CWConstCoefficient delta_one_over_K(&_delta_one_over_K[0], own_array);
+
+  DiffusionIntegrator stif_int(delta_one_over_rho);
+  MassIntegrator mass_int(delta_one_over_K);
+  if (_rule)
+  {
+    stif_int.SetIntRule(_rule);
+    mass_int.SetIntRule(_rule);
+  }
+
+  Array<int> vdofs;
+  DenseMatrix elmat;
+  for (size_t i = 0; i < elements.size(); ++i)
+  {
+    const int el = elements[i];
+    const FiniteElement &fe = *_fespace.GetFE(el);
+    ElementTransformation *T = _fespace.GetElementTransformation(el);
+    _fespace.GetElementVDofs(el, vdofs);
+
+    stif_int.AssembleElementMatrix(fe, *T, elmat);
+    S.AddSubMatrix(vdofs, vdofs, elmat);
+
+    mass_int.AssembleElementMatrix(fe, *T, elmat);
+    M.AddSubMatrix(vdofs, vdofs, elmat);
+  }
+
+  if (_dg)
+    patch_faces(elements, delta_one_over_rho, S);
+
+  // the new values, and the differences are zero everywhere again
+  for (size_t i = 0; i < cells.size(); ++i)
+  {
+    const int cell = cells[i];
+    if (cell < 0 || cell >= (int)_cell_to_element.size() ||
+        _cell_to_element[cell] < 0)
+      continue;
+    _one_over_rho[cell] += _delta_one_over_rho[cell];
+    _one_over_K[cell]   += _delta_one_over_K[cell];
+    _delta_one_over_rho[cell] = _delta_one_over_K[cell] = 0.;
+  }
+}
+
+void MediaUpdate::patch_faces(const vector<int> &elements,
+                              Coefficient &delta_one_over_rho, SparseMatrix &S)
+{
+  Mesh *mesh = _fespace.GetMesh();
+  const int dim = mesh->Dimension();
+
+  // the faces of the changed elements, every face once even if the elements
+  // on both sides are changed
+  vector<int> faces;
+  Array<int> el_faces, orientations;
+  for (size_t i = 0; i < elements.size(); ++i)
+  {
+    if (dim == 2)
+      mesh->GetElementEdges(elements[i], el_faces, orientations);
+    else
+      mesh->GetElementFaces(elements[i], el_faces, orientations);
+    for (int f = 0; f < el_faces.Size(); ++f)
+      faces.push_back(el_faces[f]);
+  }
+  sort(faces.begin(), faces.end());
+  faces.erase(unique(faces.begin(), faces.end()), faces.end());
+
+  DGDiffusionIntegrator face_int(delta_one_over_rho, _dg_sigma, _dg_kappa);
+
+  Array<int> vdofs, vdofs2;
+  DenseMatrix elmat;
+  for (size_t i = 0; i < faces.size(); ++i)
+  {
+    FaceElementTransformations *T =
+        mesh->GetInteriorFaceTransformations(faces[i]);
+    if (T)
+    {
+      _fespace.GetElementVDofs(T->Elem1No, vdofs);
+      _fespace.GetElementVDofs(T->Elem2No, vdofs2);
+      vdofs.Append(vdofs2);
+      face_int.AssembleFaceMatrix(*_fespace.GetFE(T->Elem1No),
+                                  *_fespace.GetFE(T->Elem2No), *T, elmat);
+      S.AddSubMatrix(vdofs, vdofs, elmat);
+      continue;
+    }
+
+    if (_absorbing_faces[faces[i]])
+      continue; // the natural condition, no terms as in the full assembly
+    const int be = _face_to_bdr_element[faces[i]];
+    if (be < 0)
+      continue; // a shared face or a face without a boundary element
+    T = mesh->GetBdrFaceTransformations(be);
+    if (T)
+    {
+      _fespace.GetElementVDofs(T->Elem1No, vdofs);
+      const FiniteElement &fe = *_fespace.GetFE(T->Elem1No);
+      face_int.AssembleFaceMatrix(fe, fe, *T, elmat);
+      S.AddSubMatrix(vdofs, vdofs, elmat);
+    }
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef MEDIA_UPDATE_HPP
+#define MEDIA_UPDATE_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <vector>
+
+/**
+ * Update of the media properties in a few cells (e.g. at an iteration of an
+ * inversion) with incremental re-assembly of the stiffness and mass matrices.
+ * The bilinear forms are linear in the coefficients 1/rho and 1/K, so only the
+ * contributions of the changed cells (and, for DG, of their faces) are
+ * assembled with the differences of the coefficients, and added to the
+ * existing matrices. The sparsity pattern of the matrices doesn't change.
+ *
+ * The matrices must be assembled (finalized) by BilinearForm with the same
+ * integrators, and they must be writable: the matrices taken from the
+ * OperatorCache are read-only mappings of the files.
+ */
+class MediaUpdate
+{
+public:
+  /**
+   * @param one_over_rho, one_over_K - the coefficient arrays the matrices were
+   * assembled with, indexed by the cell numbers (attributes - 1); they're
+   * updated together with the matrices.
+   * @param rule - the integration rule of the domain integrators (the GLL one
+   * for SEM), or nullptr for the default one.
+   */
+  MediaUpdate(mfem::FiniteElementSpace &fespace, double *one_over_rho,
+              double *one_over_K, const mfem::IntegrationRule *rule = nullptr);
+
+  /**
+   * The stiffness matrix has the DG face terms with the given parameters: on
+   * the interior faces and on the boundary faces not marked in
+   * absorbing_faces (see find_absorbing_faces), which have the natural
+   * condition instead of the penalty terms of the free surface.
+   */
+  void set_dg(double sigma, double kappa,
+              const std::vector<char> &absorbing_faces);
+
+  /**
+   * Set the new density and velocity in the given cells, and patch the
+   * stiffness (S) and the mass (M) matrices. The cells not belonging to the
+   * (local) mesh are ignored. A repeated cell is updated once, with its last
+   * values.
+   */
+  void update(const std::vector<int> &cells, const double *rho,
+              const double *vp, mfem::SparseMatrix &S, mfem::SparseMatrix &M);
+
+private:
+  mfem::FiniteElementSpace &_fespace;
+  double *_one_over_rho;
+  double *_one_over_K;
+  const mfem::IntegrationRule *_rule;
+
+  bool _dg;
+  double _dg_sigma;
+  double _dg_kappa;
+
+  /// element of the mesh for every cell number, or -1
+  std::vector<int> _cell_to_element;
+
+  /// face index -> boundary element index (or -1), for DG only
+  std::vector<int> _face_to_bdr_element;
+
+  /// nonzero for the boundary faces without the DG terms, for DG only
+  std::vector<char> _absorbing_faces;
+
+  /// differences of the coefficients, nonzero in the updated cells only
+  std::vector<double> _delta_one_over_rho;
+  std::vector<double> _delta_one_over_K;
+
+  void patch_faces(const std::vector<int> &elements,
+                   mfem::Coefficient &delta_one_over_rho,
+                   mfem::SparseMatrix &S);
+};
+
+#endif // MEDIA_UPDATE_HPP
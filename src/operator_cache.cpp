@@ -0,0 +1,262 @@
+#include "operator_cache.hpp"
+#include "parameters.hpp"
+#include "utilities.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace mfem;
+
+static const char CACHE_MAGIC[] = { 'A', 'C', 'W', 'O' };
+static const uint32_t CACHE_VERSION = 1;
+static const int CACHE_HEADER_SIZE = 64;
+
+struct CacheHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t hash;
+  int64_t height;
+  int64_t width;
+  int64_t nnz;
+};
+
+
+
+static void add_mesh(OperatorHash &hasher, const Mesh &mesh)
+{
+  hasher.add(mesh.Dimension());
+  hasher.add(mesh.GetNV());
+  hasher.add(mesh.GetNE());
+  for (int v = 0; v < mesh.GetNV(); ++v)
+    hasher.add(mesh.GetVertex(v), mesh.SpaceDimension() * sizeof(double));
+  for (int el = 0; el < mesh.GetNE(); ++el)
+  {
+    const Element *element = mesh.GetElement(el);
+    Array<int> vertices;
+    element->GetVertices(vertices);
+    hasher.add(element->GetAttribute());
+    hasher.add(vertices.GetData(), vertices.Size() * sizeof(int));
+  }
+}
+
+
+
+OperatorCache::OperatorCache(const Parameters &param, const string &tag)
+  : _directory()
+  , _tag(tag)
+  , _hash(0)
+{
+  if (!strcmp(param.output.cache_directory, DEFAULT_FILE_NAME))
+    return;
+  _directory = param.output.cache_directory;
+
+  OperatorHash hasher;
+  hasher.add(CACHE_VERSION);
+  hasher.add(tag);
+  hasher.add(param.dimension);
+
+  const MethodParameters &method = param.method;
+  hasher.add(method.name);
+  hasher.add(method.order);
+  hasher.add(method.dg_sigma);
+  hasher.add(method.dg_kappa);
+  hasher.add(method.gms_Nx);
+  hasher.add(method.gms_Ny);
+  hasher.add(method.gms_Nz);
+  hasher.add(method.gms_nb);
+  hasher.add(method.gms_ni);
+  hasher.add(method.gms_randomized); // the snapshot space of the basis
+  hasher.add(method.gms_oversampling);
+  hasher.add(method.gms_power_iterations);
+  hasher.add(param.grid.partitioning);
+
+  // the DG stiffness has the penalty terms on the free surfaces only
+  const BoundaryConditionsParameters &bc = param.bc;
+  const char *surfaces[] = { bc.left, bc.right, bc.bottom, bc.top, bc.front,
+                             bc.back };
+  for (int i = 0; i < 6; ++i)
+    hasher.add(surfaces[i]);
+
+  if (param.mesh)
+    add_mesh(hasher, *param.mesh);
+  if (param.par_mesh)
+    add_mesh(hasher, *param.par_mesh);
+
+  const MediaPropertiesParameters &media = param.media;
+  hasher.add(media.n_cells);
+  hasher.add(media.rho_array, media.n_cells * sizeof(double));
+  hasher.add(media.vp_array, media.n_cells * sizeof(double));
+
+  _hash = hasher.value();
+}
+
+OperatorCache::~OperatorCache()
+{
+  for (size_t i = 0; i < _matrices.size(); ++i)
+    delete _matrices[i];
+  for (size_t i = 0; i < _files.size(); ++i)
+    delete _files[i];
+}
+
+string OperatorCache::filename(const string &name) const
+{
+  return filename(_hash, name, "csr");
+}
+
+string OperatorCache::filename(uint64_t key, const string &name,
+                               const string &extension) const
+{
+  ostringstream hash;
+  hash << hex << setw(16) << setfill('0') << key;
+  return _directory + "/" + _tag + "_" + hash.str() + "_" + name + "." +
+         extension;
+}
+
+/**
+ * Write the file under a temporary name and rename it, so the processes
+ * sharing the cache never see a partially written file.
+ */
+static void write_atomically(const string &fname, const char *header,
+                             int header_size, const void *const *pieces,
+                             const uint64_t *sizes, int n_pieces)
+{
+  const string tmp_name = fname + ".tmp" + d2s(getpid());
+  {
+    ofstream out(tmp_name.c_str(), ios::binary);
+    MFEM_VERIFY(out, "File '" + tmp_name + "' can't be opened");
+    out.write(header, header_size);
+    for (int i = 0; i < n_pieces; ++i)
+      out.write(static_cast<const char*>(pieces[i]), sizes[i]);
+    MFEM_VERIFY(out, "Failed to write the file '" + tmp_name + "'");
+  }
+  const int res = rename(tmp_name.c_str(), fname.c_str());
+  MFEM_VERIFY(res == 0, "Can't rename '" + tmp_name + "' to '" + fname + "'");
+}
+
+const SparseMatrix* OperatorCache::load(const string &name)
+{
+  if (!enabled())
+    return nullptr;
+  const string fname = filename(name);
+  if (!file_exists(fname))
+    return nullptr;
+
+  MappedFile *file = new MappedFile(fname.c_str());
+  const char *data = static_cast<const char*>(file->data());
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  bool valid = (file->size() >= (uint64_t)CACHE_HEADER_SIZE);
+  if (valid)
+  {
+    memcpy(&header, data, sizeof(header));
+    valid = (!memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) &&
+             header.version == CACHE_VERSION && header.hash == _hash &&
+             header.height >= 0 && header.width >= 0 && header.nnz >= 0);
+  }
+  const uint64_t I_offset = CACHE_HEADER_SIZE;
+  const uint64_t J_offset = I_offset + (header.height + 1) * sizeof(int);
+  const uint64_t data_offset = (J_offset + header.nnz*sizeof(int) + 7) / 8 * 8;
+  if (valid)
+    valid = (file->size() == data_offset + header.nnz * sizeof(double));
+  if (!valid)
+  {
+    mfem_warning(("The cached operator '" + fname + "' is corrupted, it's "
+                  "assembled again\n").c_str());
+    delete file;
+    return nullptr;
+  }
+
+  // the mapping is read-only, and the matrix only refers to it
+  int *I = (int*)(data + I_offset);
+  int *J = (int*)(data + J_offset);
+  double *values = (double*)(data + data_offset);
+  const bool own_ij = false, own_data = false, sorted = true;
+  SparseMatrix *A = new SparseMatrix(I, J, values, header.height,
+                                     header.width, own_ij, own_data, sorted);
+  _files.push_back(file);
+  _matrices.push_back(A);
+  return A;
+}
+
+void OperatorCache::save(const string &name, const SparseMatrix &A) const
+{
+  save(name, A.GetI(), A.GetJ(), A.GetData(), A.Height(), A.Width());
+}
+
+void OperatorCache::save(const string &name, const int *I, const int *J,
+                         const double *data, int height, int width) const
+{
+  if (!enabled())
+    return;
+
+  CacheHeader header;
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.hash = _hash;
+  header.height = height;
+  header.width = width;
+  header.nnz = I[height];
+
+  char header_bytes[CACHE_HEADER_SIZE] = { 0 };
+  memcpy(header_bytes, &header, sizeof(header));
+  const char padding[8] = { 0 };
+  const uint64_t J_end = CACHE_HEADER_SIZE +
+                         (height + 1 + header.nnz) * sizeof(int);
+  const void *pieces[] = { I, J, padding, data };
+  const uint64_t sizes[] = { (height + 1) * sizeof(int),
+                             header.nnz * sizeof(int),
+                             (8 - J_end % 8) % 8,
+                             header.nnz * sizeof(double) };
+  write_atomically(filename(name), header_bytes, CACHE_HEADER_SIZE, pieces,
+                   sizes, 4);
+}
+
+bool OperatorCache::load(uint64_t key, const string &name, DenseMatrix &A) const
+{
+  if (!enabled())
+    return false;
+  const string fname = filename(key, name, "dense");
+  ifstream in(fname.c_str(), ios::binary);
+  if (!in)
+    return false;
+
+  CacheHeader header;
+  in.read((char*)&header, sizeof(header));
+  in.seekg(CACHE_HEADER_SIZE);
+  if (!in || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+      header.version != CACHE_VERSION || header.hash != key ||
+      header.height < 0 || header.width < 0)
+    return false;
+
+  A.SetSize(header.height, header.width);
+  in.read((char*)A.Data(), header.height * header.width * sizeof(double));
+  return (bool)in;
+}
+
+void OperatorCache::save(uint64_t key, const string &name,
+                         const DenseMatrix &A) const
+{
+  if (!enabled())
+    return;
+
+  CacheHeader header;
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.hash = key;
+  header.height = A.Height();
+  header.width = A.Width();
+  header.nnz = header.height * header.width;
+
+  char header_bytes[CACHE_HEADER_SIZE] = { 0 };
+  memcpy(header_bytes, &header, sizeof(header));
+  const void *pieces[] = { A.Data() };
+  const uint64_t sizes[] = { header.nnz * sizeof(double) };
+  write_atomically(filename(key, name, "dense"), header_bytes,
+                   CACHE_HEADER_SIZE, pieces, sizes, 1);
+}
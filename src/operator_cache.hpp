@@ -0,0 +1,107 @@
+#ifndef OPERATOR_CACHE_HPP
+#define OPERATOR_CACHE_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class MappedFile;
+class Parameters;
+
+
+
+/**
+ * 64-bit FNV-1a hash accumulated over several pieces of data.
+ */
+class OperatorHash
+{
+public:
+  OperatorHash() : _hash(14695981039346656037ULL) { }
+
+  void add(const void *data, size_t size)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+      _hash ^= bytes[i];
+      _hash *= 1099511628211ULL;
+    }
+  }
+  template <typename T> void add(const T &value) { add(&value, sizeof(T)); }
+  void add(const char *str) { add(str, strlen(str) + 1); }
+  void add(const std::string &str) { add(str.c_str()); }
+
+  uint64_t value() const { return _hash; }
+
+private:
+  uint64_t _hash;
+};
+
+
+
+/**
+ * On-disk cache of assembled sparse matrices. The matrices are identified by
+ * a hash of everything they depend on: the mesh, the media properties, the
+ * method, its order and its specific (DG, GMsFEM) parameters. A cached matrix
+ * is memory mapped, so reusing it requires neither assembly nor reading of
+ * the whole file. The cache is disabled if the cache directory is
+ * not given.
+ *
+ * File format: a header (magic "ACWO", version, hash, height, width, number
+ * of nonzeros) of 64 bytes, the row offsets and the column indices (int32),
+ * and the values (float64) aligned to 8 bytes. Dense matrices have the same
+ * header followed by the values in column-major order.
+ */
+class OperatorCache
+{
+public:
+  /**
+   * @param tag - distinguishes the operators of different methods and
+   * different parts of a parallel run (it's the prefix of the file names).
+   */
+  OperatorCache(const Parameters &param, const std::string &tag);
+  ~OperatorCache();
+
+  bool enabled() const { return !_directory.empty(); }
+
+  /**
+   * The cached matrix with the given name, or nullptr if there is no valid
+   * one. The matrix refers to the mapped file, and it's valid while the
+   * cache exists. It must not be modified.
+   */
+  const mfem::SparseMatrix* load(const std::string &name);
+
+  void save(const std::string &name, const mfem::SparseMatrix &A) const;
+  void save(const std::string &name, const int *I, const int *J,
+            const double *data, int height, int width) const;
+
+  /**
+   * Dense matrices identified by their own key (a hash of the data they
+   * depend on) instead of the hash of the whole model, e.g. local bases which
+   * depend on the media of a part of the domain only, so that they are reused
+   * if the model is changed elsewhere. The matrix is copied from the file.
+   */
+  bool load(uint64_t key, const std::string &name, mfem::DenseMatrix &A) const;
+  void save(uint64_t key, const std::string &name,
+            const mfem::DenseMatrix &A) const;
+
+private:
+  std::string _directory;
+  std::string _tag;
+  uint64_t _hash;
+  std::vector<MappedFile*> _files;
+  std::vector<mfem::SparseMatrix*> _matrices;
+
+  std::string filename(const std::string &name) const;
+  std::string filename(uint64_t key, const std::string &name,
+                       const std::string &extension) const;
+
+  OperatorCache(const OperatorCache&);
+  OperatorCache& operator=(const OperatorCache&);
+};
+
+#endif // OPERATOR_CACHE_HPP
@@ -0,0 +1,339 @@
+#include "output_writer.hpp"
+#include "acoustic_wave.hpp"
+#include "compression.hpp"
+#include "parameters.hpp"
+#include "receivers.hpp"
+#include "utilities.hpp"
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace mfem;
+
+
+
+//------------------------------------------------------------------------------
+//
+// Writer thread
+//
+//------------------------------------------------------------------------------
+OutputWriter::OutputWriter(int max_tasks)
+  : _thread()
+  , _mutex()
+  , _has_task()
+  , _has_room()
+  , _finished()
+  , _tasks()
+  , _max_tasks(max_tasks)
+  , _busy(false)
+  , _stop(false)
+  , _error()
+{
+  MFEM_VERIFY(max_tasks > 0, "The queue of the output tasks can't be empty");
+  _thread = thread(&OutputWriter::loop, this);
+}
+
+OutputWriter::~OutputWriter()
+{
+  {
+    unique_lock<mutex> lock(_mutex);
+    _stop = true;
+  }
+  _has_task.notify_one();
+  _thread.join();
+}
+
+void OutputWriter::post(OutputTask *task)
+{
+  {
+    unique_lock<mutex> lock(_mutex);
+    while (_tasks.size() >= _max_tasks && !_error)
+      _has_room.wait(lock);
+    if (_error)
+    {
+      delete task;
+      rethrow_exception(_error);
+    }
+    _tasks.push(task);
+  }
+  _has_task.notify_one();
+}
+
+void OutputWriter::wait(bool rethrow)
+{
+  unique_lock<mutex> lock(_mutex);
+  while (!_tasks.empty() || _busy)
+    _finished.wait(lock);
+  if (rethrow && _error)
+    rethrow_exception(_error);
+}
+
+void OutputWriter::loop()
+{
+  while (true)
+  {
+    OutputTask *task = nullptr;
+    {
+      unique_lock<mutex> lock(_mutex);
+      while (_tasks.empty() && !_stop)
+        _has_task.wait(lock);
+      if (_tasks.empty()) // stop has been requested and nothing is left
+        break;
+      task = _tasks.front();
+      _tasks.pop();
+      _busy = true;
+    }
+    _has_room.notify_one();
+
+    exception_ptr error;
+    try
+    {
+      task->run();
+    }
+    catch (const exception &e)
+    {
+      cerr << "\nOutput task failed: " << e.what() << endl;
+      error = current_exception();
+    }
+    delete task;
+
+    {
+      unique_lock<mutex> lock(_mutex);
+      _busy = false;
+      if (error && !_error)
+        _error = error;
+    }
+    _finished.notify_all();
+    _has_room.notify_all(); // a waiting post() throws the error
+  }
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Compressed seismograms
+//
+//------------------------------------------------------------------------------
+class SeismogramsBlockTask : public OutputTask
+{
+public:
+  SeismogramsBlockTask(ofstream &out, vector<float> &block, int n_steps,
+                       int n_receivers)
+    : _out(out), _block(), _n_steps(n_steps), _n_receivers(n_receivers)
+  {
+    _block.swap(block);
+  }
+
+  void run()
+  {
+    vector<unsigned char> payload;
+    compress_lossless(&_block[0], _n_steps, _n_receivers, payload);
+
+    ChunkHeader header;
+    header.codec     = LOSSLESS_FLOAT;
+    header.text_size = 0;
+    header.n_rows    = _n_steps;
+    header.n_cols    = _n_receivers;
+    header.tolerance = 0.;
+    header.n_bytes   = payload.size();
+    write_chunk(_out, header, "", payload);
+    _out.flush();
+    if (!_out)
+      throw runtime_error("Failed to write compressed seismograms");
+  }
+
+private:
+  ofstream &_out;
+  vector<float> _block;
+  int _n_steps;
+  int _n_receivers;
+};
+
+CompressedSeismograms::CompressedSeismograms(OutputWriter &writer,
+                                             const string &filename,
+                                             int n_receivers)
+  : _writer(writer)
+  , _out(filename.c_str(), ios::binary)
+  , _n_receivers(n_receivers)
+  , _n_steps(0)
+  , _block()
+{
+  MFEM_VERIFY(_out, "File '" + filename + "' can't be opened");
+  write_compressed_file_header(_out);
+  _block.reserve(COMPRESSED_SEISMOGRAMS_BLOCK * _n_receivers);
+}
+
+CompressedSeismograms::~CompressedSeismograms()
+{
+  // a failure of the writer is reported by its wait() in the runner, not from
+  // the destructor
+  try
+  {
+    flush();
+  }
+  catch (const exception&) { }
+  _writer.wait(false); // the stream is used by the writer thread
+}
+
+void CompressedSeismograms::add(const Vector &values)
+{
+  MFEM_ASSERT(values.Size() == _n_receivers, "Sizes mismatch");
+  for (int i = 0; i < values.Size(); ++i)
+    _block.push_back(values(i));
+  if (++_n_steps == COMPRESSED_SEISMOGRAMS_BLOCK)
+    flush();
+}
+
+void CompressedSeismograms::flush()
+{
+  if (_n_steps == 0) return;
+  _writer.post(new SeismogramsBlockTask(_out, _block, _n_steps, _n_receivers));
+  _block.clear();
+  _block.reserve(COMPRESSED_SEISMOGRAMS_BLOCK * _n_receivers);
+  _n_steps = 0;
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Compressed snapshots
+//
+//------------------------------------------------------------------------------
+class SnapshotTask : public OutputTask
+{
+public:
+  SnapshotTask(const string &filename, const string &header,
+               const Vector &U, double tolerance, bool relative)
+    : _filename(filename), _header(header), _values(U.Size())
+    , _tolerance(tolerance), _relative(relative)
+  {
+    for (int i = 0; i < U.Size(); ++i)
+      _values[i] = U(i);
+  }
+
+  void run()
+  {
+    const uint64_t n = _values.size();
+    const double *v = (n > 0 ? &_values[0] : nullptr);
+    const double tol = (_relative ? absolute_tolerance(v, n, _tolerance) :
+                                    _tolerance);
+    vector<unsigned char> payload;
+    compress_lossy(v, n, tol, payload);
+
+    ofstream out(_filename.c_str(), ios::binary);
+    if (!out)
+      throw runtime_error("File '" + _filename + "' can't be opened");
+    write_compressed_file_header(out);
+
+    ChunkHeader header;
+    header.codec     = LOSSY_DOUBLE;
+    header.text_size = _header.size();
+    header.n_rows    = 1;
+    header.n_cols    = n;
+    header.tolerance = tol;
+    header.n_bytes   = payload.size();
+    write_chunk(out, header, _header, payload);
+    out.close();
+    if (!out)
+      throw runtime_error("Failed to write the snapshot '" + _filename + "'");
+  }
+
+private:
+  string _filename;
+  string _header;
+  vector<double> _values;
+  double _tolerance;
+  bool _relative;
+};
+
+CompressedSnapshots::CompressedSnapshots(OutputWriter &writer,
+                                         const string &prefix,
+                                         const FiniteElementSpace &fespace,
+                                         const OutputParameters &output)
+  : _writer(writer)
+  , _prefix(prefix)
+  , _header()
+  , _tolerance(output.snapshot_tolerance)
+  , _relative(output.snapshot_relative_tol)
+{
+  MFEM_VERIFY(_tolerance > 0, "The tolerance for snapshots must be >0");
+
+  ostringstream header;
+  fespace.Save(header);
+  _header = header.str();
+
+  const string meshfile = _prefix + ".mesh";
+  ofstream mesh_out(meshfile.c_str());
+  MFEM_VERIFY(mesh_out, "File '" + meshfile + "' can't be opened");
+  mesh_out.precision(16);
+  fespace.GetMesh()->Print(mesh_out);
+}
+
+void CompressedSnapshots::write(const Vector &U, int cycle)
+{
+  const string filename = _prefix + "_" + d2s(cycle, false, 0, false, 6) +
+                          ".acz";
+  _writer.post(new SnapshotTask(filename, _header, U, _tolerance, _relative));
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Output of seismograms
+//
+//------------------------------------------------------------------------------
+SeismogramsOutput::SeismogramsOutput(const Parameters &p,
+                                     const string &method_name,
+                                     OutputWriter &writer)
+  : param(p)
+  , sets_of_receivers(p.sets_of_receivers)
+  , seisU(nullptr)
+  , compressed_seisU()
+{
+  if (!param.output.compress_seismograms)
+  {
+    open_seismo_outs(seisU, param, method_name);
+    return;
+  }
+
+  for (size_t r = 0; r < sets_of_receivers.size(); ++r)
+  {
+    const ReceiversSet *rec_set = sets_of_receivers[r];
+    const string seismofile = (string)param.output.directory + "/" +
+                              SEISMOGRAMS_DIR + method_name +
+                              param.output.extra_string +
+                              rec_set->description() + "_p.acz";
+    compressed_seisU.push_back(new CompressedSeismograms(writer, seismofile,
+                                                rec_set->n_receivers()));
+  }
+}
+
+SeismogramsOutput::~SeismogramsOutput()
+{
+  delete[] seisU;
+  for (size_t r = 0; r < compressed_seisU.size(); ++r)
+    delete compressed_seisU[r];
+}
+
+void SeismogramsOutput::write(const Mesh &mesh, const GridFunction &U)
+{
+  if (seisU)
+  {
+    output_seismograms(sets_of_receivers, mesh, U, seisU);
+    return;
+  }
+
+  for (size_t r = 0; r < compressed_seisU.size(); ++r)
+  {
+    const ReceiversSet *rec_set = sets_of_receivers[r];
+    const Vector u =
+      compute_function_at_points(mesh, rec_set->n_receivers(),
+                                 rec_set->get_receivers(),
+                                 rec_set->get_cells_containing_receivers(), U);
+    compressed_seisU[r]->add(u);
+  }
+}
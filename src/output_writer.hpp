@@ -0,0 +1,173 @@
+#ifndef OUTPUT_WRITER_HPP
+#define OUTPUT_WRITER_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Parameters;
+class OutputParameters;
+class ReceiversSet;
+
+
+
+/**
+ * A piece of output work (compression and writing of data) executed by the
+ * writer thread.
+ */
+class OutputTask
+{
+public:
+  virtual ~OutputTask() { }
+  virtual void run() = 0;
+};
+
+
+
+/**
+ * A thread executing the output tasks in the order they were posted, so that
+ * the time loop doesn't wait for compression and writing of the data. The
+ * queue of the tasks is bounded: if the writer can't keep up with the time
+ * loop, post() blocks until a task is finished, so the memory taken by the
+ * pending data (every task holds a copy of a snapshot or a block of
+ * seismograms) doesn't grow with the number of time steps. If a task fails,
+ * its exception is kept and rethrown by the following post() and wait(), so a
+ * run with missing output doesn't finish as a successful one.
+ */
+class OutputWriter
+{
+public:
+  /**
+   * @param max_tasks the maximal number of the tasks waiting in the queue
+   */
+  OutputWriter(int max_tasks = 4);
+  ~OutputWriter(); ///< all posted tasks are finished before destruction
+
+  /**
+   * Post a task to be executed. The writer takes the ownership of the task.
+   * If the queue is full, wait until there is room for the task. Throws the
+   * exception of a failed task (and then the task isn't posted).
+   */
+  void post(OutputTask *task);
+
+  /**
+   * Wait until all posted tasks are finished, and throw the exception of a
+   * failed task, if there is one (unless it's called from a destructor,
+   * where rethrow is false).
+   */
+  void wait(bool rethrow = true);
+
+private:
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _has_task;
+  std::condition_variable _has_room;
+  std::condition_variable _finished;
+  std::queue<OutputTask*> _tasks;
+  size_t _max_tasks;
+  bool _busy;
+  bool _stop;
+  std::exception_ptr _error; ///< the exception of the first failed task
+
+  void loop();
+
+  OutputWriter(const OutputWriter&);
+  OutputWriter& operator=(const OutputWriter&);
+};
+
+
+
+/**
+ * Seismograms of one set of receivers collected in blocks of time steps, which
+ * are compressed losslessly and written by the writer thread.
+ */
+class CompressedSeismograms
+{
+public:
+  CompressedSeismograms(OutputWriter &writer, const std::string &filename,
+                        int n_receivers);
+  ~CompressedSeismograms(); ///< the remaining time steps are written as well
+
+  /**
+   * Add the values of one time step.
+   */
+  void add(const mfem::Vector &values);
+
+private:
+  OutputWriter &_writer;
+  std::ofstream _out;
+  int _n_receivers;
+  int _n_steps; ///< number of time steps in the current block
+  std::vector<float> _block;
+
+  void flush();
+
+  CompressedSeismograms(const CompressedSeismograms&);
+  CompressedSeismograms& operator=(const CompressedSeismograms&);
+};
+
+
+
+/**
+ * Snapshots of a wavefield compressed with a given error bound (absolute or
+ * relative to the range of the values of each snapshot) by the writer thread.
+ * Every snapshot is a separate file, which is decompressed to an MFEM grid
+ * function. The mesh is saved once.
+ */
+class CompressedSnapshots
+{
+public:
+  CompressedSnapshots(OutputWriter &writer, const std::string &prefix,
+                      const mfem::FiniteElementSpace &fespace,
+                      const OutputParameters &output);
+  ~CompressedSnapshots() { }
+
+  void write(const mfem::Vector &U, int cycle);
+
+private:
+  OutputWriter &_writer;
+  std::string _prefix;
+  std::string _header; ///< description of the finite element space
+  double _tolerance;
+  bool _relative;
+
+  CompressedSnapshots(const CompressedSnapshots&);
+  CompressedSnapshots& operator=(const CompressedSnapshots&);
+};
+
+
+
+/**
+ * Output of seismograms of all sets of receivers, either as they are, or
+ * compressed (if it's requested by the output parameters). The sets are the
+ * ones of the current shot when the output is created, so the shots advanced
+ * together (with different groups of receivers) are recorded correctly.
+ */
+class SeismogramsOutput
+{
+public:
+  SeismogramsOutput(const Parameters &param, const std::string &method_name,
+                    OutputWriter &writer);
+  ~SeismogramsOutput();
+
+  void write(const mfem::Mesh &mesh, const mfem::GridFunction &U);
+
+private:
+  const Parameters &param;
+  std::vector<ReceiversSet*> sets_of_receivers; ///< receivers of the shot
+  std::ofstream *seisU; ///< uncompressed seismograms
+  std::vector<CompressedSeismograms*> compressed_seisU;
+
+  SeismogramsOutput(const SeismogramsOutput&);
+  SeismogramsOutput& operator=(const SeismogramsOutput&);
+};
+
+#endif // OUTPUT_WRITER_HPP
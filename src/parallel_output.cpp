@@ -0,0 +1,259 @@
+#include "parallel_output.hpp"
+#include "acoustic_wave.hpp"
+#include "parameters.hpp"
+#include "receivers.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(MFEM_USE_MPI)
+
+using namespace std;
+using namespace mfem;
+
+
+
+/**
+ * Create a file type describing the positions of the blocks of values (each
+ * block has the length 'blocklen') of one process inside a record of the
+ * length 'extent' (in the units of 'etype'). The displacements must be sorted.
+ * Since the type is resized to the whole record, consecutive collective writes
+ * go to consecutive records of the file.
+ */
+static MPI_Datatype create_filetype(const vector<int> &displs, int blocklen,
+                                    MPI_Aint extent, MPI_Datatype etype)
+{
+  int *d = (displs.empty() ? nullptr : const_cast<int*>(&displs[0]));
+
+  MPI_Datatype indexed, resized;
+  MPI_Type_create_indexed_block(displs.size(), blocklen, d, etype, &indexed);
+
+  MPI_Aint lb, etype_extent;
+  MPI_Type_get_extent(etype, &lb, &etype_extent);
+  MPI_Type_create_resized(indexed, 0, extent*etype_extent, &resized);
+  MPI_Type_commit(&resized);
+  MPI_Type_free(&indexed);
+
+  return resized;
+}
+
+static void open_shared_file(MPI_Comm comm, const string &filename,
+                             MPI_File &file)
+{
+  const int err = MPI_File_open(comm, const_cast<char*>(filename.c_str()),
+                                MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                MPI_INFO_NULL, &file);
+  MFEM_VERIFY(err == MPI_SUCCESS, "File '" + filename + "' can't be opened");
+  MPI_File_set_size(file, 0); // remove the results of previous runs
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Seismograms
+//
+//------------------------------------------------------------------------------
+ParSeismograms::ParSeismograms(const ReceiversSet &rec_set, ParMesh &par_mesh,
+                               const string &filename)
+  : _rec_set(rec_set)
+  , _par_mesh(par_mesh)
+  , _my_receivers()
+  , _my_cells()
+  , _buffer()
+{
+  MPI_Comm comm = _par_mesh.GetComm();
+  int myid, nproc;
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nproc);
+
+  const int n_rec = _rec_set.n_receivers();
+  const Vertex *receivers = _rec_set.get_receivers();
+
+  // a receiver located on the interface between subdomains is found by several
+  // processes - the one with the smallest rank owns it
+  const bool throw_exception = false;
+  vector<int> cells(n_rec);
+  vector<int> owner(n_rec, nproc), glob_owner(n_rec);
+  for (int p = 0; p < n_rec; ++p)
+  {
+    cells[p] = find_element(_par_mesh, receivers[p], throw_exception);
+    if (cells[p] >= 0)
+      owner[p] = myid;
+  }
+  if (n_rec > 0) // the same on all processes, so all of them skip the call
+    MPI_Allreduce(&owner[0], &glob_owner[0], n_rec, MPI_INT, MPI_MIN, comm);
+
+  for (int p = 0; p < n_rec; ++p)
+  {
+    MFEM_VERIFY(glob_owner[p] < nproc, "Receiver " + d2s(p) + " of the set " +
+                _rec_set.description() + " doesn't belong to the mesh");
+    if (glob_owner[p] == myid)
+    {
+      _my_receivers.push_back(p);
+      _my_cells.push_back(cells[p]);
+    }
+  }
+  _buffer.resize(_my_receivers.size());
+
+  open_shared_file(comm, filename, _file);
+  _filetype = create_filetype(_my_receivers, 1, n_rec, MPI_FLOAT);
+  MPI_File_set_view(_file, 0, MPI_FLOAT, _filetype, const_cast<char*>("native"),
+                    MPI_INFO_NULL);
+}
+
+ParSeismograms::~ParSeismograms()
+{
+  MPI_File_close(&_file);
+  MPI_Type_free(&_filetype);
+}
+
+void ParSeismograms::write(const ParGridFunction &U)
+{
+  const Vertex *receivers = _rec_set.get_receivers();
+  for (size_t i = 0; i < _my_receivers.size(); ++i)
+  {
+    _buffer[i] = compute_function_at_point(_par_mesh,
+                                           receivers[_my_receivers[i]],
+                                           _my_cells[i], U);
+  }
+
+  float *buf = (_buffer.empty() ? nullptr : &_buffer[0]);
+  MPI_Status status;
+  MPI_File_write_all(_file, buf, _buffer.size(), MPI_FLOAT, &status);
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Snapshots
+//
+//------------------------------------------------------------------------------
+ParSnapshots::ParSnapshots(ParFiniteElementSpace &fespace,
+                           const string &filename)
+  : _fespace(fespace)
+  , _n_dofs_per_cell(0)
+  , _my_elements()
+  , _buffer()
+{
+  MPI_Comm comm = _fespace.GetComm();
+
+  int n_elements = _fespace.GetNE();
+  int n_glob_elements = 0;
+  MPI_Allreduce(&n_elements, &n_glob_elements, 1, MPI_INT, MPI_SUM, comm);
+
+  // all cells are supposed to have the same number of dofs
+  int n_dofs = (n_elements > 0 ? _fespace.GetFE(0)->GetDof() *
+                                 _fespace.GetVDim() : 0);
+  MPI_Allreduce(MPI_IN_PLACE, &n_dofs, 1, MPI_INT, MPI_MAX, comm);
+  _n_dofs_per_cell = n_dofs;
+
+  // the attribute of an element is its global cell number (+1)
+  vector<pair<int, int> > cells(n_elements);
+  for (int el = 0; el < n_elements; ++el)
+  {
+    MFEM_VERIFY(_fespace.GetFE(el)->GetDof()*_fespace.GetVDim() == n_dofs,
+                "Snapshots require the same number of dofs in all cells");
+    cells[el] = make_pair(_fespace.GetAttribute(el) - 1, el);
+  }
+  sort(cells.begin(), cells.end());
+
+  vector<int> displs(n_elements);
+  _my_elements.resize(n_elements);
+  for (int i = 0; i < n_elements; ++i)
+  {
+    displs[i] = cells[i].first * n_dofs;
+    _my_elements[i] = cells[i].second;
+  }
+  _buffer.resize(n_elements * n_dofs);
+
+  open_shared_file(comm, filename, _file);
+
+  int myid;
+  MPI_Comm_rank(comm, &myid);
+  if (myid == 0)
+  {
+    const string fec_name = _fespace.FEColl()->Name();
+    SnapshotsFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PAR_SNAPSHOTS_MAGIC, sizeof(header.magic));
+    header.version = PAR_SNAPSHOTS_VERSION;
+    header.n_cells = n_glob_elements;
+    header.n_dofs_per_cell = n_dofs;
+    header.value_size = sizeof(double);
+    MFEM_VERIFY(fec_name.size() < sizeof(header.fe_collection), "The name of "
+                "the finite element collection '" + fec_name + "' is too long");
+    memcpy(header.fe_collection, fec_name.c_str(), fec_name.size());
+
+    MPI_Status status;
+    MPI_File_write_at(_file, 0, &header, sizeof(header), MPI_BYTE, &status);
+  }
+
+  // the records of the snapshots follow the header
+  _filetype = create_filetype(displs, n_dofs, (MPI_Aint)n_glob_elements*n_dofs,
+                              MPI_DOUBLE);
+  MPI_File_set_view(_file, sizeof(SnapshotsFileHeader), MPI_DOUBLE, _filetype,
+                    const_cast<char*>("native"), MPI_INFO_NULL);
+}
+
+ParSnapshots::~ParSnapshots()
+{
+  MPI_File_close(&_file);
+  MPI_Type_free(&_filetype);
+}
+
+void ParSnapshots::write(const ParGridFunction &U)
+{
+  Array<int> vdofs;
+  Vector values;
+  for (size_t i = 0, k = 0; i < _my_elements.size(); ++i)
+  {
+    _fespace.GetElementVDofs(_my_elements[i], vdofs);
+    U.GetSubVector(vdofs, values);
+    for (int j = 0; j < values.Size(); ++j, ++k)
+      _buffer[k] = values[j];
+  }
+
+  double *buf = (_buffer.empty() ? nullptr : &_buffer[0]);
+  MPI_Status status;
+  MPI_File_write_all(_file, buf, _buffer.size(), MPI_DOUBLE, &status);
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Auxiliary functions
+//
+//------------------------------------------------------------------------------
+void open_par_seismo_outs(vector<ParSeismograms*> &seisU,
+                          const Parameters &param, ParMesh &par_mesh,
+                          const string &method_name)
+{
+  const int n_rec_sets = param.sets_of_receivers.size();
+
+  seisU.resize(n_rec_sets);
+
+  for (int r = 0; r < n_rec_sets; ++r)
+  {
+    const ReceiversSet *rec_set = param.sets_of_receivers[r];
+    const string desc = rec_set->description();
+
+    string seismofile = (string)param.output.directory + "/" + SEISMOGRAMS_DIR +
+                        method_name + param.output.extra_string + desc + "_p.bin";
+    seisU[r] = new ParSeismograms(*rec_set, par_mesh, seismofile);
+  } // loop for sets of receivers
+}
+
+
+
+void output_par_seismograms(const ParGridFunction &U,
+                            vector<ParSeismograms*> &seisU)
+{
+  for (size_t rec = 0; rec < seisU.size(); ++rec)
+    seisU[rec]->write(U);
+}
+
+#endif // MFEM_USE_MPI
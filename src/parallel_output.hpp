@@ -0,0 +1,121 @@
+#ifndef PARALLEL_OUTPUT_HPP
+#define PARALLEL_OUTPUT_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(MFEM_USE_MPI)
+
+class Parameters;
+class ReceiversSet;
+
+
+
+/**
+ * Seismograms of one set of receivers written by all processes into one shared
+ * file. Every process samples only the receivers located in its own part of
+ * the parallel mesh, and all processes write their values with one collective
+ * MPI-IO call per time step at the positions these receivers have in the set.
+ * The layout of the file is the same as in the serial case: for every recorded
+ * time step there are n_receivers float values.
+ */
+class ParSeismograms
+{
+public:
+  ParSeismograms(const ReceiversSet &rec_set, mfem::ParMesh &par_mesh,
+                 const std::string &filename);
+  ~ParSeismograms();
+
+  /**
+   * Record the values of U at the receivers owned by this process (collective).
+   */
+  void write(const mfem::ParGridFunction &U);
+
+  int n_my_receivers() const { return _my_receivers.size(); }
+
+private:
+  const ReceiversSet &_rec_set;
+  mfem::ParMesh &_par_mesh;
+
+  std::vector<int> _my_receivers; ///< receivers owned by this process
+  std::vector<int> _my_cells;     ///< local cells containing these receivers
+  std::vector<float> _buffer;     ///< values of one time step
+
+  MPI_File _file;
+  MPI_Datatype _filetype; ///< positions of my receivers in one time step
+
+  ParSeismograms(const ParSeismograms&);
+  ParSeismograms& operator=(const ParSeismograms&);
+};
+
+
+
+/**
+ * The header of a file of parallel snapshots describing the records following
+ * it, so that the file can be read without the parameters of the run.
+ */
+struct SnapshotsFileHeader
+{
+  char     magic[4];        ///< PAR_SNAPSHOTS_MAGIC
+  uint32_t version;         ///< PAR_SNAPSHOTS_VERSION
+  uint64_t n_cells;         ///< number of global cells
+  uint32_t n_dofs_per_cell; ///< number of values of every cell
+  uint32_t value_size;      ///< size of a value in bytes (double)
+  char     fe_collection[48]; ///< name of the finite element collection
+};
+
+const char PAR_SNAPSHOTS_MAGIC[] = "ACWS";
+const uint32_t PAR_SNAPSHOTS_VERSION = 1;
+
+/**
+ * Snapshots of a wavefield written by all processes into one shared file. The
+ * file starts with SnapshotsFileHeader. The values are stored cell-by-cell in
+ * the order of global cell numbers (the attributes of the elements), and the
+ * values of a cell are in the order of its element vdofs, so the file doesn't
+ * depend on the partitioning of the mesh. Every snapshot is a record of
+ * n_cells*n_dofs_per_cell doubles appended to the file, so the number of
+ * snapshots follows from the size of the file.
+ */
+class ParSnapshots
+{
+public:
+  ParSnapshots(mfem::ParFiniteElementSpace &fespace,
+               const std::string &filename);
+  ~ParSnapshots();
+
+  /**
+   * Append a snapshot of U to the file (collective).
+   */
+  void write(const mfem::ParGridFunction &U);
+
+private:
+  mfem::ParFiniteElementSpace &_fespace;
+
+  int _n_dofs_per_cell;
+  std::vector<int> _my_elements; ///< local elements sorted by global cell number
+  std::vector<double> _buffer;   ///< values of my cells
+
+  MPI_File _file;
+  MPI_Datatype _filetype; ///< positions of my cells in one snapshot
+
+  ParSnapshots(const ParSnapshots&);
+  ParSnapshots& operator=(const ParSnapshots&);
+};
+
+
+
+void open_par_seismo_outs(std::vector<ParSeismograms*> &seisU,
+                          const Parameters &param,
+                          mfem::ParMesh &par_mesh,
+                          const std::string &method_name);
+
+void output_par_seismograms(const mfem::ParGridFunction &U,
+                            std::vector<ParSeismograms*> &seisU);
+
+#endif // MFEM_USE_MPI
+
+#endif // PARALLEL_OUTPUT_HPP
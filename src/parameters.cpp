@@ -1,5 +1,8 @@
+#include "distributed_mesh.hpp"
 #include "parameters.hpp"
+#include "partitioning.hpp"
 #include "receivers.hpp"
+#include "shared_memory.hpp"
 #include "utilities.hpp"
 
 #include <cfloat>
@@ -23,6 +26,11 @@ GridParameters::GridParameters()
   , ny(-1)
   , nz(-1)
   , meshfile(DEFAULT_FILE_NAME)
+  , meshprefix(DEFAULT_FILE_NAME)
+  , distributed(false)
+  , check_distributed(false)
+  , partitioning("auto")
+  , damp_cost(1.0)
 { }
 
 void GridParameters::AddOptions(OptionsParser& args)
@@ -34,11 +42,40 @@ void GridParameters::AddOptions(OptionsParser& args)
   args.AddOption(&ny, "-ny", "--numbery", "Number of elements in y-direction");
   args.AddOption(&nz, "-nz", "--numberz", "Number of elements in z-direction");
   args.AddOption(&meshfile, "-meshfile", "--mesh-file", "Name of file with mesh");
+  args.AddOption(&meshprefix, "-meshprefix", "--mesh-prefix",
+                 "Prefix of files with a pre-partitioned parallel mesh");
+  args.AddOption(&distributed, "-distmesh", "--distributed-mesh",
+                 "-no-distmesh", "--no-distributed-mesh",
+                 "Create the parallel Cartesian mesh without a serial one");
+  args.AddOption(&check_distributed, "-distmesh-check",
+                 "--check-distributed-mesh", "-no-distmesh-check",
+                 "--no-check-distributed-mesh",
+                 "Compare the distributed mesh with the one made from the "
+                 "serial mesh (builds the serial mesh, for small grids)");
+  args.AddOption(&partitioning, "-partition", "--partitioning",
+                 "Partitioning of the mesh: auto, metis, cartesian, weighted");
+  args.AddOption(&damp_cost, "-damp-cost", "--damping-cost",
+                 "Additional relative cost of cells in damping layers");
 }
 
 void GridParameters::check_parameters(int dim) const
 {
-  if (!strcmp(meshfile, DEFAULT_FILE_NAME))
+  MFEM_VERIFY(!distributed || !strcmp(meshfile, DEFAULT_FILE_NAME),
+              "A distributed mesh can be created for a Cartesian grid only");
+  MFEM_VERIFY(!check_distributed || distributed, "The check of the "
+              "distributed mesh needs the distributed mesh (-distmesh)");
+  MFEM_VERIFY(!strcmp(partitioning, "auto") ||
+              !strcmp(partitioning, "metis") ||
+              !strcmp(partitioning, "cartesian") ||
+              !strcmp(partitioning, "weighted"), "Unknown partitioning: " +
+              string(partitioning));
+  MFEM_VERIFY(strcmp(partitioning, "cartesian") ||
+              !strcmp(meshfile, DEFAULT_FILE_NAME), "Cartesian partitioning "
+              "is available for generated grids only");
+  MFEM_VERIFY(damp_cost >= 0, "Cost of damping cells (" + d2s(damp_cost) +
+              ") must be >=0");
+  if (!strcmp(meshfile, DEFAULT_FILE_NAME) &&
+      !strcmp(meshprefix, DEFAULT_FILE_NAME))
   {
     if (dim == 2)
     {
@@ -111,14 +148,25 @@ MediaPropertiesParameters::MediaPropertiesParameters()
   , vpfile(DEFAULT_FILE_NAME)
   , rho_array(nullptr)
   , vp_array(nullptr)
+  , n_cells(0)
   , min_rho(DBL_MAX), max_rho(DBL_MIN)
   , min_vp (DBL_MAX), max_vp (DBL_MIN)
+  , rho_file(nullptr)
+  , vp_file(nullptr)
+  , rho_values(nullptr)
+  , vp_values(nullptr)
+#if defined(MFEM_USE_MPI)
+  , rho_shared(nullptr)
+  , vp_shared(nullptr)
+#endif
 { }
 
 MediaPropertiesParameters::~MediaPropertiesParameters()
 {
-  delete[] rho_array;
-  delete[] vp_array;
+  delete rho_file;
+  delete vp_file;
+  delete[] rho_values;
+  delete[] vp_values;
 }
 
 void MediaPropertiesParameters::AddOptions(OptionsParser& args)
@@ -136,31 +184,121 @@ void MediaPropertiesParameters::check_parameters() const
 
 void MediaPropertiesParameters::init(int n_elements)
 {
-  rho_array = new double[n_elements];
-  vp_array = new double[n_elements];
+  n_cells = n_elements;
+  init_array(rhofile, rho, n_elements, rho_file, rho_values, rho_array,
+             min_rho, max_rho);
+  init_array(vpfile, vp, n_elements, vp_file, vp_values, vp_array,
+             min_vp, max_vp);
+}
 
-  if (!strcmp(rhofile, DEFAULT_FILE_NAME))
+void MediaPropertiesParameters::init_array(const char *filename, double value,
+                                           int n_elements, MappedFile* &file,
+                                           double* &values,
+                                           const double* &array,
+                                           double &min_val, double &max_val)
+{
+  if (!strcmp(filename, DEFAULT_FILE_NAME))
   {
-    for (int i = 0; i < n_elements; ++i) rho_array[i] = rho;
-    min_rho = max_rho = rho;
+    values = new double[n_elements];
+    for (int i = 0; i < n_elements; ++i) values[i] = value;
+    array = values;
+    min_val = max_val = value;
+    return;
+  }
+
+  file = new MappedFile(filename);
+  const int size_value = get_value_size(filename, file->size(), n_elements);
+  if (size_value == sizeof(double))
+  {
+    array = static_cast<const double*>(file->data()); // no copy
   }
   else
   {
-    read_binary(rhofile, n_elements, rho_array);
-    get_minmax(rho_array, n_elements, min_rho, max_rho);
+    // a simple loop that the compiler vectorizes
+    const float *in = static_cast<const float*>(file->data());
+    values = new double[n_elements];
+    for (int i = 0; i < n_elements; ++i)
+      values[i] = in[i];
+    array = values;
+    delete file; // the float values aren't needed anymore
+    file = nullptr;
   }
+  get_minmax(array, n_elements, min_val, max_val);
+}
 
-  if (!strcmp(vpfile, DEFAULT_FILE_NAME))
+#if defined(MFEM_USE_MPI)
+void MediaPropertiesParameters::init(MPI_Comm comm, int n_glob_cells,
+                                     const vector<int> &cells)
+{
+  n_cells = cells.size();
+  rho_values = new double[n_cells];
+  vp_values = new double[n_cells];
+  read_cells(comm, n_glob_cells, cells, rho_values, vp_values);
+  rho_array = rho_values;
+  vp_array = vp_values;
+
+  double minmax[] = { DBL_MAX, DBL_MAX, DBL_MAX, DBL_MAX }; // -max is min
+  for (int i = 0; i < n_cells; ++i)
   {
-    for (int i = 0; i < n_elements; ++i) vp_array[i] = vp;
-    min_vp = max_vp = vp;
+    minmax[0] = min(minmax[0], rho_array[i]);
+    minmax[1] = min(minmax[1], -rho_array[i]);
+    minmax[2] = min(minmax[2], vp_array[i]);
+    minmax[3] = min(minmax[3], -vp_array[i]);
   }
-  else
+  MPI_Allreduce(MPI_IN_PLACE, minmax, 4, MPI_DOUBLE, MPI_MIN, comm);
+  min_rho = minmax[0]; max_rho = -minmax[1];
+  min_vp  = minmax[2]; max_vp  = -minmax[3];
+}
+
+void MediaPropertiesParameters::init(const NodeCommunicators &comms,
+                                     int n_glob_cells)
+{
+  n_cells = n_glob_cells;
+  rho_shared = new NodeSharedArray<double>(comms, n_cells);
+  vp_shared = new NodeSharedArray<double>(comms, n_cells);
+  if (comms.is_leader())
   {
-    read_binary(vpfile, n_elements, vp_array);
-    get_minmax(vp_array, n_elements, min_vp, max_vp);
+    vector<int> cells(n_cells);
+    for (int i = 0; i < n_cells; ++i)
+      cells[i] = i;
+    read_cells(comms.leaders_comm(), n_glob_cells, cells, rho_shared->data(),
+               vp_shared->data());
   }
+  rho_shared->synchronize();
+  vp_shared->synchronize();
+  rho_array = rho_shared->data();
+  vp_array = vp_shared->data();
+
+  get_minmax(rho_array, n_cells, min_rho, max_rho);
+  get_minmax(vp_array, n_cells, min_vp, max_vp);
+}
+
+void MediaPropertiesParameters::free_shared()
+{
+  delete rho_shared;
+  delete vp_shared;
+  rho_shared = vp_shared = nullptr;
+  rho_array = vp_array = nullptr;
+}
+
+void MediaPropertiesParameters::read_cells(MPI_Comm comm, int n_glob_cells,
+                                           const vector<int> &cells,
+                                           double *rho_values,
+                                           double *vp_values) const
+{
+  const int n = cells.size();
+
+  if (!strcmp(rhofile, DEFAULT_FILE_NAME))
+    for (int i = 0; i < n; ++i) rho_values[i] = rho;
+  else
+    read_binary(comm, rhofile, n_glob_cells, cells, rho_values);
+
+  if (!strcmp(vpfile, DEFAULT_FILE_NAME))
+    for (int i = 0; i < n; ++i) vp_values[i] = vp;
+  else
+    read_binary(comm, vpfile, n_glob_cells, cells, vp_values);
 }
+#endif // MFEM_USE_MPI
 
 
 
@@ -178,22 +316,25 @@ BoundaryConditionsParameters::BoundaryConditionsParameters()
   , back  ("abs")
   , damp_layer(0.1)
   , damp_power(3.0)
+  , pml(false)
+  , pml_reflection(1e-3)
 { }
 
 void BoundaryConditionsParameters::AddOptions(OptionsParser& args)
 {
-  // Left, right, front and back surfaces are usually absorbing, so we
-  // don't need to set up program options for them, but this can be changed if
-  // desired.
-//  args.AddOption(&left, "-left", "--left-surface", "Left surface: abs or free");
-//  args.AddOption(&right, "-right", "--right-surface", "Right surface: abs or free");
-//  args.AddOption(&front, "-front", "--front-surface", "Front surface: abs or free");
-//  args.AddOption(&back, "-back", "--back-surface", "Back surface: abs or free");
-
+  // the absorbing surfaces have the first order absorbing boundary condition
+  // (SEM including ensembles, FEM, DG, DGVP; not GMsFEM), and the PML if it's
+  // on
+  args.AddOption(&left, "-left", "--left-surface", "Left surface: abs or free");
+  args.AddOption(&right, "-right", "--right-surface", "Right surface: abs or free");
+  args.AddOption(&front, "-front", "--front-surface", "Front surface: abs or free");
+  args.AddOption(&back, "-back", "--back-surface", "Back surface: abs or free");
   args.AddOption(&bottom, "-bottom", "--bottom-surface", "Bottom surface: abs or free");
   args.AddOption(&top, "-top", "--top-surface", "Top surface: abs or free");
   args.AddOption(&damp_layer, "-dlayer", "--damp-layer", "Thickness of damping layer, m");
   args.AddOption(&damp_power, "-dpower", "--damp-power", "Power in damping coefficient functions");
+  args.AddOption(&pml, "-pml", "--pml", "-no-pml", "--no-pml", "Perfectly matched layers (SEM, FEM) of the thickness of the damping layer");
+  args.AddOption(&pml_reflection, "-pml-R", "--pml-reflection", "Theoretical reflection coefficient of the PML");
 }
 
 void BoundaryConditionsParameters::check_parameters() const
@@ -210,10 +351,19 @@ void BoundaryConditionsParameters::check_parameters() const
               "condition on the front surface: " + string(front));
   MFEM_VERIFY(!strcmp(back, "abs") || !strcmp(back, "free"), "Unknown boundary "
               "condition on the back surface: " + string(back));
-  if (!strcmp(left, "abs") || !strcmp(right, "abs") || !strcmp(bottom, "abs") ||
-      !strcmp(top, "abs") || !strcmp(front, "abs") || !strcmp(back, "abs"))
+  if (absorbing())
     MFEM_VERIFY(damp_layer > 0, "Damping layer (" + d2s(damp_layer) +
                 ") must be >0");
+  if (pml)
+    MFEM_VERIFY(pml_reflection > 0 && pml_reflection < 1, "PML reflection "
+                "coefficient (" + d2s(pml_reflection) + ") must be in (0, 1)");
+}
+
+bool BoundaryConditionsParameters::absorbing(int dimension) const
+{
+  return !strcmp(left, "abs") || !strcmp(right, "abs") ||
+         !strcmp(bottom, "abs") || !strcmp(top, "abs") ||
+         (dimension == 3 && (!strcmp(front, "abs") || !strcmp(back, "abs")));
 }
 
 
@@ -228,21 +378,50 @@ MethodParameters::MethodParameters()
   , name("sem")
   , dg_sigma(-1.) // SIPDG
   , dg_kappa(10.)
+  , dg_matrix_free(false)
+  , dg_matrix_free_check(false)
+  , dg_gll(false)
   , gms_Nx(1), gms_Ny(1), gms_Nz(1)
   , gms_nb(1), gms_ni(1)
+  , gms_threads(1)
+  , gms_randomized(false)
+  , gms_oversampling(5)
+  , gms_power_iterations(3)
+  , gms_randomized_check(false)
+  , mass_solver("auto")
+  , mass_solver_memory(2048.)
 { }
 
 void MethodParameters::AddOptions(OptionsParser& args)
 {
   args.AddOption(&order, "-o", "--order", "Finite element order (polynomial degree)");
-  args.AddOption(&name, "-method", "--method", "Finite elements (fem), spectral elements (sem), discontinuous Galerkin (dg)");
+  args.AddOption(&name, "-method", "--method", "Finite elements (fem), spectral elements (sem), discontinuous Galerkin (dg), velocity-pressure DG (dgvp)");
   args.AddOption(&dg_sigma, "-dg-sigma", "--dg-sigma", "Sigma in the DG method");
   args.AddOption(&dg_kappa, "-dg-kappa", "--dg-kappa", "Kappa in the DG method");
+  args.AddOption(&dg_matrix_free, "-dg-mf", "--dg-matrix-free",
+                 "-no-dg-mf", "--no-dg-matrix-free",
+                 "Matrix-free DG stiffness operator (quadrilaterals, hexahedra)");
+  args.AddOption(&dg_matrix_free_check, "-dg-mf-check", "--dg-matrix-free-check",
+                 "-no-dg-mf-check", "--no-dg-matrix-free-check",
+                 "Compare the matrix-free DG operator with the assembled one");
+  args.AddOption(&dg_gll, "-dg-gll", "--dg-gll", "-no-dg-gll", "--no-dg-gll",
+                 "GLL nodal basis and quadrature in DG (diagonal mass matrix)");
   args.AddOption(&gms_Nx, "-gms-Nx", "--gms-Nx", "Number of coarse cells in x-direction");
   args.AddOption(&gms_Ny, "-gms-Ny", "--gms-Ny", "Number of coarse cells in y-direction");
   args.AddOption(&gms_Nz, "-gms-Nz", "--gms-Nz", "Number of coarse cells in z-direction");
   args.AddOption(&gms_nb, "-gms-nb", "--gms-nb", "Number of boundary basis functions");
   args.AddOption(&gms_ni, "-gms-ni", "--gms-ni", "Number of interior basis functions");
+  args.AddOption(&gms_threads, "-gms-threads", "--gms-threads", "Number of threads solving for the snapshots (0 - all cores)");
+  args.AddOption(&gms_randomized, "-gms-rand", "--gms-randomized",
+                 "-no-gms-rand", "--no-gms-randomized",
+                 "Randomized snapshot space: gms_nb + gms_oversampling random boundary values (CG basis)");
+  args.AddOption(&gms_oversampling, "-gms-os", "--gms-oversampling", "Oversampling of the randomized snapshot space");
+  args.AddOption(&gms_power_iterations, "-gms-pi", "--gms-power-iterations", "Subspace iterations of the randomized snapshot space");
+  args.AddOption(&gms_randomized_check, "-gms-rand-check", "--gms-randomized-check",
+                 "-no-gms-rand-check", "--no-gms-randomized-check",
+                 "Compare the randomized snapshot space with the full one (time, eigenvalues)");
+  args.AddOption(&mass_solver, "-mass-solver", "--mass-solver", "Solver of the mass systems (FEM, DG, GMsFEM): auto, cholesky, chebyshev, pcg");
+  args.AddOption(&mass_solver_memory, "-mass-solver-mem", "--mass-solver-memory", "Max memory (MB) of the Cholesky factor for the auto mass solver");
 }
 
 void MethodParameters::check_parameters() const
@@ -251,8 +430,22 @@ void MethodParameters::check_parameters() const
   MFEM_VERIFY(!strcmp(name, "FEM") || !strcmp(name, "fem") ||
               !strcmp(name, "SEM") || !strcmp(name, "sem") ||
               !strcmp(name, "DG")  || !strcmp(name, "dg")  ||
+              !strcmp(name, "DGVP") || !strcmp(name, "dgvp") ||
               !strcmp(name, "GMsFEM") || !strcmp(name, "gmsfem"),
               "Unknown method: " + string(name));
+  MFEM_VERIFY(!strcmp(mass_solver, "auto") ||
+              !strcmp(mass_solver, "cholesky") ||
+              !strcmp(mass_solver, "chebyshev") ||
+              !strcmp(mass_solver, "pcg"),
+              "Unknown mass solver: " + string(mass_solver));
+  MFEM_VERIFY(mass_solver_memory >= 0, "mass_solver_memory (" +
+              d2s(mass_solver_memory) + ") must be >=0");
+  MFEM_VERIFY(gms_threads >= 0, "gms_threads (" + d2s(gms_threads) + ") "
+              "must be >=0");
+  MFEM_VERIFY(gms_oversampling >= 0, "gms_oversampling (" +
+              d2s(gms_oversampling) + ") must be >=0");
+  MFEM_VERIFY(gms_power_iterations >= 0, "gms_power_iterations (" +
+              d2s(gms_power_iterations) + ") must be >=0");
 }
 
 
@@ -270,6 +463,10 @@ OutputParameters::OutputParameters()
   , view_boundary_basis(false)
   , view_interior_basis(false)
   , view_dg_basis(false)
+  , compress_seismograms(false)
+  , snapshot_tolerance(0.)
+  , snapshot_relative_tol(false)
+  , cache_directory(DEFAULT_FILE_NAME)
 { }
 
 void OutputParameters::AddOptions(OptionsParser& args)
@@ -291,11 +488,21 @@ void OutputParameters::AddOptions(OptionsParser& args)
   args.AddOption(&view_dg_basis, "-viewdgbasis", "--view-dg-basis",
                  "-no-viewdgbasis", "--no-view-dg-basis",
                  "Visualize DG multiscale basis (via GLVis)");
+  args.AddOption(&compress_seismograms, "-compress-seis", "--compress-seismograms",
+                 "-no-compress-seis", "--no-compress-seismograms",
+                 "Compress seismograms (losslessly)");
+  args.AddOption(&snapshot_tolerance, "-snap-tol", "--snapshot-tolerance",
+                 "Error bound of lossy compression of snapshots (0 - no compression)");
+  args.AddOption(&snapshot_relative_tol, "-snap-reltol", "--snapshot-relative-tolerance",
+                 "-snap-abstol", "--snapshot-absolute-tolerance",
+                 "Error bound of snapshots is relative to the range of values");
+  args.AddOption(&cache_directory, "-cache-dir", "--cache-directory",
+                 "Directory of the cache of assembled operators");
 }
 
 void OutputParameters::check_parameters() const
 {
-  // nothing to check
+  MFEM_VERIFY(snapshot_tolerance >= 0, "Tolerance for snapshots must be >=0");
 }
 
 
@@ -320,15 +527,36 @@ Parameters::Parameters()
   , step_snap(1000)
   , step_seis(1)
   , receivers_file(DEFAULT_FILE_NAME)
+  , shots_file(DEFAULT_FILE_NAME)
+  , shots_block(1)
+  , active_region(false)
+  , group_size(0)
+  , ensemble_file(DEFAULT_FILE_NAME)
+  , ensemble()
+  , ensemble_threads(1)
+#if defined(MFEM_USE_MPI)
+  , comm(MPI_COMM_WORLD)
+  , node_comms(nullptr)
+#endif
 { }
 
 Parameters::~Parameters()
 {
-  for (size_t i = 0; i < sets_of_receivers.size(); ++i)
-    delete sets_of_receivers[i];
+  // sets_of_receivers refers to one of the groups
+  for (size_t g = 0; g < receivers_groups.size(); ++g)
+    for (size_t i = 0; i < receivers_groups[g].size(); ++i)
+      delete receivers_groups[g][i];
 
   delete mesh;
   delete par_mesh;
+
+#if defined(MFEM_USE_MPI)
+  // the receivers and the media may be in the windows of the node
+  media.free_shared();
+  delete node_comms;
+  if (comm != MPI_COMM_WORLD)
+    MPI_Comm_free(&comm);
+#endif
 }
 
 void Parameters::init(int argc, char **argv)
@@ -354,6 +582,12 @@ void Parameters::init(int argc, char **argv)
   args.AddOption(&step_snap, "-step-snap", "--step-snapshot", "Time step for outputting snapshots");
   args.AddOption(&step_seis, "-step-seis", "--step-seismogram", "Time step for outputting seismograms");
   args.AddOption(&receivers_file, "-rec-file", "--receivers-file", "File with information about receivers");
+  args.AddOption(&shots_file, "-shots", "--shots-file", "Table of shots: source locations, wavelets and receivers");
+  args.AddOption(&shots_block, "-shots-block", "--shots-block", "Number of shots advanced together (SEM)");
+  args.AddOption(&active_region, "-active", "--active-region", "-no-active", "--no-active-region", "Update only the region reached by the waves from the source (SEM)");
+  args.AddOption(&group_size, "-group-size", "--group-size", "Number of processes running one shot (0 - all; >1 - FEM, GMsFEM only)");
+  args.AddOption(&ensemble_file, "-ensemble", "--ensemble-file", "Table of media realizations: rhofile vpfile (SEM)");
+  args.AddOption(&ensemble_threads, "-ensemble-threads", "--ensemble-threads", "Number of realizations advanced concurrently (0 - all cores)");
 
   output.AddOptions(args);
 
@@ -369,83 +603,208 @@ void Parameters::init(int argc, char **argv)
 
   check_parameters();
 
+  base_extra_string = output.extra_string;
+  read_shots();
+  read_ensemble();
+
+#if defined(MFEM_USE_MPI)
+  if (group_size > 0 && group_size < nproc)
+  {
+    // the processes are split into groups, and every group runs its own shots
+    // on its own copy of the mesh
+    MFEM_VERIFY(nproc % group_size == 0, "The number of processes (" +
+                d2s(nproc) + ") must be a multiple of the group size (" +
+                d2s(group_size) + ")");
+    if (myid == 0)
+      cout << "Shots are run by " << nproc / group_size << " groups of "
+           << group_size << " processes" << endl;
+    MPI_Comm_split(MPI_COMM_WORLD, myid / group_size, myid, &comm);
+    MPI_Comm_size(comm, &nproc); // the mesh is partitioned within a group
+  }
+#endif
 
   if (myid == 0)
     cout << "Mesh initialization..." << endl;
-  const int generate_edges = 1;
-  if (strcmp(grid.meshfile, DEFAULT_FILE_NAME))
+  int n_glob_elements = 0;
+#if defined(MFEM_USE_MPI)
+  // the parallel FEM doesn't need the serial mesh, so by default a generated
+  // grid is created by blocks without it, and a mesh file is read into the
+  // serial mesh which is deleted after the partitioning
+  const bool parallel_fem = (!strcmp(method.name, "fem") ||
+                             !strcmp(method.name, "FEM")) && nproc > 1;
+  const bool generated = !strcmp(grid.meshfile, DEFAULT_FILE_NAME) &&
+                         !strcmp(grid.meshprefix, DEFAULT_FILE_NAME);
+  if (grid.distributed || strcmp(grid.meshprefix, DEFAULT_FILE_NAME) ||
+      (parallel_fem && generated && !strcmp(grid.partitioning, "auto")))
   {
-    if (myid == 0)
-      cout << "  Reading mesh from " << grid.meshfile << endl;
-    ifstream in(grid.meshfile);
-    MFEM_VERIFY(in, "File can't be opened");
-    const int refine = 0;
-    mesh = new Mesh(in, generate_edges, refine);
-    double xmin = DBL_MAX, xmax = DBL_MIN;
-    double ymin = DBL_MAX, ymax = DBL_MIN;
-    double zmin = DBL_MAX, zmax = DBL_MIN;
-    for (int i = 0; i < mesh->GetNV(); ++i)
+    // there is no serial mesh: every process creates or reads its own part
+    if (strcmp(grid.meshprefix, DEFAULT_FILE_NAME))
     {
-      const double* v = mesh->GetVertex(i);
-      xmin = std::min(xmin, v[0]);
-      xmax = std::max(xmax, v[0]);
-      ymin = std::min(ymin, v[1]);
-      ymax = std::max(ymax, v[1]);
-      zmin = std::min(zmin, v[2]);
-      zmax = std::max(zmax, v[2]);
+      if (myid == 0)
+        cout << "  Reading parallel mesh from " << grid.meshprefix << ".*"
+             << endl;
+      par_mesh = read_par_mesh(comm, grid.meshprefix);
+
+      double bbox[] = { DBL_MAX, DBL_MAX, DBL_MAX,     // min coordinates
+                        DBL_MAX, DBL_MAX, DBL_MAX };   // -max coordinates
+      for (int i = 0; i < par_mesh->GetNV(); ++i)
+      {
+        const double* v = par_mesh->GetVertex(i);
+        for (int d = 0; d < par_mesh->SpaceDimension(); ++d)
+        {
+          bbox[d]   = std::min(bbox[d], v[d]);
+          bbox[3+d] = std::min(bbox[3+d], -v[d]);
+        }
+      }
+      MPI_Allreduce(MPI_IN_PLACE, bbox, 6, MPI_DOUBLE, MPI_MIN, comm);
+      grid.sx = -bbox[3] - bbox[0];
+      grid.sy = -bbox[4] - bbox[1];
+      grid.sz = (dimension == 3 ? -bbox[5] - bbox[2] : 0.);
     }
-    if (myid == 0)
+    else
     {
-      cout << "min coord: x " << xmin << " y " << ymin << " z " << zmin
-           << "\nmax coord: x " << xmax << " y " << ymax << " z " << zmax
-           << "\n";
+      if (myid == 0)
+        cout << "  Generating distributed Cartesian mesh" << endl;
+      par_mesh = create_cartesian_par_mesh(comm, dimension, grid);
+      if (grid.check_distributed)
+        check_cartesian_par_mesh(*par_mesh, dimension, grid, cout);
     }
-    grid.sx = xmax - xmin;
-    grid.sy = ymax - ymin;
-    grid.sz = zmax - zmin;
+    MFEM_VERIFY(par_mesh->Dimension() == dimension, "Unexpected mesh dimension");
+    int n_my_elements = par_mesh->GetNE();
+    MPI_Allreduce(&n_my_elements, &n_glob_elements, 1, MPI_INT, MPI_SUM,
+                  comm);
+    if (myid == 0)
+      cout << "Mesh initialization is done" << endl;
   }
   else
+#endif
   {
-    if (myid == 0)
-      cout << "  Generating mesh" << endl;
-    if (dimension == 2)
+    const int generate_edges = 1;
+    if (strcmp(grid.meshfile, DEFAULT_FILE_NAME))
     {
-      mesh = new Mesh(grid.nx, grid.ny, Element::QUADRILATERAL,
-                      generate_edges, grid.sx, grid.sy);
+      if (myid == 0)
+        cout << "  Reading mesh from " << grid.meshfile << endl;
+      ifstream in(grid.meshfile);
+      MFEM_VERIFY(in, "File can't be opened");
+      const int refine = 0;
+      mesh = new Mesh(in, generate_edges, refine);
+      double xmin = DBL_MAX, xmax = DBL_MIN;
+      double ymin = DBL_MAX, ymax = DBL_MIN;
+      double zmin = DBL_MAX, zmax = DBL_MIN;
+      for (int i = 0; i < mesh->GetNV(); ++i)
+      {
+        const double* v = mesh->GetVertex(i);
+        xmin = std::min(xmin, v[0]);
+        xmax = std::max(xmax, v[0]);
+        ymin = std::min(ymin, v[1]);
+        ymax = std::max(ymax, v[1]);
+        zmin = std::min(zmin, v[2]);
+        zmax = std::max(zmax, v[2]);
+      }
+      if (myid == 0)
+      {
+        cout << "min coord: x " << xmin << " y " << ymin << " z " << zmin
+             << "\nmax coord: x " << xmax << " y " << ymax << " z " << zmax
+             << "\n";
+      }
+      grid.sx = xmax - xmin;
+      grid.sy = ymax - ymin;
+      grid.sz = zmax - zmin;
     }
     else
     {
-      mesh = new Mesh(grid.nx, grid.ny, grid.nz, Element::HEXAHEDRON,
-                      generate_edges, grid.sx, grid.sy, grid.sz);
+      if (myid == 0)
+        cout << "  Generating mesh" << endl;
+      if (dimension == 2)
+      {
+        mesh = new Mesh(grid.nx, grid.ny, Element::QUADRILATERAL,
+                        generate_edges, grid.sx, grid.sy);
+      }
+      else
+      {
+        mesh = new Mesh(grid.nx, grid.ny, grid.nz, Element::HEXAHEDRON,
+                        generate_edges, grid.sx, grid.sy, grid.sz);
+      }
     }
-  }
-
-  MFEM_VERIFY(mesh->Dimension() == dimension, "Unexpected mesh dimension");
-  for (int el = 0; el < mesh->GetNE(); ++el)
-    mesh->GetElement(el)->SetAttribute(el+1);
-  if (myid == 0)
-    cout << "Mesh initialization is done" << endl;
-
-//  int nxy[] = { 1, nproc };
-//  int *partitioning = mesh->CartesianPartitioning(nxy);
-//  par_mesh = new ParMesh(MPI_COMM_WORLD, *mesh, partitioning);
-//  delete[] partitioning;
 
-  par_mesh = new ParMesh(MPI_COMM_WORLD, *mesh);
+    MFEM_VERIFY(mesh->Dimension() == dimension, "Unexpected mesh dimension");
+    for (int el = 0; el < mesh->GetNE(); ++el)
+      mesh->GetElement(el)->SetAttribute(el+1);
+    if (myid == 0)
+      cout << "Mesh initialization is done" << endl;
+
+    int *partitioning = partition_mesh(*this, *mesh, nproc);
+    par_mesh = new ParMesh(comm, *mesh, partitioning);
+    delete[] partitioning;
+    n_glob_elements = mesh->GetNE();
+#if defined(MFEM_USE_MPI)
+    if (parallel_fem)
+    {
+      delete mesh;
+      mesh = nullptr;
+    }
+#endif
+  }
 
-  media.init(mesh->GetNE());
+#if defined(MFEM_USE_MPI)
+  print_partitioning_statistics(*this, *par_mesh, cout);
+  int world_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  if (world_size > 1)
+    node_comms = new NodeCommunicators(MPI_COMM_WORLD);
+  if (node_comms && nproc == 1)
+  {
+    // every process holds the whole mesh (the groups have one process), so
+    // the media properties of all cells are the same for all processes, and
+    // there is one copy of them per node
+    for (int el = 0; el < par_mesh->GetNE(); ++el)
+      MFEM_VERIFY(par_mesh->GetAttribute(el) == el + 1, "The cells of the "
+                  "mesh of one process must be in the global order");
+    media.init(*node_comms, n_glob_elements);
+  }
+  else
+  {
+    // every process reads the media properties of its own cells and of the
+    // face neighbors (which DG face terms need), in the order of local element
+    // numbers (ElementNo) used by the element transformations
+    par_mesh->ExchangeFaceNbrData();
+    vector<int> cells(par_mesh->GetNE() + par_mesh->face_nbr_elements.Size());
+    for (int el = 0; el < par_mesh->GetNE(); ++el)
+      cells[el] = par_mesh->GetAttribute(el) - 1;
+    for (int el = 0; el < par_mesh->face_nbr_elements.Size(); ++el)
+      cells[par_mesh->GetNE() + el] =
+        par_mesh->face_nbr_elements[el]->GetAttribute() - 1;
+    media.init(comm, n_glob_elements, cells);
+  }
+#else
+  media.init(n_glob_elements);
+#endif
 
+  double max_frequency = 0.;
+  for (size_t s = 0; s < shots.size(); ++s)
+    max_frequency = max(max_frequency, shots[s].frequency);
   const double min_wavelength = min(media.min_vp, media.min_vp) /
-                                (2.0*source.frequency);
+                                (2.0*max_frequency);
   if (myid == 0)
     cout << "min wavelength = " << min_wavelength << endl;
 
-  if (bc.damp_layer < 2.5*min_wavelength && myid == 0)
+  // the PML absorbs the waves with a much thinner layer
+  if (bc.pml)
+  {
+    if (bc.damp_layer < 0.5*min_wavelength && myid == 0)
+      mfem_warning("PML for absorbing bc should be about 0.5*wavelength\n");
+  }
+  else if (bc.damp_layer < 2.5*min_wavelength && myid == 0)
     mfem_warning("damping layer for absorbing bc should be about 3*wavelength\n");
 
+  // the receivers of every group are read and located in the mesh only once
+  // for all shots
+  receivers_groups.resize(receivers_group_files.size());
+  for (size_t g = 0; g < receivers_group_files.size(); ++g)
   {
-    ifstream in(receivers_file);
-    MFEM_VERIFY(in, "The file '" + string(receivers_file) + "' can't be opened");
+    const string &filename = receivers_group_files[g];
+    ifstream in(filename.c_str());
+    MFEM_VERIFY(in, "The file '" + filename + "' can't be opened");
     string line; // we read the file line-by-line
     string type; // type of the set of receivers
     while (getline(in, line))
@@ -464,20 +823,123 @@ void Parameters::init(int argc, char **argv)
 
       rec_set->init(in); // read the parameters
       rec_set->distribute_receivers();
-      rec_set->find_cells_containing_receivers(*mesh);
-      sets_of_receivers.push_back(rec_set); // put this set in the vector
+      if (mesh) // otherwise the receivers are found in the parallel mesh
+        rec_set->find_cells_containing_receivers(*mesh);
+#if defined(MFEM_USE_MPI)
+      // the receivers are the same for all processes
+      if (node_comms)
+        rec_set->share_on_nodes(*node_comms);
+#endif
+      receivers_groups[g].push_back(rec_set); // put this set in the group
     }
   }
 
+  set_shot(0);
+
   {
     string cmd = "mkdir -p " + (string)output.directory + " ; ";
     cmd += "mkdir -p " + (string)output.directory + "/" + SNAPSHOTS_DIR + " ; ";
     cmd += "mkdir -p " + (string)output.directory + "/" + SEISMOGRAMS_DIR + " ; ";
+    if (strcmp(output.cache_directory, DEFAULT_FILE_NAME))
+      cmd += "mkdir -p " + (string)output.cache_directory + " ; ";
     const int res = system(cmd.c_str());
     MFEM_VERIFY(res == 0, "Failed to create a directory " + (string)output.directory);
   }
 }
 
+void Parameters::read_shots()
+{
+  if (!strcmp(shots_file, DEFAULT_FILE_NAME))
+  {
+    // one shot described by the source parameters
+    Shot shot;
+    shot.location = source.location;
+    shot.frequency = source.frequency;
+    shot.scale = source.scale;
+    shot.receivers = find_receivers_group(receivers_file);
+    shots.push_back(shot);
+    return;
+  }
+
+  // every line of the table: x y [z] frequency scale [receivers_file], where
+  // the receivers file is the one of the parameters if it's omitted
+  ifstream in(shots_file);
+  MFEM_VERIFY(in, "The file '" + string(shots_file) + "' can't be opened");
+  string line;
+  while (getline(in, line))
+  {
+    // ignore empty lines and lines starting from '#'
+    if (line.empty() || line[0] == '#') continue;
+    istringstream iss(line);
+    Shot shot;
+    for (int d = 0; d < dimension; ++d)
+      iss >> shot.location(d);
+    iss >> shot.frequency >> shot.scale;
+    MFEM_VERIFY(iss, "Can't read the shot " + d2s(shots.size()) + " from the "
+                "line '" + line + "'");
+    MFEM_VERIFY(shot.frequency > 0, "Frequency of the shot " +
+                d2s(shots.size()) + " (" + d2s(shot.frequency) + ") must be >0");
+    string filename;
+    if (!(iss >> filename))
+      filename = receivers_file;
+    shot.receivers = find_receivers_group(filename);
+    shots.push_back(shot);
+  }
+  MFEM_VERIFY(!shots.empty(), "There are no shots in the file '" +
+              string(shots_file) + "'");
+}
+
+void Parameters::read_ensemble()
+{
+  if (!strcmp(ensemble_file, DEFAULT_FILE_NAME))
+    return;
+
+  // every line of the table: rhofile vpfile
+  ifstream in(ensemble_file);
+  MFEM_VERIFY(in, "The file '" + string(ensemble_file) + "' can't be opened");
+  string line;
+  while (getline(in, line))
+  {
+    // ignore empty lines and lines starting from '#'
+    if (line.empty() || line[0] == '#') continue;
+    istringstream iss(line);
+    MediaRealization realization;
+    iss >> realization.rhofile >> realization.vpfile;
+    MFEM_VERIFY(iss, "Can't read the realization " + d2s(ensemble.size()) +
+                " from the line '" + line + "'");
+    ensemble.push_back(realization);
+  }
+  MFEM_VERIFY(!ensemble.empty(), "There are no realizations in the file '" +
+              string(ensemble_file) + "'");
+}
+
+int Parameters::find_receivers_group(const string &filename)
+{
+  for (size_t g = 0; g < receivers_group_files.size(); ++g)
+    if (receivers_group_files[g] == filename)
+      return g;
+  receivers_group_files.push_back(filename);
+  return receivers_group_files.size() - 1;
+}
+
+void Parameters::set_shot(int shot)
+{
+  MFEM_VERIFY(shot >= 0 && shot < n_shots(), "Shot " + d2s(shot) + " is out "
+              "of range [0, " + d2s(n_shots()) + ")");
+  const Shot &s = shots[shot];
+  source.location = s.location;
+  source.frequency = s.frequency;
+  source.scale = s.scale;
+  sets_of_receivers = receivers_groups[s.receivers];
+
+  if (strcmp(shots_file, DEFAULT_FILE_NAME))
+  {
+    // the output of every shot goes to its own files
+    shot_extra_string = base_extra_string + "_shot" + d2s(shot);
+    output.extra_string = shot_extra_string.c_str();
+  }
+}
+
 void Parameters::check_parameters() const
 {
   MFEM_VERIFY(dimension == 2 || dimension == 3, "Dimension (" + d2s(dimension) +
@@ -494,5 +956,46 @@ void Parameters::check_parameters() const
   MFEM_VERIFY(dt < T, "dt (" + d2s(dt) + ") must be < T (" + d2s(T) + ")");
   MFEM_VERIFY(step_snap > 0, "step_snap (" + d2s(step_snap) + ") must be >0");
   MFEM_VERIFY(step_seis > 0, "step_seis (" + d2s(step_seis) + ") must be >0");
+  MFEM_VERIFY(shots_block > 0, "shots_block (" + d2s(shots_block) + ") must "
+              "be >0");
+  MFEM_VERIFY(group_size >= 0, "group_size (" + d2s(group_size) + ") must be "
+              ">=0");
+  MFEM_VERIFY(group_size <= 1 || !strcmp(method.name, "fem") ||
+              !strcmp(method.name, "FEM") || !strcmp(method.name, "gmsfem") ||
+              !strcmp(method.name, "GMsFEM"), "Groups of several processes "
+              "(group_size = " + d2s(group_size) + ") run shots with FEM and "
+              "GMsFEM only: the other methods have no parallel runner");
+  MFEM_VERIFY((!grid.distributed &&
+               !strcmp(grid.meshprefix, DEFAULT_FILE_NAME)) ||
+              !strcmp(method.name, "fem") || !strcmp(method.name, "FEM"),
+              "The parallel mesh without a serial one (-distmesh, -meshprefix) "
+              "is used by FEM only: the other methods need the serial mesh");
+  MFEM_VERIFY(shots_block == 1 || !strcmp(method.name, "sem") ||
+              !strcmp(method.name, "SEM"), "Several shots are advanced "
+              "together by SEM only");
+  MFEM_VERIFY(!active_region || !strcmp(method.name, "sem") ||
+              !strcmp(method.name, "SEM"), "The active region time stepping "
+              "is implemented for SEM only");
+  MFEM_VERIFY(!bc.pml || !strcmp(method.name, "sem") ||
+              !strcmp(method.name, "SEM") || !strcmp(method.name, "fem") ||
+              !strcmp(method.name, "FEM"), "PML is implemented for SEM and FEM "
+              "only");
+  MFEM_VERIFY(!bc.absorbing(dimension) || (strcmp(method.name, "gmsfem") &&
+              strcmp(method.name, "GMsFEM")), "The absorbing surfaces are not "
+              "implemented for GMsFEM: all the surfaces must be free (-left "
+              "free -right free -bottom free -top free, and -front free -back "
+              "free in 3D)");
+  MFEM_VERIFY(ensemble_threads >= 0, "ensemble_threads (" +
+              d2s(ensemble_threads) + ") must be >=0");
+  if (strcmp(ensemble_file, DEFAULT_FILE_NAME))
+  {
+    MFEM_VERIFY(!strcmp(method.name, "sem") || !strcmp(method.name, "SEM"),
+                "Ensembles of media realizations are run by SEM only");
+    MFEM_VERIFY(shots_block == 1, "Realizations of an ensemble are advanced "
+                "by threads, so shots_block must be 1");
+    MFEM_VERIFY(!bc.pml, "PML is not implemented for ensembles");
+    MFEM_VERIFY(!active_region, "The active region time stepping is not "
+                "implemented for ensembles");
+  }
 }
 
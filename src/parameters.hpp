@@ -10,8 +10,13 @@
 
 static const char DEFAULT_FILE_NAME[] = "no-file";
 
+class MappedFile;
 class ReceiversSet;
 class SnapshotsSet;
+#if defined(MFEM_USE_MPI)
+class NodeCommunicators;
+template <typename T> class NodeSharedArray;
+#endif
 
 
 
@@ -28,6 +33,15 @@ public:
   int nx, ny, nz; ///< number of cells in x-, y- and z-directions
 
   const char* meshfile; ///< name of file with mesh
+  const char* meshprefix; ///< prefix of files with parts of a parallel mesh
+  bool distributed; ///< create a parallel Cartesian mesh without a serial one
+  bool check_distributed; ///< compare the distributed mesh with the one made
+                          ///< from the serial mesh (small grids only)
+  const char* partitioning; ///< partitioning of the mesh among processes:
+                            ///< auto (blocks of a generated grid, METIS for
+                            ///< a mesh file), metis, cartesian, weighted
+  double damp_cost; ///< additional relative cost of cells in damping layers
+                    ///< for the weighted partitioning
 
   double get_hx() const { return sx / nx; }
   double get_hy() const { return sy / ny; }
@@ -70,6 +84,37 @@ private:
 
 
 
+/**
+ * One shot of a survey: the location and the wavelet (Ricker) of the source,
+ * and the receivers recording it.
+ */
+class Shot
+{
+public:
+  Shot() : location(), frequency(0.), scale(0.), receivers(0)
+  { location(0) = location(1) = location(2) = 0.; }
+
+  mfem::Vertex location;
+  double frequency; ///< central frequency of the wavelet
+  double scale; ///< scaling factor of the wavelet
+  int receivers; ///< index of the group of receivers sets recording the shot
+};
+
+
+
+/**
+ * One realization of the media properties of an ensemble (e.g. of stochastic
+ * models) computed on the same mesh with the same sources and receivers.
+ */
+class MediaRealization
+{
+public:
+  std::string rhofile; ///< files with the values in every cell
+  std::string vpfile;
+};
+
+
+
 /**
  * Parameters describing the media properties.
  */
@@ -84,16 +129,58 @@ public:
   const char *rhofile; ///< file names for heterogeneous media properties
   const char *vpfile;
 
-  double *rho_array, *vp_array; ///< arrays of values describing media
-                                ///< properties
+  const double *rho_array, *vp_array; ///< arrays of values describing media
+                                      ///< properties
+  int n_cells; ///< number of values in the arrays
 
-  double min_rho, max_rho, min_vp, max_vp;
+  double min_rho, max_rho, min_vp, max_vp; ///< global values
 
   void AddOptions(mfem::OptionsParser& args);
   void check_parameters() const;
   void init(int n_elements);
 
+#if defined(MFEM_USE_MPI)
+  /**
+   * Initialize the arrays with the values of the given global cells only, so
+   * that every process holds the media properties of its own part of the
+   * mesh. The arrays are indexed by the position of a cell in the vector.
+   */
+  void init(MPI_Comm comm, int n_glob_cells, const std::vector<int> &cells);
+
+  /**
+   * Initialize the arrays with the values of all cells, when every process
+   * holds the whole mesh, in the arrays shared by the processes of a node.
+   * The node leaders read the files (collective).
+   */
+  void init(const NodeCommunicators &comms, int n_glob_cells);
+
+  /**
+   * Free the arrays shared by the node (collective), before the communicators
+   * of the node.
+   */
+  void free_shared();
+
+  /**
+   * Read (collectively) the media properties of the given global cells.
+   */
+  void read_cells(MPI_Comm comm, int n_glob_cells,
+                  const std::vector<int> &cells,
+                  double *rho_values, double *vp_values) const;
+#endif
+
 private:
+  MappedFile *rho_file, *vp_file; ///< files with double values are used in
+                                  ///< place
+  double *rho_values, *vp_values; ///< homogeneous or converted float values
+#if defined(MFEM_USE_MPI)
+  NodeSharedArray<double> *rho_shared, *vp_shared; ///< values of all cells
+                                                   ///< shared by the node
+#endif
+
+  void init_array(const char *filename, double value, int n_elements,
+                  MappedFile* &file, double* &values, const double* &array,
+                  double &min_val, double &max_val);
+
   MediaPropertiesParameters(const MediaPropertiesParameters&);
   MediaPropertiesParameters& operator=(const MediaPropertiesParameters&);
 };
@@ -117,10 +204,16 @@ public:
   const char* back;   ///< back surface   (Z=sz): absorbing (abs) or free
   double damp_layer; ///< thickness of a damping layer
   double damp_power; ///< power in damping coefficient functions
+  bool pml; ///< perfectly matched layers instead of the damping layers
+  double pml_reflection; ///< theoretical reflection coefficient of the PML
 
   void AddOptions(mfem::OptionsParser& args);
   void check_parameters() const;
 
+  /// there is at least one absorbing surface (the front and the back ones
+  /// are considered in 3D only)
+  bool absorbing(int dimension = 3) const;
+
 private:
   BoundaryConditionsParameters(const BoundaryConditionsParameters&);
   BoundaryConditionsParameters& operator=(const BoundaryConditionsParameters&);
@@ -137,7 +230,7 @@ public:
   ~MethodParameters() { }
 
   int order; ///< finite element order
-  const char *name; ///< FEM, SEM, DG, GMsFEM
+  const char *name; ///< FEM, SEM, DG, DGVP, GMsFEM
 
   /**
    * Parameters of the DG method.
@@ -146,13 +239,35 @@ public:
    * sigma = +1, kappa = 0: the method of Baumann and Oden
    */
   double dg_sigma, dg_kappa;
+  bool dg_matrix_free; ///< apply the DG stiffness without assembling it
+  bool dg_matrix_free_check; ///< compare it with the assembled one
+  bool dg_gll; ///< GLL nodal basis and quadrature (diagonal mass matrix)
 
   /**
    * Parameters of the GMsFEM method
    */
   int gms_Nx, gms_Ny, gms_Nz; // number of coarse cells
   int gms_nb, gms_ni; // number of basis functions
+  int gms_threads; ///< threads solving for the snapshots (0 - all cores)
+
+  /**
+   * Randomized snapshot space: the harmonic extensions of gms_nb +
+   * gms_oversampling random boundary values instead of all unit ones,
+   * improved by gms_power_iterations subspace iterations, and (if
+   * gms_randomized_check) the comparison with the full space.
+   */
+  bool gms_randomized;
+  int gms_oversampling;
+  int gms_power_iterations;
+  bool gms_randomized_check;
 
+  /**
+   * Solver of the systems with the mass matrix (FEM, DG, GMsFEM): cholesky,
+   * chebyshev, pcg, or auto (Cholesky if its factor takes at most
+   * mass_solver_memory MB; Chebyshev for distributed matrices).
+   */
+  const char *mass_solver;
+  double mass_solver_memory;
 
   void AddOptions(mfem::OptionsParser& args);
   void check_parameters() const;
@@ -181,6 +296,15 @@ public:
   bool view_interior_basis;
   bool view_dg_basis;
 
+  bool compress_seismograms; ///< lossless compression of seismograms
+  double snapshot_tolerance; ///< error bound of lossy compression of snapshots
+                             ///< (0 - snapshots are not compressed)
+  bool snapshot_relative_tol; ///< the error bound is relative to the range of
+                              ///< values of a snapshot
+
+  const char *cache_directory; ///< directory of the cache of assembled
+                               ///< operators (no-file - no cache)
+
   void AddOptions(mfem::OptionsParser& args);
   void check_parameters() const;
 
@@ -218,12 +342,48 @@ public:
   int step_snap; ///< time step for outputting snapshots (every *th time step)
   int step_seis; ///< time step for outputting seismograms (every *th time step)
   const char *receivers_file; ///< file describing the sets of receivers
-  std::vector<ReceiversSet*> sets_of_receivers;
+  std::vector<ReceiversSet*> sets_of_receivers; ///< receivers of the current
+                                                ///< shot
+
+  const char *shots_file; ///< table of shots (sources and their receivers)
+  std::vector<Shot> shots;
+  int shots_block; ///< number of shots advanced together in one time loop
+  bool active_region; ///< update only the region reached by the waves (SEM)
+  int group_size; ///< number of processes running one shot (0 - all of them)
+
+  const char *ensemble_file; ///< table of media realizations (rhofile vpfile)
+  std::vector<MediaRealization> ensemble;
+  int ensemble_threads; ///< number of realizations advanced concurrently
+                        ///< (0 - as many as the hardware threads)
+
+#if defined(MFEM_USE_MPI)
+  MPI_Comm comm; ///< processes of the group running the same shots
+  NodeCommunicators *node_comms; ///< processes of the same node (if there
+                                 ///< are several processes)
+#endif
 
   void init(int argc, char **argv);
   void check_parameters() const;
 
+  int n_shots() const { return shots.size(); }
+
+  /**
+   * Make the given shot current: the source parameters, the sets of receivers
+   * and the extra string of the output files describe this shot.
+   */
+  void set_shot(int shot);
+
 private:
+  /// groups of receivers sets (one group per file) shared by the shots
+  std::vector<std::vector<ReceiversSet*> > receivers_groups;
+  std::vector<std::string> receivers_group_files;
+  std::string base_extra_string; ///< the extra string given by the user
+  std::string shot_extra_string;
+
+  void read_shots();
+  void read_ensemble();
+  int find_receivers_group(const std::string &filename);
+
   Parameters(const Parameters&); // no copies
   Parameters& operator=(const Parameters&); // no copies
 };
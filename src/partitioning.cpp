@@ -0,0 +1,238 @@
+#include "partitioning.hpp"
+#include "parameters.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <vector>
+
+#if defined(MFEM_USE_MPI)
+  #if defined(MFEM_USE_METIS_5)
+    #include <metis.h>
+  #else
+    typedef int idx_t;
+    extern "C" {
+      void METIS_PartGraphKway(int*, idx_t*, idx_t*, idx_t*, idx_t*, int*,
+                               int*, int*, int*, int*, idx_t*);
+    }
+  #endif
+#endif
+
+using namespace std;
+using namespace mfem;
+
+
+
+void processors_grid(int nproc, int dim, const int n[], int p[])
+{
+  double best_area = -1.;
+  p[0] = nproc; p[1] = p[2] = 1;
+  for (int px = 1; px <= nproc; ++px)
+  {
+    if (nproc % px) continue;
+    for (int py = 1; py <= nproc / px; ++py)
+    {
+      if ((nproc / px) % py) continue;
+      const int pz = nproc / px / py;
+      if (dim == 2 && pz != 1) continue;
+      if (px > n[0] || py > n[1] || (dim == 3 && pz > n[2])) continue;
+
+      const double nz = (dim == 3 ? n[2] : 1.);
+      const double area = (px - 1.) * n[1] * nz + (py - 1.) * n[0] * nz +
+                          (pz - 1.) * n[0] * n[1];
+      if (best_area < 0 || area < best_area)
+      {
+        best_area = area;
+        p[0] = px; p[1] = py; p[2] = pz;
+      }
+    }
+  }
+  MFEM_VERIFY(best_area >= 0, "The number of processes " + d2s(nproc) + " is "
+              "too large for the grid");
+}
+
+
+
+/**
+ * Check if the point is inside a damping layer of an absorbing surface: left
+ * (X=0), right (X=sx), bottom (Y=0), top (Y=sy), front (Z=0), back (Z=sz).
+ */
+static bool in_damping_layer(const Parameters &param, const double *point)
+{
+  const BoundaryConditionsParameters &bc = param.bc;
+  const double layer = bc.damp_layer;
+  const double x = point[0], y = point[1];
+
+  if (!strcmp(bc.left,   "abs") && x < layer) return true;
+  if (!strcmp(bc.right,  "abs") && x > param.grid.sx - layer) return true;
+  if (!strcmp(bc.bottom, "abs") && y < layer) return true;
+  if (!strcmp(bc.top,    "abs") && y > param.grid.sy - layer) return true;
+  if (param.dimension == 3)
+  {
+    const double z = point[2];
+    if (!strcmp(bc.front, "abs") && z < layer) return true;
+    if (!strcmp(bc.back,  "abs") && z > param.grid.sz - layer) return true;
+  }
+  return false;
+}
+
+double element_cost(const Parameters &param, const Mesh &mesh, int el)
+{
+  const int dim = mesh.Dimension();
+  const int p = param.method.order;
+  const char *name = param.method.name;
+  const bool dg = (!strcmp(name, "dg") || !strcmp(name, "DG") ||
+                   !strcmp(name, "dgvp") || !strcmp(name, "DGVP") ||
+                   !strcmp(name, "gmsfem") || !strcmp(name, "GMsFEM"));
+
+  // dofs belonging to one element (continuous dofs are shared among cells)
+  const double n_dofs = (dg ? pow(p + 1., dim) : pow((double)p, dim));
+
+  // a dense block of the operators per element, and the blocks coupling it
+  // with the neighbors through the faces (quadrilaterals or hexahedra) for DG
+  double cost = n_dofs * n_dofs;
+  if (dg)
+    cost *= 1 + 2*dim;
+
+  Array<int> vertices;
+  mesh.GetElementVertices(el, vertices);
+  double center[] = { 0., 0., 0. };
+  for (int v = 0; v < vertices.Size(); ++v)
+  {
+    const double *coord = mesh.GetVertex(vertices[v]);
+    for (int d = 0; d < dim; ++d)
+      center[d] += coord[d] / vertices.Size();
+  }
+  if (in_damping_layer(param, center))
+    cost *= 1 + param.grid.damp_cost;
+
+  return cost;
+}
+
+
+
+int* partition_mesh(const Parameters &param, Mesh &mesh, int nproc)
+{
+  const char *method = param.grid.partitioning;
+  if (!strcmp(method, "auto")) // blocks of a generated grid
+    method = (strcmp(param.grid.meshfile, DEFAULT_FILE_NAME) ? "metis" :
+              "cartesian");
+
+  if (!strcmp(method, "metis") || nproc == 1)
+    return nullptr; // the default one
+
+  if (!strcmp(method, "cartesian"))
+  {
+    MFEM_VERIFY(!strcmp(param.grid.meshfile, DEFAULT_FILE_NAME), "Cartesian "
+                "partitioning is available for generated grids only");
+    const int n[] = { param.grid.nx, param.grid.ny, param.grid.nz };
+    int p[3];
+    processors_grid(nproc, param.dimension, n, p);
+    return mesh.CartesianPartitioning(p);
+  }
+
+#if defined(MFEM_USE_MPI)
+  if (!strcmp(method, "weighted"))
+  {
+    const int n_elements = mesh.GetNE();
+
+    // the weights are integers for METIS, and the minimal one is 1
+    vector<double> costs(n_elements);
+    double min_cost = 0.;
+    for (int el = 0; el < n_elements; ++el)
+    {
+      costs[el] = element_cost(param, mesh, el);
+      min_cost = (el == 0 ? costs[el] : min(min_cost, costs[el]));
+    }
+    vector<idx_t> weights(n_elements);
+    for (int el = 0; el < n_elements; ++el)
+      weights[el] = (idx_t)(costs[el] / min_cost + 0.5);
+
+    const Table &el_to_el = mesh.ElementToElementTable();
+    vector<idx_t> xadj(el_to_el.GetI(), el_to_el.GetI() + n_elements + 1);
+    vector<idx_t> adjncy(el_to_el.GetJ(),
+                         el_to_el.GetJ() + el_to_el.Size_of_connections());
+
+    vector<idx_t> part(n_elements);
+    idx_t n = n_elements, nparts = nproc, edgecut = 0;
+#if defined(MFEM_USE_METIS_5)
+    idx_t ncon = 1;
+    idx_t options[METIS_NOPTIONS];
+    METIS_SetDefaultOptions(options);
+    options[METIS_OPTION_CONTIG] = 1; // connected subdomains
+    const int err = METIS_PartGraphKway(&n, &ncon, &xadj[0], &adjncy[0],
+                                        &weights[0], nullptr, nullptr,
+                                        &nparts, nullptr, nullptr, options,
+                                        &edgecut, &part[0]);
+    MFEM_VERIFY(err == METIS_OK, "METIS partitioning failed");
+#else
+    int wgtflag = 2; // weights of vertices only
+    int numflag = 0; // C-style numbering
+    int options[5] = { 0, 0, 0, 0, 0 };
+    METIS_PartGraphKway(&n, &xadj[0], &adjncy[0], &weights[0], nullptr,
+                        &wgtflag, &numflag, &nparts, options, &edgecut,
+                        &part[0]);
+#endif
+
+    int *partitioning = new int[n_elements];
+    for (int el = 0; el < n_elements; ++el)
+      partitioning[el] = part[el];
+    return partitioning;
+  }
+#endif // MFEM_USE_MPI
+
+  MFEM_ABORT("Unknown partitioning method: " + string(method));
+  return nullptr;
+}
+
+
+
+#if defined(MFEM_USE_MPI)
+void print_partitioning_statistics(const Parameters &param, ParMesh &par_mesh,
+                                   ostream &out)
+{
+  MPI_Comm comm = par_mesh.GetComm();
+  int myid, nproc;
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nproc);
+
+  par_mesh.ExchangeFaceNbrData();
+
+  double load = 0.;
+  for (int el = 0; el < par_mesh.GetNE(); ++el)
+    load += element_cost(param, par_mesh, el);
+
+  // cells, load, halo cells (face neighbors), shared faces, neighbors
+  const int n_stats = 5;
+  double stats[n_stats] = { (double)par_mesh.GetNE(),
+                            load,
+                            (double)par_mesh.face_nbr_elements.Size(),
+                            (double)par_mesh.GetNSharedFaces(),
+                            (double)par_mesh.GetNFaceNeighbors() };
+  double min_stats[n_stats], max_stats[n_stats], sum_stats[n_stats];
+  MPI_Reduce(stats, min_stats, n_stats, MPI_DOUBLE, MPI_MIN, 0, comm);
+  MPI_Reduce(stats, max_stats, n_stats, MPI_DOUBLE, MPI_MAX, 0, comm);
+  MPI_Reduce(stats, sum_stats, n_stats, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+  if (myid != 0)
+    return;
+
+  const char *names[n_stats] = { "cells", "load", "halo cells",
+                                 "shared faces", "neighbors" };
+  out << "Partitioning (" << param.grid.partitioning << ") among " << nproc
+      << " processes:\n";
+  for (int i = 0; i < n_stats; ++i)
+  {
+    const double avg = sum_stats[i] / nproc;
+    out << "  " << setw(12) << left << names[i] << right
+        << " min " << setw(12) << min_stats[i]
+        << " max " << setw(12) << max_stats[i]
+        << " avg " << setw(12) << avg;
+    if (i <= 1 && avg > 0)
+      out << " imbalance " << max_stats[i] / avg;
+    out << "\n";
+  }
+  out << flush;
+}
+#endif // MFEM_USE_MPI
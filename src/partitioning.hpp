@@ -0,0 +1,44 @@
+#ifndef PARTITIONING_HPP
+#define PARTITIONING_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <iostream>
+
+class Parameters;
+
+/**
+ * Choose the numbers of blocks of processes in every direction (their product
+ * is nproc) minimizing the total area of the interfaces between the blocks of
+ * a Cartesian grid with n[0] x n[1] (x n[2]) cells.
+ */
+void processors_grid(int nproc, int dim, const int n[], int p[]);
+
+/**
+ * The estimated cost (in arbitrary units, proportional to the work per time
+ * step) of the given element: it depends on the number of dofs per element
+ * (the order of the method, DG or CG) and on whether the element is inside a
+ * damping layer near an absorbing boundary.
+ */
+double element_cost(const Parameters &param, const mfem::Mesh &mesh, int el);
+
+/**
+ * Partitioning of the serial mesh among nproc processes with the method
+ * selected by the grid parameters (auto means the Cartesian blocks of a
+ * generated grid, and METIS for a mesh file). nullptr means the default
+ * partitioning of ParMesh (METIS without weights). The array should be deleted
+ * by the caller.
+ */
+int* partition_mesh(const Parameters &param, mfem::Mesh &mesh, int nproc);
+
+#if defined(MFEM_USE_MPI)
+/**
+ * Print (on the process 0) the statistics of the load and of the halo sizes
+ * of all processes (collective).
+ */
+void print_partitioning_statistics(const Parameters &param,
+                                   mfem::ParMesh &par_mesh, std::ostream &out);
+#endif
+
+#endif // PARTITIONING_HPP
@@ -0,0 +1,288 @@
+#include "pml.hpp"
+#include "parameters.hpp"
+
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace mfem;
+
+
+
+PML::PML(const Parameters &param, FiniteElementSpace &fespace,
+         Coefficient &one_over_rho, Coefficient &one_over_K,
+         const IntegrationRule *rule, int n_fields)
+  : _dim(param.dimension)
+  , _n_fields(n_fields)
+  , _n_dofs(0)
+  , _n_pts(0)
+  , _n_psi(0)
+{
+  const BoundaryConditionsParameters &bc = param.bc;
+  const double size[] = { param.grid.sx, param.grid.sy, param.grid.sz };
+  const bool low[]  = { !strcmp(bc.left, "abs"), !strcmp(bc.bottom, "abs"),
+                        !strcmp(bc.front, "abs") };
+  const bool high[] = { !strcmp(bc.right, "abs"), !strcmp(bc.top, "abs"),
+                        !strcmp(bc.back, "abs") };
+  const double L = bc.damp_layer;
+  const double power = bc.damp_power;
+  const double z0 = (power + 1.) * param.media.max_vp *
+                    log(1. / bc.pml_reflection) / (2. * L);
+
+  Mesh &mesh = *fespace.GetMesh();
+  if (mesh.GetNE() == 0)
+    return;
+
+  const FiniteElement &fe = *fespace.GetFE(0);
+  if (!rule)
+    rule = &IntRules.Get(fe.GetGeomType(), 2*fe.GetOrder() + 1);
+  _n_dofs = fe.GetDof();
+  _n_pts = rule->GetNPoints();
+
+  _N.resize(_n_pts * _n_dofs);
+  _G.resize(_n_pts * _n_dofs * _dim);
+  Vector shape(_n_dofs);
+  DenseMatrix dshape(_n_dofs, _dim);
+  for (int q = 0; q < _n_pts; ++q)
+  {
+    fe.CalcShape(rule->IntPoint(q), shape);
+    fe.CalcDShape(rule->IntPoint(q), dshape);
+    for (int i = 0; i < _n_dofs; ++i)
+    {
+      _N[q*_n_dofs + i] = shape(i);
+      for (int k = 0; k < _dim; ++k)
+        _G[(q*_n_dofs + i)*_dim + k] = dshape(i, k);
+    }
+  }
+
+  const int nf = n_factors();
+  vector<double> z(_n_pts * _dim); // profiles at the points of an element
+  Vector x(_dim);
+  DenseMatrix invJ(_dim);
+  Array<int> vdofs;
+  vector<int> psi_index(_dim == 3 ? fespace.GetVSize() : 0, -1);
+
+  for (int el = 0; el < mesh.GetNE(); ++el)
+  {
+    MFEM_VERIFY(fespace.GetFE(el)->GetGeomType() == fe.GetGeomType(),
+                "PML needs the elements of the same type");
+    ElementTransformation &T = *fespace.GetElementTransformation(el);
+
+    bool in_layer = false;
+    for (int q = 0; q < _n_pts; ++q)
+    {
+      T.Transform(rule->IntPoint(q), x);
+      for (int d = 0; d < _dim; ++d)
+      {
+        double dist = 0.;
+        if (low[d] && x(d) < L)
+          dist = L - x(d);
+        else if (high[d] && x(d) > size[d] - L)
+          dist = x(d) - (size[d] - L);
+        z[q*_dim + d] = (dist > 0. ? z0 * pow(dist / L, power) : 0.);
+        in_layer = in_layer || dist > 0.;
+      }
+    }
+    if (!in_layer)
+      continue;
+
+    _elements.push_back(el);
+    fespace.GetElementDofs(el, vdofs);
+    MFEM_VERIFY(vdofs.Size() == _n_dofs, "Unexpected number of dofs");
+    for (int i = 0; i < _n_dofs; ++i)
+    {
+      _dofs.push_back(vdofs[i]);
+      if (_dim == 3)
+      {
+        if (psi_index[vdofs[i]] < 0)
+        {
+          psi_index[vdofs[i]] = _n_psi++;
+          _psi_global.push_back(vdofs[i]);
+        }
+        _psi_dofs.push_back(psi_index[vdofs[i]]);
+      }
+    }
+
+    for (int q = 0; q < _n_pts; ++q)
+    {
+      const IntegrationPoint &ip = rule->IntPoint(q);
+      T.SetIntPoint(&ip);
+      const double w = ip.weight * T.Weight();
+      const double w_K = w * one_over_K.Eval(T, ip);
+      const double inv_rho = one_over_rho.Eval(T, ip);
+      CalcInverse(T.Jacobian(), invJ);
+
+      const double *zq = &z[q*_dim];
+      double s1 = 0., s2 = 0., s3 = (_dim == 3 ? 1. : 0.);
+      for (int d = 0; d < _dim; ++d)
+      {
+        s1 += zq[d];
+        for (int e = d + 1; e < _dim; ++e)
+          s2 += zq[d] * zq[e];
+        if (_dim == 3)
+          s3 *= zq[d];
+      }
+
+      _factors.resize(_factors.size() + nf);
+      double *f = &_factors[_factors.size() - nf];
+      f[0] = w_K * s1;
+      f[1] = w_K * s2;
+      f[2] = w_K * s3;
+      f[3] = w;
+      for (int d = 0; d < _dim; ++d)
+      {
+        f[4 + d] = zq[d];
+        f[4 + _dim + d] = inv_rho * (s1 - 2.*zq[d]);
+        f[4 + 2*_dim + d] = (_dim == 3 ? inv_rho * zq[(d+1)%3] * zq[(d+2)%3]
+                                       : 0.);
+        for (int k = 0; k < _dim; ++k)
+          f[4 + 3*_dim + k*_dim + d] = invJ(k, d);
+      }
+    }
+  }
+
+  _phi.resize(_elements.size() * _n_pts * _dim * _n_fields, 0.);
+  _psi.resize((size_t)_n_psi * _n_fields, 0.);
+  _u1.resize(_n_dofs * _n_fields);
+  _u2.resize(_n_dofs * _n_fields);
+  _ps.resize(_n_dofs * _n_fields);
+  _out.resize(_n_dofs * _n_fields);
+  _pts.resize((3 + 3*_dim) * _n_fields);
+}
+
+size_t PML::memory() const
+{
+  return (_phi.size() + _psi.size() + _factors.size()) * sizeof(double);
+}
+
+void PML::add_damping(double a, SparseMatrix &A) const
+{
+  const int nf = n_factors();
+  DenseMatrix elmat(_n_dofs);
+  Array<int> dofs(_n_dofs);
+  for (size_t e = 0; e < _elements.size(); ++e)
+  {
+    elmat = 0.0;
+    for (int q = 0; q < _n_pts; ++q)
+    {
+      const double c = a * _factors[(e*_n_pts + q)*nf];
+      const double *N = &_N[q*_n_dofs];
+      for (int j = 0; j < _n_dofs; ++j)
+        for (int i = 0; i < _n_dofs; ++i)
+          elmat(i, j) += c * N[i] * N[j];
+    }
+    for (int i = 0; i < _n_dofs; ++i)
+      dofs[i] = _dofs[e*_n_dofs + i];
+    A.AddSubMatrix(dofs, dofs, elmat);
+  }
+}
+
+void PML::add_rhs(double dt, const double *u_1, const double *u_2,
+                  double *rhs)
+{
+  if (_elements.empty())
+    return;
+
+  const int k = _n_fields;
+  const int nf = n_factors();
+  const double dt2 = dt * dt;
+
+  // psi at the current time step (trapezoidal rule)
+  for (int c = 0; c < _n_psi; ++c)
+  {
+    const size_t g = (size_t)_psi_global[c] * k;
+    for (int s = 0; s < k; ++s)
+      _psi[(size_t)c*k + s] += 0.5 * dt * (u_1[g + s] + u_2[g + s]);
+  }
+
+  // values and reference gradients at a point, and the flux of phi
+  double *u1q = &_pts[0], *u2q = u1q + k, *psq = u2q + k;
+  double *g1 = psq + k, *gps = g1 + _dim*k, *v = gps + _dim*k;
+
+  for (size_t e = 0; e < _elements.size(); ++e)
+  {
+    const int *dofs = &_dofs[e*_n_dofs];
+    for (int i = 0; i < _n_dofs; ++i)
+      for (int s = 0; s < k; ++s)
+      {
+        _u1[i*k + s] = u_1[(size_t)dofs[i]*k + s];
+        _u2[i*k + s] = u_2[(size_t)dofs[i]*k + s];
+        _ps[i*k + s] = 0.;
+        if (_dim == 3)
+          _ps[i*k + s] = _psi[(size_t)_psi_dofs[e*_n_dofs + i]*k + s];
+        _out[i*k + s] = 0.;
+      }
+
+    for (int q = 0; q < _n_pts; ++q)
+    {
+      const double *f = &_factors[(e*_n_pts + q)*nf];
+      const double *invJ = f + 4 + 3*_dim;
+      const double *N = &_N[q*_n_dofs];
+      const double *G = &_G[q*_n_dofs*_dim];
+
+      for (int s = 0; s < k; ++s)
+        u1q[s] = u2q[s] = psq[s] = 0.;
+      for (int j = 0; j < _dim*k; ++j)
+        g1[j] = gps[j] = 0.;
+      for (int i = 0; i < _n_dofs; ++i)
+        for (int s = 0; s < k; ++s)
+        {
+          u1q[s] += N[i] * _u1[i*k + s];
+          u2q[s] += N[i] * _u2[i*k + s];
+          psq[s] += N[i] * _ps[i*k + s];
+          for (int r = 0; r < _dim; ++r)
+          {
+            g1[r*k + s]  += G[i*_dim + r] * _u1[i*k + s];
+            gps[r*k + s] += G[i*_dim + r] * _ps[i*k + s];
+          }
+        }
+
+      // advance phi (Crank-Nicolson for the damping), and use its average
+      // over the time step in the divergence term
+      double *phi = &_phi[(e*_n_pts + q)*_dim*k];
+      for (int j = 0; j < _dim*k; ++j)
+        v[j] = 0.;
+      for (int d = 0; d < _dim; ++d)
+      {
+        const double a = 0.5 * dt * f[4 + d];
+        for (int s = 0; s < k; ++s)
+        {
+          double gu = 0., gp = 0.;
+          for (int r = 0; r < _dim; ++r)
+          {
+            gu += invJ[r*_dim + d] * g1[r*k + s];
+            gp += invJ[r*_dim + d] * gps[r*k + s];
+          }
+          const double old = phi[d*k + s];
+          const double src = f[4 + _dim + d]*gu + f[4 + 2*_dim + d]*gp;
+          phi[d*k + s] = ((1. - a)*old + dt*src) / (1. + a);
+          const double avg = 0.5 * (old + phi[d*k + s]);
+          for (int r = 0; r < _dim; ++r)
+            v[r*k + s] -= dt2 * f[3] * invJ[r*_dim + d] * avg;
+        }
+      }
+
+      for (int s = 0; s < k; ++s)
+      {
+        const double c = 0.5*dt*f[0]*u2q[s] - dt2*(f[1]*u1q[s] + f[2]*psq[s]);
+        for (int i = 0; i < _n_dofs; ++i)
+        {
+          double val = N[i] * c;
+          for (int r = 0; r < _dim; ++r)
+            val += G[i*_dim + r] * v[r*k + s];
+          _out[i*k + s] += val;
+        }
+      }
+    }
+
+    for (int i = 0; i < _n_dofs; ++i)
+      for (int s = 0; s < k; ++s)
+        rhs[(size_t)dofs[i]*k + s] += _out[i*k + s];
+  }
+}
+
+void PML::reset()
+{
+  fill(_phi.begin(), _phi.end(), 0.);
+  fill(_psi.begin(), _psi.end(), 0.);
+}
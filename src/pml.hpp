@@ -0,0 +1,103 @@
+#ifndef PML_HPP
+#define PML_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <vector>
+
+class Parameters;
+
+/**
+ * Perfectly matched layers at the absorbing surfaces for the second order
+ * (pressure) wave equation, in the auxiliary variables formulation of Grote
+ * and Sim:
+ *
+ *   1/K (p_tt + sum(z_i) p_t + sum(z_i*z_j) p + z_1*z_2*z_3 psi) =
+ *     div(1/rho grad(p)) + div(phi),
+ *   phi_t = -Z phi + 1/rho (A grad(p) + B grad(psi)),  psi_t = p  (3D only),
+ *
+ * where z_i are the damping profiles across the layers of the i-th direction,
+ * Z = diag(z_i), and A, B are diagonal matrices of the profiles (in 2D
+ * A = diag(z_2 - z_1, z_1 - z_2), B = 0). The equation for phi is the
+ * convolution of the stretched gradient with the memory kernel, written as an
+ * ODE, so phi lives only in the layers, and it's stored only at the quadrature
+ * points of the elements in the layers, psi - at their dofs. The profiles are
+ * z(d) = z_0*(d/L)^n with z_0 = (n+1)*vp_max*ln(1/R)/(2L) for the thickness L,
+ * the power n and the theoretical reflection coefficient R.
+ *
+ * The terms of the time step of the explicit scheme
+ *
+ *   (M + dt/2 C) p^{k+1} = M (2p^k - p^{k-1}) - dt^2 (S p^k - f) +
+ *                          dt/2 C p^{k-1} - dt^2 (K p^k + G(phi, psi))
+ *
+ * are computed element by element in the layers, C is to be added to the
+ * system matrix. Several wavefields (shots), interleaved as in
+ * mult_interleaved, can be advanced together.
+ */
+class PML
+{
+public:
+  /**
+   * @param rule - the rule of the quadrature in the elements (the GLL one for
+   * SEM, then C is diagonal), or nullptr for the default one.
+   * @param n_fields - the number of interleaved wavefields.
+   */
+  PML(const Parameters &param, mfem::FiniteElementSpace &fespace,
+      mfem::Coefficient &one_over_rho, mfem::Coefficient &one_over_K,
+      const mfem::IntegrationRule *rule = nullptr, int n_fields = 1);
+
+  int n_elements() const { return _elements.size(); }
+
+  /// memory (in bytes) taken by the auxiliary variables and the factors
+  size_t memory() const;
+
+  /**
+   * A += a*C, where C is the damping matrix of the layers. The sparsity
+   * pattern of A must include the one of the mass matrix.
+   */
+  void add_damping(double a, mfem::SparseMatrix &A) const;
+
+  /**
+   * Advance the auxiliary variables from the pressure at the current (u_1)
+   * and the previous (u_2) time steps, and add the layer terms of the time
+   * step to the right hand side: rhs += dt/2 C u_2 - dt^2 (K u_1 + G).
+   */
+  void add_rhs(double dt, const double *u_1, const double *u_2, double *rhs);
+
+  /// zero the auxiliary variables (e.g. for the next shot)
+  void reset();
+
+private:
+  int _dim;
+  int _n_fields;
+  int _n_dofs;  ///< number of dofs of an element
+  int _n_pts;   ///< number of quadrature points of an element
+
+  std::vector<int> _elements; ///< the elements in the layers
+  std::vector<int> _dofs;     ///< their dofs (element by element)
+  std::vector<int> _psi_dofs; ///< numbers of the dofs among the psi variables
+  std::vector<int> _psi_global; ///< psi variables -> dofs
+  int _n_psi;                 ///< number of dofs with psi (3D)
+
+  /// values (N) and reference gradients (G) of the basis at the points
+  std::vector<double> _N, _G;
+
+  /**
+   * At every point of the layers: w*det(J)/K times sum(z_i), sum(z_i*z_j),
+   * z_1*z_2*z_3; w*det(J); z_i; A_ii/rho; B_ii/rho; J^{-1}.
+   */
+  std::vector<double> _factors;
+
+  std::vector<double> _phi; ///< per point, direction, field
+  std::vector<double> _psi; ///< per psi dof, field
+
+  std::vector<double> _u1, _u2, _ps, _out, _pts;
+
+  int n_factors() const { return 4 + 3*_dim + _dim*_dim; }
+
+  PML(const PML&);
+  PML& operator=(const PML&);
+};
+
+#endif // PML_HPP
@@ -1,5 +1,6 @@
 #include "mfem.hpp"
 #include "receivers.hpp"
+#include "shared_memory.hpp"
 
 using namespace mfem;
 
@@ -13,11 +14,64 @@ ReceiversSet::ReceiversSet(int d)
     _n_receivers(0),
     _receivers(),
     _cells_containing_receivers(),
+#if defined(MFEM_USE_MPI)
+    _shared_receivers(nullptr),
+    _shared_cells(nullptr),
+#endif
     _dimension(d)
 {
   MFEM_VERIFY(_dimension == 2 || _dimension == 3, "Incorrect dimension");
 }
 
+ReceiversSet::~ReceiversSet()
+{
+#if defined(MFEM_USE_MPI)
+  delete _shared_receivers;
+  delete _shared_cells;
+#endif
+}
+
+const Vertex* ReceiversSet::get_receivers() const
+{
+#if defined(MFEM_USE_MPI)
+  if (_shared_receivers)
+    return _shared_receivers->data();
+#endif
+  return _receivers.empty() ? nullptr : &_receivers[0];
+}
+
+const int* ReceiversSet::get_cells_containing_receivers() const
+{
+#if defined(MFEM_USE_MPI)
+  if (_shared_cells)
+    return _shared_cells->data();
+#endif
+  return _cells_containing_receivers.empty() ? nullptr :
+         &_cells_containing_receivers[0];
+}
+
+#if defined(MFEM_USE_MPI)
+void ReceiversSet::share_on_nodes(const NodeCommunicators &comms)
+{
+  MFEM_VERIFY(!_shared_receivers, "The receivers are already shared");
+  _shared_receivers = new NodeSharedArray<Vertex>(comms, _receivers.size());
+  _shared_cells = new NodeSharedArray<int>(comms,
+                                           _cells_containing_receivers.size());
+  if (comms.is_leader())
+  {
+    std::copy(_receivers.begin(), _receivers.end(),
+              _shared_receivers->data());
+    std::copy(_cells_containing_receivers.begin(),
+              _cells_containing_receivers.end(), _shared_cells->data());
+  }
+  _shared_receivers->synchronize();
+  _shared_cells->synchronize();
+
+  std::vector<Vertex>().swap(_receivers);
+  std::vector<int>().swap(_cells_containing_receivers);
+}
+#endif
+
 void ReceiversSet::
 find_cells_containing_receivers(const Mesh &mesh)
 {
@@ -9,6 +9,11 @@
 
 namespace mfem { class Vertex; }
 
+#if defined(MFEM_USE_MPI)
+class NodeCommunicators;
+template <typename T> class NodeSharedArray;
+#endif
+
 /**
  * Abstract class representing a set (a straight line, a circle, or other line)
  * of receivers (stations).
@@ -17,7 +22,7 @@ class ReceiversSet
 {
 public:
 
-  virtual ~ReceiversSet() {}
+  virtual ~ReceiversSet();
 
   /**
    * Find and save the numbers of cells containing the receivers.
@@ -28,11 +33,22 @@ public:
 
   int n_receivers() const { return _n_receivers; }
 
-  const std::vector<mfem::Vertex>& get_receivers() const
-  { return _receivers; }
+  /**
+   * The locations of the receivers and the numbers of the cells containing
+   * them (if they're found), in the arrays of this process or in the ones
+   * shared by the node.
+   */
+  const mfem::Vertex* get_receivers() const;
+  const int* get_cells_containing_receivers() const;
 
-  const std::vector<int>& get_cells_containing_receivers() const
-  { return _cells_containing_receivers; }
+#if defined(MFEM_USE_MPI)
+  /**
+   * Move the locations of the receivers and the numbers of their cells, which
+   * are the same on all processes, to the arrays shared by the processes of a
+   * node (collective).
+   */
+  void share_on_nodes(const NodeCommunicators &comms);
+#endif
 
   /**
    * Initialize the parameters of the receivers set reading them from a given
@@ -73,6 +89,14 @@ protected:
    */
   std::vector<int> _cells_containing_receivers;
 
+#if defined(MFEM_USE_MPI)
+  /**
+   * The same arrays shared by the node (if they are).
+   */
+  NodeSharedArray<mfem::Vertex> *_shared_receivers;
+  NodeSharedArray<int> *_shared_cells;
+#endif
+
   /**
    * Dimension of the problem to be solved (affects some features of receivers)
    */
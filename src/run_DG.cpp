@@ -1,5 +1,13 @@
+#include "absorbing_boundary.hpp"
 #include "acoustic_wave.hpp"
+#include "dg_operator.hpp"
+#include "GLL_quadrature.hpp"
+#include "mass_solver.hpp"
+#include "operator_cache.hpp"
+#include "output_writer.hpp"
 #include "parameters.hpp"
+#include "shot_scheduler.hpp"
+#include "structured_assembly.hpp"
 #include "utilities.hpp"
 
 #include <float.h>
@@ -13,7 +21,7 @@ void AcousticWave::run_DG() const
 {
 #if defined(MFEM_USE_MPI)
   int size;
-  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  MPI_Comm_size(param.comm, &size);
   if (size == 1)
     run_DG_serial();
   else
@@ -32,6 +40,39 @@ void AcousticWave::run_DG_parallel() const
 
 
 
+/**
+ * Add the terms of the interior penalty DG on the boundary faces of the free
+ * surfaces (the weak condition p = 0) to the stiffness matrix. The absorbing
+ * surfaces have the natural condition instead, and the damping of the
+ * absorbing boundary condition.
+ */
+static void add_free_surface_terms(const Parameters &param,
+                                   FiniteElementSpace &fespace,
+                                   Coefficient &one_over_rho,
+                                   const vector<char> &absorbing_faces,
+                                   SparseMatrix &S)
+{
+  Mesh &mesh = *fespace.GetMesh();
+  DGDiffusionIntegrator integ(one_over_rho, param.method.dg_sigma,
+                              param.method.dg_kappa);
+  Array<int> dofs;
+  DenseMatrix elmat;
+  for (int f = 0; f < mesh.GetNumFaces(); ++f)
+  {
+    int elem1, elem2;
+    mesh.GetFaceElements(f, &elem1, &elem2);
+    if (elem2 >= 0 || absorbing_faces[f])
+      continue;
+    FaceElementTransformations *FT = mesh.GetFaceElementTransformations(f);
+    const FiniteElement &fe = *fespace.GetFE(elem1);
+    integ.AssembleFaceMatrix(fe, fe, *FT, elmat);
+    fespace.GetElementVDofs(elem1, dofs);
+    S.AddSubMatrix(dofs, dofs, elmat);
+  }
+}
+
+
+
 void AcousticWave::run_DG_serial() const
 {
   MFEM_VERIFY(param.mesh, "The mesh is not initialized");
@@ -43,8 +84,16 @@ void AcousticWave::run_DG_serial() const
   const int dim = param.dimension;
   const int n_elements = param.mesh->GetNE();
 
+  // with the GLL nodal basis and the GLL quadrature the mass matrix is
+  // diagonal (as in SEM), and the time stepping is fully explicit
+  const bool gll = param.method.dg_gll;
+
   cout << "FE space generation..." << flush;
-  FiniteElementCollection *fec = new DG_FECollection(param.method.order, dim);
+  FiniteElementCollection *fec = nullptr;
+  if (gll)
+    fec = new L2_FECollection(param.method.order, dim, BasisType::GaussLobatto);
+  else
+    fec = new DG_FECollection(param.method.order, dim);
   FiniteElementSpace fespace(param.mesh, fec);
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
@@ -85,29 +134,89 @@ void AcousticWave::run_DG_serial() const
   CWConstCoefficient one_over_rho_coef(one_over_rho, own_array);
   CWConstCoefficient one_over_K_coef(one_over_K, own_array);
 
-  cout << "Stif matrix..." << flush;
+  IntegrationRule segment_GLL;
+  IntegrationRule *GLL_rule = nullptr;
+  if (gll)
+  {
+    create_segment_GLL_rule(param.method.order, segment_GLL);
+    if (dim == 2)
+      GLL_rule = new IntegrationRule(segment_GLL, segment_GLL);
+    else
+      GLL_rule = new IntegrationRule(segment_GLL, segment_GLL, segment_GLL);
+  }
+
+  // the operators are taken from the cache if they have been assembled for
+  // the same mesh, media and discretization
+  OperatorCache cache(param, gll ? "DG_GLL" : "DG");
+
+  // the absorbing surfaces have no penalty terms in the stiffness
+  vector<char> absorbing_faces;
+  find_absorbing_faces(param, *param.mesh, absorbing_faces);
+
+  // the matrix-free operator stores only the geometric factors at the
+  // quadrature points instead of the element and the face coupling blocks
+  DGStiffnessOperator *S_mf = nullptr;
+  if (param.method.dg_matrix_free)
+  {
+    cout << "Stif operator (matrix-free)..." << flush;
+    S_mf = new DGStiffnessOperator(fespace, one_over_rho_coef,
+                                   param.method.dg_sigma,
+                                   param.method.dg_kappa,
+                                   gll ? &segment_GLL : nullptr,
+                                   &absorbing_faces);
+    cout << "done. Memory = " << S_mf->memory() / 1048576. << " MB. Time = "
+         << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
+  }
+
+  // the assembled matrix is needed without the matrix-free operator or to
+  // check it
+  const bool assemble_stif = (!S_mf || param.method.dg_matrix_free_check);
   BilinearForm stif(&fespace);
-  stif.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
-  stif.AddInteriorFaceIntegrator(
-        new DGDiffusionIntegrator(one_over_rho_coef,
-                                  param.method.dg_sigma,
-                                  param.method.dg_kappa));
-  stif.AddBdrFaceIntegrator(
-        new DGDiffusionIntegrator(one_over_rho_coef,
-                                  param.method.dg_sigma,
-                                  param.method.dg_kappa));
-  stif.Assemble();
-  stif.Finalize();
-  const SparseMatrix& S = stif.SpMat();
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-  chrono.Clear();
+  const SparseMatrix *S_cached = nullptr;
+  if (assemble_stif)
+  {
+    cout << "Stif matrix..." << flush;
+    S_cached = cache.load("stif");
+    if (!S_cached)
+    {
+      stif.AddDomainIntegrator(stiffness_integrator(*param.mesh,
+                                                    one_over_rho_coef,
+                                                    GLL_rule));
+      stif.AddInteriorFaceIntegrator(
+            new DGDiffusionIntegrator(one_over_rho_coef,
+                                      param.method.dg_sigma,
+                                      param.method.dg_kappa));
+      stif.Assemble();
+      add_free_surface_terms(param, fespace, one_over_rho_coef,
+                             absorbing_faces, stif.SpMat());
+      stif.Finalize();
+      cache.save("stif", stif.SpMat());
+    }
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
+  }
+  if (S_mf && assemble_stif)
+  {
+    const SparseMatrix& S_assembled = (S_cached ? *S_cached : stif.SpMat());
+    cout << "Matrix-free vs assembled stif: relative difference = "
+         << S_mf->relative_difference(S_assembled) << endl;
+  }
+  const Operator& S = (S_mf ? static_cast<const Operator&>(*S_mf) :
+                       S_cached ? *S_cached : stif.SpMat());
 
   cout << "Mass matrix..." << flush;
   BilinearForm mass(&fespace);
-  mass.AddDomainIntegrator(new MassIntegrator(one_over_K_coef));
-  mass.Assemble();
-  mass.Finalize();
-  const SparseMatrix& M = mass.SpMat();
+  const SparseMatrix *M_cached = cache.load("mass");
+  if (!M_cached)
+  {
+    mass.AddDomainIntegrator(mass_integrator(*param.mesh, one_over_K_coef,
+                                             GLL_rule));
+    mass.Assemble();
+    mass.Finalize();
+    cache.save("mass", mass.SpMat());
+  }
+  const SparseMatrix& M = (M_cached ? *M_cached : mass.SpMat());
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
 
@@ -115,171 +224,229 @@ void AcousticWave::run_DG_serial() const
   {
     cout << "Output mass matrix..." << flush;
     ofstream mout("mass_mat.dat");
-    mass.PrintMatlab(mout);
+    M.PrintMatlab(mout);
     cout << "M.nnz = " << M.NumNonZeroElems() << endl;
     cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
     chrono.Clear();
   }
 
-//  cout << "Damp matrix..." << flush;
-//  VectorMassIntegrator *damp_int = new VectorMassIntegrator(rho_damp_coef);
-//  damp_int->SetIntRule(GLL_rule);
-//  BilinearForm dampM(&fespace);
-//  dampM.AddDomainIntegrator(damp_int);
-//  dampM.Assemble();
-//  dampM.Finalize();
-//  SparseMatrix& D = dampM.SpMat();
-//  double omega = 2.0*M_PI*param.source.frequency; // angular frequency
-//  D *= 0.5*param.dt*omega;
-//  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-//  chrono.Clear();
-
-  cout << "Sys matrix..." << flush;
-  const SparseMatrix& CopyFrom = M;
-  const int nnz = CopyFrom.NumNonZeroElems();
-  const bool ownij  = false;
-  const bool ownval = true;
-  SparseMatrix Sys(CopyFrom.GetI(), CopyFrom.GetJ(), new double[nnz],
-                   CopyFrom.Height(), CopyFrom.Width(), ownij, ownval,
-                   CopyFrom.areColumnsSorted());
-  Sys = 0.0;
-  //Sys += D;
-  Sys += M;
-  GSSmoother prec(Sys);
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-  chrono.Clear();
-
-  cout << "RHS vector... " << flush;
-  LinearForm b(&fespace);
-  ConstantCoefficient zero(0.0); // homogeneous Dirichlet bc
-  if (param.source.plane_wave)
+  // the first order absorbing boundary condition on the absorbing surfaces
+  // (with the GLL quadrature on the faces for the GLL basis, so it's diagonal
+  // too): the system matrix is M + D, where D = dt/2*B
+  IntegrationRule *square_GLL = nullptr;
+  if (gll && dim == 3)
+    square_GLL = new IntegrationRule(segment_GLL, segment_GLL);
+  AbsorbingBoundary abs_bc(param, fespace,
+                           !gll ? nullptr :
+                           square_GLL ? square_GLL : &segment_GLL);
+  cout << "Dofs on absorbing surfaces: " << abs_bc.n_dofs() << endl;
+
+  SparseMatrix *Sys = nullptr;
+  Solver *sys_solver = nullptr;
+  Vector diagM, diagMD;
+  if (gll)
   {
-    PlaneWaveSource plane_wave_source(param, one_over_K_coef);
-    b.AddDomainIntegrator(new DomainLFIntegrator(plane_wave_source));
-    b.AddBdrFaceIntegrator(
-          new DGDirichletLFIntegrator(zero, one_over_rho_coef,
-                                      param.method.dg_sigma,
-                                      param.method.dg_kappa));
-    b.Assemble();
+    // the mass matrix is diagonal, so the solve is a division
+    M.GetDiag(diagM);
+    double off_diag = 0.;
+    for (int i = 0; i < M.Height(); ++i)
+    {
+      MFEM_VERIFY(fabs(diagM[i]) > FLOAT_NUMBERS_EQUALITY_TOLERANCE,
+                  "There is a small (" + d2s(diagM[i]) + ") number (row "
+                  + d2s(i) + ") on the mass matrix diagonal");
+      for (int k = M.GetI()[i]; k < M.GetI()[i+1]; ++k)
+        if (M.GetJ()[k] != i)
+          off_diag = max(off_diag, fabs(M.GetData()[k] / diagM[i]));
+    }
+    MFEM_VERIFY(off_diag < FLOAT_NUMBERS_EQUALITY_TOLERANCE, "The mass matrix "
+                "with the GLL basis is not diagonal (relative off-diagonal "
+                "entry " + d2s(off_diag) + ")");
+
+    diagMD = diagM;
+    abs_bc.add_diagonal(0.5*param.dt, diagMD);
   }
   else
   {
-    ScalarPointForce scalar_point_force(param, one_over_K_coef);
-    b.AddDomainIntegrator(new DomainLFIntegrator(scalar_point_force));
-    b.AddBdrFaceIntegrator(
-          new DGDirichletLFIntegrator(zero, one_over_rho_coef,
-                                      param.method.dg_sigma,
-                                      param.method.dg_kappa));
-    b.Assemble();
-  }
-  cout << "||b||_L2 = " << b.Norml2() << endl;
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-  chrono.Clear();
-
-  const string method_name = "DG_";
-
-  cout << "Open seismograms files..." << flush;
-  ofstream *seisU; // for pressure
-  open_seismo_outs(seisU, param, method_name);
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-  chrono.Clear();
-
-  GridFunction u_0(&fespace); // pressure
-  GridFunction u_1(&fespace);
-  GridFunction u_2(&fespace);
-  u_0 = 0.0;
-  u_1 = 0.0;
-  u_2 = 0.0;
-
-  const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
-  const int tenth = 0.1 * n_time_steps;
-
-  const int N = u_0.Size();
-
-  cout << "N time steps = " << n_time_steps
-       << "\nTime loop..." << endl;
+    cout << "Sys matrix..." << flush;
+    const SparseMatrix& CopyFrom = M;
+    const int nnz = CopyFrom.NumNonZeroElems();
+    const bool ownij  = false;
+    const bool ownval = true;
+    Sys = new SparseMatrix(CopyFrom.GetI(), CopyFrom.GetJ(), new double[nnz],
+                           CopyFrom.Height(), CopyFrom.Width(), ownij, ownval,
+                           CopyFrom.areColumnsSorted());
+    *Sys = 0.0;
+    *Sys += M;
+    abs_bc.add_to(0.5*param.dt, *Sys);
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
 
-  // the values of the time-dependent part of the source
-  vector<double> time_values(n_time_steps);
-  for (int time_step = 1; time_step <= n_time_steps; ++time_step)
-  {
-    const double cur_time = time_step * param.dt;
-    time_values[time_step-1] = RickerWavelet(param.source,
-                                             cur_time - param.dt);
+    // the mass matrix is block diagonal (one block per element), so it's
+    // factorized element by element
+    sys_solver = new_mass_solver(param.method, *Sys, fespace, true);
+    cout << "Mass solver setup time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
   }
 
-  const string name = method_name + param.output.extra_string;
-  const string pref_path = (string)param.output.directory + "/" + SNAPSHOTS_DIR;
-  VisItDataCollection visit_dc(name.c_str(), param.mesh);
-  visit_dc.SetPrefixPath(pref_path.c_str());
-  visit_dc.RegisterField("pressure", &u_0);
-
-  StopWatch time_loop_timer;
-  time_loop_timer.Start();
-  double time_of_snapshots = 0.;
-  double time_of_seismograms = 0.;
-  for (int time_step = 1; time_step <= n_time_steps; ++time_step)
-  {
-    Vector y = u_1; y *= 2.0; y -= u_2;        // y = 2*u_1 - u_2
-
-    Vector z0; z0.SetSize(N);                  // z0 = M * (2*u_1 - u_2)
-    M.Mult(y, z0);
+  const string method_name = (gll ? "DGGLL_" : "DG_");
 
-    Vector z1; z1.SetSize(N); S.Mult(u_1, z1);     // z1 = S * u_1
-    Vector z2 = b; z2 *= time_values[time_step-1]; // z2 = timeval*source
-
-    // y = dt^2 * (S*u_1 - timeval*source), where it can be
-    // y = dt^2 * (S*u_1 - ricker*pointforce) OR
-    // y = dt^2 * (S*u_1 - gaussfirstderivative*momenttensor)
-    y = z1; y -= z2; y *= param.dt*param.dt;
+  // the operators are assembled once, and only the source vector and the
+  // output are renewed for every shot
+  OutputWriter writer; // compresses and writes the data in the background
+  for (int shot = scheduler->next(); shot >= 0; shot = scheduler->next())
+  {
+    param.set_shot(shot);
+    if (param.n_shots() > 1)
+      cout << "\nShot " << shot + 1 << " / " << param.n_shots() << endl;
+
+    cout << "RHS vector... " << flush;
+    LinearForm b(&fespace);
+    ConstantCoefficient zero(0.0); // homogeneous Dirichlet bc
+    if (param.source.plane_wave)
+    {
+      PlaneWaveSource plane_wave_source(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(plane_wave_source));
+      b.AddBdrFaceIntegrator(
+            new DGDirichletLFIntegrator(zero, one_over_rho_coef,
+                                        param.method.dg_sigma,
+                                        param.method.dg_kappa));
+      b.Assemble();
+    }
+    else
+    {
+      ScalarPointForce scalar_point_force(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(scalar_point_force));
+      b.AddBdrFaceIntegrator(
+            new DGDirichletLFIntegrator(zero, one_over_rho_coef,
+                                        param.method.dg_sigma,
+                                        param.method.dg_kappa));
+      b.Assemble();
+    }
+    cout << "||b||_L2 = " << b.Norml2() << endl;
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
 
-    // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source)
-    Vector RHS = z0; RHS -= y;
+    cout << "Open seismograms files..." << flush;
+    SeismogramsOutput seisU(param, method_name, writer); // for pressure
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
 
-//    for (int i = 0; i < N; ++i) y[i] = diagD[i] * u_2[i]; // y = D * u_2
+    GridFunction u_0(&fespace); // pressure
+    GridFunction u_1(&fespace);
+    GridFunction u_2(&fespace);
+    u_0 = 0.0;
+    u_1 = 0.0;
+    u_2 = 0.0;
 
-    // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2
-//    RHS += y;
+    const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
+    const int tenth = 0.1 * n_time_steps;
 
-    // (M+D)*x_0 = M*(2*x_1-x_2) - dt^2*(S*x_1-r*b) + D*x_2
-    PCG(Sys, prec, RHS, u_0, 0, 200, 1e-12, 0.0);
+    const int N = u_0.Size();
 
-    // Compute and print the L^2 norm of the error
-    if (time_step % tenth == 0) {
-      cout << "step " << time_step << " / " << n_time_steps
-           << " ||solution||_{L^2} = " << u_0.Norml2() << endl;
-    }
+    cout << "N time steps = " << n_time_steps
+         << "\nTime loop..." << endl;
 
-    if (time_step % param.step_snap == 0) {
-      StopWatch timer;
-      timer.Start();
-      visit_dc.SetCycle(time_step);
-      visit_dc.SetTime(time_step*param.dt);
-      visit_dc.Save();
-      timer.Stop();
-      time_of_snapshots += timer.UserTime();
+    // the values of the time-dependent part of the source
+    vector<double> time_values(n_time_steps);
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      const double cur_time = time_step * param.dt;
+      time_values[time_step-1] = RickerWavelet(param.source,
+                                               cur_time - param.dt);
     }
 
-    if (time_step % param.step_seis == 0) {
-      StopWatch timer;
-      timer.Start();
-      output_seismograms(param, *param.mesh, u_0, seisU);
-      timer.Stop();
-      time_of_seismograms += timer.UserTime();
+    const string name = method_name + param.output.extra_string;
+    const string pref_path = (string)param.output.directory + "/" +
+                             SNAPSHOTS_DIR;
+    VisItDataCollection visit_dc(name.c_str(), param.mesh);
+    visit_dc.SetPrefixPath(pref_path.c_str());
+    visit_dc.RegisterField("pressure", &u_0);
+
+    CompressedSnapshots *snapshots = nullptr;
+    if (param.output.snapshot_tolerance > 0)
+      snapshots = new CompressedSnapshots(writer, pref_path + name, fespace,
+                                          param.output);
+
+    StopWatch time_loop_timer;
+    time_loop_timer.Start();
+    double time_of_snapshots = 0.;
+    double time_of_seismograms = 0.;
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      Vector y = u_1; y *= 2.0; y -= u_2;        // y = 2*u_1 - u_2
+
+      Vector z0; z0.SetSize(N);                  // z0 = M * (2*u_1 - u_2)
+      M.Mult(y, z0);
+
+      Vector z1; z1.SetSize(N); S.Mult(u_1, z1);     // z1 = S * u_1
+      Vector z2 = b; z2 *= time_values[time_step-1]; // z2 = timeval*source
+
+      // y = dt^2 * (S*u_1 - timeval*source), where it can be
+      // y = dt^2 * (S*u_1 - ricker*pointforce) OR
+      // y = dt^2 * (S*u_1 - gaussfirstderivative*momenttensor)
+      y = z1; y -= z2; y *= param.dt*param.dt;
+
+      // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source)
+      Vector RHS = z0; RHS -= y;
+
+      // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2
+      abs_bc.add_mult(0.5*param.dt, u_2.GetData(), RHS.GetData());
+
+      // (M+D)*x_0 = M*(2*x_1-x_2) - dt^2*(S*x_1-r*b) + D*x_2
+      if (sys_solver)
+        sys_solver->Mult(RHS, u_0);
+      else
+        for (int i = 0; i < N; ++i)
+          u_0[i] = RHS[i] / diagMD[i];
+
+      // Compute and print the L^2 norm of the error
+      if (time_step % tenth == 0) {
+        cout << "step " << time_step << " / " << n_time_steps
+             << " ||solution||_{L^2} = " << u_0.Norml2() << endl;
+      }
+
+      if (time_step % param.step_snap == 0) {
+        StopWatch timer;
+        timer.Start();
+        if (snapshots)
+          snapshots->write(u_0, time_step);
+        else
+        {
+          visit_dc.SetCycle(time_step);
+          visit_dc.SetTime(time_step*param.dt);
+          visit_dc.Save();
+        }
+        timer.Stop();
+        time_of_snapshots += timer.UserTime();
+      }
+
+      if (time_step % param.step_seis == 0) {
+        StopWatch timer;
+        timer.Start();
+        seisU.write(*param.mesh, u_0);
+        timer.Stop();
+        time_of_seismograms += timer.UserTime();
+      }
+
+      u_2 = u_1;
+      u_1 = u_0;
     }
 
-    u_2 = u_1;
-    u_1 = u_0;
-  }
-
-  time_loop_timer.Stop();
+    time_loop_timer.Stop();
 
-  delete[] seisU;
+    delete snapshots;
+    writer.wait();
 
-  cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
-       << "\n\ttime of snapshots = " << time_of_snapshots
-       << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+    cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
+         << "\n\ttime of snapshots = " << time_of_snapshots
+         << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+  }
 
+  delete sys_solver;
+  delete Sys;
+  delete S_mf;
+  delete square_GLL;
+  delete GLL_rule;
   delete fec;
 }
 
@@ -0,0 +1,458 @@
+#include "absorbing_boundary.hpp"
+#include "acoustic_wave.hpp"
+#include "GLL_quadrature.hpp"
+#include "mass_solver.hpp"
+#include "output_writer.hpp"
+#include "parameters.hpp"
+#include "shot_scheduler.hpp"
+#include "structured_assembly.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <float.h>
+
+using namespace std;
+using namespace mfem;
+
+
+
+/**
+ * The coefficients of the low-storage (2N) 5-stage 4th order Runge-Kutta
+ * method of Carpenter and Kennedy.
+ */
+static const int LSRK_STAGES = 5;
+static const double LSRK_A[] = {
+  0.,
+  -567301805773.  / 1357537059087.,
+  -2404267990393. / 2016746695238.,
+  -3550918686646. / 2091501179385.,
+  -1275806237668. / 842570457699.
+};
+static const double LSRK_B[] = {
+  1432997174477.  / 9575080441755.,
+  5161836677717.  / 13612068292357.,
+  1720146321549.  / 2090206949498.,
+  3134564353537.  / 4481467310338.,
+  2277821191437.  / 14882151754819.
+};
+static const double LSRK_C[] = {
+  0.,
+  1432997174477.  / 9575080441755.,
+  2526269341429.  / 6820363183890.,
+  2006345519317.  / 3224310063776.,
+  2802321613138.  / 2924317926251.
+};
+
+
+
+/**
+ * Assemble the operator of the first order acoustic system
+ *   (1/K) dp/dt + div v = f,  rho dv/dt + grad p = 0
+ * in the strong DG form (without the mass matrices) with the upwind flux, i.e.
+ * the exact solution of the Riemann problem between the cells with the
+ * impedances Z = rho*vp. The unknowns are ordered by fields: p, v_x, v_y, v_z,
+ * each of them in the dofs of the scalar space. The free surfaces of the outer
+ * boundary have p = 0 (the mirror state p+ = -p-, v+ = v-), and the absorbing
+ * surfaces have the exterior state at rest with the same impedance
+ * (p+ = 0, v+ = 0), so the outgoing waves leave the domain (the first order
+ * absorbing condition).
+ */
+static void assemble_dgvp_operator(const Parameters &param,
+                                   const FiniteElementSpace &fespace,
+                                   SparseMatrix &A)
+{
+  const double *rho = param.media.rho_array;
+  const double *vp = param.media.vp_array;
+  Mesh &mesh = *fespace.GetMesh();
+  const int dim = mesh.Dimension();
+  const int n_fields = 1 + dim;
+  const int N = fespace.GetVSize();
+
+  // volume terms: -div v in the equation of p, and -grad p in the ones of v
+  ConstantCoefficient one(1.0);
+  DenseMatrix elmat;
+  Array<int> dofs, rows, cols;
+  for (int el = 0; el < mesh.GetNE(); ++el)
+  {
+    const FiniteElement &fe = *fespace.GetFE(el);
+    ElementTransformation *T = mesh.GetElementTransformation(el);
+    fespace.GetElementVDofs(el, dofs);
+    const int nd = dofs.Size();
+    rows.SetSize(nd);
+    cols.SetSize(nd);
+    for (int d = 0; d < dim; ++d)
+    {
+      DerivativeIntegrator deriv(one, d);
+      deriv.AssembleElementMatrix(fe, *T, elmat); // (phi_i, d(phi_j)/dx_d)
+      elmat *= -1.0;
+      for (int i = 0; i < nd; ++i)
+      {
+        rows[i] = dofs[i];                // p
+        cols[i] = (1 + d)*N + dofs[i];    // v_d
+      }
+      A.AddSubMatrix(rows, cols, elmat);
+      A.AddSubMatrix(cols, rows, elmat);
+    }
+  }
+
+  // face terms: (v.n - v*.n, q) and ((p - p*) n, w), where p* and v*.n are
+  // the upwind states
+  Vector nor(dim), shape[2], center(dim);
+  Array<int> side_dofs[2];
+  for (int f = 0; f < mesh.GetNumFaces(); ++f)
+  {
+    FaceElementTransformations *FT = mesh.GetFaceElementTransformations(f);
+    const int elem[] = { FT->Elem1No, FT->Elem2No };
+    const bool interior = (elem[1] >= 0);
+    const int n_sides = (interior ? 2 : 1);
+
+    double Z[2];
+    int order = 0;
+    int offset[3] = { 0, 0, 0 }; // of the sides in the local matrix
+    for (int s = 0; s < n_sides; ++s)
+    {
+      const int cell = mesh.GetAttribute(elem[s]) - 1;
+      Z[s] = rho[cell] * vp[cell];
+      fespace.GetElementVDofs(elem[s], side_dofs[s]);
+      shape[s].SetSize(side_dofs[s].Size());
+      order = max(order, fespace.GetFE(elem[s])->GetOrder());
+      offset[s+1] = offset[s] + n_fields * side_dofs[s].Size();
+    }
+
+    // coefs[test side][test field: 0 - p, 1 - v][trial: p1, vn1, p2, vn2]
+    double coefs[2][2][4];
+    if (interior)
+    {
+      const double c = 1. / (Z[0] + Z[1]);
+      const double Z12 = Z[0] * Z[1];
+      const double C[2][2][4] = {
+        { { -c,      c*Z[1], c,       -c*Z[1] },
+          { c*Z[0], -c*Z12, -c*Z[0],   c*Z12  } },
+        { { c,       c*Z[0], -c,      -c*Z[0] },
+          { -c*Z[1], -c*Z12,  c*Z[1],  c*Z12  } } };
+      std::copy(&C[0][0][0], &C[0][0][0] + 16, &coefs[0][0][0]);
+    }
+    else
+    {
+      FT->Face->Transform(Geometries.GetCenter(FT->FaceGeom), center);
+      if (on_absorbing_surface(param, center))
+      {
+        const double C[2][2][4] = {
+          { { -0.5 / Z[0], 0.5,         0., 0. },
+            { 0.5,         -0.5 * Z[0], 0., 0. } },
+          { { 0., 0., 0., 0. },
+            { 0., 0., 0., 0. } } };
+        std::copy(&C[0][0][0], &C[0][0][0] + 16, &coefs[0][0][0]);
+      }
+      else
+      {
+        const double C[2][2][4] = {
+          { { -1. / Z[0], 0., 0., 0. },
+            { 1.,         0., 0., 0. } },
+          { { 0., 0., 0., 0. },
+            { 0., 0., 0., 0. } } };
+        std::copy(&C[0][0][0], &C[0][0][0] + 16, &coefs[0][0][0]);
+      }
+    }
+
+    elmat.SetSize(offset[n_sides]);
+    elmat = 0.0;
+    const IntegrationRule &rule = IntRules.Get(FT->FaceGeom, 2*order);
+    for (int q = 0; q < rule.GetNPoints(); ++q)
+    {
+      const IntegrationPoint &ip = rule.IntPoint(q);
+      FT->Face->SetIntPoint(&ip);
+      CalcOrtho(FT->Face->Jacobian(), nor); // from the side 1 to the side 2
+      const double area = nor.Norml2();
+      const double w = ip.weight * area;
+      nor /= area;
+
+      IntegrationPoint eip;
+      FT->Loc1.Transform(ip, eip);
+      fespace.GetFE(elem[0])->CalcShape(eip, shape[0]);
+      if (interior)
+      {
+        FT->Loc2.Transform(ip, eip);
+        fespace.GetFE(elem[1])->CalcShape(eip, shape[1]);
+      }
+
+      for (int s = 0; s < n_sides; ++s)          // test side
+        for (int F = 0; F < n_fields; ++F)       // test field
+        {
+          // the normal of the side s is (-1)^s * nor
+          const double test = (F == 0 ? 1. : (s == 0 ? 1. : -1.) * nor(F-1));
+          const double *C = coefs[s][F == 0 ? 0 : 1];
+          for (int t = 0; t < n_sides; ++t)      // trial side
+            for (int G = 0; G < n_fields; ++G)   // trial field
+            {
+              const double trial = (G == 0 ? C[2*t] : C[2*t+1] * nor(G-1));
+              const double c = w * test * trial;
+              if (c == 0.)
+                continue;
+              for (int i = 0; i < shape[s].Size(); ++i)
+                for (int j = 0; j < shape[t].Size(); ++j)
+                  elmat(offset[s] + F*shape[s].Size() + i,
+                        offset[t] + G*shape[t].Size() + j) +=
+                    c * shape[s](i) * shape[t](j);
+            }
+        }
+    }
+
+    rows.SetSize(offset[n_sides]);
+    for (int s = 0; s < n_sides; ++s)
+      for (int F = 0; F < n_fields; ++F)
+        for (int i = 0; i < side_dofs[s].Size(); ++i)
+          rows[offset[s] + F*side_dofs[s].Size() + i] = F*N + side_dofs[s][i];
+    A.AddSubMatrix(rows, rows, elmat);
+  }
+}
+
+
+
+void AcousticWave::run_DGVP() const
+{
+#if defined(MFEM_USE_MPI)
+  int size;
+  MPI_Comm_size(param.comm, &size);
+  MFEM_VERIFY(size == 1, "The velocity-pressure DG is not implemented in "
+              "parallel");
+#endif
+  MFEM_VERIFY(param.mesh, "The mesh is not initialized");
+
+  StopWatch chrono;
+
+  chrono.Start();
+
+  const int dim = param.dimension;
+  const int n_elements = param.mesh->GetNE();
+  const bool gll = param.method.dg_gll;
+
+  cout << "FE space generation..." << flush;
+  FiniteElementCollection *fec = nullptr;
+  if (gll)
+    fec = new L2_FECollection(param.method.order, dim, BasisType::GaussLobatto);
+  else
+    fec = new DG_FECollection(param.method.order, dim);
+  FiniteElementSpace fespace(param.mesh, fec);
+  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  const int N = fespace.GetVSize();
+  cout << "Number of unknowns: " << (1 + dim) * N << " (pressure and "
+       << dim << " velocity components)" << endl;
+
+  double *one_over_K = new double[n_elements]; // one over bulk modulus
+
+  double Rho[] = { DBL_MAX, DBL_MIN };
+  double Vp[]  = { DBL_MAX, DBL_MIN };
+  double Kap[] = { DBL_MAX, DBL_MIN };
+
+  for (int i = 0; i < n_elements; ++i)
+  {
+    const double rho = param.media.rho_array[i];
+    const double vp  = param.media.vp_array[i];
+    const double K   = rho*vp*vp;
+
+    MFEM_VERIFY(rho > 1.0 && vp > 1.0, "Incorrect media properties arrays");
+
+    Rho[0] = std::min(Rho[0], rho);
+    Rho[1] = std::max(Rho[1], rho);
+    Vp[0]  = std::min(Vp[0], vp);
+    Vp[1]  = std::max(Vp[1], vp);
+    Kap[0] = std::min(Kap[0], K);
+    Kap[1] = std::max(Kap[1], K);
+
+    one_over_K[i] = 1. / K;
+  }
+
+  std::cout << "Rho: min " << Rho[0] << " max " << Rho[1] << "\n";
+  std::cout << "Vp:  min " << Vp[0]  << " max " << Vp[1] << "\n";
+  std::cout << "Kap: min " << Kap[0] << " max " << Kap[1] << "\n";
+
+  const bool own_array = false;
+  CWConstCoefficient rho_coef(param.media.rho_array, own_array);
+  CWConstCoefficient one_over_K_coef(one_over_K, own_array);
+
+  IntegrationRule segment_GLL;
+  IntegrationRule *GLL_rule = nullptr;
+  if (gll)
+  {
+    create_segment_GLL_rule(param.method.order, segment_GLL);
+    if (dim == 2)
+      GLL_rule = new IntegrationRule(segment_GLL, segment_GLL);
+    else
+      GLL_rule = new IntegrationRule(segment_GLL, segment_GLL, segment_GLL);
+  }
+
+  cout << "Mass matrices..." << flush;
+  BilinearForm mass_p(&fespace); // with 1/K for the pressure
+  mass_p.AddDomainIntegrator(mass_integrator(*param.mesh, one_over_K_coef,
+                                             GLL_rule));
+  mass_p.Assemble();
+  mass_p.Finalize();
+  BilinearForm mass_v(&fespace); // with rho for every velocity component
+  mass_v.AddDomainIntegrator(mass_integrator(*param.mesh, rho_coef,
+                                             GLL_rule));
+  mass_v.Assemble();
+  mass_v.Finalize();
+
+  // the mass matrices are block diagonal, so their inverses are applied
+  // element by element, and there are no global solves
+  BlockCholeskySolver Mp_inv(mass_p.SpMat(), fespace);
+  BlockCholeskySolver Mv_inv(mass_v.SpMat(), fespace);
+  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  cout << "System operator (upwind flux)..." << flush;
+  SparseMatrix A((1 + dim) * N);
+  assemble_dgvp_operator(param, fespace, A);
+  A.Finalize();
+  cout << "done. nnz = " << A.NumNonZeroElems() << ". Time = "
+       << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  {
+    // the stable time step of the upwind DG with LSRK(5,4) is of the order of
+    // h / (vp*(p+1)^2) and doesn't depend on a penalty parameter
+    double h_min = DBL_MAX;
+    for (int el = 0; el < n_elements; ++el)
+      h_min = min(h_min, param.mesh->GetElementSize(el, 1));
+    const int p1 = param.method.order + 1;
+    cout << "CFL number vp_max*dt*(p+1)^2/h_min = "
+         << Vp[1] * param.dt * p1 * p1 / h_min << endl;
+  }
+
+  const string method_name = "DGVP_";
+
+  OutputWriter writer; // compresses and writes the data in the background
+  for (int shot = scheduler->next(); shot >= 0; shot = scheduler->next())
+  {
+    param.set_shot(shot);
+    if (param.n_shots() > 1)
+      cout << "\nShot " << shot + 1 << " / " << param.n_shots() << endl;
+
+    // the source of the pressure equation is the time integral of the one of
+    // the second order equation, i.e. the integral of the Ricker wavelet
+    cout << "RHS vector... " << flush;
+    LinearForm b(&fespace);
+    if (param.source.plane_wave)
+    {
+      PlaneWaveSource plane_wave_source(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(plane_wave_source));
+      b.Assemble();
+    }
+    else
+    {
+      ScalarPointForce scalar_point_force(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(scalar_point_force));
+      b.Assemble();
+    }
+    cout << "||b||_L2 = " << b.Norml2() << endl;
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
+
+    cout << "Open seismograms files..." << flush;
+    SeismogramsOutput seisU(param, method_name, writer); // for pressure
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
+
+    // the two registers of the low-storage Runge-Kutta method, and the
+    // evaluation of the right hand side
+    Vector U((1 + dim) * N), dU((1 + dim) * N), K((1 + dim) * N);
+    Vector AU((1 + dim) * N);
+    U = 0.0;
+    dU = 0.0;
+    GridFunction p(&fespace, U.GetData()); // pressure (the first field)
+
+    const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
+    const int tenth = 0.1 * n_time_steps;
+
+    cout << "N time steps = " << n_time_steps
+         << "\nTime loop..." << endl;
+
+    const string name = method_name + param.output.extra_string;
+    const string pref_path = (string)param.output.directory + "/" +
+                             SNAPSHOTS_DIR;
+    VisItDataCollection visit_dc(name.c_str(), param.mesh);
+    visit_dc.SetPrefixPath(pref_path.c_str());
+    visit_dc.RegisterField("pressure", &p);
+
+    CompressedSnapshots *snapshots = nullptr;
+    if (param.output.snapshot_tolerance > 0)
+      snapshots = new CompressedSnapshots(writer, pref_path + name, fespace,
+                                          param.output);
+
+    StopWatch time_loop_timer;
+    time_loop_timer.Start();
+    double time_of_snapshots = 0.;
+    double time_of_seismograms = 0.;
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      const double t0 = (time_step - 1) * param.dt;
+      for (int s = 0; s < LSRK_STAGES; ++s)
+      {
+        // K = M^{-1} (A U + r(t) b)
+        A.Mult(U, AU);
+        const double timeval = GaussFirstDerivative(param.source,
+                                                    t0 + LSRK_C[s]*param.dt);
+        Vector AU_p(AU.GetData(), N);
+        AU_p.Add(timeval, b);
+        for (int F = 0; F <= dim; ++F)
+        {
+          Vector AU_F(AU.GetData() + F*N, N);
+          Vector K_F(K.GetData() + F*N, N);
+          if (F == 0)
+            Mp_inv.Mult(AU_F, K_F);
+          else
+            Mv_inv.Mult(AU_F, K_F);
+        }
+
+        dU *= LSRK_A[s];
+        dU.Add(param.dt, K);
+        U.Add(LSRK_B[s], dU);
+      }
+
+      // Compute and print the L^2 norm of the error
+      if (time_step % tenth == 0) {
+        cout << "step " << time_step << " / " << n_time_steps
+             << " ||p||_{L^2} = " << p.Norml2() << endl;
+      }
+
+      if (time_step % param.step_snap == 0) {
+        StopWatch timer;
+        timer.Start();
+        if (snapshots)
+          snapshots->write(p, time_step);
+        else
+        {
+          visit_dc.SetCycle(time_step);
+          visit_dc.SetTime(time_step*param.dt);
+          visit_dc.Save();
+        }
+        timer.Stop();
+        time_of_snapshots += timer.UserTime();
+      }
+
+      if (time_step % param.step_seis == 0) {
+        StopWatch timer;
+        timer.Start();
+        seisU.write(*param.mesh, p);
+        timer.Stop();
+        time_of_seismograms += timer.UserTime();
+      }
+    }
+
+    time_loop_timer.Stop();
+
+    delete snapshots;
+    writer.wait();
+
+    cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
+         << "\n\ttime of snapshots = " << time_of_snapshots
+         << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+  }
+
+  delete GLL_rule;
+  delete[] one_over_K;
+  delete fec;
+}
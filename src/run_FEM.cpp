@@ -1,8 +1,17 @@
+#include "absorbing_boundary.hpp"
 #include "acoustic_wave.hpp"
+#include "mass_solver.hpp"
+#include "operator_cache.hpp"
+#include "output_writer.hpp"
+#include "parallel_output.hpp"
 #include "parameters.hpp"
+#include "pml.hpp"
+#include "shot_scheduler.hpp"
+#include "structured_assembly.hpp"
 #include "utilities.hpp"
 
 #include <float.h>
+#include <sstream>
 
 using namespace std;
 using namespace mfem;
@@ -20,15 +29,290 @@ void AcousticWave::run_FEM() const
 
 
 
+#if defined(MFEM_USE_MPI)
+/**
+ * The coefficient dt/2 * 1/(rho*vp) of the damping matrix of the first order
+ * absorbing boundary condition on the boundary elements of the local part of
+ * the parallel mesh: the media of the adjacent cells on the absorbing
+ * surfaces, zero on the other boundary elements. The values are indexed by the
+ * local boundary elements, the media arrays - by the local cells.
+ */
+static double* absorbing_damping(const Parameters &param, ParMesh &mesh,
+                                 int &n_abs_elements)
+{
+  double *values = new double[max(1, mesh.GetNBE())];
+  n_abs_elements = 0;
+  Vector center(param.dimension);
+  for (int be = 0; be < mesh.GetNBE(); ++be)
+  {
+    values[be] = 0.;
+    ElementTransformation &T = *mesh.GetBdrElementTransformation(be);
+    T.Transform(Geometries.GetCenter(mesh.GetBdrElementBaseGeometry(be)),
+                center);
+    if (!on_absorbing_surface(param, center))
+      continue;
+    FaceElementTransformations *FT = mesh.GetBdrFaceTransformations(be);
+    MFEM_VERIFY(FT, "No element adjacent to the boundary element " + d2s(be));
+    const int cell = FT->Elem1No;
+    values[be] = 0.5 * param.dt / (param.media.rho_array[cell] *
+                                   param.media.vp_array[cell]);
+    ++n_abs_elements;
+  }
+  return values;
+}
+
 void AcousticWave::run_FEM_parallel() const
 {
+  // the parallel mesh without a serial one is run by this function even on
+  // one process
   int size;
-  MPI_Comm_size(MPI_COMM_WORLD, &size);
-  if (size == 1)
+  MPI_Comm_size(param.comm, &size);
+  if (size == 1 && param.mesh)
+  {
     run_FEM_serial();
-  else
-    MFEM_ABORT("NOT implemented");
+    return;
+  }
+
+  MFEM_VERIFY(param.par_mesh, "The parallel mesh is not initialized");
+  MFEM_VERIFY(!param.bc.pml, "PML is not implemented for the parallel FEM");
+
+  int myid;
+  MPI_Comm_rank(param.comm, &myid);
+  const bool root = (myid == 0); // only it prints the progress
+
+  StopWatch chrono;
+  chrono.Start();
+
+  const int dim = param.dimension;
+  // local cells followed by the face neighbors
+  const int n_elements = param.media.n_cells;
+
+  if (root) cout << "FE space generation..." << flush;
+  H1_FECollection fec(param.method.order, dim);
+  ParFiniteElementSpace fespace(param.par_mesh, &fec);
+  const HYPRE_Int n_dofs = fespace.GlobalTrueVSize();
+  if (root) cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  if (root) cout << "Number of unknowns: " << n_dofs << endl;
+
+  double *one_over_rho = new double[n_elements]; // one over density
+  double *one_over_K   = new double[n_elements]; // one over bulk modulus
+  for (int i = 0; i < n_elements; ++i)
+  {
+    const double rho = param.media.rho_array[i];
+    const double vp  = param.media.vp_array[i];
+    MFEM_VERIFY(rho > 1.0 && vp > 1.0, "Incorrect media properties arrays");
+    one_over_rho[i] = 1. / rho;
+    one_over_K[i]   = 1. / (rho*vp*vp);
+  }
+
+  const bool own_array = true;
+  const bool local_index = true;
+  CWConstCoefficient one_over_rho_coef(one_over_rho, own_array, local_index);
+  CWConstCoefficient one_over_K_coef(one_over_K, own_array, local_index);
+
+  if (root) cout << "Stif matrix..." << flush;
+  ParBilinearForm stif(&fespace);
+  stif.AddDomainIntegrator(stiffness_integrator(*param.par_mesh,
+                                                one_over_rho_coef));
+  stif.Assemble();
+  stif.Finalize();
+  HypreParMatrix *S = stif.ParallelAssemble();
+  if (root) cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  if (root) cout << "Mass matrix..." << flush;
+  ParBilinearForm mass(&fespace);
+  mass.AddDomainIntegrator(mass_integrator(*param.par_mesh, one_over_K_coef));
+  mass.Assemble();
+  mass.Finalize();
+  HypreParMatrix *M = mass.ParallelAssemble();
+  if (root) cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  // the first order absorbing boundary condition on the absorbing surfaces:
+  // D = dt/2*B, where B is the boundary mass matrix with 1/(rho*vp), and the
+  // system matrix is M + D
+  int n_abs_elements;
+  double *damping = absorbing_damping(param, *param.par_mesh, n_abs_elements);
+  CWConstCoefficient damping_coef(damping, own_array, local_index);
+  MPI_Allreduce(MPI_IN_PLACE, &n_abs_elements, 1, MPI_INT, MPI_SUM,
+                param.comm);
+  if (root)
+    cout << "Boundary elements on absorbing surfaces: " << n_abs_elements
+         << endl;
+  HypreParMatrix *D = nullptr;
+  HypreParMatrix *Sys = nullptr;
+  if (n_abs_elements > 0)
+  {
+    if (root) cout << "Damping and system matrices..." << flush;
+    ParBilinearForm damp(&fespace);
+    damp.AddBoundaryIntegrator(new MassIntegrator(damping_coef));
+    damp.Assemble();
+    damp.Finalize();
+    D = damp.ParallelAssemble();
+
+    ParBilinearForm sys(&fespace);
+    sys.AddDomainIntegrator(mass_integrator(*param.par_mesh, one_over_K_coef));
+    sys.AddBoundaryIntegrator(new MassIntegrator(damping_coef));
+    sys.Assemble();
+    sys.Finalize();
+    Sys = sys.ParallelAssemble();
+    if (root) cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
+  }
+
+  // the system matrix is constant, so its solver is set up once, and the time
+  // steps need no global reductions with the Chebyshev iteration
+  ostringstream quiet;
+  Solver *M_solver = new_mass_solver(param.method, Sys ? *Sys : *M,
+                                     root ? cout : quiet);
+  if (root)
+    cout << "Mass solver setup time = " << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  const string method_name = "parFEM_";
+
+  for (int shot = scheduler->next(); shot >= 0; shot = scheduler->next())
+  {
+    param.set_shot(shot);
+    if (root && param.n_shots() > 1)
+      cout << "\nShot " << shot + 1 << " / " << param.n_shots() << endl;
+
+    if (root) cout << "RHS vector... " << flush;
+    ParLinearForm b(&fespace);
+    if (param.source.plane_wave)
+    {
+      PlaneWaveSource plane_wave_source(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(plane_wave_source));
+      b.Assemble();
+    }
+    else
+    {
+      ScalarPointForce scalar_point_force(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(scalar_point_force));
+      b.Assemble();
+    }
+    HypreParVector *B = b.ParallelAssemble();
+    const double b_norm = GlobalLpNorm(2, B->Norml2(), param.comm);
+    if (root)
+    {
+      cout << "||b||_L2 = " << b_norm << endl;
+      cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    }
+    chrono.Clear();
+
+    if (root) cout << "Open seismograms files..." << flush;
+    vector<ParSeismograms*> seisU; // for pressure
+    open_par_seismo_outs(seisU, param, *param.par_mesh, method_name);
+    if (root) cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
+
+    const string snapfile = string(param.output.directory) + "/" +
+                            SNAPSHOTS_DIR + method_name +
+                            param.output.extra_string + "_p.bin";
+    ParSnapshots snapU(fespace, snapfile);
+
+    // the time stepping is done in the true dofs
+    HypreParVector U_0(*M); U_0 = 0.0;
+    HypreParVector U_1(*M); U_1 = 0.0;
+    HypreParVector U_2(*M); U_2 = 0.0;
+    ParGridFunction u_0(&fespace); // pressure
+
+    const int N = U_0.Size();
+    Vector y(N), z(N), RHS(N);
+
+    const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
+    const int tenth = 0.1 * n_time_steps;
+
+    if (root)
+      cout << "N time steps = " << n_time_steps
+           << "\nTime loop..." << endl;
+
+    // the values of the time-dependent part of the source
+    vector<double> time_values(n_time_steps);
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      const double cur_time = time_step * param.dt;
+      time_values[time_step-1] = RickerWavelet(param.source,
+                                               cur_time - param.dt);
+    }
+
+    StopWatch time_loop_timer;
+    time_loop_timer.Start();
+    double time_of_snapshots = 0.;
+    double time_of_seismograms = 0.;
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      y = U_1; y *= 2.0; y -= U_2;       // y = 2*u_1 - u_2
+      M->Mult(y, RHS);                   // RHS = M * (2*u_1 - u_2)
+      S->Mult(U_1, z);                   // z = S*u_1 - timeval*source
+      z.Add(-time_values[time_step-1], *B);
+
+      // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source)
+      RHS.Add(-param.dt*param.dt, z);
+
+      // RHS += D*u_2
+      if (D)
+        D->Mult(1.0, U_2, 1.0, RHS);
+
+      // (M+D)*u_0 = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2
+      M_solver->Mult(RHS, U_0);
+
+      // Compute and print the L^2 norm of the solution (a global reduction,
+      // so not at every step)
+      if (time_step % tenth == 0) {
+        const double norm = GlobalLpNorm(2, U_0.Norml2(), param.comm);
+        if (root)
+          cout << "step " << time_step << " / " << n_time_steps
+              << " ||solution||_{L^2} = " << norm << endl;
+      }
+
+      const bool snap = (time_step % param.step_snap == 0);
+      const bool seis = (time_step % param.step_seis == 0);
+      if (snap || seis)
+        u_0.Distribute(&U_0);
+
+      if (snap) {
+        StopWatch timer;
+        timer.Start();
+        snapU.write(u_0);
+        timer.Stop();
+        time_of_snapshots += timer.UserTime();
+      }
+
+      if (seis) {
+        StopWatch timer;
+        timer.Start();
+        output_par_seismograms(u_0, seisU);
+        timer.Stop();
+        time_of_seismograms += timer.UserTime();
+      }
+
+      U_2 = U_1;
+      U_1 = U_0;
+    }
+
+    time_loop_timer.Stop();
+
+    for (size_t i = 0; i < seisU.size(); ++i)
+      delete seisU[i];
+    delete B;
+
+    if (root)
+      cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
+           << "\n\ttime of snapshots = " << time_of_snapshots
+           << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+  }
+
+  delete M_solver;
+  delete Sys;
+  delete D;
+  delete M;
+  delete S;
 }
+#endif // MFEM_USE_MPI
 
 
 
@@ -85,21 +369,36 @@ void AcousticWave::run_FEM_serial() const
   CWConstCoefficient one_over_rho_coef(one_over_rho, own_array);
   CWConstCoefficient one_over_K_coef(one_over_K, own_array);
 
+  // the operators are taken from the cache if they have been assembled for
+  // the same mesh, media and discretization
+  OperatorCache cache(param, "FEM");
+
   cout << "Stif matrix..." << flush;
   BilinearForm stif(&fespace);
-  stif.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
-  stif.Assemble();
-  stif.Finalize();
-  const SparseMatrix& S = stif.SpMat();
+  const SparseMatrix *S_cached = cache.load("stif");
+  if (!S_cached)
+  {
+    stif.AddDomainIntegrator(stiffness_integrator(*param.mesh,
+                                                  one_over_rho_coef));
+    stif.Assemble();
+    stif.Finalize();
+    cache.save("stif", stif.SpMat());
+  }
+  const SparseMatrix& S = (S_cached ? *S_cached : stif.SpMat());
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
 
   cout << "Mass matrix..." << flush;
   BilinearForm mass(&fespace);
-  mass.AddDomainIntegrator(new MassIntegrator(one_over_K_coef));
-  mass.Assemble();
-  mass.Finalize();
-  const SparseMatrix& M = mass.SpMat();
+  const SparseMatrix *M_cached = cache.load("mass");
+  if (!M_cached)
+  {
+    mass.AddDomainIntegrator(mass_integrator(*param.mesh, one_over_K_coef));
+    mass.Assemble();
+    mass.Finalize();
+    cache.save("mass", mass.SpMat());
+  }
+  const SparseMatrix& M = (M_cached ? *M_cached : mass.SpMat());
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
 
@@ -107,25 +406,27 @@ void AcousticWave::run_FEM_serial() const
   {
     cout << "Output mass matrix..." << flush;
     ofstream mout("mass_mat.dat");
-    mass.PrintMatlab(mout);
+    M.PrintMatlab(mout);
     cout << "M.nnz = " << M.NumNonZeroElems() << endl;
     cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
     chrono.Clear();
   }
 #endif
 
-//  cout << "Damp matrix..." << flush;
-//  VectorMassIntegrator *damp_int = new VectorMassIntegrator(rho_damp_coef);
-//  damp_int->SetIntRule(GLL_rule);
-//  BilinearForm dampM(&fespace);
-//  dampM.AddDomainIntegrator(damp_int);
-//  dampM.Assemble();
-//  dampM.Finalize();
-//  SparseMatrix& D = dampM.SpMat();
-//  double omega = 2.0*M_PI*param.source.frequency; // angular frequency
-//  D *= 0.5*param.dt*omega;
-//  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-//  chrono.Clear();
+  // the first order absorbing boundary condition on the absorbing surfaces
+  AbsorbingBoundary abs_bc(param, fespace);
+  cout << "Dofs on absorbing surfaces: " << abs_bc.n_dofs() << endl;
+
+  PML *pml = nullptr;
+  if (param.bc.pml)
+  {
+    cout << "PML..." << flush;
+    pml = new PML(param, fespace, one_over_rho_coef, one_over_K_coef);
+    cout << "done. Elements in PML: " << pml->n_elements() << ", memory = "
+         << pml->memory() / 1048576. << " MB. Time = " << chrono.RealTime()
+         << " sec" << endl;
+    chrono.Clear();
+  }
 
   cout << "Sys matrix..." << flush;
   const SparseMatrix& CopyFrom = M;
@@ -136,134 +437,169 @@ void AcousticWave::run_FEM_serial() const
                    CopyFrom.Height(), CopyFrom.Width(), ownij, ownval,
                    CopyFrom.areColumnsSorted());
   Sys = 0.0;
-  //Sys += D;
   Sys += M;
-  GSSmoother prec(Sys);
+  // D = dt/2*(B + C) of the absorbing boundary and the PML
+  abs_bc.add_to(0.5*param.dt, Sys);
+  if (pml)
+    pml->add_damping(0.5*param.dt, Sys);
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
 
-  cout << "RHS vector... " << flush;
-  LinearForm b(&fespace);
-  if (param.source.plane_wave)
-  {
-    PlaneWaveSource plane_wave_source(param, one_over_K_coef);
-    b.AddDomainIntegrator(new DomainLFIntegrator(plane_wave_source));
-    b.Assemble();
-  }
-  else
-  {
-    ScalarPointForce scalar_point_force(param, one_over_K_coef);
-    b.AddDomainIntegrator(new DomainLFIntegrator(scalar_point_force));
-    b.Assemble();
-  }
-  cout << "||b||_L2 = " << b.Norml2() << endl;
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  // the system matrix is constant, so it's factorized once, and every time
+  // step is a forward and a backward substitution
+  Solver *sys_solver = new_mass_solver(param.method, Sys, fespace, false);
+  cout << "Mass solver setup time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
 
   const string method_name = "FEM_";
 
-  cout << "Open seismograms files..." << flush;
-  ofstream *seisU; // for pressure
-  open_seismo_outs(seisU, param, method_name);
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-  chrono.Clear();
-
-  GridFunction u_0(&fespace); // pressure
-  GridFunction u_1(&fespace);
-  GridFunction u_2(&fespace);
-  u_0 = 0.0;
-  u_1 = 0.0;
-  u_2 = 0.0;
-
-  const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
-  const int tenth = 0.1 * n_time_steps;
-
-  const int N = u_0.Size();
-
-  cout << "N time steps = " << n_time_steps
-       << "\nTime loop..." << endl;
-
-  // the values of the time-dependent part of the source
-  vector<double> time_values(n_time_steps);
-  for (int time_step = 1; time_step <= n_time_steps; ++time_step)
-  {
-    const double cur_time = time_step * param.dt;
-    time_values[time_step-1] = RickerWavelet(param.source,
-                                             cur_time - param.dt);
-  }
-
-  const string name = method_name + param.output.extra_string;
-  const string pref_path = (string)param.output.directory + "/" + SNAPSHOTS_DIR;
-  VisItDataCollection visit_dc(name.c_str(), param.mesh);
-  visit_dc.SetPrefixPath(pref_path.c_str());
-  visit_dc.RegisterField("pressure", &u_0);
-
-  StopWatch time_loop_timer;
-  time_loop_timer.Start();
-  double time_of_snapshots = 0.;
-  double time_of_seismograms = 0.;
-  for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+  // the operators are assembled once, and only the source vector and the
+  // output are renewed for every shot
+  OutputWriter writer; // compresses and writes the data in the background
+  for (int shot = scheduler->next(); shot >= 0; shot = scheduler->next())
   {
-    Vector y = u_1; y *= 2.0; y -= u_2;        // y = 2*u_1 - u_2
-
-    Vector z0; z0.SetSize(N);                  // z0 = M * (2*u_1 - u_2)
-    M.Mult(y, z0);
-
-    Vector z1; z1.SetSize(N); S.Mult(u_1, z1);     // z1 = S * u_1
-    Vector z2 = b; z2 *= time_values[time_step-1]; // z2 = timeval*source
+    param.set_shot(shot);
+    if (param.n_shots() > 1)
+      cout << "\nShot " << shot + 1 << " / " << param.n_shots() << endl;
+
+    cout << "RHS vector... " << flush;
+    LinearForm b(&fespace);
+    if (param.source.plane_wave)
+    {
+      PlaneWaveSource plane_wave_source(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(plane_wave_source));
+      b.Assemble();
+    }
+    else
+    {
+      ScalarPointForce scalar_point_force(param, one_over_K_coef);
+      b.AddDomainIntegrator(new DomainLFIntegrator(scalar_point_force));
+      b.Assemble();
+    }
+    cout << "||b||_L2 = " << b.Norml2() << endl;
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
 
-    // y = dt^2 * (S*u_1 - timeval*source), where it can be
-    // y = dt^2 * (S*u_1 - ricker*pointforce) OR
-    // y = dt^2 * (S*u_1 - gaussfirstderivative*momenttensor)
-    y = z1; y -= z2; y *= param.dt*param.dt;
+    cout << "Open seismograms files..." << flush;
+    SeismogramsOutput seisU(param, method_name, writer); // for pressure
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
 
-    // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source)
-    Vector RHS = z0; RHS -= y;
+    if (pml)
+      pml->reset();
 
-//    for (int i = 0; i < N; ++i) y[i] = diagD[i] * u_2[i]; // y = D * u_2
+    GridFunction u_0(&fespace); // pressure
+    GridFunction u_1(&fespace);
+    GridFunction u_2(&fespace);
+    u_0 = 0.0;
+    u_1 = 0.0;
+    u_2 = 0.0;
 
-    // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2
-//    RHS += y;
+    const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
+    const int tenth = 0.1 * n_time_steps;
 
-    // (M+D)*x_0 = M*(2*x_1-x_2) - dt^2*(S*x_1-r*b) + D*x_2
-    PCG(Sys, prec, RHS, u_0, 0, 200, 1e-12, 0.0);
+    const int N = u_0.Size();
 
-    // Compute and print the L^2 norm of the error
-    if (time_step % tenth == 0) {
-      cout << "step " << time_step << " / " << n_time_steps
-           << " ||solution||_{L^2} = " << u_0.Norml2() << endl;
-    }
+    cout << "N time steps = " << n_time_steps
+         << "\nTime loop..." << endl;
 
-    if (time_step % param.step_snap == 0) {
-      StopWatch timer;
-      timer.Start();
-      visit_dc.SetCycle(time_step);
-      visit_dc.SetTime(time_step*param.dt);
-      visit_dc.Save();
-      timer.Stop();
-      time_of_snapshots += timer.UserTime();
+    // the values of the time-dependent part of the source
+    vector<double> time_values(n_time_steps);
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      const double cur_time = time_step * param.dt;
+      time_values[time_step-1] = RickerWavelet(param.source,
+                                               cur_time - param.dt);
     }
 
-    if (time_step % param.step_seis == 0) {
-      StopWatch timer;
-      timer.Start();
-      output_seismograms(param, *param.mesh, u_0, seisU);
-      timer.Stop();
-      time_of_seismograms += timer.UserTime();
+    const string name = method_name + param.output.extra_string;
+    const string pref_path = (string)param.output.directory + "/" +
+                             SNAPSHOTS_DIR;
+    VisItDataCollection visit_dc(name.c_str(), param.mesh);
+    visit_dc.SetPrefixPath(pref_path.c_str());
+    visit_dc.RegisterField("pressure", &u_0);
+
+    CompressedSnapshots *snapshots = nullptr;
+    if (param.output.snapshot_tolerance > 0)
+      snapshots = new CompressedSnapshots(writer, pref_path + name, fespace,
+                                          param.output);
+
+    StopWatch time_loop_timer;
+    time_loop_timer.Start();
+    double time_of_snapshots = 0.;
+    double time_of_seismograms = 0.;
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      Vector y = u_1; y *= 2.0; y -= u_2;        // y = 2*u_1 - u_2
+
+      Vector z0; z0.SetSize(N);                  // z0 = M * (2*u_1 - u_2)
+      M.Mult(y, z0);
+
+      Vector z1; z1.SetSize(N); S.Mult(u_1, z1);     // z1 = S * u_1
+      Vector z2 = b; z2 *= time_values[time_step-1]; // z2 = timeval*source
+
+      // y = dt^2 * (S*u_1 - timeval*source), where it can be
+      // y = dt^2 * (S*u_1 - ricker*pointforce) OR
+      // y = dt^2 * (S*u_1 - gaussfirstderivative*momenttensor)
+      y = z1; y -= z2; y *= param.dt*param.dt;
+
+      // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source)
+      Vector RHS = z0; RHS -= y;
+
+      // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2 + the rest
+      // of the PML terms (dt^2*(K*u_1 + G))
+      abs_bc.add_mult(0.5*param.dt, u_2.GetData(), RHS.GetData());
+      if (pml)
+        pml->add_rhs(param.dt, u_1.GetData(), u_2.GetData(), RHS.GetData());
+
+      // (M+D)*x_0 = M*(2*x_1-x_2) - dt^2*(S*x_1-r*b) + D*x_2
+      sys_solver->Mult(RHS, u_0);
+
+      // Compute and print the L^2 norm of the error
+      if (time_step % tenth == 0) {
+        cout << "step " << time_step << " / " << n_time_steps
+             << " ||solution||_{L^2} = " << u_0.Norml2() << endl;
+      }
+
+      if (time_step % param.step_snap == 0) {
+        StopWatch timer;
+        timer.Start();
+        if (snapshots)
+          snapshots->write(u_0, time_step);
+        else
+        {
+          visit_dc.SetCycle(time_step);
+          visit_dc.SetTime(time_step*param.dt);
+          visit_dc.Save();
+        }
+        timer.Stop();
+        time_of_snapshots += timer.UserTime();
+      }
+
+      if (time_step % param.step_seis == 0) {
+        StopWatch timer;
+        timer.Start();
+        seisU.write(*param.mesh, u_0);
+        timer.Stop();
+        time_of_seismograms += timer.UserTime();
+      }
+
+      u_2 = u_1;
+      u_1 = u_0;
     }
 
-    u_2 = u_1;
-    u_1 = u_0;
-  }
-
-  time_loop_timer.Stop();
+    time_loop_timer.Stop();
 
-  delete[] seisU;
+    delete snapshots;
+    writer.wait();
 
-  cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
-       << "\n\ttime of snapshots = " << time_of_snapshots
-       << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+    cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
+         << "\n\ttime of snapshots = " << time_of_snapshots
+         << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+  }
 
+  delete sys_solver;
+  delete pml;
   delete fec;
 }
 
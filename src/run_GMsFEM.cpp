@@ -1,7 +1,13 @@
 #include "acoustic_wave.hpp"
+#include "mass_solver.hpp"
+#include "operator_cache.hpp"
+#include "parallel_output.hpp"
 #include "parameters.hpp"
+#include "shared_memory.hpp"
+#include "structured_assembly.hpp"
 #include "utilities.hpp"
 
+#include <algorithm>
 #include <float.h>
 
 using namespace std;
@@ -15,7 +21,7 @@ using namespace mfem;
 void AcousticWave::run_GMsFEM() const
 {
 //  int size;
-//  MPI_Comm_size(MPI_COMM_WORLD, &size);
+//  MPI_Comm_size(param.comm, &size);
 //  if (size == 1)
 //    run_GMsFEM_serial();
 //  else
@@ -128,7 +134,8 @@ void AcousticWave::run_GMsFEM_serial() const
 
   cout << "Fine scale stif matrix..." << flush;
   BilinearForm stif_fine(&fespace);
-  stif_fine.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
+  stif_fine.AddDomainIntegrator(stiffness_integrator(*fespace.GetMesh(),
+                                                     one_over_rho_coef));
   stif_fine.AddInteriorFaceIntegrator(
         new DGDiffusionIntegrator(one_over_rho_coef,
                                   param.method.dg_sigma,
@@ -145,7 +152,8 @@ void AcousticWave::run_GMsFEM_serial() const
 
   cout << "Fine scale mass matrix..." << flush;
   BilinearForm mass_fine(&fespace);
-  mass_fine.AddDomainIntegrator(new MassIntegrator(one_over_K_coef));
+  mass_fine.AddDomainIntegrator(mass_integrator(*fespace.GetMesh(),
+                                                one_over_K_coef));
   mass_fine.Assemble();
   mass_fine.Finalize();
   const SparseMatrix& M_fine = mass_fine.SpMat();
@@ -596,7 +604,7 @@ void AcousticWave::run_GMsFEM_serial() const
 //      StopWatch timer;
 //      timer.Start();
 //      R_global_T.Mult(U_0, u_0);
-//      output_seismograms(param, *param.mesh, u_0, seisU);
+//      output_seismograms(param.sets_of_receivers, *param.mesh, u_0, seisU);
 //      timer.Stop();
 //      time_of_seismograms += timer.UserTime();
 //    }
@@ -622,22 +630,10 @@ void AcousticWave::run_GMsFEM_serial() const
 
 #ifdef MFEM_USE_MPI
 static void par_time_step(HypreParMatrix &M, HypreParMatrix &S,
+                          const Solver &M_solver,
                           const Vector &b, double timeval, double dt,
                           Vector &U_0, Vector &U_1, Vector &U_2)
 {
-  HypreSmoother M_prec;
-  CGSolver M_solver(M.GetComm());
-
-  M_prec.SetType(HypreSmoother::Jacobi);
-  M_solver.SetPreconditioner(M_prec);
-  M_solver.SetOperator(M);
-
-  M_solver.iterative_mode = false;
-  M_solver.SetRelTol(1e-12);
-  M_solver.SetAbsTol(0.0);
-  M_solver.SetMaxIter(200);
-  M_solver.SetPrintLevel(0);
-
   Vector y = U_1; y *= 2.0; y -= U_2;        // y = 2*u_1 - u_2
 
   Vector z0 = U_0;         // z0 = M * (2*u_1 - u_2)
@@ -671,7 +667,7 @@ static void par_time_step(HypreParMatrix &M, HypreParMatrix &S,
 static void print_par_matrix_matlab(HypreParMatrix &A, const string &filename)
 {
   int myid;
-  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+  MPI_Comm_rank(A.GetComm(), &myid);
 
   // This call works because HypreParMatrix implicitly converts to hypre_ParCSRMatrix*
   hypre_CSRMatrix* A_serial = hypre_ParCSRMatrixToCSRMatrixAll(A);
@@ -694,16 +690,62 @@ static void print_par_matrix_matlab(HypreParMatrix &A, const string &filename)
   hypre_CSRMatrixDestroy(A_serial);
 }
 
+/**
+ * The key of the multiscale basis of a coarse cell: it depends on the fine
+ * grid of the cell, on the media inside it, and on the parameters of the
+ * method, but not on the position of the cell or the rest of the model.
+ */
+static uint64_t coarse_cell_basis_key(const Parameters &param, int n_fine_x,
+                                      int n_fine_y, int n_fine_z, double hx,
+                                      double hy, double hz,
+                                      const double *local_one_over_rho,
+                                      const double *local_one_over_K)
+{
+  OperatorHash hasher;
+  hasher.add(param.dimension);
+  hasher.add(param.method.order);
+  hasher.add(param.method.dg_sigma);
+  hasher.add(param.method.dg_kappa);
+  hasher.add(param.method.gms_nb);
+  hasher.add(param.method.gms_ni);
+#ifdef BASIS_DG
+  hasher.add("DG");
+#else
+  hasher.add("CG");
+  if (param.method.gms_randomized)
+  {
+    hasher.add("randomized");
+    hasher.add(param.method.gms_oversampling);
+    hasher.add(param.method.gms_power_iterations);
+  }
+#endif
+  hasher.add(n_fine_x);
+  hasher.add(n_fine_y);
+  hasher.add(n_fine_z);
+  hasher.add(hx);
+  hasher.add(hy);
+  hasher.add(hz);
+  const size_t n_cells = (size_t)n_fine_x * n_fine_y * n_fine_z;
+  hasher.add(local_one_over_rho, n_cells * sizeof(double));
+  hasher.add(local_one_over_K, n_cells * sizeof(double));
+  return hasher.value();
+}
+
+
+
 void AcousticWave::run_GMsFEM_parallel() const
 {
-  MFEM_VERIFY(param.mesh, "The serial mesh is not initialized");
+  MFEM_VERIFY(param.mesh, "The serial mesh is not initialized (GMsFEM requires "
+              "it, so -distmesh and -meshprefix can't be used)");
   MFEM_VERIFY(param.par_mesh, "The parallel mesh is not initialized");
 
-  int myid, nproc;
-  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
-  MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+  int myid, nproc, world_id;
+  MPI_Comm_rank(param.comm, &myid);
+  MPI_Comm_size(param.comm, &nproc);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_id); // unique among groups of processes
 
-  string fileout = string(param.output.directory) + "/outputlog." + d2s(myid);
+  string fileout = string(param.output.directory) + "/outputlog." +
+                   d2s(world_id);
   ofstream out(fileout.c_str());
   MFEM_VERIFY(out, "Cannot open file " << fileout);
 
@@ -711,7 +753,8 @@ void AcousticWave::run_GMsFEM_parallel() const
   chrono.Start();
 
   const int dim = param.dimension;
-  const int n_elements = param.mesh->GetNE();
+  // local cells followed by the face neighbors
+  const int n_elements = param.media.n_cells;
 
   out << "FE space generation..." << flush;
   chrono.Clear();
@@ -754,13 +797,15 @@ void AcousticWave::run_GMsFEM_parallel() const
   out << "Kap: min " << Kap[0] << " max " << Kap[1] << endl;
 
   const bool own_array = true;
-  CWConstCoefficient one_over_rho_coef(one_over_rho, own_array);
-  CWConstCoefficient one_over_K_coef(one_over_K, own_array);
+  const bool local_index = true;
+  CWConstCoefficient one_over_rho_coef(one_over_rho, own_array, local_index);
+  CWConstCoefficient one_over_K_coef(one_over_K, own_array, local_index);
 
   out << "Fine scale stif matrix..." << flush;
   chrono.Clear();
   ParBilinearForm stif_fine(&fespace);
-  stif_fine.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
+  stif_fine.AddDomainIntegrator(stiffness_integrator(*fespace.GetMesh(),
+                                                     one_over_rho_coef));
   stif_fine.AddInteriorFaceIntegrator(
         new DGDiffusionIntegrator(one_over_rho_coef,
                                   param.method.dg_sigma,
@@ -778,7 +823,8 @@ void AcousticWave::run_GMsFEM_parallel() const
   out << "Fine scale mass matrix..." << flush;
   chrono.Clear();
   ParBilinearForm mass_fine(&fespace);
-  mass_fine.AddDomainIntegrator(new MassIntegrator(one_over_K_coef));
+  mass_fine.AddDomainIntegrator(mass_integrator(*fespace.GetMesh(),
+                                                one_over_K_coef));
   mass_fine.Assemble();
   mass_fine.Finalize();
   HypreParMatrix *M_fine = mass_fine.ParallelAssemble();
@@ -828,7 +874,7 @@ void AcousticWave::run_GMsFEM_parallel() const
     b_fine.Assemble();
   }
   HypreParVector *B_fine = b_fine.ParallelAssemble();
-  const double b_fine_norm = GlobalLpNorm(2, B_fine->Norml2(), MPI_COMM_WORLD);
+  const double b_fine_norm = GlobalLpNorm(2, B_fine->Norml2(), param.comm);
   out << "||b_h||_L2 = " << b_fine_norm << endl;
   out << "done. Time = " << chrono.RealTime() << " sec" << endl;
 
@@ -873,9 +919,9 @@ void AcousticWave::run_GMsFEM_parallel() const
     for (int rank = 1; rank < nproc; ++rank)
     {
       int ncells_dofs;
-      MPI_Recv(&ncells_dofs, 1, MPI_INT, rank, 101, MPI_COMM_WORLD, &status);
+      MPI_Recv(&ncells_dofs, 1, MPI_INT, rank, 101, param.comm, &status);
       vector<int> cells_dofs(ncells_dofs);
-      MPI_Recv(&cells_dofs[0], ncells_dofs, MPI_INT, rank, 102, MPI_COMM_WORLD, &status);
+      MPI_Recv(&cells_dofs[0], ncells_dofs, MPI_INT, rank, 102, param.comm, &status);
       my_cells_dofs.reserve(my_cells_dofs.size() + ncells_dofs);
 //      my_cells_dofs.insert(my_cells_dofs.end(), cells_dofs.begin(), cells_dofs.end());
       for (int i = 0; i < ncells_dofs; ++i)
@@ -885,40 +931,60 @@ void AcousticWave::run_GMsFEM_parallel() const
   else
   {
     int my_ncells_dofs = my_cells_dofs.size();
-    MPI_Send(&my_ncells_dofs, 1, MPI_INT, 0, 101, MPI_COMM_WORLD);
-    MPI_Send(&my_cells_dofs[0], my_ncells_dofs, MPI_INT, 0, 102, MPI_COMM_WORLD);
+    MPI_Send(&my_ncells_dofs, 1, MPI_INT, 0, 101, param.comm);
+    MPI_Send(&my_cells_dofs[0], my_ncells_dofs, MPI_INT, 0, 102, param.comm);
   }
 
   int nglob_cells_dofs = my_cells_dofs.size();
-  MPI_Bcast(&nglob_cells_dofs, 1, MPI_INT, 0, MPI_COMM_WORLD);
-  if (myid != 0)
-    my_cells_dofs.resize(nglob_cells_dofs);
-  MPI_Bcast(&my_cells_dofs[0], nglob_cells_dofs, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&nglob_cells_dofs, 1, MPI_INT, 0, param.comm);
 
+  // the global map between cells and their dofs is the same for all processes,
+  // so there is only one copy of it per node: the dofs of the cell 'c' are
+  // cell_dofs[cell_dofs_offsets[c] : cell_dofs_offsets[c+1]]
   const int globNE = param.mesh->GetNE();
   out << "globNE " << globNE << endl;
-  vector<vector<int> > map_cell_dofs(globNE);
-  for (int el = 0, k = 0; el < globNE; ++el)
+  NodeCommunicators node_comms(param.comm);
+  NodeSharedArray<int> cell_dofs_offsets(node_comms, globNE + 1);
+  NodeSharedArray<int> cell_dofs(node_comms, nglob_cells_dofs - 2*globNE);
+  if (myid == 0)
   {
-    MFEM_VERIFY(k < (int)my_cells_dofs.size(), "k is out of range");
-    int cellID = my_cells_dofs[k++];
-    MFEM_VERIFY(cellID <= 0, "Incorrect cellID");
-    cellID = -cellID;
-    const int ndofs = my_cells_dofs[k++];
-    if (!(cellID >= 0 && cellID < globNE))
-      out << "el " << el << " cellID " << cellID << endl;
-    MFEM_VERIFY(cellID >= 0 && cellID < globNE, "cellID is out of range");
-    MFEM_VERIFY(map_cell_dofs[cellID].empty(), "This cellID has been already added");
-    map_cell_dofs[cellID].resize(ndofs);
-    for (int i = 0; i < ndofs; ++i)
-      map_cell_dofs[cellID][i] = my_cells_dofs[k++];
+    for (int c = 0; c <= globNE; ++c)
+      cell_dofs_offsets[c] = 0;
+    for (int el = 0, k = 0; el < globNE; ++el)
+    {
+      MFEM_VERIFY(k < (int)my_cells_dofs.size(), "k is out of range");
+      int cellID = my_cells_dofs[k++];
+      MFEM_VERIFY(cellID <= 0, "Incorrect cellID");
+      cellID = -cellID;
+      const int ndofs = my_cells_dofs[k++];
+      MFEM_VERIFY(cellID >= 0 && cellID < globNE, "cellID is out of range");
+      MFEM_VERIFY(cell_dofs_offsets[cellID+1] == 0, "This cellID has been "
+                  "already added");
+      cell_dofs_offsets[cellID+1] = ndofs;
+      k += ndofs;
+    }
+    for (int c = 0; c < globNE; ++c)
+      cell_dofs_offsets[c+1] += cell_dofs_offsets[c];
+    MFEM_VERIFY(cell_dofs_offsets[globNE] == cell_dofs.size(), "Unexpected "
+                "number of cells dofs");
+
+    for (int el = 0, k = 0; el < globNE; ++el)
+    {
+      const int cellID = -my_cells_dofs[k++];
+      const int ndofs = my_cells_dofs[k++];
+      for (int i = 0; i < ndofs; ++i)
+        cell_dofs[cell_dofs_offsets[cellID] + i] = my_cells_dofs[k++];
+    }
   }
+  cell_dofs_offsets.broadcast(MPI_INT);
+  cell_dofs.broadcast(MPI_INT);
+  vector<int>().swap(my_cells_dofs); // not needed anymore
 
   out << "map_cell_dofs:\n";
-  for (size_t i = 0; i < map_cell_dofs.size(); ++i) {
+  for (int i = 0; i < globNE; ++i) {
     out << i << " ";
-    for (size_t j = 0; j < map_cell_dofs[i].size(); ++j)
-      out << map_cell_dofs[i][j] << " ";
+    for (int j = cell_dofs_offsets[i]; j < cell_dofs_offsets[i+1]; ++j)
+      out << cell_dofs[j] << " ";
     out << endl;
   }
 
@@ -939,7 +1005,31 @@ void AcousticWave::run_GMsFEM_parallel() const
   std::vector<std::vector<int> > local2global;
   std::vector<DenseMatrix> R;
 
-  if (param.dimension == 2)
+  // the rows of the global R matrix (the basis functions of my coarse cells)
+  // are taken from the cache if they have been computed for the same mesh,
+  // media, parameters of the method and partitioning
+  OperatorCache cache(param, "GMsFEM_np" + d2s(nproc) + "_rank" + d2s(myid));
+  const SparseMatrix *R_cached = cache.load("R");
+  {
+    // the computation of the basis is collective, so the cache is used only
+    // if all processes have their parts of R there
+    int all_cached = (R_cached != nullptr);
+    MPI_Allreduce(MPI_IN_PLACE, &all_cached, 1, MPI_INT, MPI_MIN, param.comm);
+    if (!all_cached)
+      R_cached = nullptr;
+  }
+
+  // the bases of separate coarse cells, identified by the media inside them,
+  // so that after a local change of the media only the bases of the affected
+  // coarse cells are computed again
+  OperatorCache basis_cache(param, "GMsFEM_cell");
+  int n_cached_bases = 0;
+
+  if (R_cached)
+  {
+    out << "The basis is taken from the cache" << endl;
+  }
+  else if (param.dimension == 2)
   {
     const int n_coarse_cells = param.method.gms_Nx * param.method.gms_Ny;
 
@@ -959,6 +1049,37 @@ void AcousticWave::run_GMsFEM_parallel() const
 
     std::vector<std::vector<int> > local2global_serial(my_end_cell - my_start_cell);
 
+    // media properties of the fine cells of my coarse cells (in the order
+    // they are traversed below)
+    std::vector<int> my_fine_cells;
+    {
+      int off_x, off_y = 0;
+      for (int iy = 0; iy < param.method.gms_Ny; ++iy)
+      {
+        off_x = 0;
+        for (int ix = 0; ix < param.method.gms_Nx; ++ix)
+        {
+          const int global_coarse_cell = iy*param.method.gms_Nx + ix;
+          if (global_coarse_cell >= my_start_cell &&
+              global_coarse_cell < my_end_cell)
+          {
+            for (int fiy = 0; fiy < n_fine_cell_per_coarse_y[iy]; ++fiy)
+              for (int fix = 0; fix < n_fine_cell_per_coarse_x[ix]; ++fix)
+                my_fine_cells.push_back((off_y + fiy) * param.grid.nx +
+                                        (off_x + fix));
+          }
+          off_x += n_fine_cell_per_coarse_x[ix];
+        }
+        off_y += n_fine_cell_per_coarse_y[iy];
+      }
+    }
+    std::vector<double> fine_rho(my_fine_cells.size());
+    std::vector<double> fine_vp(my_fine_cells.size());
+    param.media.read_cells(param.comm, param.mesh->GetNE(), my_fine_cells,
+                           fine_rho.empty() ? nullptr : &fine_rho[0],
+                           fine_vp.empty() ? nullptr : &fine_vp[0]);
+    int fine_cell_index = 0;
+
     int offset_x, offset_y = 0;
 
     for (int iy = 0; iy < param.method.gms_Ny; ++iy)
@@ -992,26 +1113,38 @@ void AcousticWave::run_GMsFEM_parallel() const
           for (int fix = 0; fix < n_fine_x; ++fix)
           {
             const int loc_cell = fiy*n_fine_x + fix;
-            const int glob_cell = (offset_y + fiy) * param.grid.nx +
-                                  (offset_x + fix);
+            const double rho = fine_rho[fine_cell_index];
+            const double vp  = fine_vp[fine_cell_index];
+            ++fine_cell_index;
 
-            local_one_over_rho[loc_cell] = one_over_rho[glob_cell];
-            local_one_over_K[loc_cell]   = one_over_K[glob_cell];
+            local_one_over_rho[loc_cell] = 1. / rho;
+            local_one_over_K[loc_cell]   = 1. / (rho*vp*vp);
           }
         }
         const bool own_array = true;
         CWConstCoefficient local_one_over_rho_coef(local_one_over_rho, own_array);
         CWConstCoefficient local_one_over_K_coef(local_one_over_K, own_array);
 
+        // the basis is recomputed only if the media of this coarse cell have
+        // changed since it was computed last time
+        const uint64_t basis_key =
+            coarse_cell_basis_key(param, n_fine_x, n_fine_y, 1, hx, hy, 0.,
+                                  local_one_over_rho, local_one_over_K);
+        if (!basis_cache.load(basis_key, "basis", R[my_coarse_cell]))
+        {
 #ifdef BASIS_DG
-        compute_basis_DG(ccell_fine_mesh, param.method.gms_nb, param.method.gms_ni,
-                         local_one_over_rho_coef, local_one_over_K_coef,
-                         R[my_coarse_cell]);
+          compute_basis_DG(ccell_fine_mesh, param.method.gms_nb, param.method.gms_ni,
+                           local_one_over_rho_coef, local_one_over_K_coef,
+                           R[my_coarse_cell]);
 #else
-        compute_basis_CG(ccell_fine_mesh, param.method.gms_nb, param.method.gms_ni,
-                         local_one_over_rho_coef, local_one_over_K_coef,
-                         R[my_coarse_cell]);
+          compute_basis_CG(ccell_fine_mesh, param.method.gms_nb, param.method.gms_ni,
+                           local_one_over_rho_coef, local_one_over_K_coef,
+                           R[my_coarse_cell]);
 #endif
+          basis_cache.save(basis_key, "basis", R[my_coarse_cell]);
+        }
+        else
+          ++n_cached_bases;
 
         // initialize with all -1 to check that all values are defined later
         local2global[my_coarse_cell].resize(R[my_coarse_cell].Height(), -1);
@@ -1026,12 +1159,13 @@ void AcousticWave::run_GMsFEM_parallel() const
             const int loc_cell = fiy*n_fine_x + fix;
             const int glob_cell = (offset_y + fiy) * param.grid.nx +
                                   (offset_x + fix);
-            MFEM_VERIFY(glob_cell >= 0 && glob_cell < (int)map_cell_dofs.size(),
+            MFEM_VERIFY(glob_cell >= 0 && glob_cell < globNE,
                         "glob_cell is out of range");
 
             DG_fespace.GetElementVDofs(loc_cell, loc_dofs);
-            const vector<int> &glob_dofs = map_cell_dofs[glob_cell];
-            MFEM_VERIFY(loc_dofs.Size() == (int)glob_dofs.size(), "Dimensions mismatch");
+            const int *glob_dofs = &cell_dofs[cell_dofs_offsets[glob_cell]];
+            MFEM_VERIFY(loc_dofs.Size() == cell_dofs_offsets[glob_cell+1] -
+                        cell_dofs_offsets[glob_cell], "Dimensions mismatch");
 
             Array<int> glob_dofs_serial;
             fespace_serial.GetElementVDofs(glob_cell, glob_dofs_serial);
@@ -1068,6 +1202,10 @@ void AcousticWave::run_GMsFEM_parallel() const
       }
       offset_y += n_fine_y;
     }
+
+    if (basis_cache.enabled())
+      out << "bases of coarse cells taken from the cache: " << n_cached_bases
+          << " of " << R.size() << endl;
   }
   else // 3D
   {
@@ -1158,12 +1296,20 @@ void AcousticWave::run_GMsFEM_parallel() const
     my_ncols += h; // transpose
     my_nnonzero += h * w;
   }
+  if (R_cached)
+  {
+    my_nrows = R_cached->Height();
+    my_nnonzero = R_cached->NumNonZeroElems();
+  }
 
   int glob_nrows = 0;
   int glob_ncols = 0;
 
-  MPI_Allreduce(&my_nrows, &glob_nrows, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(&my_ncols, &glob_ncols, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(&my_nrows, &glob_nrows, 1, MPI_INT, MPI_SUM, param.comm);
+  if (R_cached)
+    glob_ncols = R_cached->Width();
+  else
+    MPI_Allreduce(&my_ncols, &glob_ncols, 1, MPI_INT, MPI_SUM, param.comm);
 
   out << "\nmy_nrows " << my_nrows << " my_ncols " << my_ncols << endl;
   out << "glob_nrows " << glob_nrows << " glob_ncols " << glob_ncols << endl;
@@ -1177,15 +1323,15 @@ void AcousticWave::run_GMsFEM_parallel() const
     for (int rank = 1; rank < nproc; ++rank)
     {
       int nrows;
-      MPI_Recv(&nrows, 1, MPI_INT, rank, 103, MPI_COMM_WORLD, &status);
+      MPI_Recv(&nrows, 1, MPI_INT, rank, 103, param.comm, &status);
       Rrows[rank + 1] = Rrows[rank] + nrows;
     }
   }
   else
   {
-    MPI_Send(&my_nrows, 1, MPI_INT, 0, 103, MPI_COMM_WORLD);
+    MPI_Send(&my_nrows, 1, MPI_INT, 0, 103, param.comm);
   }
-  MPI_Bcast(Rrows, nproc + 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(Rrows, nproc + 1, MPI_INT, 0, param.comm);
 
   out << "\nRrows: ";
   for (int i = 0; i < nproc + 1; ++i)
@@ -1209,25 +1355,35 @@ void AcousticWave::run_GMsFEM_parallel() const
   int *Rj = new int[my_nnonzero];
   double *Rdata = new double[my_nnonzero];
 
-  Ri[0] = 0;
-  int k = 0;
-  int p = 0;
-  for (size_t r = 0; r < R.size(); ++r)
+  if (R_cached)
   {
-    const int h = R[r].Height();
-    const int w = R[r].Width();
-    for (int i = 0; i < w; ++i)
+    std::copy(R_cached->GetI(), R_cached->GetI() + my_nrows + 1, Ri);
+    std::copy(R_cached->GetJ(), R_cached->GetJ() + my_nnonzero, Rj);
+    std::copy(R_cached->GetData(), R_cached->GetData() + my_nnonzero, Rdata);
+  }
+  else
+  {
+    Ri[0] = 0;
+    int k = 0;
+    int p = 0;
+    for (size_t r = 0; r < R.size(); ++r)
     {
-      Ri[k+1] = Ri[k] + h;
-      ++k;
-
-      for (int j = 0; j < h; ++j)
+      const int h = R[r].Height();
+      const int w = R[r].Width();
+      for (int i = 0; i < w; ++i)
       {
-        Rj[p] = local2global[r][j];
-        Rdata[p] = R[r](j, i);
-        ++p;
+        Ri[k+1] = Ri[k] + h;
+        ++k;
+
+        for (int j = 0; j < h; ++j)
+        {
+          Rj[p] = local2global[r][j];
+          Rdata[p] = R[r](j, i);
+          ++p;
+        }
       }
     }
+    cache.save("R", Ri, Rj, Rdata, my_nrows, glob_ncols);
   }
 
   int myRrows[] = { my_start_row, my_end_row };
@@ -1236,7 +1392,7 @@ void AcousticWave::run_GMsFEM_parallel() const
       processor described by the I, J and data arrays. The local matrix should
       be of size (local) nrows by (global) glob_ncols. The new parallel matrix
       contains copies of all input arrays (so they can be deleted). */
-  HypreParMatrix R_global(MPI_COMM_WORLD, my_nrows, glob_nrows, glob_ncols,
+  HypreParMatrix R_global(param.comm, my_nrows, glob_nrows, glob_ncols,
                           Ri, Rj, Rdata, myRrows, S_fine->RowPart());
 
   HypreParMatrix *R_global_T = R_global.Transpose();
@@ -1317,6 +1473,24 @@ void AcousticWave::run_GMsFEM_parallel() const
 
   const string method_name = "parGMsFEM_";
 
+  if (myid == 0)
+    cout << "Open seismograms files..." << flush;
+  chrono.Clear();
+  vector<ParSeismograms*> seisU; // for pressure
+  open_par_seismo_outs(seisU, param, *param.par_mesh, method_name);
+  if (myid == 0)
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+
+  const string snapfile = string(param.output.directory) + "/" + SNAPSHOTS_DIR +
+                          method_name + param.output.extra_string + "_p.bin";
+  ParSnapshots snapU(fespace, snapfile);
+
+  // the mass matrix is constant, so its solver (with the estimates of the
+  // spectrum for Chebyshev) is set up once for all time steps
+  chrono.Clear();
+  Solver *M_solver = new_mass_solver(param.method, *M_coarse, out);
+  out << "Mass solver setup time = " << chrono.RealTime() << " sec" << endl;
+
   HypreParVector U_0(*M_coarse); U_0 = 0.0;
   HypreParVector U_1(*M_coarse); U_1 = 0.0;
   HypreParVector U_2(*M_coarse); U_2 = 0.0;
@@ -1338,20 +1512,6 @@ void AcousticWave::run_GMsFEM_parallel() const
                                              cur_time - param.dt);
   }
 
-  const string name = method_name + param.output.extra_string;
-  const string pref_path = string(param.output.directory) + "/" + SNAPSHOTS_DIR;
-  VisItDataCollection visit_dc(name.c_str(), param.par_mesh);
-  visit_dc.SetPrefixPath(pref_path.c_str());
-  visit_dc.RegisterField("coarse_pressure", &u_0);
-  {
-    visit_dc.SetCycle(0);
-    visit_dc.SetTime(0.0);
-    HypreParVector u_tmp(&fespace);
-    R_global_T->Mult(U_0, u_tmp);
-    u_0 = u_tmp;
-    visit_dc.Save();
-  }
-
   StopWatch time_loop_timer;
   time_loop_timer.Start();
   double time_of_snapshots = 0.;
@@ -1359,63 +1519,55 @@ void AcousticWave::run_GMsFEM_parallel() const
   for (int t_step = 1; t_step <= n_time_steps; ++t_step)
   {
     {
-      par_time_step(*M_coarse, *S_coarse, b_coarse, time_values[t_step-1],
-                    param.dt, U_0, U_1, U_2); //, out);
+      par_time_step(*M_coarse, *S_coarse, *M_solver, b_coarse,
+                    time_values[t_step-1], param.dt, U_0, U_1, U_2); //, out);
     }
 
-    // Compute and print the L^2 norm of the error
-    double glob_norm = GlobalLpNorm(2, U_0.Norml2(), MPI_COMM_WORLD);
+    // Compute and print the L^2 norm of the error (a global reduction, so
+    // not at every step)
     if (t_step % tenth == 0) {
+      const double glob_norm = GlobalLpNorm(2, U_0.Norml2(), param.comm);
       out << "step " << t_step << " / " << n_time_steps
            << " ||U||_{L^2} = " << glob_norm << endl;
     }
 
+    // the fine scale pressure is written to the shared file of snapshots
+    // (there are no per-process VisIt files, as in the parallel FEM)
+    if (t_step % param.step_snap == 0)
     {
       StopWatch timer;
       timer.Start();
       HypreParVector u_tmp(&fespace);
       R_global_T->Mult(U_0, u_tmp);
-      //{ double norm = GlobalLpNorm(2, u_tmp.Norml2(), MPI_COMM_WORLD); out << "||utmp_H|| = " << norm << endl; }
-      if (t_step % param.step_snap == 0) {
-        visit_dc.SetCycle(t_step);
-        visit_dc.SetTime(t_step*param.dt);
-        u_0 = u_tmp;
-        visit_dc.Save();
-      }
+      u_0 = u_tmp;
+      snapU.write(u_0);
       timer.Stop();
       time_of_snapshots += timer.UserTime();
     }
 
-    if (t_step % param.step_snap == 0)
-    {
-      ostringstream mesh_name, sol_name;
-      mesh_name << param.output.directory << "/" << param.output.extra_string << "_mesh." << setfill('0') << setw(6) << myid;
-      sol_name << param.output.directory << "/" << param.output.extra_string << "_sol_t" << t_step << "." << setfill('0') << setw(6) << myid;
-
-      ofstream mesh_ofs(mesh_name.str().c_str());
-      mesh_ofs.precision(8);
-      param.par_mesh->Print(mesh_ofs);
-
-      ofstream sol_ofs(sol_name.str().c_str());
-      sol_ofs.precision(8);
+    if (t_step % param.step_seis == 0) {
+      StopWatch timer;
+      timer.Start();
       HypreParVector u_tmp(&fespace);
       R_global_T->Mult(U_0, u_tmp);
-      ParGridFunction x(&fespace, &u_tmp);
-      x.Save(sol_ofs);
+      u_0 = u_tmp;
+      output_par_seismograms(u_0, seisU);
+      timer.Stop();
+      time_of_seismograms += timer.UserTime();
     }
-
-//    if (t_step % param.step_seis == 0) {
-//      StopWatch timer;
-//      timer.Start();
-//      R_global_T.Mult(U_0, u_0);
-//      output_seismograms(param, *param.mesh, u_0, seisU);
-//      timer.Stop();
-//      time_of_seismograms += timer.UserTime();
-//    }
   }
 
   time_loop_timer.Stop();
 
+  for (size_t i = 0; i < seisU.size(); ++i)
+    delete seisU[i];
+
+  if (myid == 0)
+    cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
+         << "\n\ttime of snapshots = " << time_of_snapshots
+         << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+
+  delete M_solver;
   delete S_coarse;
   delete M_coarse;
   delete R_global_T;
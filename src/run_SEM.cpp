@@ -1,8 +1,16 @@
+#include "absorbing_boundary.hpp"
+#include "active_region.hpp"
 #include "acoustic_wave.hpp"
 #include "GLL_quadrature.hpp"
+#include "operator_cache.hpp"
+#include "output_writer.hpp"
 #include "parameters.hpp"
+#include "pml.hpp"
+#include "shot_scheduler.hpp"
+#include "structured_assembly.hpp"
 #include "utilities.hpp"
 
+#include <algorithm>
 #include <float.h>
 
 using namespace std;
@@ -12,9 +20,15 @@ using namespace mfem;
 
 void AcousticWave::run_SEM() const
 {
+  if (!param.ensemble.empty())
+  {
+    run_SEM_ensemble();
+    return;
+  }
+
 #if defined(MFEM_USE_MPI)
   int size;
-  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  MPI_Comm_size(param.comm, &size);
   if (size == 1)
     run_SEM_serial();
   else
@@ -26,6 +40,64 @@ void AcousticWave::run_SEM() const
 
 
 
+/**
+ * Assemble the source vector of the current shot.
+ */
+static void source_vector(const Parameters &param, Coefficient &one_over_K_coef,
+                          const IntegrationRule *GLL_rule, LinearForm &b)
+{
+  if (param.source.plane_wave)
+  {
+    PlaneWaveSource plane_wave_source(param, one_over_K_coef);
+    DomainLFIntegrator *plane_wave_int =
+        new DomainLFIntegrator(plane_wave_source);
+    plane_wave_int->SetIntRule(GLL_rule);
+    b.AddDomainIntegrator(plane_wave_int);
+    b.Assemble();
+  }
+  else
+  {
+    ScalarPointForce scalar_point_force(param, one_over_K_coef);
+    DomainLFIntegrator *point_force_int =
+        new DomainLFIntegrator(scalar_point_force);
+    point_force_int->SetIntRule(GLL_rule);
+    b.AddDomainIntegrator(point_force_int);
+    b.Assemble();
+  }
+}
+
+
+
+/**
+ * Compare the time of the product of the stiffness matrix and a block of k
+ * interleaved vectors with the time of k separate products (SpMV).
+ */
+static void report_spmm_gain(const SparseMatrix &S, int k)
+{
+  const int N = S.Height();
+  const int n_repeats = 10;
+  Vector x(N), y(N);
+  x = 1.0;
+  vector<double> X((size_t)N*k, 1.0), Y((size_t)N*k);
+
+  StopWatch timer;
+  timer.Start();
+  for (int r = 0; r < n_repeats; ++r)
+    S.Mult(x, y);
+  const double time_spmv = timer.RealTime() / n_repeats;
+
+  timer.Clear();
+  for (int r = 0; r < n_repeats; ++r)
+    mult_interleaved(S, k, &X[0], &Y[0]);
+  const double time_spmm = timer.RealTime() / n_repeats / k;
+
+  cout << "Stiffness matrix product per shot: SpMV " << time_spmv
+       << " sec, SpMM with " << k << " shots " << time_spmm
+       << " sec, gain " << (time_spmm > 0 ? time_spmv / time_spmm : 0.) << endl;
+}
+
+
+
 void AcousticWave::run_SEM_parallel() const
 {
   MFEM_ABORT("NOT implemented");
@@ -94,25 +166,37 @@ void AcousticWave::run_SEM_serial() const
   else
     GLL_rule = new IntegrationRule(segment_GLL, segment_GLL, segment_GLL);
 
+  // the operators are taken from the cache if they have been assembled for
+  // the same mesh, media and discretization
+  OperatorCache cache(param, "SEM");
+
   cout << "Stif matrix..." << flush;
-  DiffusionIntegrator *elast_int = new DiffusionIntegrator(one_over_rho_coef);
-  elast_int->SetIntRule(GLL_rule);
   BilinearForm stif(&fespace);
-  stif.AddDomainIntegrator(elast_int);
-  stif.Assemble();
-  stif.Finalize();
-  const SparseMatrix& S = stif.SpMat();
+  const SparseMatrix *S_cached = cache.load("stif");
+  if (!S_cached)
+  {
+    stif.AddDomainIntegrator(stiffness_integrator(*param.mesh,
+                                                  one_over_rho_coef, GLL_rule));
+    stif.Assemble();
+    stif.Finalize();
+    cache.save("stif", stif.SpMat());
+  }
+  const SparseMatrix& S = (S_cached ? *S_cached : stif.SpMat());
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
 
   cout << "Mass matrix..." << flush;
-  MassIntegrator *mass_int = new MassIntegrator(one_over_K_coef);
-  mass_int->SetIntRule(GLL_rule);
   BilinearForm mass(&fespace);
-  mass.AddDomainIntegrator(mass_int);
-  mass.Assemble();
-  mass.Finalize();
-  const SparseMatrix& M = mass.SpMat();
+  const SparseMatrix *M_cached = cache.load("mass");
+  if (!M_cached)
+  {
+    mass.AddDomainIntegrator(mass_integrator(*param.mesh, one_over_K_coef,
+                                             GLL_rule));
+    mass.Assemble();
+    mass.Finalize();
+    cache.save("mass", mass.SpMat());
+  }
+  const SparseMatrix& M = (M_cached ? *M_cached : mass.SpMat());
   cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
   chrono.Clear();
 
@@ -120,53 +204,13 @@ void AcousticWave::run_SEM_serial() const
   {
     cout << "Output mass matrix..." << flush;
     ofstream mout("mass_mat.dat");
-    mass.PrintMatlab(mout);
+    M.PrintMatlab(mout);
     cout << "M.nnz = " << M.NumNonZeroElems() << endl;
     cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
     chrono.Clear();
   }
 
-//  cout << "Damp matrix..." << flush;
-//  VectorMassIntegrator *damp_int = new VectorMassIntegrator(rho_damp_coef);
-//  damp_int->SetIntRule(GLL_rule);
-//  BilinearForm dampM(&fespace);
-//  dampM.AddDomainIntegrator(damp_int);
-//  dampM.Assemble();
-//  dampM.Finalize();
-//  SparseMatrix& D = dampM.SpMat();
-//  double omega = 2.0*M_PI*param.source.frequency; // angular frequency
-//  D *= 0.5*param.dt*omega;
-//  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-//  chrono.Clear();
-
-  cout << "RHS vector... " << flush;
-  LinearForm b(&fespace);
-  if (param.source.plane_wave)
-  {
-    PlaneWaveSource plane_wave_source(param, one_over_K_coef);
-    DomainLFIntegrator *plane_wave_int =
-        new DomainLFIntegrator(plane_wave_source);
-    plane_wave_int->SetIntRule(GLL_rule);
-    b.AddDomainIntegrator(plane_wave_int);
-    b.Assemble();
-  }
-  else
-  {
-    ScalarPointForce scalar_point_force(param, one_over_K_coef);
-    DomainLFIntegrator *point_force_int =
-        new DomainLFIntegrator(scalar_point_force);
-    point_force_int->SetIntRule(GLL_rule);
-    b.AddDomainIntegrator(point_force_int);
-    b.Assemble();
-  }
-  cout << "||b||_L2 = " << b.Norml2() << endl;
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-  chrono.Clear();
-
-  delete GLL_rule;
-
   Vector diagM; M.GetDiag(diagM); // mass matrix is diagonal
-//  Vector diagD; D.GetDiag(diagD); // damping matrix is diagonal
 
   for (int i = 0; i < diagM.Size(); ++i)
   {
@@ -175,109 +219,272 @@ void AcousticWave::run_SEM_serial() const
                 + d2s(i) + ") on the mass matrix diagonal");
   }
 
-  const string method_name = "SEM_";
-
-  cout << "Open seismograms files..." << flush;
-  ofstream *seisU; // for pressure
-  open_seismo_outs(seisU, param, method_name);
-  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
-  chrono.Clear();
+  // the first order absorbing boundary condition on the absorbing surfaces,
+  // with the GLL quadrature on the boundary elements (so it's diagonal too)
+  IntegrationRule *square_GLL = nullptr;
+  if (param.dimension == 3)
+    square_GLL = new IntegrationRule(segment_GLL, segment_GLL);
+  AbsorbingBoundary abs_bc(param, fespace,
+                           square_GLL ? square_GLL : &segment_GLL);
+  cout << "Dofs on absorbing surfaces: " << abs_bc.n_dofs() << endl;
 
-  GridFunction u_0(&fespace); // pressure
-  GridFunction u_1(&fespace);
-  GridFunction u_2(&fespace);
-  u_0 = 0.0;
-  u_1 = 0.0;
-  u_2 = 0.0;
+  const string method_name = "SEM_";
+  const string pref_path = (string)param.output.directory + "/" + SNAPSHOTS_DIR;
 
   const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
   const int tenth = 0.1 * n_time_steps;
+  const double dt2 = param.dt * param.dt;
 
-  const int N = u_0.Size();
-
-  cout << "N time steps = " << n_time_steps
-       << "\nTime loop..." << endl;
-
-  // the values of the time-dependent part of the source
-  vector<double> time_values(n_time_steps);
-  for (int time_step = 1; time_step <= n_time_steps; ++time_step)
-  {
-    const double cur_time = time_step * param.dt;
-    time_values[time_step-1] = RickerWavelet(param.source,
-                                             cur_time - param.dt);
-  }
-
-  const string name = method_name + param.output.extra_string;
-  const string pref_path = (string)param.output.directory + "/" + SNAPSHOTS_DIR;
-  VisItDataCollection visit_dc(name.c_str(), param.mesh);
-  visit_dc.SetPrefixPath(pref_path.c_str());
-  visit_dc.RegisterField("pressure", &u_0);
-
-  StopWatch time_loop_timer;
-  time_loop_timer.Start();
-  double time_of_snapshots = 0.;
-  double time_of_seismograms = 0.;
-  for (int time_step = 1; time_step <= n_time_steps; ++time_step)
-  {
-    Vector y = u_1; y *= 2.0; y -= u_2;        // y = 2*u_1 - u_2
-
-    Vector z0; z0.SetSize(N);                  // z0 = M * (2*u_1 - u_2)
-    for (int i = 0; i < N; ++i) z0[i] = diagM[i] * y[i];
+  const int N = fespace.GetVSize();
 
-    Vector z1; z1.SetSize(N); S.Mult(u_1, z1);     // z1 = S * u_1
-    Vector z2 = b; z2 *= time_values[time_step-1]; // z2 = timeval*source
+  if (param.shots_block > 1)
+    report_spmm_gain(S, min(param.shots_block, param.n_shots()));
 
-    // y = dt^2 * (S*u_1 - timeval*source), where it can be
-    // y = dt^2 * (S*u_1 - ricker*pointforce) OR
-    // y = dt^2 * (S*u_1 - gaussfirstderivative*momenttensor)
-    y = z1; y -= z2; y *= param.dt*param.dt;
+  // the operators are assembled once, and the shots are advanced in blocks of
+  // shots_block wavefields stored interleaved (the values of all shots at a
+  // dof are contiguous), so every entry of the stiffness matrix loaded from
+  // memory is applied to all shots of a block
+  OutputWriter writer; // compresses and writes the data in the background
 
-    // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source)
-    Vector RHS = z0; RHS -= y;
+  // early in the time loop the waves occupy a small region around the
+  // sources, and the rest of the solution is zero, so only the region is
+  // updated
+  ActiveRegion *active = nullptr;
+  if (param.active_region)
+    active = new ActiveRegion(fespace, param.media.max_vp);
 
-//    for (int i = 0; i < N; ++i) y[i] = diagD[i] * u_2[i]; // y = D * u_2
-
-    // RHS = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2
-//    RHS += y;
-
-    // (M+D)*x_0 = M*(2*x_1-x_2) - dt^2*(S*x_1-r*b) + D*x_2
-    for (int i = 0; i < N; ++i) u_0[i] = RHS[i] / (diagM[i]); //+diagD[i]);
-
-    // Compute and print the L^2 norm of the error
-    if (time_step % tenth == 0) {
-      cout << "step " << time_step << " / " << n_time_steps
-           << " ||solution||_{L^2} = " << u_0.Norml2() << endl;
+  while (true)
+  {
+    vector<int> block_shots; // the shots advanced together
+    for (int shot = 0; (int)block_shots.size() < param.shots_block &&
+                       (shot = scheduler->next()) >= 0; )
+      block_shots.push_back(shot);
+    if (block_shots.empty())
+      break;
+    const int k = block_shots.size();
+
+    vector<double> B((size_t)N*k); // source vectors
+    vector<double> time_values((size_t)n_time_steps*k); // wavelets
+    vector<GridFunction*> U(k); // pressure of every shot for the output
+    vector<SeismogramsOutput*> seisU(k);
+    vector<VisItDataCollection*> visit_dc(k);
+    vector<CompressedSnapshots*> snapshots(k, nullptr);
+
+    for (int s = 0; s < k; ++s)
+    {
+      param.set_shot(block_shots[s]);
+      if (param.n_shots() > 1)
+        cout << "\nShot " << block_shots[s] + 1 << " / " << param.n_shots()
+             << endl;
+
+      cout << "RHS vector... " << flush;
+      LinearForm b(&fespace);
+      source_vector(param, one_over_K_coef, GLL_rule, b);
+      cout << "||b||_L2 = " << b.Norml2() << endl;
+      cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+      chrono.Clear();
+      for (int i = 0; i < N; ++i)
+        B[(size_t)i*k + s] = b[i];
+
+      // the values of the time-dependent part of the source
+      for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+      {
+        const double cur_time = time_step * param.dt;
+        time_values[(size_t)(time_step-1)*k + s] =
+          RickerWavelet(param.source, cur_time - param.dt);
+      }
+
+      cout << "Open seismograms files..." << flush;
+      seisU[s] = new SeismogramsOutput(param, method_name, writer);
+      cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+      chrono.Clear();
+
+      U[s] = new GridFunction(&fespace);
+      *U[s] = 0.0;
+
+      const string name = method_name + param.output.extra_string;
+      visit_dc[s] = new VisItDataCollection(name.c_str(), param.mesh);
+      visit_dc[s]->SetPrefixPath(pref_path.c_str());
+      visit_dc[s]->RegisterField("pressure", U[s]);
+
+      if (param.output.snapshot_tolerance > 0)
+        snapshots[s] = new CompressedSnapshots(writer, pref_path + name,
+                                               fespace, param.output);
     }
 
-    if (time_step % param.step_snap == 0) {
-      StopWatch timer;
-      timer.Start();
-      visit_dc.SetCycle(time_step);
-      visit_dc.SetTime(time_step*param.dt);
-      visit_dc.Save();
-      timer.Stop();
-      time_of_snapshots += timer.UserTime();
+    vector<double> u_0((size_t)N*k, 0.); // pressure
+    vector<double> u_1((size_t)N*k, 0.);
+    vector<double> u_2((size_t)N*k, 0.);
+    vector<double> z1((size_t)N*k);
+
+    // the absorbing boundary and the PML (whose auxiliary variables are kept
+    // for every shot of the block) damp the waves, and the (diagonal) system
+    // matrix is M + D, where D = dt/2*(B + C)
+    PML *pml = nullptr;
+    const bool damping = (abs_bc.n_dofs() > 0 || param.bc.pml);
+    vector<double> z_damp;
+    Vector diagMD;
+    if (damping)
+    {
+      if (param.bc.pml)
+      {
+        pml = new PML(param, fespace, one_over_rho_coef, one_over_K_coef,
+                      GLL_rule, k);
+        cout << "Elements in PML: " << pml->n_elements() << ", memory = "
+             << pml->memory() / 1048576. << " MB" << endl;
+      }
+      const int nnz = M.NumNonZeroElems();
+      SparseMatrix D(M.GetI(), M.GetJ(), new double[nnz], M.Height(),
+                     M.Width(), false, true, M.areColumnsSorted());
+      D = 0.0;
+      abs_bc.add_to(0.5*param.dt, D);
+      if (pml)
+        pml->add_damping(0.5*param.dt, D);
+      D.GetDiag(diagMD);
+      diagMD += diagM;
+      z_damp.resize((size_t)N*k);
     }
 
-    if (time_step % param.step_seis == 0) {
-      StopWatch timer;
-      timer.Start();
-      output_seismograms(param, *param.mesh, u_0, seisU);
-      timer.Stop();
-      time_of_seismograms += timer.UserTime();
+    if (active)
+      active->start(&B[0], k);
+    double n_updated_rows = 0.; // in all time steps
+
+    cout << "N time steps = " << n_time_steps << "\nN shots together = " << k
+         << "\nTime loop..." << endl;
+
+    StopWatch time_loop_timer;
+    time_loop_timer.Start();
+    double time_of_snapshots = 0.;
+    double time_of_seismograms = 0.;
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      // the rows updated at this step: the active region or all of them (the
+      // rows outside of the region stay zero)
+      const vector<int> *rows = nullptr;
+      if (active)
+      {
+        active->update(time_step * param.dt);
+        if (!active->full())
+          rows = &active->rows();
+      }
+      const int n_rows = (rows ? (int)rows->size() : N);
+      n_updated_rows += n_rows;
+
+      if (rows)
+        mult_interleaved_rows(S, k, *rows, &u_1[0], &z1[0]);
+      else
+        mult_interleaved(S, k, &u_1[0], &z1[0]);   // z1 = S * u_1
+      const double *tv = &time_values[(size_t)(time_step-1)*k];
+
+      // M*u_0 = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source), where it can be
+      // source = ricker*pointforce OR
+      // source = gaussfirstderivative*momenttensor
+      if (damping)
+      {
+        // (M+D)*u_0 = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2 +
+        //             the rest of the PML terms
+        fill(z_damp.begin(), z_damp.end(), 0.);
+        abs_bc.add_mult(0.5*param.dt, &u_2[0], &z_damp[0], k);
+        if (pml)
+          pml->add_rhs(param.dt, &u_1[0], &u_2[0], &z_damp[0]);
+        for (int r = 0; r < n_rows; ++r)
+        {
+          const int i = (rows ? (*rows)[r] : r);
+          const double inv_m = 1. / diagMD[i]; // the matrix is diagonal
+          for (int s = 0; s < k; ++s)
+          {
+            const size_t j = (size_t)i*k + s;
+            u_0[j] = inv_m * (diagM[i]*(2.*u_1[j] - u_2[j]) -
+                              dt2*(z1[j] - tv[s]*B[j]) + z_damp[j]);
+          }
+        }
+      }
+      else
+      {
+        for (int r = 0; r < n_rows; ++r)
+        {
+          const int i = (rows ? (*rows)[r] : r);
+          const double inv_m = 1. / diagM[i]; // mass matrix is diagonal
+          for (int s = 0; s < k; ++s)
+          {
+            const size_t j = (size_t)i*k + s;
+            u_0[j] = 2.*u_1[j] - u_2[j] - dt2*inv_m*(z1[j] - tv[s]*B[j]);
+          }
+        }
+      }
+
+      const bool print_step = (time_step % tenth == 0);
+      const bool snap_step  = (time_step % param.step_snap == 0);
+      const bool seis_step  = (time_step % param.step_seis == 0);
+      if (print_step || snap_step || seis_step)
+      {
+        for (int s = 0; s < k; ++s)
+          for (int i = 0; i < N; ++i)
+            (*U[s])[i] = u_0[(size_t)i*k + s];
+      }
+
+      // Compute and print the L^2 norm of the error
+      if (print_step) {
+        for (int s = 0; s < k; ++s)
+          cout << "step " << time_step << " / " << n_time_steps
+               << " shot " << block_shots[s] + 1
+               << " ||solution||_{L^2} = " << U[s]->Norml2() << endl;
+      }
+
+      if (snap_step) {
+        StopWatch timer;
+        timer.Start();
+        for (int s = 0; s < k; ++s)
+        {
+          if (snapshots[s])
+            snapshots[s]->write(*U[s], time_step);
+          else
+          {
+            visit_dc[s]->SetCycle(time_step);
+            visit_dc[s]->SetTime(time_step*param.dt);
+            visit_dc[s]->Save();
+          }
+        }
+        timer.Stop();
+        time_of_snapshots += timer.UserTime();
+      }
+
+      if (seis_step) {
+        StopWatch timer;
+        timer.Start();
+        for (int s = 0; s < k; ++s)
+          seisU[s]->write(*param.mesh, *U[s]);
+        timer.Stop();
+        time_of_seismograms += timer.UserTime();
+      }
+
+      u_2.swap(u_1); // u_2 = u_1
+      u_1.swap(u_0); // u_1 = u_0
     }
 
-    u_2 = u_1;
-    u_1 = u_0;
-  }
-
-  time_loop_timer.Stop();
-
-  delete[] seisU;
+    time_loop_timer.Stop();
 
-  cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
-       << "\n\ttime of snapshots = " << time_of_snapshots
-       << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+    delete pml;
+    for (int s = 0; s < k; ++s)
+    {
+      delete snapshots[s];
+      delete visit_dc[s];
+      delete seisU[s];
+      delete U[s];
+    }
+    writer.wait();
+
+    cout << "Time loop is over\n\tpure time = " << time_loop_timer.UserTime()
+         << "\n\tpure time per shot = " << time_loop_timer.UserTime() / k
+         << "\n\ttime of snapshots = " << time_of_snapshots
+         << "\n\ttime of seismograms = " << time_of_seismograms << endl;
+    if (active)
+      cout << "\tupdated rows = "
+           << 100. * n_updated_rows / ((double)N * n_time_steps) << " %\n";
+  }
 
+  delete active;
+  delete square_GLL;
+  delete GLL_rule;
   delete fec;
 }
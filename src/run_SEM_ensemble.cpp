@@ -0,0 +1,433 @@
+#include "absorbing_boundary.hpp"
+#include "acoustic_wave.hpp"
+#include "GLL_quadrature.hpp"
+#include "output_writer.hpp"
+#include "parameters.hpp"
+#include "shot_scheduler.hpp"
+#include "structured_assembly.hpp"
+#include "utilities.hpp"
+
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace mfem;
+
+
+
+/**
+ * The contributions of the elements of the source support to the source vector
+ * computed with the unit media coefficient. The source coefficient is the
+ * product of the source function and 1/K, which is constant in every cell, so
+ * the source vector of any realization is the sum of these vectors scaled by
+ * the values of 1/K.
+ */
+class SourceSupport
+{
+public:
+  SourceSupport(const Parameters &param, FiniteElementSpace &fespace,
+                const IntegrationRule *GLL_rule)
+    : elements(), vectors()
+  {
+    ConstantCoefficient one(1.0);
+    PlaneWaveSource plane_wave_source(param, one);
+    ScalarPointForce scalar_point_force(param, one);
+    Coefficient &source = (param.source.plane_wave ?
+                           (Coefficient&)plane_wave_source :
+                           (Coefficient&)scalar_point_force);
+    DomainLFIntegrator source_int(source);
+    source_int.SetIntRule(GLL_rule);
+
+    Vector elvect;
+    for (int el = 0; el < fespace.GetNE(); ++el)
+    {
+      source_int.AssembleRHSElementVect(*fespace.GetFE(el),
+                                        *fespace.GetElementTransformation(el),
+                                        elvect);
+      if (elvect.Normlinf() == 0.)
+        continue;
+      elements.push_back(el);
+      vectors.push_back(elvect);
+    }
+  }
+
+  /**
+   * The source vector for the given values of 1/K in the cells.
+   */
+  void assemble(const FiniteElementSpace &fespace, const Mesh &mesh,
+                const double *one_over_K, Vector &b) const
+  {
+    b = 0.0;
+    Array<int> vdofs;
+    Vector elvect;
+    for (size_t i = 0; i < elements.size(); ++i)
+    {
+      fespace.GetElementVDofs(elements[i], vdofs);
+      elvect = vectors[i];
+      elvect *= one_over_K[mesh.GetAttribute(elements[i]) - 1];
+      b.AddElementVector(vdofs, elvect);
+    }
+  }
+
+private:
+  std::vector<int> elements;
+  std::vector<Vector> vectors;
+};
+
+
+
+/**
+ * A realization advanced by one thread. The operators are assembled once, and
+ * for every next realization only their values are refilled, so the FE space,
+ * the sparsity patterns and the source support are shared by all of them. The
+ * absorbing boundary (which depends on the media too) is refilled as well.
+ */
+class EnsembleMember
+{
+public:
+  /**
+   * @param boundary_rule - the GLL rule on the boundary elements for the
+   * absorbing boundary.
+   */
+  EnsembleMember(const Parameters &param, FiniteElementSpace &fespace,
+                 const IntegrationRule *GLL_rule,
+                 const IntegrationRule *boundary_rule)
+    : n_elements(fespace.GetMesh()->GetNE())
+    , one_over_rho(n_elements)
+    , one_over_K(n_elements)
+    , one_over_rho_coef(&one_over_rho[0], false)
+    , one_over_K_coef(&one_over_K[0], false)
+    , stif(&fespace)
+    , mass(&fespace)
+    , diagM()
+    , abs_bc(param, fespace, boundary_rule)
+    , diagMD()
+    , b(fespace.GetVSize())
+    , U(&fespace)
+    , seisU(nullptr)
+    , visit_dc(nullptr)
+    , snapshots(nullptr)
+    , realization(-1)
+    , time_loop(0.)
+  {
+    Mesh &mesh = *fespace.GetMesh();
+    stif.AddDomainIntegrator(stiffness_integrator(mesh, one_over_rho_coef,
+                                                  GLL_rule));
+    mass.AddDomainIntegrator(mass_integrator(mesh, one_over_K_coef, GLL_rule));
+  }
+
+  ~EnsembleMember() { close_outputs(); }
+
+  /**
+   * Read the media of the given realization, and refill the values of the
+   * operators (the sparsity patterns are built at the first call only).
+   */
+  void set_realization(const Parameters &param, int r)
+  {
+    realization = r;
+    const MediaRealization &media = param.ensemble[r];
+    read_binary(media.rhofile.c_str(), n_elements, &one_over_rho[0]);
+    read_binary(media.vpfile.c_str(), n_elements, &one_over_K[0]);
+    for (int i = 0; i < n_elements; ++i)
+      MFEM_VERIFY(one_over_rho[i] > 1.0 && one_over_K[i] > 1.0, "Incorrect "
+                  "media properties of the realization " + d2s(r) + " in the "
+                  "cell " + d2s(i));
+
+    // the absorbing boundary takes the density and the velocity, and then the
+    // arrays are converted to the coefficients
+    abs_bc.set_media(&one_over_rho[0], &one_over_K[0]);
+    for (int i = 0; i < n_elements; ++i)
+    {
+      const double rho = one_over_rho[i];
+      const double vp  = one_over_K[i];
+      one_over_rho[i] = 1. / rho;
+      one_over_K[i]   = 1. / (rho*vp*vp);
+    }
+
+    stif = 0.0;
+    stif.Assemble();
+    stif.Finalize();
+    mass = 0.0;
+    mass.Assemble();
+    mass.Finalize();
+
+    mass.SpMat().GetDiag(diagM); // mass matrix is diagonal
+    for (int i = 0; i < diagM.Size(); ++i)
+    {
+      MFEM_VERIFY(fabs(diagM[i]) > FLOAT_NUMBERS_EQUALITY_TOLERANCE,
+                  "There is a small (" + d2s(diagM[i]) + ") number (row "
+                  + d2s(i) + ") on the mass matrix diagonal");
+    }
+
+    // the system matrix M + dt/2*B is diagonal too
+    diagMD = diagM;
+    abs_bc.add_diagonal(0.5*param.dt, diagMD);
+  }
+
+  void open_outputs(const Parameters &param, OutputWriter &writer,
+                    const FiniteElementSpace &fespace)
+  {
+    const string method_name = "SEM_real" + d2s(realization) + "_";
+    const string pref_path = (string)param.output.directory + "/" +
+                             SNAPSHOTS_DIR;
+    const string name = method_name + param.output.extra_string;
+
+    seisU = new SeismogramsOutput(param, method_name, writer);
+    visit_dc = new VisItDataCollection(name.c_str(), param.mesh);
+    visit_dc->SetPrefixPath(pref_path.c_str());
+    visit_dc->RegisterField("pressure", &U);
+    if (param.output.snapshot_tolerance > 0)
+      snapshots = new CompressedSnapshots(writer, pref_path + name, fespace,
+                                          param.output);
+  }
+
+  void close_outputs()
+  {
+    delete snapshots; snapshots = nullptr;
+    delete visit_dc;  visit_dc = nullptr;
+    delete seisU;     seisU = nullptr;
+  }
+
+  /**
+   * The time loop of the current shot. The output (which uses the shared
+   * mesh) is serialized among the threads by the mutex.
+   */
+  void run(const Parameters &param, mutex &output_mutex)
+  {
+    StopWatch timer;
+    timer.Start();
+
+    const SparseMatrix &S = stif.SpMat();
+    const int N = b.Size();
+    const int n_time_steps = param.T / param.dt + 0.5; // nearest integer
+    const int tenth = 0.1 * n_time_steps;
+    const double dt2 = param.dt * param.dt;
+
+    Vector u_0(N), u_1(N), u_2(N), z1(N); // pressure
+    u_0 = 0.0; u_1 = 0.0; u_2 = 0.0;
+    U = 0.0;
+
+    const bool damping = (abs_bc.n_dofs() > 0);
+    Vector z_damp(damping ? N : 0);
+
+    for (int time_step = 1; time_step <= n_time_steps; ++time_step)
+    {
+      const double cur_time = time_step * param.dt;
+      const double timeval = RickerWavelet(param.source, cur_time - param.dt);
+
+      S.Mult(u_1, z1); // z1 = S * u_1
+
+      if (damping)
+      {
+        // (M+D)*u_0 = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source) + D*u_2,
+        // where D = dt/2*B
+        z_damp = 0.0;
+        abs_bc.add_mult(0.5*param.dt, &u_2[0], &z_damp[0]);
+        for (int i = 0; i < N; ++i)
+          u_0[i] = (diagM[i]*(2.*u_1[i] - u_2[i]) -
+                    dt2*(z1[i] - timeval*b[i]) + z_damp[i]) / diagMD[i];
+      }
+      else
+      {
+        // M*u_0 = M*(2*u_1-u_2) - dt^2*(S*u_1-timeval*source)
+        for (int i = 0; i < N; ++i)
+          u_0[i] = 2.*u_1[i] - u_2[i] - dt2*(z1[i] - timeval*b[i]) / diagM[i];
+      }
+
+      const bool print_step = (time_step % tenth == 0);
+      const bool snap_step  = (time_step % param.step_snap == 0);
+      const bool seis_step  = (time_step % param.step_seis == 0);
+      if (print_step || snap_step || seis_step)
+      {
+        U = u_0;
+        lock_guard<mutex> lock(output_mutex);
+        if (print_step)
+          cout << "step " << time_step << " / " << n_time_steps
+               << " realization " << realization
+               << " ||solution||_{L^2} = " << U.Norml2() << endl;
+        try
+        {
+          if (snap_step)
+          {
+            if (snapshots)
+              snapshots->write(U, time_step);
+            else
+            {
+              visit_dc->SetCycle(time_step);
+              visit_dc->SetTime(time_step*param.dt);
+              visit_dc->Save();
+            }
+          }
+          if (seis_step)
+            seisU->write(*param.mesh, U);
+        }
+        catch (const exception&)
+        {
+          // the writer has failed: the realization stops, and the error is
+          // rethrown by the writer in the main thread
+          time_loop = timer.RealTime();
+          return;
+        }
+      }
+
+      u_2.Swap(u_1); // u_2 = u_1
+      u_1.Swap(u_0); // u_1 = u_0
+    }
+
+    time_loop = timer.RealTime();
+  }
+
+  /**
+   * The source vector of the current shot for the current realization.
+   */
+  void set_source(const SourceSupport &source,
+                  const FiniteElementSpace &fespace, const Mesh &mesh)
+  {
+    source.assemble(fespace, mesh, &one_over_K[0], b);
+  }
+
+  double time_of_loop() const { return time_loop; }
+
+private:
+  const int n_elements;
+  std::vector<double> one_over_rho; ///< media of the current realization
+  std::vector<double> one_over_K;
+  CWConstCoefficient one_over_rho_coef;
+  CWConstCoefficient one_over_K_coef;
+  BilinearForm stif;
+  BilinearForm mass;
+  Vector diagM;
+  AbsorbingBoundary abs_bc;
+  Vector diagMD; ///< diagonal of M + dt/2*B
+  Vector b; ///< source vector of the current shot and realization
+  GridFunction U;
+  SeismogramsOutput *seisU;
+  VisItDataCollection *visit_dc;
+  CompressedSnapshots *snapshots;
+  int realization;
+  double time_loop; ///< wall time of the last time loop
+
+  EnsembleMember(const EnsembleMember&);
+  EnsembleMember& operator=(const EnsembleMember&);
+};
+
+
+
+void AcousticWave::run_SEM_ensemble() const
+{
+  MFEM_VERIFY(param.mesh, "The mesh is not initialized");
+#if defined(MFEM_USE_MPI)
+  int size;
+  MPI_Comm_size(param.comm, &size);
+  MFEM_VERIFY(size == 1, "Every realization of an ensemble is run by one "
+              "process (use -group-size 1 to farm the shots out)");
+#endif
+
+  StopWatch chrono;
+  chrono.Start();
+
+  const int dim = param.dimension;
+  const int n_realizations = param.ensemble.size();
+
+  int n_threads = param.ensemble_threads;
+  if (n_threads == 0)
+    n_threads = max(1u, thread::hardware_concurrency());
+  n_threads = min(n_threads, n_realizations);
+
+  cout << "FE space generation..." << flush;
+  FiniteElementCollection *fec = new H1_FECollection(param.method.order, dim);
+  FiniteElementSpace fespace(param.mesh, fec);
+  cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+  chrono.Clear();
+
+  cout << "Number of unknowns: " << fespace.GetVSize()
+       << "\nNumber of realizations: " << n_realizations
+       << "\nNumber of realizations advanced concurrently: " << n_threads
+       << endl;
+
+  IntegrationRule segment_GLL;
+  create_segment_GLL_rule(param.method.order, segment_GLL);
+  IntegrationRule *GLL_rule = nullptr;
+  if (dim == 2)
+    GLL_rule = new IntegrationRule(segment_GLL, segment_GLL);
+  else
+    GLL_rule = new IntegrationRule(segment_GLL, segment_GLL, segment_GLL);
+
+  // the absorbing boundary with the GLL quadrature on the boundary elements,
+  // as in SEM
+  IntegrationRule *square_GLL = nullptr;
+  if (dim == 3)
+    square_GLL = new IntegrationRule(segment_GLL, segment_GLL);
+  const IntegrationRule *boundary_rule = (square_GLL ? square_GLL :
+                                          &segment_GLL);
+
+  vector<EnsembleMember*> members(n_threads);
+  for (int t = 0; t < n_threads; ++t)
+    members[t] = new EnsembleMember(param, fespace, GLL_rule, boundary_rule);
+
+  OutputWriter writer; // compresses and writes the data in the background
+  mutex output_mutex;
+
+  for (int shot = scheduler->next(); shot >= 0; shot = scheduler->next())
+  {
+    param.set_shot(shot);
+    if (param.n_shots() > 1)
+      cout << "\nShot " << shot + 1 << " / " << param.n_shots() << endl;
+
+    cout << "Source support..." << flush;
+    const SourceSupport source(param, fespace, GLL_rule);
+    cout << "done. Time = " << chrono.RealTime() << " sec" << endl;
+    chrono.Clear();
+
+    StopWatch shot_timer;
+    shot_timer.Start();
+    double time_of_refill = 0.;
+    double time_of_loops = 0.;
+
+    // the realizations are run in batches of n_threads; the assembly (which
+    // uses the shared mesh) is done by the main thread
+    for (int first = 0; first < n_realizations; first += n_threads)
+    {
+      const int n_batch = min(n_threads, n_realizations - first);
+
+      StopWatch timer;
+      timer.Start();
+      for (int t = 0; t < n_batch; ++t)
+      {
+        members[t]->set_realization(param, first + t);
+        members[t]->set_source(source, fespace, *param.mesh);
+      }
+      time_of_refill += timer.RealTime();
+
+      vector<thread> threads;
+      for (int t = 0; t < n_batch; ++t)
+      {
+        members[t]->open_outputs(param, writer, fespace);
+        threads.push_back(thread(&EnsembleMember::run, members[t],
+                                 cref(param), ref(output_mutex)));
+      }
+      for (int t = 0; t < n_batch; ++t)
+      {
+        threads[t].join();
+        members[t]->close_outputs();
+        time_of_loops += members[t]->time_of_loop();
+      }
+    }
+    writer.wait();
+
+    shot_timer.Stop();
+    cout << "Ensemble is over\n\twall time = " << shot_timer.RealTime()
+         << "\n\twall time per realization = "
+         << shot_timer.RealTime() / n_realizations
+         << "\n\ttime of refilling the operators = " << time_of_refill
+         << "\n\ttime loop per realization = "
+         << time_of_loops / n_realizations << endl;
+  }
+
+  for (int t = 0; t < n_threads; ++t)
+    delete members[t];
+  delete square_GLL;
+  delete GLL_rule;
+  delete fec;
+}
@@ -0,0 +1,29 @@
+#include "shared_memory.hpp"
+
+#if defined(MFEM_USE_MPI)
+
+NodeCommunicators::NodeCommunicators(MPI_Comm comm)
+  : _node_comm(MPI_COMM_NULL)
+  , _leaders_comm(MPI_COMM_NULL)
+  , _node_rank(0)
+{
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                      &_node_comm);
+  MPI_Comm_rank(_node_comm, &_node_rank);
+
+  // ordering by the original rank guarantees that the process 0 is the leader
+  // of its node, and has the rank 0 among the leaders
+  MPI_Comm_split(comm, (_node_rank == 0 ? 0 : MPI_UNDEFINED), rank,
+                 &_leaders_comm);
+}
+
+NodeCommunicators::~NodeCommunicators()
+{
+  if (_leaders_comm != MPI_COMM_NULL)
+    MPI_Comm_free(&_leaders_comm);
+  MPI_Comm_free(&_node_comm);
+}
+
+#endif // MFEM_USE_MPI
@@ -0,0 +1,122 @@
+#ifndef SHARED_MEMORY_HPP
+#define SHARED_MEMORY_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <algorithm>
+
+#if defined(MFEM_USE_MPI)
+
+/**
+ * Communicators describing the processes running on the same node.
+ */
+class NodeCommunicators
+{
+public:
+  NodeCommunicators(MPI_Comm comm);
+  ~NodeCommunicators();
+
+  MPI_Comm node_comm() const { return _node_comm; }
+
+  /**
+   * The communicator of the node leaders (the processes with the rank 0 on
+   * their nodes). It's MPI_COMM_NULL for other processes. The process with
+   * the rank 0 in the original communicator is the leader with the rank 0.
+   */
+  MPI_Comm leaders_comm() const { return _leaders_comm; }
+
+  bool is_leader() const { return _node_rank == 0; }
+
+private:
+  MPI_Comm _node_comm;
+  MPI_Comm _leaders_comm;
+  int _node_rank;
+
+  NodeCommunicators(const NodeCommunicators&);
+  NodeCommunicators& operator=(const NodeCommunicators&);
+};
+
+
+
+/**
+ * An array in an MPI-3 shared memory window: there is only one copy of the
+ * array per node, allocated by the node leader, and all processes of the node
+ * access it directly. It's intended for the read-only data which are the same
+ * for all processes. The data are written by the node leaders, and then the
+ * array is synchronized (collectively on the node).
+ */
+template <typename T>
+class NodeSharedArray
+{
+public:
+  NodeSharedArray(const NodeCommunicators &comms, MPI_Aint size)
+    : _comms(comms), _data(nullptr), _size(size), _win(MPI_WIN_NULL)
+  {
+    const MPI_Aint my_size = (_comms.is_leader() ? _size * sizeof(T) : 0);
+    MPI_Win_allocate_shared(my_size, sizeof(T), MPI_INFO_NULL,
+                            _comms.node_comm(), &_data, &_win);
+    MPI_Aint leader_size;
+    int disp_unit;
+    MPI_Win_shared_query(_win, 0, &leader_size, &disp_unit, &_data);
+    MFEM_VERIFY(leader_size == my_size || !_comms.is_leader(), "Unexpected "
+                "size of a shared memory segment");
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, _win);
+  }
+
+  ~NodeSharedArray()
+  {
+    MPI_Win_unlock_all(_win);
+    MPI_Win_free(&_win);
+  }
+
+  /**
+   * Make the data written by the node leader visible to all processes of the
+   * node (collective on the node).
+   */
+  void synchronize()
+  {
+    MPI_Win_sync(_win);
+    MPI_Barrier(_comms.node_comm());
+    MPI_Win_sync(_win);
+  }
+
+  /**
+   * Copy the data of the leader with the rank 'root' to all other leaders, and
+   * synchronize the array on every node (collective).
+   */
+  void broadcast(MPI_Datatype type, int root = 0)
+  {
+    if (_comms.is_leader())
+    {
+      // the size may be larger than INT_MAX, so the data are sent in pieces
+      const MPI_Aint piece = 1 << 28;
+      for (MPI_Aint start = 0; start < _size; start += piece)
+      {
+        const int count = std::min(piece, _size - start);
+        MPI_Bcast(_data + start, count, type, root, _comms.leaders_comm());
+      }
+    }
+    synchronize();
+  }
+
+  T* data() { return _data; }
+  const T* data() const { return _data; }
+  MPI_Aint size() const { return _size; }
+
+  T& operator[](MPI_Aint i) { return _data[i]; }
+  const T& operator[](MPI_Aint i) const { return _data[i]; }
+
+private:
+  const NodeCommunicators &_comms;
+  T *_data;
+  MPI_Aint _size;
+  MPI_Win _win;
+
+  NodeSharedArray(const NodeSharedArray&);
+  NodeSharedArray& operator=(const NodeSharedArray&);
+};
+
+#endif // MFEM_USE_MPI
+
+#endif // SHARED_MEMORY_HPP
@@ -0,0 +1,122 @@
+#include "shot_scheduler.hpp"
+#include "parameters.hpp"
+
+#include <vector>
+
+using namespace std;
+using namespace mfem;
+
+
+
+ShotScheduler::ShotScheduler(const Parameters &param)
+  : _n_shots(param.n_shots())
+  , _next_shot(0)
+  , _n_my_shots(0)
+  , _timer()
+#if defined(MFEM_USE_MPI)
+  , _group_comm(param.comm)
+  , _farm(param.comm != MPI_COMM_WORLD)
+  , _win(MPI_WIN_NULL)
+  , _counter(nullptr)
+#endif
+{
+#if defined(MFEM_USE_MPI)
+  if (_farm)
+  {
+    int myid;
+    MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+    const MPI_Aint size = (myid == 0 ? sizeof(int) : 0);
+    MPI_Win_allocate(size, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD,
+                     &_counter, &_win);
+    if (myid == 0)
+    {
+      MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, _win);
+      *_counter = 0;
+      MPI_Win_unlock(0, _win);
+    }
+    MPI_Barrier(MPI_COMM_WORLD); // the counter is initialized
+  }
+#endif
+  _timer.Start();
+}
+
+ShotScheduler::~ShotScheduler()
+{
+#if defined(MFEM_USE_MPI)
+  if (_win != MPI_WIN_NULL)
+    MPI_Win_free(&_win);
+#endif
+}
+
+int ShotScheduler::next()
+{
+  int shot = _next_shot;
+#if defined(MFEM_USE_MPI)
+  if (_farm)
+  {
+    // the leader of the group takes the shot from the counter, and the other
+    // processes of the group get it from the leader
+    int group_rank;
+    MPI_Comm_rank(_group_comm, &group_rank);
+    if (group_rank == 0)
+    {
+      const int one = 1;
+      MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, _win);
+      MPI_Fetch_and_op(&one, &shot, MPI_INT, 0, 0, MPI_SUM, _win);
+      MPI_Win_unlock(0, _win);
+    }
+    MPI_Bcast(&shot, 1, MPI_INT, 0, _group_comm);
+  }
+#endif
+  ++_next_shot;
+
+  if (shot >= _n_shots)
+    return -1;
+  ++_n_my_shots;
+  return shot;
+}
+
+void ShotScheduler::report(ostream &out)
+{
+  const double time = _timer.RealTime();
+
+#if defined(MFEM_USE_MPI)
+  if (_farm)
+  {
+    int myid, nproc, group_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+    MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+    MPI_Comm_rank(_group_comm, &group_rank);
+
+    // the statistics of the groups are sent by their leaders
+    double stats[] = { (double)(group_rank == 0), (double)_n_my_shots, time };
+    vector<double> all_stats(myid == 0 ? 3*nproc : 0);
+    MPI_Gather(stats, 3, MPI_DOUBLE, (myid == 0 ? &all_stats[0] : nullptr), 3,
+               MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (myid != 0)
+      return;
+
+    out << "\nShots per group of processes:\n";
+    int group = 0;
+    for (int rank = 0; rank < nproc; ++rank)
+    {
+      const double *s = &all_stats[3*rank];
+      if (s[0] == 0.) continue; // not a leader
+      out << "  group " << group++ << " (process " << rank << "): "
+          << (int)s[1] << " shots in " << s[2] << " sec, "
+          << (s[1] > 0 ? s[2] / s[1] : 0.) << " sec per shot\n";
+    }
+    out << flush;
+    return;
+  }
+
+  int myid;
+  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+  if (myid != 0)
+    return;
+#endif
+
+  out << "\nShots: " << _n_my_shots << " in " << time << " sec, "
+      << (_n_my_shots > 0 ? time / _n_my_shots : 0.) << " sec per shot"
+      << endl;
+}
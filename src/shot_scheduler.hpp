@@ -0,0 +1,54 @@
+#ifndef SHOT_SCHEDULER_HPP
+#define SHOT_SCHEDULER_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+#include <iostream>
+
+class Parameters;
+
+
+
+/**
+ * Assignment of the shots of the survey to the groups of processes. The shots
+ * are taken dynamically from a counter shared by all groups (in an MPI-3 RMA
+ * window on the process 0), so the groups which are faster take more shots.
+ * If there is only one group (or no MPI), the shots are taken in order.
+ */
+class ShotScheduler
+{
+public:
+  ShotScheduler(const Parameters &param);
+  ~ShotScheduler();
+
+  /**
+   * The next shot to be run by the group of the calling process, or -1 if
+   * there are no more shots (collective on the group).
+   */
+  int next();
+
+  /**
+   * Print (on the process 0) the number of shots and the throughput of every
+   * group (collective on all processes).
+   */
+  void report(std::ostream &out);
+
+private:
+  int _n_shots;
+  int _next_shot; ///< the counter if there is only one group
+  int _n_my_shots; ///< number of shots run by the group
+  mfem::StopWatch _timer;
+
+#if defined(MFEM_USE_MPI)
+  MPI_Comm _group_comm;
+  bool _farm; ///< there are several groups sharing the counter
+  MPI_Win _win;
+  int *_counter;
+#endif
+
+  ShotScheduler(const ShotScheduler&);
+  ShotScheduler& operator=(const ShotScheduler&);
+};
+
+#endif // SHOT_SCHEDULER_HPP
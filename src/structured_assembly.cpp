@@ -0,0 +1,116 @@
+#include "structured_assembly.hpp"
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+using namespace mfem;
+
+
+
+bool identical_elements(Mesh &mesh)
+{
+  if (mesh.GetNE() == 0 || mesh.GetNodes())
+    return false;
+
+  const int dim = mesh.SpaceDimension();
+  const int geom = mesh.GetElementBaseGeometry(0);
+
+  // the positions of the vertices of the first element relative to its first
+  // vertex
+  Array<int> vertices;
+  mesh.GetElementVertices(0, vertices);
+  const int n_vertices = vertices.Size();
+  vector<double> offsets(n_vertices * dim);
+  double size = 0.;
+  for (int v = 0; v < n_vertices; ++v)
+  {
+    const double *x0 = mesh.GetVertex(vertices[0]);
+    const double *x  = mesh.GetVertex(vertices[v]);
+    for (int d = 0; d < dim; ++d)
+    {
+      offsets[v*dim + d] = x[d] - x0[d];
+      size = max(size, fabs(offsets[v*dim + d]));
+    }
+  }
+  const double tol = 1e-10 * size;
+
+  for (int el = 1; el < mesh.GetNE(); ++el)
+  {
+    if (mesh.GetElementBaseGeometry(el) != geom)
+      return false;
+    mesh.GetElementVertices(el, vertices);
+    if (vertices.Size() != n_vertices)
+      return false;
+    const double *x0 = mesh.GetVertex(vertices[0]);
+    for (int v = 1; v < n_vertices; ++v)
+    {
+      const double *x = mesh.GetVertex(vertices[v]);
+      for (int d = 0; d < dim; ++d)
+        if (fabs(x[d] - x0[d] - offsets[v*dim + d]) > tol)
+          return false;
+    }
+  }
+  return true;
+}
+
+
+
+ReferenceElementIntegrator::
+ReferenceElementIntegrator(Type type, Coefficient &coef,
+                           const IntegrationRule *rule)
+  : BilinearFormIntegrator(rule)
+  , _one(1.0)
+  , _unit_integ(nullptr)
+  , _coef(coef)
+  , _reference()
+{
+  if (type == DIFFUSION)
+    _unit_integ = new DiffusionIntegrator(_one);
+  else
+    _unit_integ = new MassIntegrator(_one);
+  if (rule)
+    _unit_integ->SetIntRule(rule);
+}
+
+void ReferenceElementIntegrator::
+AssembleElementMatrix(const FiniteElement &el, ElementTransformation &T,
+                      DenseMatrix &elmat)
+{
+  if (_reference.Height() == 0)
+    _unit_integ->AssembleElementMatrix(el, T, _reference);
+
+  const IntegrationPoint &center = Geometries.GetCenter(el.GetGeomType());
+  T.SetIntPoint(&center);
+  elmat = _reference;
+  elmat *= _coef.Eval(T, center);
+}
+
+
+
+BilinearFormIntegrator* stiffness_integrator(Mesh &mesh,
+                                             Coefficient &one_over_rho,
+                                             const IntegrationRule *rule)
+{
+  if (identical_elements(mesh))
+    return new ReferenceElementIntegrator(ReferenceElementIntegrator::DIFFUSION,
+                                          one_over_rho, rule);
+
+  BilinearFormIntegrator *integ = new DiffusionIntegrator(one_over_rho);
+  if (rule)
+    integ->SetIntRule(rule);
+  return integ;
+}
+
+BilinearFormIntegrator* mass_integrator(Mesh &mesh, Coefficient &one_over_K,
+                                        const IntegrationRule *rule)
+{
+  if (identical_elements(mesh))
+    return new ReferenceElementIntegrator(ReferenceElementIntegrator::MASS,
+                                          one_over_K, rule);
+
+  BilinearFormIntegrator *integ = new MassIntegrator(one_over_K);
+  if (rule)
+    integ->SetIntRule(rule);
+  return integ;
+}
@@ -0,0 +1,66 @@
+#ifndef STRUCTURED_ASSEMBLY_HPP
+#define STRUCTURED_ASSEMBLY_HPP
+
+#include "config.hpp"
+#include "mfem.hpp"
+
+/**
+ * Check if all elements of the mesh are the same up to a translation: the same
+ * geometry, and the same positions of the vertices (in the same local order)
+ * relative to the first vertex. It's true for the generated Cartesian meshes,
+ * including the fine meshes of the GMsFEM coarse cells. Curved meshes (with
+ * nodes) are never considered identical.
+ */
+bool identical_elements(mfem::Mesh &mesh);
+
+/**
+ * An integrator of a bilinear form with a cell-wise constant coefficient on a
+ * mesh of identical elements. The element matrix is computed once, with the
+ * unit coefficient, for the first element, and the matrix of every element is
+ * the copy of it scaled by the value of the coefficient in the element. So the
+ * Jacobians, the quadrature and the evaluation of the coefficient at every
+ * point are avoided.
+ */
+class ReferenceElementIntegrator : public mfem::BilinearFormIntegrator
+{
+public:
+  enum Type { DIFFUSION, MASS };
+
+  /**
+   * @param coef - constant in every element; it's evaluated at the center.
+   * @param rule - the integration rule of the reference matrix (e.g. GLL), or
+   * nullptr for the default one.
+   */
+  ReferenceElementIntegrator(Type type, mfem::Coefficient &coef,
+                             const mfem::IntegrationRule *rule = nullptr);
+  virtual ~ReferenceElementIntegrator() { delete _unit_integ; }
+
+  virtual void AssembleElementMatrix(const mfem::FiniteElement &el,
+                                     mfem::ElementTransformation &T,
+                                     mfem::DenseMatrix &elmat);
+
+private:
+  mfem::ConstantCoefficient _one;
+  mfem::BilinearFormIntegrator *_unit_integ;
+  mfem::Coefficient &_coef;
+  mfem::DenseMatrix _reference; ///< element matrix with the unit coefficient
+
+  ReferenceElementIntegrator(const ReferenceElementIntegrator&);
+  ReferenceElementIntegrator& operator=(const ReferenceElementIntegrator&);
+};
+
+/**
+ * The domain integrators of the stiffness (with 1/rho) and the mass (with 1/K)
+ * matrices: the reference element ones if all elements of the mesh are
+ * identical, and the regular ones otherwise. The integrator is to be owned by
+ * a bilinear form.
+ */
+mfem::BilinearFormIntegrator*
+stiffness_integrator(mfem::Mesh &mesh, mfem::Coefficient &one_over_rho,
+                     const mfem::IntegrationRule *rule = nullptr);
+
+mfem::BilinearFormIntegrator*
+mass_integrator(mfem::Mesh &mesh, mfem::Coefficient &one_over_K,
+                const mfem::IntegrationRule *rule = nullptr);
+
+#endif // STRUCTURED_ASSEMBLY_HPP
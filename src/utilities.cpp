@@ -1,9 +1,16 @@
 #include "mfem.hpp"
 #include "utilities.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace std;
 using namespace mfem;
 
@@ -16,44 +23,149 @@ double to_radians(double x)
 
 
 
-void read_binary(const char *filename, int n_values, double *values)
+MappedFile::MappedFile(const char *filename)
+  : _filename(filename)
+  , _data(nullptr)
+  , _size(0)
 {
-  ifstream in(filename, ios::binary);
-  MFEM_VERIFY(in, "File '" + string(filename) + "' can't be opened");
+  const int fd = open(filename, O_RDONLY);
+  MFEM_VERIFY(fd >= 0, "File '" + _filename + "' can't be opened");
 
-  in.seekg(0, in.end); // jump to the end of the file
-  int length = in.tellg(); // total length of the file in bytes
-  int size_value = length / n_values; // size (in bytes) of one value
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    MFEM_ABORT("Can't get the size of the file '" + _filename + "'");
+  }
+  _size = st.st_size;
 
-  MFEM_VERIFY(length % n_values == 0, "The number of bytes in the file '" +
-              string(filename) + "' is not divisible by the number of elements "
-              + d2s(n_values));
+  if (_size > 0)
+  {
+    _data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (_data == MAP_FAILED)
+    {
+      close(fd);
+      MFEM_ABORT("File '" + _filename + "' can't be mapped into memory");
+    }
+    madvise(_data, _size, MADV_SEQUENTIAL);
+  }
+  close(fd); // the mapping remains valid
+}
 
-  in.seekg(0, in.beg); // jump to the beginning of the file
+MappedFile::~MappedFile()
+{
+  if (_data)
+    munmap(_data, _size);
+}
+
+
+
+int get_value_size(const char *filename, uint64_t file_size,
+                   uint64_t n_values)
+{
+  MFEM_VERIFY(n_values > 0, "The number of values must be positive");
+  MFEM_VERIFY(file_size % n_values == 0, "The number of bytes in the file '" +
+              string(filename) + "' is not divisible by the number of "
+              "elements " + d2s(n_values));
+
+  const uint64_t size_value = file_size / n_values; // size of one value
+  MFEM_VERIFY(size_value == sizeof(float) || size_value == sizeof(double),
+              "Unknown size of an element (" + d2s(size_value) + ") in bytes. "
+              "Expected one is either sizeof(float) = " + d2s(sizeof(float)) +
+              ", or sizeof(double) = " + d2s(sizeof(double)));
+
+  return size_value;
+}
+
+
+
+void read_binary(const char *filename, uint64_t n_values, double *values)
+{
+  MappedFile file(filename);
+  const int size_value = get_value_size(filename, file.size(), n_values);
 
   if (size_value == sizeof(double))
   {
-    in.read((char*)values, n_values*size_value); // read all at once
+    memcpy(values, file.data(), n_values*sizeof(double));
+  }
+  else
+  {
+    // a simple loop that the compiler vectorizes
+    const float *in = static_cast<const float*>(file.data());
+    for (uint64_t i = 0; i < n_values; ++i)
+      values[i] = in[i];
+  }
+}
+
 
-    MFEM_VERIFY(n_values == static_cast<int>(in.gcount()), "The number of "
-                "successfully read elements is different from the expected one");
+
+#if defined(MFEM_USE_MPI)
+void read_binary(MPI_Comm comm, const char *filename, uint64_t n_glob_values,
+                 const vector<int> &indices, double *values)
+{
+  MPI_File file;
+  const int err = MPI_File_open(comm, const_cast<char*>(filename),
+                                MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+  MFEM_VERIFY(err == MPI_SUCCESS, "File '" + string(filename) + "' can't be "
+              "opened");
+
+  MPI_Offset file_size;
+  MPI_File_get_size(file, &file_size);
+  const int size_value = get_value_size(filename, file_size, n_glob_values);
+  MPI_Datatype etype = (size_value == sizeof(double) ? MPI_DOUBLE : MPI_FLOAT);
+
+  // the file view requires sorted positions without repetitions
+  const int n_indices = indices.size();
+  vector<pair<int, int> > order(n_indices);
+  for (int i = 0; i < n_indices; ++i)
+  {
+    MFEM_VERIFY(indices[i] >= 0 && (uint64_t)indices[i] < n_glob_values,
+                "Index " + d2s(indices[i]) + " is out of range");
+    order[i] = make_pair(indices[i], i);
   }
-  else if (size_value == sizeof(float))
+  sort(order.begin(), order.end());
+
+  vector<int> displs;
+  vector<int> position(n_indices); // position of a value among read ones
+  displs.reserve(n_indices);
+  for (int i = 0; i < n_indices; ++i)
   {
-    float val = 0;
-    for (int i = 0; i < n_values; ++i)  // read element-by-element
-    {
-      in.read((char*)&val, size_value); // read a 'float' value
-      values[i] = val;                  // convert it to a 'double' value
-    }
+    if (displs.empty() || displs.back() != order[i].first)
+      displs.push_back(order[i].first);
+    position[order[i].second] = displs.size() - 1;
   }
-  else MFEM_VERIFY(0, "Unknown size of an element (" + d2s(size_value) + ") in "
-                   "bytes. Expected one is either sizeof(float) = " +
-                   d2s(sizeof(float)) + ", or sizeof(double) = " +
-                   d2s(sizeof(double)));
 
-  in.close();
+  MPI_Datatype filetype;
+  int *d = (displs.empty() ? nullptr : &displs[0]);
+  MPI_Type_create_indexed_block(displs.size(), 1, d, etype, &filetype);
+  MPI_Type_commit(&filetype);
+  MPI_File_set_view(file, 0, etype, filetype, const_cast<char*>("native"),
+                    MPI_INFO_NULL);
+
+  vector<char> buffer(displs.size() * size_value);
+  MPI_Status status;
+  MPI_File_read_all(file, (buffer.empty() ? nullptr : &buffer[0]),
+                    displs.size(), etype, &status);
+  MPI_Type_free(&filetype);
+  MPI_File_close(&file);
+
+  if (n_indices == 0)
+    return;
+
+  if (size_value == sizeof(double))
+  {
+    const double *in = reinterpret_cast<const double*>(&buffer[0]);
+    for (int i = 0; i < n_indices; ++i)
+      values[i] = in[position[i]];
+  }
+  else
+  {
+    const float *in = reinterpret_cast<const float*>(&buffer[0]);
+    for (int i = 0; i < n_indices; ++i)
+      values[i] = in[position[i]];
+  }
 }
+#endif // MFEM_USE_MPI
 
 
 
@@ -73,7 +185,8 @@ void write_binary(const char *filename, int n_values, double *values)
 
 
 
-void get_minmax(double *a, int n_elements, double &min_val, double &max_val)
+void get_minmax(const double *a, int n_elements, double &min_val,
+                double &max_val)
 {
   min_val = max_val = a[0];
   for (int i = 1; i < n_elements; ++i)
@@ -85,6 +198,53 @@ void get_minmax(double *a, int n_elements, double &min_val, double &max_val)
 
 
 
+void mult_interleaved(const SparseMatrix &A, int k, const double *X, double *Y)
+{
+  const int *I = A.GetI();
+  const int *J = A.GetJ();
+  const double *values = A.GetData();
+  for (int row = 0; row < A.Height(); ++row)
+  {
+    double *y = Y + (size_t)row*k;
+    for (int v = 0; v < k; ++v)
+      y[v] = 0.;
+    for (int p = I[row]; p < I[row+1]; ++p)
+    {
+      const double a = values[p];
+      const double *x = X + (size_t)J[p]*k;
+      for (int v = 0; v < k; ++v)
+        y[v] += a * x[v];
+    }
+  }
+}
+
+
+
+void mult_interleaved_rows(const SparseMatrix &A, int k,
+                           const vector<int> &rows, const double *X,
+                           double *Y)
+{
+  const int *I = A.GetI();
+  const int *J = A.GetJ();
+  const double *values = A.GetData();
+  for (size_t r = 0; r < rows.size(); ++r)
+  {
+    const int row = rows[r];
+    double *y = Y + (size_t)row*k;
+    for (int v = 0; v < k; ++v)
+      y[v] = 0.;
+    for (int p = I[row]; p < I[row+1]; ++p)
+    {
+      const double a = values[p];
+      const double *x = X + (size_t)J[p]*k;
+      for (int v = 0; v < k; ++v)
+        y[v] += a * x[v];
+    }
+  }
+}
+
+
+
 void write_vts_vector(const std::string& filename, const std::string& solname,
                       double sx, double sy, double sz, int nx, int ny, int nz,
                       const Vector& sol_x, const Vector& sol_y,
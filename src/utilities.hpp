@@ -6,11 +6,17 @@
 #include <iomanip>
 #include <sstream>
 #include <stdexcept>
+#include <stdint.h>
 #include <vector>
 
+#if defined(MFEM_USE_MPI)
+  #include <mpi.h>
+#endif
+
 namespace mfem
 {
   class Mesh;
+  class SparseMatrix;
   class Vector;
 }
 
@@ -63,9 +69,49 @@ inline std::string d2s(T data,
 double to_radians(double x);
 
 /**
- * Read a binary file
+ * A file mapped into memory (read-only). The size of the file is not limited
+ * by 2 GB.
+ */
+class MappedFile
+{
+public:
+  MappedFile(const char *filename);
+  ~MappedFile();
+
+  const void* data() const { return _data; }
+  uint64_t size() const { return _size; }
+
+private:
+  std::string _filename;
+  void *_data;
+  uint64_t _size;
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+/**
+ * Get the size (in bytes) of one value of a binary file with n_values values
+ * which are either floats or doubles.
+ */
+int get_value_size(const char *filename, uint64_t file_size,
+                   uint64_t n_values);
+
+/**
+ * Read a binary file of float or double values. The file is memory mapped,
+ * and float values are converted to doubles with one pass over the array.
  */
-void read_binary(const char *filename, int n_values, double *values);
+void read_binary(const char *filename, uint64_t n_values, double *values);
+
+#if defined(MFEM_USE_MPI)
+/**
+ * Read (collectively) only the values with the given indices from a binary file
+ * of n_glob_values float or double values. Every process gets the values of
+ * its own indices in the same order.
+ */
+void read_binary(MPI_Comm comm, const char *filename, uint64_t n_glob_values,
+                 const std::vector<int> &indices, double *values);
+#endif
 
 /**
  * Write a binary file
@@ -75,7 +121,23 @@ void write_binary(const char *filename, int n_values, double *values);
 /**
  * Find min and max values of the given array (vector) a
  */
-void get_minmax(double *a, int n_elements, double &min_val, double &max_val);
+void get_minmax(const double *a, int n_elements, double &min_val,
+                double &max_val);
+
+/**
+ * Y = A * X, where X and Y are blocks of k vectors stored interleaved (the k
+ * values of every row are contiguous, i.e. X[row*k + vector]), so that every
+ * entry of the matrix is loaded once for all k vectors.
+ */
+void mult_interleaved(const mfem::SparseMatrix &A, int k, const double *X,
+                      double *Y);
+
+/**
+ * The same for the given rows of Y only (the other rows are not touched).
+ */
+void mult_interleaved_rows(const mfem::SparseMatrix &A, int k,
+                           const std::vector<int> &rows, const double *X,
+                           double *Y);
 
 /**
  * Write a snapshot of a vector wavefield in a VTS format
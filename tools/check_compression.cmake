@@ -0,0 +1,49 @@
+# Test of the lossy compression: a synthetic trace is generated and compressed
+# with a relative error bound, then decompressed and compared with the
+# original values by the decompressor, which fails if the bound is violated.
+# The trace is mostly zero (the pulses occupy a small part of the line), so
+# the compression ratio must be far above 8 (one byte per double).
+#
+# Usage: cmake -DMAKE_TRACE=... -DDECOMPRESS=... -DWORK_DIR=...
+#              -P check_compression.cmake
+
+foreach(var MAKE_TRACE DECOMPRESS WORK_DIR)
+  if(NOT ${var})
+    message(FATAL_ERROR "${var} is not defined")
+  endif()
+endforeach()
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+# relative tolerances and the minimal compression ratios
+set(tolerances 1e-2 1e-4 1e-7)
+set(min_ratios 100 40 15)
+
+foreach(i 0 1 2)
+  list(GET tolerances ${i} tol)
+  list(GET min_ratios ${i} min_ratio)
+  set(trace "${WORK_DIR}/trace_${tol}.acz")
+  set(original "${WORK_DIR}/trace_${tol}.bin")
+
+  execute_process(COMMAND ${MAKE_TRACE} ${trace} ${original} ${tol}
+                  OUTPUT_VARIABLE output
+                  RESULT_VARIABLE result)
+  message(STATUS "${output}")
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Generation of the trace (tolerance ${tol}) failed")
+  endif()
+  if(NOT output MATCHES "compression ratio ([0-9.]+)")
+    message(FATAL_ERROR "No compression ratio in the output: ${output}")
+  endif()
+  if(CMAKE_MATCH_1 LESS ${min_ratio})
+    message(FATAL_ERROR "Compression ratio ${CMAKE_MATCH_1} (tolerance ${tol}) "
+                        "is less than ${min_ratio}")
+  endif()
+
+  execute_process(COMMAND ${DECOMPRESS} ${trace} "${WORK_DIR}/trace.out"
+                          ${original}
+                  RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Check of the trace (tolerance ${tol}) failed")
+  endif()
+endforeach()
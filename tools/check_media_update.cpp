@@ -0,0 +1,225 @@
+/**
+ * Test of the incremental update of the media (MediaUpdate): a few cells of a
+ * small mesh get new properties, and the patched stiffness and mass matrices
+ * must coincide with the ones assembled anew with the updated media. It's
+ * checked for the continuous (CG, SEM) and the discontinuous (DG) spaces; the
+ * DG stiffness has the penalty terms on the free surfaces, but not on the
+ * absorbing one (the left side of the domain here).
+ *
+ * Usage: acwave_check_media_update
+ */
+
+#include "config.hpp"
+#include "acoustic_wave.hpp"
+#include "media_update.hpp"
+#include "mfem.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace mfem;
+
+const int N_CELLS_X = 6;
+const int N_CELLS_Y = 5;
+const double SIZE_X = 600.;
+const double SIZE_Y = 500.;
+const int ORDER = 2;
+const double DG_SIGMA = -1.;
+const double DG_KAPPA = 10.;
+const double TOLERANCE = 1e-12;
+
+
+
+/**
+ * Marker of the boundary faces of the left side (X=0) of the domain, which
+ * are absorbing, as find_absorbing_faces would give.
+ */
+static void left_side_faces(Mesh &mesh, vector<char> &marker)
+{
+  marker.assign(mesh.GetNumFaces(), 0);
+  Vector center(mesh.Dimension());
+  for (int f = 0; f < mesh.GetNumFaces(); ++f)
+  {
+    int elem1, elem2;
+    mesh.GetFaceElements(f, &elem1, &elem2);
+    if (elem2 >= 0)
+      continue; // interior face
+    ElementTransformation &T = *mesh.GetFaceTransformation(f);
+    T.Transform(Geometries.GetCenter(mesh.GetFaceBaseGeometry(f)), center);
+    marker[f] = (fabs(center(0)) < 1e-6 * SIZE_X);
+  }
+}
+
+/**
+ * Full assembly of the stiffness and the mass matrices, as in the runs of SEM
+ * and DG.
+ */
+static void assemble(FiniteElementSpace &fespace, double *one_over_rho,
+                     double *one_over_K, bool dg,
+                     const vector<char> &absorbing_faces,
+                     SparseMatrix *&S, SparseMatrix *&M)
+{
+  const bool own_array = false;
+  CWConstCoefficient one_over_rho_coef(one_over_rho, own_array);
+  CWConstCoefficient one_over_K_coef(one_over_K, own_array);
+
+  BilinearForm stif(&fespace);
+  stif.AddDomainIntegrator(new DiffusionIntegrator(one_over_rho_coef));
+  if (dg)
+    stif.AddInteriorFaceIntegrator(
+          new DGDiffusionIntegrator(one_over_rho_coef, DG_SIGMA, DG_KAPPA));
+  stif.Assemble();
+  if (dg)
+  {
+    Mesh &mesh = *fespace.GetMesh();
+    DGDiffusionIntegrator integ(one_over_rho_coef, DG_SIGMA, DG_KAPPA);
+    Array<int> dofs;
+    DenseMatrix elmat;
+    for (int f = 0; f < mesh.GetNumFaces(); ++f)
+    {
+      int elem1, elem2;
+      mesh.GetFaceElements(f, &elem1, &elem2);
+      if (elem2 >= 0 || absorbing_faces[f])
+        continue;
+      FaceElementTransformations *FT = mesh.GetFaceElementTransformations(f);
+      const FiniteElement &fe = *fespace.GetFE(elem1);
+      integ.AssembleFaceMatrix(fe, fe, *FT, elmat);
+      fespace.GetElementVDofs(elem1, dofs);
+      stif.SpMat().AddSubMatrix(dofs, dofs, elmat);
+    }
+  }
+  stif.Finalize();
+
+  BilinearForm mass(&fespace);
+  mass.AddDomainIntegrator(new MassIntegrator(one_over_K_coef));
+  mass.Assemble();
+  mass.Finalize();
+
+  S = stif.LoseMat();
+  M = mass.LoseMat();
+}
+
+/**
+ * max|A - B| / max|B|
+ */
+static double relative_difference(const SparseMatrix &A, const SparseMatrix &B)
+{
+  SparseMatrix *D = Add(1., A, -1., B);
+  double max_diff = 0., max_B = 0.;
+  for (int i = 0; i < D->NumNonZeroElems(); ++i)
+    max_diff = max(max_diff, fabs(D->GetData()[i]));
+  for (int i = 0; i < B.NumNonZeroElems(); ++i)
+    max_B = max(max_B, fabs(B.GetData()[i]));
+  delete D;
+  return max_diff / max_B;
+}
+
+/**
+ * Update a few cells (including the ones at the absorbing and the free
+ * surfaces, and a repeated cell) and compare the patched matrices with the
+ * reassembled ones. Returns true if they coincide.
+ */
+static bool check(Mesh &mesh, bool dg)
+{
+  const int dim = mesh.Dimension();
+  FiniteElementCollection *fec = nullptr;
+  if (dg)
+    fec = new L2_FECollection(ORDER, dim);
+  else
+    fec = new H1_FECollection(ORDER, dim);
+  FiniteElementSpace fespace(&mesh, fec);
+
+  vector<char> absorbing_faces;
+  left_side_faces(mesh, absorbing_faces);
+
+  const int n_cells = mesh.GetNE();
+  vector<double> rho(n_cells), vp(n_cells);
+  vector<double> one_over_rho(n_cells), one_over_K(n_cells);
+  for (int c = 0; c < n_cells; ++c)
+  {
+    rho[c] = 1000. + 37. * (c % 11);
+    vp[c]  = 1500. + 53. * (c % 7);
+    one_over_rho[c] = 1. / rho[c];
+    one_over_K[c]   = 1. / (rho[c]*vp[c]*vp[c]);
+  }
+
+  SparseMatrix *S = nullptr, *M = nullptr;
+  assemble(fespace, &one_over_rho[0], &one_over_K[0], dg, absorbing_faces,
+           S, M);
+
+  MediaUpdate update(fespace, &one_over_rho[0], &one_over_K[0]);
+  if (dg)
+    update.set_dg(DG_SIGMA, DG_KAPPA, absorbing_faces);
+
+  // the corner cell (absorbing and free sides), a cell at the absorbing side,
+  // a cell at the free surface, two neighbor interior cells, and a repeated
+  // cell with its last values to be used
+  const int changed[] = { 0, N_CELLS_X, N_CELLS_X - 1, 8, 9, 14, 8 };
+  const int n_changed = sizeof(changed) / sizeof(changed[0]);
+  vector<int> cells(changed, changed + n_changed);
+  vector<double> new_rho(n_changed), new_vp(n_changed);
+  for (int i = 0; i < n_changed; ++i)
+  {
+    new_rho[i] = 2000. + 100. * i;
+    new_vp[i]  = 3000. - 150. * i;
+  }
+  update.update(cells, &new_rho[0], &new_vp[0], *S, *M);
+
+  for (int i = 0; i < n_changed; ++i)
+  {
+    rho[cells[i]] = new_rho[i];
+    vp[cells[i]]  = new_vp[i];
+  }
+  vector<double> ref_one_over_rho(n_cells), ref_one_over_K(n_cells);
+  for (int c = 0; c < n_cells; ++c)
+  {
+    ref_one_over_rho[c] = 1. / rho[c];
+    ref_one_over_K[c]   = 1. / (rho[c]*vp[c]*vp[c]);
+  }
+
+  SparseMatrix *S_ref = nullptr, *M_ref = nullptr;
+  assemble(fespace, &ref_one_over_rho[0], &ref_one_over_K[0], dg,
+           absorbing_faces, S_ref, M_ref);
+
+  const double diff_S = relative_difference(*S, *S_ref);
+  const double diff_M = relative_difference(*M, *M_ref);
+  double diff_coef = 0.;
+  for (int c = 0; c < n_cells; ++c)
+    diff_coef = max(diff_coef,
+                    fabs(one_over_rho[c] - ref_one_over_rho[c]) *
+                    rho[c]);
+
+  cout << (dg ? "DG" : "CG") << ": relative difference of stif = " << diff_S
+       << ", of mass = " << diff_M << ", of 1/rho = " << diff_coef << endl;
+
+  delete S_ref;
+  delete M_ref;
+  delete S;
+  delete M;
+  delete fec;
+
+  return (diff_S < TOLERANCE && diff_M < TOLERANCE && diff_coef < TOLERANCE);
+}
+
+
+
+int main()
+{
+  const int generate_edges = 1;
+  Mesh mesh(N_CELLS_X, N_CELLS_Y, Element::QUADRILATERAL, generate_edges,
+            SIZE_X, SIZE_Y);
+  for (int el = 0; el < mesh.GetNE(); ++el)
+    mesh.GetElement(el)->SetAttribute(el+1);
+
+  const bool cg_ok = check(mesh, false);
+  const bool dg_ok = check(mesh, true);
+  if (!cg_ok || !dg_ok)
+  {
+    cerr << "Error: the patched matrices differ from the reassembled ones"
+         << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,72 @@
+# Test of the shots advanced together (SEM, -shots-block): two shots with
+# different groups of receivers (one set and two sets of receivers) are run
+# one by one and as one block, and the seismograms must be identical (the
+# arithmetic of every shot in a block is the same as in a single run).
+#
+# Usage: cmake -DACWAVE=... -DWORK_DIR=... -P check_shots_block.cmake
+
+foreach(var ACWAVE WORK_DIR)
+  if(NOT ${var})
+    message(FATAL_ERROR "${var} is not defined")
+  endif()
+endforeach()
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+file(WRITE ${WORK_DIR}/receivers_1.txt
+"Line
+p 5
+100 800
+900 800
+")
+file(WRITE ${WORK_DIR}/receivers_2.txt
+"Line
+p 3
+100 200
+900 200
+Line
+p 7
+200 100
+200 900
+")
+file(WRITE ${WORK_DIR}/shots.txt
+"# x y frequency scale receivers
+300 500 10 1e6 ${WORK_DIR}/receivers_1.txt
+700 500 15 1e6 ${WORK_DIR}/receivers_2.txt
+")
+
+set(args -method sem -o 2 -d 2 -sx 1000 -sy 1000 -nx 20 -ny 20
+         -rho 1000 -vp 2000 -T 0.2 -dt 1e-3 -step-snap 100000
+         -shots ${WORK_DIR}/shots.txt)
+
+foreach(block 1 2)
+  execute_process(COMMAND ${ACWAVE} ${args} -shots-block ${block}
+                          -outdir ${WORK_DIR}/block${block}
+                  WORKING_DIRECTORY ${WORK_DIR}
+                  OUTPUT_FILE ${WORK_DIR}/block${block}.log
+                  RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "The run with -shots-block ${block} failed, see "
+                        "${WORK_DIR}/block${block}.log")
+  endif()
+endforeach()
+
+# every shot has a file for every set of its own group: 1 + 2 files
+file(GLOB_RECURSE seismograms RELATIVE ${WORK_DIR}/block1
+     ${WORK_DIR}/block1/*_shot*_rec_*.bin)
+list(LENGTH seismograms n_files)
+if(NOT n_files EQUAL 3)
+  message(FATAL_ERROR "Expected 3 files of seismograms, found ${n_files}: "
+                      "${seismograms}")
+endif()
+
+foreach(f ${seismograms})
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+                          ${WORK_DIR}/block1/${f} ${WORK_DIR}/block2/${f}
+                  RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Seismograms ${f} of the block of shots differ from "
+                        "the ones of the single shot")
+  endif()
+endforeach()
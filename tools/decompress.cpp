@@ -0,0 +1,187 @@
+/**
+ * Decompression of the output data (seismograms and snapshots) of acwave.
+ *
+ * Usage: acwave_decompress input.acz output [original]
+ *
+ * Seismograms are decompressed to the same binary format as the uncompressed
+ * ones (float values of all receivers time step by time step). Snapshots are
+ * decompressed to MFEM grid functions (which can be visualized along with the
+ * saved mesh). If the original (uncompressed) data are given, the decompressed
+ * values are compared with them, and the maximal error is checked against the
+ * error bound.
+ */
+
+#include "compression.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+
+
+/**
+ * Read the next n float values of uncompressed seismograms.
+ */
+static void read_original(istream &in, uint64_t n, vector<double> &values)
+{
+  values.resize(n);
+  for (uint64_t i = 0; i < n; ++i)
+  {
+    float val;
+    in.read(reinterpret_cast<char*>(&val), sizeof(val));
+    values[i] = val;
+  }
+  if (!in)
+    throw runtime_error("The original data are shorter than compressed ones");
+}
+
+/**
+ * Read the values of a grid function saved by MFEM (the description of the
+ * finite element space is followed by an empty line and the values).
+ */
+static void read_original_grid_function(istream &in, uint64_t n,
+                                        vector<double> &values)
+{
+  string line;
+  while (getline(in, line) && !line.empty()) ;
+  values.resize(n);
+  for (uint64_t i = 0; i < n; ++i)
+    in >> values[i];
+  if (!in)
+    throw runtime_error("The original grid function is shorter than the "
+                        "compressed one");
+}
+
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    cout << "Usage: " << argv[0] << " input.acz output [original]" << endl;
+    return 1;
+  }
+
+  try
+  {
+    ifstream in(argv[1], ios::binary);
+    if (!in)
+      throw runtime_error(string("File '") + argv[1] + "' can't be opened");
+    read_compressed_file_header(in);
+
+    ofstream out(argv[2], ios::binary);
+    if (!out)
+      throw runtime_error(string("File '") + argv[2] + "' can't be opened");
+
+    ifstream original;
+    if (argc > 3)
+    {
+      original.open(argv[3], ios::binary);
+      if (!original)
+        throw runtime_error(string("File '") + argv[3] + "' can't be opened");
+    }
+
+    uint64_t n_values = 0;
+    double max_error = 0.;
+    bool bound_violated = false;
+
+    ChunkHeader header;
+    string text;
+    vector<unsigned char> payload;
+    vector<double> orig;
+    while (read_chunk(in, header, text, payload))
+    {
+      const uint64_t n = header.n_rows * header.n_cols;
+      const unsigned char *data = (payload.empty() ? nullptr : &payload[0]);
+      vector<double> values(n);
+
+      if (header.codec == LOSSLESS_FLOAT)
+      {
+        vector<float> fvalues(n);
+        decompress_lossless(data, payload.size(), header.n_rows, header.n_cols,
+                            (n > 0 ? &fvalues[0] : nullptr));
+        if (n > 0)
+          out.write(reinterpret_cast<const char*>(&fvalues[0]),
+                    n*sizeof(float));
+        for (uint64_t i = 0; i < n; ++i)
+          values[i] = fvalues[i];
+        if (original.is_open())
+          read_original(original, n, orig);
+      }
+      else if (header.codec == LOSSY_DOUBLE)
+      {
+        decompress_lossy(data, payload.size(), n, header.tolerance,
+                         (n > 0 ? &values[0] : nullptr));
+        if (!text.empty()) // grid function
+        {
+          out << text;
+          out.precision(16);
+          for (uint64_t i = 0; i < n; ++i)
+            out << values[i] << "\n";
+          if (original.is_open())
+            read_original_grid_function(original, n, orig);
+        }
+        else
+        {
+          if (n > 0)
+            out.write(reinterpret_cast<const char*>(&values[0]),
+                      n*sizeof(double));
+          if (original.is_open())
+          {
+            orig.resize(n);
+            if (n > 0)
+              original.read(reinterpret_cast<char*>(&orig[0]),
+                            n*sizeof(double));
+            if (!original)
+              throw runtime_error("The original data are shorter than "
+                                  "compressed ones");
+          }
+        }
+      }
+      else
+      {
+        ostringstream msg;
+        msg << "Unknown codec " << header.codec;
+        throw runtime_error(msg.str());
+      }
+
+      if (original.is_open())
+      {
+        for (uint64_t i = 0; i < n; ++i)
+        {
+          const double err = (std::isnan(orig[i]) && std::isnan(values[i]) ?
+                              0. : fabs(orig[i] - values[i]));
+          if (!(err <= header.tolerance))
+            bound_violated = true;
+          if (err > max_error || std::isnan(err))
+            max_error = err;
+        }
+      }
+      n_values += n;
+    }
+
+    cout << "Decompressed values: " << n_values << endl;
+    if (original.is_open())
+    {
+      cout << "Max error: " << max_error << endl;
+      if (bound_violated)
+      {
+        cout << "The error bound is violated" << endl;
+        return 2;
+      }
+      cout << "The error bound is satisfied" << endl;
+    }
+  }
+  catch (const exception &e)
+  {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Generation of a synthetic trace for the test of the lossy compression.
+ *
+ * Usage: acwave_make_trace trace.acz original.bin [rel_tolerance]
+ *
+ * The trace is a sequence of snapshots of a wave field (a Ricker pulse
+ * travelling along a line of points, with a jump of the medium), compressed
+ * with the error bound rel_tolerance * (max - min) of every snapshot, as the
+ * snapshots of acwave are. A few snapshots are special: a constant one, one
+ * with tiny values, and one with a NaN and a spike, which are stored exactly.
+ * The original values are written as raw doubles, so that the trace can be
+ * checked by 'acwave_decompress trace.acz output original.bin'.
+ */
+
+#include "compression.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+const int N_SNAPSHOTS = 20;
+const int N_POINTS = 10000;
+
+
+
+/**
+ * The wave field at the points x in [0, 1] at the time t: the Ricker pulse
+ * with the peak frequency f travelling with the velocity 1 and reflected by
+ * the jump of the medium at x = 0.6.
+ */
+static double wave_field(double x, double t)
+{
+  const double f = 25.;
+  const double pi2 = M_PI * M_PI;
+  const double x0 = 0.6, refl = -0.4;
+  double u = 0.;
+  const double s[] = { x - t, 2.*x0 - x - t }; // incident and reflected
+  for (int i = 0; i < 2; ++i)
+  {
+    if (i == 1 && x > x0) break;
+    const double a = pi2 * f * f * s[i] * s[i];
+    u += (i == 0 ? 1. : refl) * (1. - 2.*a) * exp(-a);
+  }
+  return (x > x0 ? (1. + refl) * u : u);
+}
+
+static void make_snapshot(int k, vector<double> &values)
+{
+  values.resize(N_POINTS);
+  const double t = 0.05 + 0.9 * k / (N_SNAPSHOTS - 1);
+  for (int i = 0; i < N_POINTS; ++i)
+    values[i] = wave_field((i + 0.5) / N_POINTS, t);
+
+  if (k == 3) // constant
+    for (int i = 0; i < N_POINTS; ++i)
+      values[i] = 1.5;
+  else if (k == 7) // tiny values
+    for (int i = 0; i < N_POINTS; ++i)
+      values[i] *= 1e-300;
+  else if (k == 11) // a NaN and a spike
+  {
+    values[N_POINTS / 3] = numeric_limits<double>::quiet_NaN();
+    values[N_POINTS / 2] = 1e3;
+  }
+}
+
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    cout << "Usage: " << argv[0] << " trace.acz original.bin [rel_tolerance]"
+         << endl;
+    return 1;
+  }
+
+  try
+  {
+    const double rel_tolerance = (argc > 3 ? atof(argv[3]) : 1e-4);
+    if (!(rel_tolerance > 0))
+      throw runtime_error("The tolerance must be >0");
+
+    ofstream out(argv[1], ios::binary);
+    if (!out)
+      throw runtime_error(string("File '") + argv[1] + "' can't be opened");
+    ofstream original(argv[2], ios::binary);
+    if (!original)
+      throw runtime_error(string("File '") + argv[2] + "' can't be opened");
+
+    write_compressed_file_header(out);
+
+    uint64_t n_bytes = 0;
+    vector<double> values;
+    vector<unsigned char> payload;
+    for (int k = 0; k < N_SNAPSHOTS; ++k)
+    {
+      make_snapshot(k, values);
+      const double tol = absolute_tolerance(&values[0], values.size(),
+                                            rel_tolerance);
+      compress_lossy(&values[0], values.size(), tol, payload);
+
+      ChunkHeader header;
+      header.codec     = LOSSY_DOUBLE;
+      header.text_size = 0;
+      header.n_rows    = 1;
+      header.n_cols    = values.size();
+      header.tolerance = tol;
+      header.n_bytes   = payload.size();
+      write_chunk(out, header, "", payload);
+      n_bytes += payload.size();
+
+      original.write(reinterpret_cast<const char*>(&values[0]),
+                     values.size()*sizeof(double));
+    }
+    if (!out || !original)
+      throw runtime_error("Writing of the trace failed");
+
+    cout << "Snapshots: " << N_SNAPSHOTS << " x " << N_POINTS << " values, "
+         << "compression ratio "
+         << (double)N_SNAPSHOTS * N_POINTS * sizeof(double) / n_bytes << endl;
+  }
+  catch (const exception &e)
+  {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
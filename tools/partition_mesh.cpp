@@ -0,0 +1,69 @@
+/**
+ * One-time partitioning of a serial mesh into the parts read by acwave with
+ * the -meshprefix option. It must be run with the same number of processes as
+ * the simulation:
+ *
+ *   mpirun -np P acwave_partition_mesh -meshfile mesh.mesh -prefix parts/mesh
+ *
+ * Every process writes its part of the mesh to prefix.<rank> (in the format of
+ * ParMesh::ParPrint). The attribute of every element is set to its number in
+ * the serial mesh (+1), as acwave expects.
+ */
+
+#include "config.hpp"
+#include "distributed_mesh.hpp"
+#include "mfem.hpp"
+
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace mfem;
+
+
+
+int main(int argc, char *argv[])
+{
+  MPI_Init(&argc, &argv);
+  int myid;
+  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+
+  const char *meshfile = "";
+  const char *prefix = "";
+
+  OptionsParser args(argc, argv);
+  args.AddOption(&meshfile, "-meshfile", "--mesh-file", "Serial mesh to partition");
+  args.AddOption(&prefix, "-prefix", "--prefix", "Prefix of the output files");
+  args.Parse();
+  if (!args.Good() || !strlen(meshfile) || !strlen(prefix))
+  {
+    if (myid == 0)
+      args.PrintUsage(cout);
+    MPI_Finalize();
+    return 1;
+  }
+
+  // every process reads the serial mesh only once here, instead of doing that
+  // at every start of a simulation
+  ifstream in(meshfile);
+  MFEM_VERIFY(in, "File '" + string(meshfile) + "' can't be opened");
+  const int generate_edges = 1, refine = 0;
+  Mesh *mesh = new Mesh(in, generate_edges, refine);
+  for (int el = 0; el < mesh->GetNE(); ++el)
+    mesh->GetElement(el)->SetAttribute(el+1);
+
+  ParMesh par_mesh(MPI_COMM_WORLD, *mesh);
+  delete mesh;
+
+  const string filename = par_mesh_filename(prefix, myid);
+  ofstream out(filename.c_str());
+  MFEM_VERIFY(out, "File '" + filename + "' can't be opened");
+  out.precision(16);
+  par_mesh.ParPrint(out);
+
+  if (myid == 0)
+    cout << "The mesh is partitioned into " << prefix << ".*" << endl;
+
+  MPI_Finalize();
+  return 0;
+}